@@ -0,0 +1,211 @@
+// Size checks of the production build, from webpack.config.js.
+//
+// Every production build fails when the "app" entry point is over the budgets in package.json ("bundleBudgets"),
+// and when a script under Scripts/ newly imports a whole package that has a much smaller way in (a new heavy
+// import is an error, the ones listed in "knownHeavyImports" stay warnings). With --env report it also writes
+// the size, gzip and brotli size of every module, summed up per package, to obj/webpack/<flavor>.report.json
+// and prints the largest packages.
+const fs = require("fs");
+const path = require("path");
+const zlib = require("zlib");
+
+// Request -> what it pulls in and what to import instead.
+const HeavyImports = {
+    "@fortawesome/fontawesome-free/js/all": "every icon as SVG, ~1.2 MB; the webfonts through scss/solid and scss/regular, or @fortawesome/fontawesome-svg-core with the icons in use, are a fraction of it",
+    "@fortawesome/fontawesome-free": "every icon; import the webfont styles or single icons",
+    "buefy": "every Buefy component; Vue.use() the ones in use from buefy/dist/components/<name>",
+    "lodash": "the whole of lodash, which does not tree-shake; import lodash/<function>",
+    "core-js": "every polyfill; import the features needed from core-js/es/<feature>",
+    "core-js/stable": "every stable polyfill; import the features needed from core-js/es/<feature>",
+    "rxjs/Rx": "all of RxJS 5; import from rxjs and rxjs/operators",
+};
+
+const TopPackages = 20;
+
+class BundleReportPlugin
+{
+    constructor(options)
+    {
+        this.flavor = options.flavor;
+        this.report = options.report;
+        this.scriptsDir = options.scriptsDir;
+        this.budgets = options.budgets || {};
+        this.outputDir = options.outputDir;
+    }
+
+    apply(compiler)
+    {
+        const { Compilation, WebpackError } = compiler.webpack;
+        compiler.hooks.thisCompilation.tap("BundleReportPlugin", compilation =>
+        {
+            // After minification and before the files are written, so the sizes are the ones that get served.
+            compilation.hooks.processAssets.tap({ name: "BundleReportPlugin", stage: Compilation.PROCESS_ASSETS_STAGE_REPORT }, () =>
+            {
+                const warn = message => compilation.warnings.push(new WebpackError(message));
+                const fail = message => compilation.errors.push(new WebpackError(message));
+
+                this.checkImports(compilation, warn, fail);
+                const entry = this.checkBudgets(compilation, fail);
+                if (this.report)
+                {
+                    this.writeReport(compilation, entry);
+                }
+            });
+        });
+    }
+
+    checkImports(compilation, warn, fail)
+    {
+        const known = new Set(this.budgets.knownHeavyImports || []);
+        for (const module of compilation.modules)
+        {
+            if (!module.resource || !module.resource.startsWith(this.scriptsDir))
+            {
+                continue;
+            }
+            // Static imports only: import() is what splits a package off the entry point in the first place.
+            const flagged = new Set();
+            for (const dependency of module.dependencies)
+            {
+                const hint = dependency.request && HeavyImports[dependency.request];
+                if (hint && !flagged.has(dependency.request))
+                {
+                    flagged.add(dependency.request);
+                    const message = `${path.relative(this.scriptsDir, module.resource)} imports "${dependency.request}": ${hint}.`;
+                    (known.has(dependency.request) ? warn : fail)(message);
+                }
+            }
+        }
+    }
+
+    checkBudgets(compilation, fail)
+    {
+        const entrypoint = compilation.entrypoints.get("app");
+        const entryChunkFiles = new Set(entrypoint.getEntrypointChunk().files);
+        const entry = { files: [], entrypointGzip: 0, entryChunkGzip: 0, cssGzip: 0 };
+
+        for (const file of entrypoint.getFiles())
+        {
+            if (!file.endsWith(".js") && !file.endsWith(".css"))
+            {
+                continue;
+            }
+            const sizes = measure(compilation.getAsset(file).source.buffer());
+            entry.files.push({ file, ...sizes });
+            if (file.endsWith(".css"))
+            {
+                entry.cssGzip += sizes.gzip;
+                continue;
+            }
+            entry.entrypointGzip += sizes.gzip;
+            if (entryChunkFiles.has(file))
+            {
+                entry.entryChunkGzip += sizes.gzip;
+            }
+        }
+
+        const check = (name, actual, label) =>
+        {
+            const budget = this.budgets[name];
+            if (budget && actual > budget)
+            {
+                fail(`${this.flavor}: ${label} is ${kib(actual)} gzipped, over the budget of ${kib(budget)} (bundleBudgets.${name} in package.json).`);
+            }
+        };
+        check("entrypointGzip", entry.entrypointGzip, "the script of the app entry point, with its vendor chunks,");
+        check("entryChunkGzip", entry.entryChunkGzip, "the app entry chunk");
+        check("cssGzip", entry.cssGzip, "the CSS of the app entry point");
+        return entry;
+    }
+
+    writeReport(compilation, entry)
+    {
+        const { chunkGraph } = compilation;
+        const modules = [];
+        for (const chunk of compilation.chunks)
+        {
+            for (const module of chunkGraph.getChunkModulesIterable(chunk))
+            {
+                // A concatenated module is one scope hoisted out of several; report the modules it was made of.
+                for (const inner of module.modules || [module])
+                {
+                    const source = inner.originalSource && inner.originalSource();
+                    if (!source)
+                    {
+                        continue;
+                    }
+                    modules.push({
+                        chunk: chunk.name || String(chunk.id),
+                        initial: chunk.canBeInitial(),
+                        module: inner.readableIdentifier(compilation.requestShortener),
+                        package: packageOf(inner.resource),
+                        ...measure(source.buffer()),
+                    });
+                }
+            }
+        }
+        modules.sort((x, y) => y.gzip - x.gzip);
+
+        const packages = new Map();
+        for (const module of modules)
+        {
+            const key = module.package;
+            const total = packages.get(key) || { package: key, modules: 0, raw: 0, gzip: 0, brotli: 0, initial: false };
+            total.modules++;
+            total.raw += module.raw;
+            total.gzip += module.gzip;
+            total.brotli += module.brotli;
+            total.initial = total.initial || module.initial;
+            packages.set(key, total);
+        }
+        const byPackage = [...packages.values()].sort((x, y) => y.gzip - x.gzip);
+
+        fs.mkdirSync(this.outputDir, { recursive: true });
+        const file = path.join(this.outputDir, this.flavor + ".report.json");
+        fs.writeFileSync(file, JSON.stringify({ flavor: this.flavor, entry, packages: byPackage, modules }, null, 2));
+
+        // Module sizes are before minification, so they add up to more than the files; the files are what is served.
+        const lines = [`Bundle report (${this.flavor}) -> ${file}`, "  app entry point:"];
+        for (const asset of entry.files)
+        {
+            lines.push(`    ${pad(kib(asset.raw), 10)} ${pad(kib(asset.gzip), 10)} gz ${pad(kib(asset.brotli), 10)} br  ${asset.file}`);
+        }
+        lines.push(`  largest packages (module source, before minification):`);
+        for (const total of byPackage.slice(0, TopPackages))
+        {
+            lines.push(`    ${pad(kib(total.raw), 10)} ${pad(kib(total.gzip), 10)} gz ${pad(kib(total.brotli), 10)} br  ${total.package} (${total.modules} modules${total.initial ? "" : ", lazy"})`);
+        }
+        console.log(lines.join("\n"));
+    }
+}
+
+function measure(buffer)
+{
+    return {
+        raw: buffer.length,
+        gzip: zlib.gzipSync(buffer, { level: 9 }).length,
+        brotli: zlib.brotliCompressSync(buffer, { params: { [zlib.constants.BROTLI_PARAM_QUALITY]: 11 } }).length,
+    };
+}
+
+function packageOf(resource)
+{
+    if (!resource)
+    {
+        return "(webpack)";
+    }
+    const match = /node_modules[\\/]((?:@[^\\/]+[\\/])?[^\\/]+)/.exec(resource);
+    return match ? match[1].replace("\\", "/") : "(app)";
+}
+
+function kib(bytes)
+{
+    return (bytes / 1024).toFixed(1) + " KiB";
+}
+
+function pad(text, width)
+{
+    return text.padStart(width);
+}
+
+module.exports = BundleReportPlugin;
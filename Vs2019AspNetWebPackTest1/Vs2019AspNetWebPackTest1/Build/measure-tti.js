@@ -0,0 +1,230 @@
+// Time to interactive of a page (by default the Index view) in headless Chrome, for regressions of the bundles that
+// the size budgets do not catch.
+//
+//   npm run perf:tti -- [--url http://localhost:5000/] [--runs 5] [--cpu-throttle 4] [--warm]
+//
+// Run it against the site in the Production environment after npm run build:prod, so that the page loads the
+// minified bundles. Every run is a cold load (unless --warm) with the CPU slowed down like a mid-range phone.
+// TTI is computed close to the way Lighthouse does it: the end of the last long task (over 50 ms) before the first
+// 5-second window after the first contentful paint with no long task and at most two requests in flight, and no
+// earlier than DOMContentLoaded. The median of the runs is printed, written to obj/webpack/tti.json, and checked against
+// bundleBudgets.timeToInteractiveMs in package.json (the exit code is 1 when it is over). An alert, confirm or prompt
+// would block the page until answered; it is dismissed, and fails the measurement because the page did not load cleanly.
+const fs = require("fs");
+const path = require("path");
+const puppeteer = require("puppeteer");
+
+const QuietWindow = 5000;
+const MaxInFlight = 2;
+
+function parseArgs(argv)
+{
+    const options = { url: "http://localhost:5000/", runs: 5, cpuThrottle: 4, warm: false };
+    for (let i = 0; i < argv.length; i++)
+    {
+        switch (argv[i])
+        {
+            case "--url":
+                options.url = argv[++i];
+                break;
+            case "--runs":
+                options.runs = parseInt(argv[++i], 10);
+                break;
+            case "--cpu-throttle":
+                options.cpuThrottle = parseFloat(argv[++i]);
+                break;
+            case "--warm":
+                options.warm = true;
+                break;
+            default:
+                throw new Error("Unknown option: " + argv[i]);
+        }
+    }
+    return options;
+}
+
+async function measure(browser, options)
+{
+    const page = await browser.newPage();
+    const dialogs = [];
+    page.on("dialog", dialog =>
+    {
+        dialogs.push(`${dialog.type()}: ${dialog.message()}`);
+        dialog.dismiss().catch(() => { });
+    });
+    try
+    {
+        const client = await page.target().createCDPSession();
+        await client.send("Emulation.setCPUThrottlingRate", { rate: options.cpuThrottle });
+        await page.setCacheEnabled(options.warm);
+
+        await page.evaluateOnNewDocument(() =>
+        {
+            window.__ttiLongTasks = [];
+            new PerformanceObserver(list =>
+            {
+                for (const entry of list.getEntries())
+                {
+                    window.__ttiLongTasks.push([entry.startTime, entry.startTime + entry.duration]);
+                }
+            }).observe({ entryTypes: ["longtask"] });
+        });
+
+        await page.goto(options.url, { waitUntil: "networkidle0" });
+        // Long enough after the last request for a quiet window to exist, unless a task keeps the page busy.
+        await page.waitForTimeout(QuietWindow);
+
+        const timing = await page.evaluate(() =>
+        {
+            const navigation = performance.getEntriesByType("navigation")[0];
+            const paint = performance.getEntriesByType("paint").find(entry => entry.name === "first-contentful-paint");
+            const resources = performance.getEntriesByType("resource");
+            return {
+                domContentLoaded: navigation.domContentLoadedEventEnd,
+                load: navigation.loadEventEnd,
+                firstContentfulPaint: paint ? paint.startTime : navigation.domContentLoadedEventEnd,
+                longTasks: window.__ttiLongTasks,
+                requests: resources.map(entry => [entry.startTime, entry.responseEnd]),
+                scriptBytes: resources.filter(entry => entry.initiatorType === "script").reduce((sum, entry) => sum + entry.transferSize, 0),
+                observedUntil: performance.now(),
+            };
+        });
+        timing.timeToInteractive = computeTti(timing);
+        timing.dialogs = dialogs;
+        return timing;
+    }
+    finally
+    {
+        await page.close();
+    }
+}
+
+function computeTti(timing)
+{
+    const { firstContentfulPaint, domContentLoaded, longTasks, requests, observedUntil } = timing;
+
+    // A quiet window can only start at the first paint or where a long task or a request ends.
+    const starts = [firstContentfulPaint]
+        .concat(longTasks.map(task => task[1]), requests.map(request => request[1]))
+        .filter(time => time >= firstContentfulPaint)
+        .sort((x, y) => x - y);
+
+    for (const start of starts)
+    {
+        const end = start + QuietWindow;
+        if (end > observedUntil)
+        {
+            break;
+        }
+        if (longTasks.some(([taskStart, taskEnd]) => taskEnd > start && taskStart < end))
+        {
+            continue;
+        }
+        if (maxInFlight(requests, start, end) > MaxInFlight)
+        {
+            continue;
+        }
+        const lastTask = longTasks.filter(task => task[1] <= start).reduce((last, task) => Math.max(last, task[1]), firstContentfulPaint);
+        return Math.max(lastTask, domContentLoaded);
+    }
+    return null;
+}
+
+function maxInFlight(requests, start, end)
+{
+    // Sweep the starts and ends of the requests that overlap the window.
+    const events = [];
+    for (const [requestStart, requestEnd] of requests)
+    {
+        if (requestEnd > start && requestStart < end)
+        {
+            events.push([Math.max(requestStart, start), 1], [requestEnd, -1]);
+        }
+    }
+    events.sort((x, y) => x[0] - y[0] || x[1] - y[1]);
+
+    let current = 0, max = 0;
+    for (const [, delta] of events)
+    {
+        current += delta;
+        max = Math.max(max, current);
+    }
+    return max;
+}
+
+function median(values)
+{
+    const sorted = values.filter(value => value != null).sort((x, y) => x - y);
+    return sorted.length === 0 ? null : sorted[Math.floor(sorted.length / 2)];
+}
+
+function ms(value)
+{
+    return value == null ? "n/a" : Math.round(value) + " ms";
+}
+
+async function main()
+{
+    const options = parseArgs(process.argv.slice(2));
+    const budgets = require("../package.json").bundleBudgets || {};
+
+    const runs = [];
+    const browser = await puppeteer.launch({ headless: true });
+    try
+    {
+        for (let i = 0; i < options.runs; i++)
+        {
+            const run = await measure(browser, options);
+            runs.push(run);
+            console.log(`run ${i + 1}: FCP ${ms(run.firstContentfulPaint)}, DOMContentLoaded ${ms(run.domContentLoaded)}, load ${ms(run.load)}, TTI ${ms(run.timeToInteractive)}, ${run.longTasks.length} long task(s), ${Math.round(run.scriptBytes / 1024)} KiB of script`);
+            for (const dialog of run.dialogs)
+            {
+                console.error(`run ${i + 1}: dismissed ${dialog}`);
+            }
+        }
+    }
+    finally
+    {
+        await browser.close();
+    }
+
+    const result = {
+        url: options.url,
+        cpuThrottle: options.cpuThrottle,
+        warm: options.warm,
+        firstContentfulPaint: median(runs.map(run => run.firstContentfulPaint)),
+        domContentLoaded: median(runs.map(run => run.domContentLoaded)),
+        load: median(runs.map(run => run.load)),
+        timeToInteractive: median(runs.map(run => run.timeToInteractive)),
+        scriptBytes: median(runs.map(run => run.scriptBytes)),
+        runs: runs.map(run => ({ ...run, longTasks: run.longTasks.length, requests: run.requests.length })),
+    };
+
+    const outputDir = path.resolve(__dirname, "../obj/webpack");
+    fs.mkdirSync(outputDir, { recursive: true });
+    fs.writeFileSync(path.join(outputDir, "tti.json"), JSON.stringify(result, null, 2));
+    console.log(`median of ${runs.length}: FCP ${ms(result.firstContentfulPaint)}, TTI ${ms(result.timeToInteractive)} (${options.url}, CPU x${options.cpuThrottle}${options.warm ? ", warm cache" : ""})`);
+
+    const dialogs = runs.reduce((sum, run) => sum + run.dialogs.length, 0);
+    if (dialogs > 0)
+    {
+        console.error(`The page opened ${dialogs} dialog(s), which block it until answered; the timings are not comparable.`);
+        process.exitCode = 1;
+    }
+    else if (result.timeToInteractive == null)
+    {
+        console.error("The page never became quiet for " + QuietWindow + " ms.");
+        process.exitCode = 1;
+    }
+    else if (budgets.timeToInteractiveMs && result.timeToInteractive > budgets.timeToInteractiveMs)
+    {
+        console.error(`TTI is over the budget of ${budgets.timeToInteractiveMs} ms (bundleBudgets.timeToInteractiveMs in package.json).`);
+        process.exitCode = 1;
+    }
+}
+
+main().catch(e =>
+{
+    console.error(e);
+    process.exitCode = 1;
+});
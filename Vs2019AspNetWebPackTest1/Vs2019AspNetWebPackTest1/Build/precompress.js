@@ -0,0 +1,104 @@
+// Writes a .br and a .gz next to every compressible file under wwwroot (the webpack outputs, wwwroot/lib, css and
+// js), for PrecompressedStaticFiles.cs to serve to the clients that accept them. Both are compressed as hard as the
+// formats go, which is too slow to do per request. A variant gets the time of its file; the server ignores a variant
+// whose time differs, and this script rewrites it, so a file that changed is never served in an old version.
+// Variants of files that are gone are deleted, and so are variants that would not be at least 10% smaller.
+//
+//   node Build/precompress.js [directory]    (run by npm run build:prod after webpack)
+const fs = require("fs");
+const path = require("path");
+const zlib = require("zlib");
+
+const Compressible = new Set([".js", ".css", ".map", ".json", ".svg", ".html", ".txt", ".xml", ".ico", ".ttf", ".eot"]);
+const Variants = [
+    { extension: ".br", compress: data => zlib.brotliCompressSync(data, { params: { [zlib.constants.BROTLI_PARAM_QUALITY]: zlib.constants.BROTLI_MAX_QUALITY, [zlib.constants.BROTLI_PARAM_SIZE_HINT]: data.length } }) },
+    { extension: ".gz", compress: data => zlib.gzipSync(data, { level: zlib.constants.Z_BEST_COMPRESSION }) },
+];
+const MinSize = 1024;
+const MaxRatio = 0.9;
+const FreshnessToleranceMs = 1000;
+
+function* walk(dir)
+{
+    for (const entry of fs.readdirSync(dir, { withFileTypes: true }))
+    {
+        const file = path.join(dir, entry.name);
+        if (entry.isDirectory())
+        {
+            yield* walk(file);
+        }
+        else if (entry.isFile())
+        {
+            yield file;
+        }
+    }
+}
+
+function remove(file)
+{
+    if (fs.existsSync(file))
+    {
+        fs.unlinkSync(file);
+    }
+}
+
+function main()
+{
+    const root = path.resolve(__dirname, "..", process.argv[2] || "wwwroot");
+    const totals = { files: 0, written: 0, raw: 0, ".br": 0, ".gz": 0 };
+
+    for (const file of walk(root))
+    {
+        const variant = Variants.find(v => file.endsWith(v.extension));
+        if (variant)
+        {
+            if (!fs.existsSync(file.slice(0, -variant.extension.length)))
+            {
+                fs.unlinkSync(file);
+            }
+            continue;
+        }
+        if (!Compressible.has(path.extname(file).toLowerCase()))
+        {
+            continue;
+        }
+
+        const stat = fs.statSync(file);
+        if (stat.size < MinSize)
+        {
+            Variants.forEach(v => remove(file + v.extension));
+            continue;
+        }
+
+        let data = null;
+        totals.files++;
+        totals.raw += stat.size;
+        for (const v of Variants)
+        {
+            const target = file + v.extension;
+            if (fs.existsSync(target) && Math.abs(fs.statSync(target).mtimeMs - stat.mtimeMs) <= FreshnessToleranceMs)
+            {
+                totals[v.extension] += fs.statSync(target).size;
+                continue;
+            }
+
+            data = data || fs.readFileSync(file);
+            const compressed = v.compress(data);
+            if (compressed.length > data.length * MaxRatio)
+            {
+                remove(target);
+                totals[v.extension] += data.length;
+                continue;
+            }
+            fs.writeFileSync(target, compressed);
+            fs.utimesSync(target, stat.atime, stat.mtime);
+            totals[v.extension] += compressed.length;
+            totals.written++;
+        }
+    }
+
+    const mib = bytes => (bytes / 1048576).toFixed(2) + " MiB";
+    console.log(`precompress: ${totals.files} files in ${path.relative(process.cwd(), root) || "."}, ${totals.written} variants written; ${mib(totals.raw)} -> ${mib(totals[".br"])} br, ${mib(totals[".gz"])} gz`);
+}
+
+main();
@@ -0,0 +1,74 @@
+using Microsoft.AspNetCore.Hosting;
+using Microsoft.Extensions.FileProviders;
+using Microsoft.Extensions.Hosting;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Text.Json;
+
+namespace Vs2019AspNetWebPackTest1
+{
+    /// <summary>
+    /// The script and style files of the production build (webpack --mode production), read from the
+    /// wwwroot/dist/legacy.json and modern.json webpack writes, so that the layout references the hashed
+    /// file names of the last build. Unavailable in the Development environment and before the first
+    /// production build, when the layout falls back to the development bundle.js.
+    /// </summary>
+    public class BundleManifest
+    {
+        public const string DistPath = "/dist/";
+
+        public bool IsAvailable { get; }
+
+        public BundleFiles Legacy { get; } = BundleFiles.Empty;
+
+        public BundleFiles Modern { get; } = BundleFiles.Empty;
+
+        public BundleManifest(IWebHostEnvironment env)
+        {
+            if (env.IsDevelopment())
+            {
+                return;
+            }
+
+            BundleFiles? legacy = Load(env.WebRootFileProvider, "legacy.json");
+            BundleFiles? modern = Load(env.WebRootFileProvider, "modern.json");
+            if (legacy != null && modern != null)
+            {
+                Legacy = legacy;
+                Modern = modern;
+                IsAvailable = true;
+            }
+        }
+
+        private static BundleFiles? Load(IFileProvider files, string name)
+        {
+            IFileInfo file = files.GetFileInfo(DistPath + name);
+            if (!file.Exists)
+            {
+                return null;
+            }
+
+            using Stream stream = file.CreateReadStream();
+            using JsonDocument json = JsonDocument.Parse(stream);
+            JsonElement app = json.RootElement.GetProperty("app");
+            return new BundleFiles(ReadPaths(app, "js"), ReadPaths(app, "css"));
+        }
+
+        private static IReadOnlyList<string> ReadPaths(JsonElement entrypoint, string kind)
+        {
+            var paths = new List<string>();
+            foreach (JsonElement file in entrypoint.GetProperty(kind).EnumerateArray())
+            {
+                paths.Add(DistPath + file.GetString());
+            }
+            return paths;
+        }
+    }
+
+    /// <summary>The files of one build, in the order the entry point needs them loaded.</summary>
+    public record BundleFiles(IReadOnlyList<string> Scripts, IReadOnlyList<string> Styles)
+    {
+        public static BundleFiles Empty { get; } = new BundleFiles(Array.Empty<string>(), Array.Empty<string>());
+    }
+}
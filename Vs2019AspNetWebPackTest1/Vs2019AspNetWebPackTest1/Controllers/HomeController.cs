@@ -18,11 +18,13 @@ namespace Vs2019AspNetWebPackTest1.Controllers
             _logger = logger;
         }
 
+        [ResponseCache(CacheProfileName = Startup.StaticPageCacheProfile)]
         public IActionResult Index()
         {
             return View();
         }
 
+        [ResponseCache(CacheProfileName = Startup.StaticPageCacheProfile)]
         public IActionResult Privacy()
         {
             return View();
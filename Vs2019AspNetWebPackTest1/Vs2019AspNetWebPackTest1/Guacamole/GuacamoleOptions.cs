@@ -0,0 +1,47 @@
+using System;
+using System.Collections.Generic;
+
+namespace Vs2019AspNetWebPackTest1.Guacamole
+{
+    /// <summary>The "Guacamole" section of appsettings.json: where guacd is, and the connections a browser can open.</summary>
+    public class GuacamoleOptions
+    {
+        public const string Section = "Guacamole";
+
+        public string GuacdHost { get; set; } = "localhost";
+
+        public int GuacdPort { get; set; } = 4822;
+
+        /// <summary>Sessions beyond this are refused with CLIENT_TOO_MANY.</summary>
+        public int MaxSessions { get; set; } = 4096;
+
+        /// <summary>
+        /// The longest instruction either side may send, in bytes, and so what a session buffers at most in each
+        /// direction. guacd splits images into blobs of a few KB, so a much longer instruction is not one of its own.
+        /// </summary>
+        public int MaxInstructionLength { get; set; } = 64 * 1024;
+
+        /// <summary>What a session reads from guacd at a time; held by every session while it waits for guacd.</summary>
+        public int UpstreamBufferSize { get; set; } = 8 * 1024;
+
+        /// <summary>What a session receives from the browser at a time; also held while it waits.</summary>
+        public int DownstreamBufferSize { get; set; } = 4 * 1024;
+
+        /// <summary>A browser that takes longer than this to accept one message is disconnected.</summary>
+        public TimeSpan SendTimeout { get; set; } = TimeSpan.FromSeconds(30);
+
+        public TimeSpan ConnectTimeout { get; set; } = TimeSpan.FromSeconds(10);
+
+        /// <summary>By the id the browser connects with ("id=..."), so that it names a connection rather than describing one.</summary>
+        public Dictionary<string, GuacamoleConnection> Connections { get; set; } = new Dictionary<string, GuacamoleConnection>();
+    }
+
+    public class GuacamoleConnection
+    {
+        /// <summary>rdp, vnc, ssh or telnet.</summary>
+        public string Protocol { get; set; } = "rdp";
+
+        /// <summary>The arguments guacd asks for by name in its "args" instruction, such as hostname and port.</summary>
+        public Dictionary<string, string> Parameters { get; set; } = new Dictionary<string, string>();
+    }
+}
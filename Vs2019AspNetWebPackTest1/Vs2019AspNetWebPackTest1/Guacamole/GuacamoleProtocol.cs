@@ -0,0 +1,206 @@
+using System;
+using System.Buffers;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Text;
+
+namespace Vs2019AspNetWebPackTest1.Guacamole
+{
+    /// <summary>
+    /// The framing of the Guacamole protocol: an instruction is its opcode and arguments, each prefixed with its
+    /// length in Unicode code points (not bytes) and a dot, separated by commas and terminated by a semicolon, as in
+    /// "4.size,4.1024,3.768;". The tunnel only has to find where instructions end, which it does on the UTF-8 bytes
+    /// without decoding them; the few instructions it reads itself (the handshake) are decoded into strings.
+    /// </summary>
+    public static class GuacamoleProtocol
+    {
+        /// <summary>The subprotocol guacamole-common-js asks for when it opens the WebSocket.</summary>
+        public const string WebSocketSubprotocol = "guacamole";
+
+        /// <summary>The empty opcode of the instructions between the tunnel and the browser, never for guacd.</summary>
+        public const string InternalOpcode = "";
+
+        // Status codes of the protocol (Guacamole.Status.Code), sent as the reason when the WebSocket is closed.
+        public const int Success = 0x0000;
+        public const int ServerError = 0x0200;
+        public const int ServerBusy = 0x0201;
+        public const int UpstreamTimeout = 0x0202;
+        public const int UpstreamError = 0x0203;
+        public const int ResourceNotFound = 0x0204;
+        public const int UpstreamNotFound = 0x0207;
+        public const int ClientBadRequest = 0x0300;
+        public const int ClientTooMany = 0x031D;
+
+        private const int MaxLengthDigits = 10;
+
+        private static readonly byte[] Comma = { (byte)',' };
+        private static readonly byte[] Semicolon = { (byte)';' };
+
+        /// <summary>
+        /// Reads one complete instruction. Returns false, with <paramref name="reader"/> where it was, when the data
+        /// ends inside it; throws <see cref="InvalidDataException"/> when it is malformed or longer than
+        /// <paramref name="maxLength"/> bytes, which is the bound on what a peer can make the tunnel buffer.
+        /// </summary>
+        public static bool TryReadInstruction(ref SequenceReader<byte> reader, int maxLength, out ReadOnlySequence<byte> instruction)
+        {
+            SequenceReader<byte> start = reader;
+            while (true)
+            {
+                if (!TryReadLength(ref reader, maxLength, out long length) || !TrySkipCodePoints(ref reader, length) ||
+                    !reader.TryRead(out byte terminator))
+                {
+                    if (reader.Consumed - start.Consumed > maxLength)
+                    {
+                        throw new InvalidDataException($"Instruction longer than {maxLength} bytes.");
+                    }
+                    reader = start;
+                    instruction = default;
+                    return false;
+                }
+
+                if (reader.Consumed - start.Consumed > maxLength)
+                {
+                    throw new InvalidDataException($"Instruction longer than {maxLength} bytes.");
+                }
+                if (terminator == (byte)';')
+                {
+                    instruction = start.Sequence.Slice(start.Position, reader.Position);
+                    return true;
+                }
+                if (terminator != (byte)',')
+                {
+                    throw new InvalidDataException($"Expected ',' or ';' after an element, not 0x{terminator:X2}.");
+                }
+            }
+        }
+
+        /// <summary>The instruction at the start of <paramref name="buffer"/>, if it is complete.</summary>
+        public static bool TryReadInstruction(ReadOnlySequence<byte> buffer, int maxLength, out ReadOnlySequence<byte> instruction)
+        {
+            var reader = new SequenceReader<byte>(buffer);
+            return TryReadInstruction(ref reader, maxLength, out instruction);
+        }
+
+        /// <summary>Where the complete instructions at the start of <paramref name="buffer"/> end.</summary>
+        public static SequencePosition EndOfInstructions(ReadOnlySequence<byte> buffer, int maxLength)
+        {
+            var reader = new SequenceReader<byte>(buffer);
+            while (TryReadInstruction(ref reader, maxLength, out _))
+            {
+            }
+            return reader.Position;
+        }
+
+        /// <summary>Whether <paramref name="instruction"/> has the internal (empty) opcode: starts with "0.".</summary>
+        public static bool IsInternal(ReadOnlySequence<byte> instruction)
+        {
+            var reader = new SequenceReader<byte>(instruction);
+            return reader.IsNext((byte)'0', advancePast: true) && reader.IsNext((byte)'.');
+        }
+
+        /// <summary>The opcode and the arguments of a complete instruction, decoded.</summary>
+        public static List<string> Decode(ReadOnlySequence<byte> instruction)
+        {
+            var elements = new List<string>();
+            var reader = new SequenceReader<byte>(instruction);
+            while (!reader.End)
+            {
+                TryReadLength(ref reader, int.MaxValue, out long length);
+                SequenceReader<byte> value = reader;
+                TrySkipCodePoints(ref reader, length);
+                elements.Add(Encoding.UTF8.GetString(instruction.Slice(value.Position, reader.Position)));
+                reader.Advance(1);
+            }
+            return elements;
+        }
+
+        /// <summary>Writes an instruction of <paramref name="opcode"/> and <paramref name="args"/>.</summary>
+        public static void Encode(IBufferWriter<byte> output, string opcode, params string[] args)
+        {
+            WriteElement(output, opcode);
+            foreach (string arg in args)
+            {
+                output.Write(Comma);
+                WriteElement(output, arg);
+            }
+            output.Write(Semicolon);
+        }
+
+        public static byte[] Encode(string opcode, params string[] args)
+        {
+            var output = new ArrayBufferWriter<byte>();
+            Encode(output, opcode, args);
+            return output.WrittenSpan.ToArray();
+        }
+
+        private static void WriteElement(IBufferWriter<byte> output, string value)
+        {
+            // The length is in code points: a surrogate pair is one.
+            int codePoints = value.Length;
+            foreach (char c in value)
+            {
+                if (char.IsLowSurrogate(c))
+                {
+                    codePoints--;
+                }
+            }
+            Encoding.ASCII.GetBytes(codePoints.ToString(CultureInfo.InvariantCulture) + ".", output);
+            Encoding.UTF8.GetBytes(value, output);
+        }
+
+        private static bool TryReadLength(ref SequenceReader<byte> reader, int maxLength, out long length)
+        {
+            length = 0;
+            for (int digits = 0; ; digits++)
+            {
+                if (!reader.TryRead(out byte b))
+                {
+                    return false;
+                }
+                if (b == (byte)'.' && digits != 0)
+                {
+                    return true;
+                }
+                if (b < (byte)'0' || b > (byte)'9' || digits == MaxLengthDigits)
+                {
+                    throw new InvalidDataException("Malformed element length.");
+                }
+                length = length * 10 + (b - '0');
+                if (length > maxLength)
+                {
+                    throw new InvalidDataException($"Element longer than {maxLength} code points.");
+                }
+            }
+        }
+
+        /// <summary>
+        /// Moves past <paramref name="count"/> code points, to the byte after them, which is the ',' or ';' of the
+        /// element. Code points are counted by their first bytes: a UTF-8 continuation byte is 10xxxxxx.
+        /// </summary>
+        private static bool TrySkipCodePoints(ref SequenceReader<byte> reader, long count)
+        {
+            while (true)
+            {
+                ReadOnlySpan<byte> span = reader.UnreadSpan;
+                if (span.IsEmpty)
+                {
+                    return false;
+                }
+                for (int i = 0; i < span.Length; i++)
+                {
+                    if ((span[i] & 0xC0) != 0x80)
+                    {
+                        if (count == 0)
+                        {
+                            reader.Advance(i);
+                            return true;
+                        }
+                        count--;
+                    }
+                }
+                reader.Advance(span.Length);
+            }
+        }
+    }
+}
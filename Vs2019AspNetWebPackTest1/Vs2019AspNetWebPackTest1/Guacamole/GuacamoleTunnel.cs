@@ -0,0 +1,451 @@
+using Microsoft.AspNetCore.Builder;
+using Microsoft.AspNetCore.Http;
+using Microsoft.AspNetCore.Routing;
+using Microsoft.Extensions.DependencyInjection;
+using Microsoft.Extensions.Logging;
+using Microsoft.Extensions.Options;
+using System;
+using System.Buffers;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Pipelines;
+using System.Net.Sockets;
+using System.Net.WebSockets;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Vs2019AspNetWebPackTest1.Guacamole
+{
+    /// <summary>
+    /// The server end of Guacamole.WebSocketTunnel: does the handshake with guacd for the connection the browser
+    /// names, then relays instructions both ways.
+    ///
+    /// Memory per session is bounded, whatever the browser does. Nothing is read from guacd while a message is being
+    /// sent to the browser, so a slow browser fills TCP windows, not buffers, and guacd (which also waits for the
+    /// browser's sync replies before it sends more frames) slows down to its pace. Each direction holds one pooled
+    /// buffer plus at most one incomplete instruction of MaxInstructionLength, and a browser that stops reading for
+    /// SendTimeout is disconnected.
+    /// </summary>
+    public static class GuacamoleTunnel
+    {
+        private static int _sessions;
+
+        public static int ActiveSessions => Volatile.Read(ref _sessions);
+
+        public static IEndpointConventionBuilder MapGuacamoleTunnel(this IEndpointRouteBuilder endpoints, string pattern)
+        {
+            return endpoints.Map(pattern, HandleAsync);
+        }
+
+        private static async Task HandleAsync(HttpContext context)
+        {
+            if (!context.WebSockets.IsWebSocketRequest)
+            {
+                context.Response.StatusCode = StatusCodes.Status400BadRequest;
+                return;
+            }
+
+            GuacamoleOptions options = context.RequestServices.GetRequiredService<IOptions<GuacamoleOptions>>().Value;
+            ILogger logger = context.RequestServices.GetRequiredService<ILogger<GuacamoleSession>>();
+
+            using WebSocket socket = await context.WebSockets.AcceptWebSocketAsync(GuacamoleProtocol.WebSocketSubprotocol);
+            try
+            {
+                if (Interlocked.Increment(ref _sessions) > options.MaxSessions)
+                {
+                    logger.LogWarning("Refused a Guacamole session: {MaxSessions} are open already.", options.MaxSessions);
+                    await GuacamoleSession.CloseAsync(socket, GuacamoleProtocol.ClientTooMany, CancellationToken.None);
+                    return;
+                }
+
+                var session = new GuacamoleSession(socket, options, logger);
+                await session.RunAsync(context.Request.Query, context.RequestAborted);
+            }
+            finally
+            {
+                Interlocked.Decrement(ref _sessions);
+            }
+        }
+    }
+
+    /// <summary>One browser connected to guacd through the tunnel.</summary>
+    public sealed class GuacamoleSession
+    {
+        private readonly WebSocket _socket;
+        private readonly GuacamoleOptions _options;
+        private readonly ILogger _logger;
+
+        // The browser side has one sender at a time: instructions from guacd and the replies to the browser's pings.
+        private readonly SemaphoreSlim _sendLock = new SemaphoreSlim(1, 1);
+
+        private static readonly byte[] Disconnect = GuacamoleProtocol.Encode("disconnect");
+        private static readonly TimeSpan CloseTimeout = TimeSpan.FromSeconds(5);
+
+        public GuacamoleSession(WebSocket socket, GuacamoleOptions options, ILogger logger)
+        {
+            _socket = socket;
+            _options = options;
+            _logger = logger;
+        }
+
+        public async Task RunAsync(IQueryCollection query, CancellationToken aborted)
+        {
+            string id = query["id"];
+            if (string.IsNullOrEmpty(id) || !_options.Connections.TryGetValue(id, out GuacamoleConnection? connection))
+            {
+                _logger.LogWarning("No Guacamole connection {Id}.", id);
+                await CloseAsync(_socket, GuacamoleProtocol.ResourceNotFound, aborted);
+                return;
+            }
+
+            using var guacd = new Socket(SocketType.Stream, ProtocolType.Tcp) { NoDelay = true };
+            try
+            {
+                using var timeout = CancellationTokenSource.CreateLinkedTokenSource(aborted);
+                timeout.CancelAfter(_options.ConnectTimeout);
+                await guacd.ConnectAsync(_options.GuacdHost, _options.GuacdPort, timeout.Token);
+            }
+            catch (Exception e) when (e is SocketException || e is OperationCanceledException)
+            {
+                _logger.LogWarning("Cannot connect to guacd at {Host}:{Port}: {Error}", _options.GuacdHost, _options.GuacdPort, e.Message);
+                await CloseAsync(_socket, GuacamoleProtocol.UpstreamNotFound, aborted);
+                return;
+            }
+
+            await using var stream = new NetworkStream(guacd, ownsSocket: false);
+            PipeReader upstream = PipeReader.Create(stream, new StreamPipeReaderOptions(
+                pool: MemoryPool<byte>.Shared, bufferSize: _options.UpstreamBufferSize, minimumReadSize: _options.UpstreamBufferSize / 4, leaveOpen: true));
+            try
+            {
+                string? connectionId = await HandshakeAsync(connection, query, stream, upstream, aborted);
+                if (connectionId == null)
+                {
+                    return;
+                }
+                _logger.LogInformation("Guacamole session {Id} connected to {Protocol} as {ConnectionId}.", id, connection.Protocol, connectionId);
+
+                // The tunnel's UUID, which also tells the browser that the tunnel is open.
+                await SendAsync(new ReadOnlySequence<byte>(GuacamoleProtocol.Encode(GuacamoleProtocol.InternalOpcode, Guid.NewGuid().ToString())), aborted);
+
+                await RelayAsync(stream, upstream, aborted);
+                _logger.LogInformation("Guacamole session {ConnectionId} closed.", connectionId);
+            }
+            catch (Exception e) when (e is InvalidDataException || e is IOException || e is WebSocketException || e is OperationCanceledException)
+            {
+                _logger.LogInformation("Guacamole session {Id} ended: {Error}", id, e.Message);
+                int status = e is InvalidDataException ? GuacamoleProtocol.ClientBadRequest : GuacamoleProtocol.UpstreamError;
+                await CloseAsync(_socket, status, CancellationToken.None);
+            }
+            finally
+            {
+                await upstream.CompleteAsync();
+            }
+        }
+
+        /// <summary>
+        /// select, then the arguments guacd asks for, then the client's size and formats (from the connect data of
+        /// the browser, with the names guacamole-client uses), and connect. Returns guacd's connection id, or null
+        /// when guacd refused, in which case its error instruction has been passed on to the browser.
+        /// </summary>
+        private async Task<string?> HandshakeAsync(GuacamoleConnection connection, IQueryCollection query, Stream guacd, PipeReader upstream, CancellationToken cancellation)
+        {
+            await guacd.WriteAsync(GuacamoleProtocol.Encode("select", connection.Protocol), cancellation);
+
+            List<string> args = await ReadHandshakeInstructionAsync(upstream, "args", cancellation);
+            if (args.Count == 0)
+            {
+                return null;
+            }
+
+            var values = new string[args.Count - 1];
+            for (int i = 1; i < args.Count; i++)
+            {
+                string name = args[i];
+                // Since 1.1 the first argument is the protocol version guacd speaks; repeating it accepts it.
+                values[i - 1] = i == 1 && name.StartsWith("VERSION_", StringComparison.Ordinal)
+                    ? name
+                    : connection.Parameters.TryGetValue(name, out string? value) ? value : "";
+            }
+
+            var output = new ArrayBufferWriter<byte>();
+            GuacamoleProtocol.Encode(output, "size", Query(query, "GUAC_WIDTH", "1024"), Query(query, "GUAC_HEIGHT", "768"), Query(query, "GUAC_DPI", "96"));
+            GuacamoleProtocol.Encode(output, "audio", query["GUAC_AUDIO"].ToArray());
+            GuacamoleProtocol.Encode(output, "video", query["GUAC_VIDEO"].ToArray());
+            GuacamoleProtocol.Encode(output, "image", query["GUAC_IMAGE"].Count != 0 ? query["GUAC_IMAGE"].ToArray() : new[] { "image/png", "image/jpeg" });
+            if (query.ContainsKey("GUAC_TIMEZONE"))
+            {
+                GuacamoleProtocol.Encode(output, "timezone", query["GUAC_TIMEZONE"].ToString());
+            }
+            GuacamoleProtocol.Encode(output, "connect", values);
+            await guacd.WriteAsync(output.WrittenMemory, cancellation);
+
+            List<string> ready = await ReadHandshakeInstructionAsync(upstream, "ready", cancellation);
+            return ready.Count == 0 ? null : ready.Count > 1 ? ready[1] : "";
+        }
+
+        private static string Query(IQueryCollection query, string name, string defaultValue)
+        {
+            string value = query[name];
+            return string.IsNullOrEmpty(value) ? defaultValue : value;
+        }
+
+        /// <summary>
+        /// The next instruction from guacd, which has to be <paramref name="opcode"/>. An error instruction instead is
+        /// sent on to the browser, which shows it, and an empty list returned.
+        /// </summary>
+        private async Task<List<string>> ReadHandshakeInstructionAsync(PipeReader upstream, string opcode, CancellationToken cancellation)
+        {
+            while (true)
+            {
+                ReadResult result = await upstream.ReadAsync(cancellation);
+                if (GuacamoleProtocol.TryReadInstruction(result.Buffer, _options.MaxInstructionLength, out ReadOnlySequence<byte> instruction))
+                {
+                    List<string> elements = GuacamoleProtocol.Decode(instruction);
+                    if (elements[0] == "error")
+                    {
+                        _logger.LogWarning("guacd refused the connection: {Message}", elements.Count > 1 ? elements[1] : "");
+                        await SendAsync(instruction, cancellation);
+                        upstream.AdvanceTo(instruction.End);
+                        await CloseAsync(_socket, GuacamoleProtocol.UpstreamError, cancellation);
+                        return new List<string>();
+                    }
+                    upstream.AdvanceTo(instruction.End);
+                    if (elements[0] != opcode)
+                    {
+                        throw new InvalidDataException($"guacd sent {elements[0]} instead of {opcode}.");
+                    }
+                    return elements;
+                }
+
+                upstream.AdvanceTo(result.Buffer.Start, result.Buffer.End);
+                if (result.IsCompleted)
+                {
+                    throw new IOException("guacd closed the connection during the handshake.");
+                }
+            }
+        }
+
+        /// <summary>Until either side closes: then the other is closed too.</summary>
+        private async Task RelayAsync(Stream guacd, PipeReader upstream, CancellationToken aborted)
+        {
+            using var stop = CancellationTokenSource.CreateLinkedTokenSource(aborted);
+            Task fromGuacd = RelayFromGuacdAsync(upstream, stop.Token);
+            Task fromBrowser = RelayFromBrowserAsync(guacd, stop.Token);
+
+            Task first = await Task.WhenAny(fromGuacd, fromBrowser);
+            if (first == fromGuacd && fromGuacd.IsCompletedSuccessfully)
+            {
+                // guacd is done: say so to the browser and give it a moment to close its side.
+                await CloseAsync(_socket, GuacamoleProtocol.Success, stop.Token);
+                stop.CancelAfter(CloseTimeout);
+            }
+            else
+            {
+                if (first == fromBrowser && fromBrowser.IsCompletedSuccessfully)
+                {
+                    // The browser closed: let guacd end the connection properly rather than see it reset.
+                    try
+                    {
+                        await guacd.WriteAsync(Disconnect, stop.Token);
+                    }
+                    catch (IOException)
+                    {
+                    }
+                    await CloseAsync(_socket, GuacamoleProtocol.Success, stop.Token);
+                }
+                stop.Cancel();
+            }
+
+            try
+            {
+                await Task.WhenAll(fromGuacd, fromBrowser);
+            }
+            catch (OperationCanceledException) when (stop.IsCancellationRequested)
+            {
+            }
+        }
+
+        private async Task RelayFromGuacdAsync(PipeReader upstream, CancellationToken cancellation)
+        {
+            while (true)
+            {
+                ReadResult result = await upstream.ReadAsync(cancellation);
+                ReadOnlySequence<byte> buffer = result.Buffer;
+
+                // Whole instructions only: the browser parses every message on its own.
+                SequencePosition end = GuacamoleProtocol.EndOfInstructions(buffer, _options.MaxInstructionLength);
+                ReadOnlySequence<byte> instructions = buffer.Slice(0, end);
+                if (!instructions.IsEmpty)
+                {
+                    await SendAsync(instructions, cancellation);
+                }
+
+                upstream.AdvanceTo(end, buffer.End);
+                if (result.IsCompleted)
+                {
+                    return;
+                }
+            }
+        }
+
+        private async Task RelayFromBrowserAsync(Stream guacd, CancellationToken cancellation)
+        {
+            byte[] buffer = ArrayPool<byte>.Shared.Rent(_options.DownstreamBufferSize);
+            try
+            {
+                while (true)
+                {
+                    // One message, into a bigger buffer if it does not fit, up to the longest instruction allowed.
+                    int length = 0;
+                    ValueWebSocketReceiveResult received;
+                    do
+                    {
+                        if (length == buffer.Length)
+                        {
+                            if (buffer.Length >= _options.MaxInstructionLength)
+                            {
+                                throw new InvalidDataException($"Message longer than {_options.MaxInstructionLength} bytes.");
+                            }
+                            byte[] larger = ArrayPool<byte>.Shared.Rent(Math.Min(buffer.Length * 2, _options.MaxInstructionLength));
+                            buffer.AsSpan(0, length).CopyTo(larger);
+                            ArrayPool<byte>.Shared.Return(buffer);
+                            buffer = larger;
+                        }
+                        received = await _socket.ReceiveAsync(buffer.AsMemory(length), cancellation);
+                        length += received.Count;
+                    }
+                    while (!received.EndOfMessage);
+
+                    if (received.MessageType == WebSocketMessageType.Close)
+                    {
+                        return;
+                    }
+
+                    await ForwardAsync(new ReadOnlySequence<byte>(buffer, 0, length), guacd, cancellation);
+
+                    // Back to the small buffer after a large message, so that an idle session holds little.
+                    if (buffer.Length > _options.DownstreamBufferSize)
+                    {
+                        ArrayPool<byte>.Shared.Return(buffer);
+                        buffer = ArrayPool<byte>.Shared.Rent(_options.DownstreamBufferSize);
+                    }
+                }
+            }
+            finally
+            {
+                ArrayPool<byte>.Shared.Return(buffer);
+            }
+        }
+
+        /// <summary>
+        /// Writes the instructions of a message to guacd, except the internal ones: a ping is answered (the browser
+        /// measures the round trip with it) and the others are dropped. A message has to end with an instruction,
+        /// so that the browser cannot leave one half-written in guacd's stream.
+        /// </summary>
+        private async Task ForwardAsync(ReadOnlySequence<byte> message, Stream guacd, CancellationToken cancellation)
+        {
+            while (TryFindInternal(message, out ReadOnlySequence<byte> instruction))
+            {
+                await WriteAsync(guacd, message.Slice(0, instruction.Start), cancellation);
+                List<string> elements = GuacamoleProtocol.Decode(instruction);
+                if (elements.Count > 1 && elements[1] == "ping")
+                {
+                    await SendAsync(instruction, cancellation);
+                }
+                message = message.Slice(instruction.End);
+            }
+            await WriteAsync(guacd, message, cancellation);
+        }
+
+        /// <summary>The first internal instruction of <paramref name="message"/>, checking the ones before it.</summary>
+        private bool TryFindInternal(ReadOnlySequence<byte> message, out ReadOnlySequence<byte> instruction)
+        {
+            var reader = new SequenceReader<byte>(message);
+            while (!reader.End)
+            {
+                if (!GuacamoleProtocol.TryReadInstruction(ref reader, _options.MaxInstructionLength, out instruction))
+                {
+                    throw new InvalidDataException("Incomplete instruction from the browser.");
+                }
+                if (GuacamoleProtocol.IsInternal(instruction))
+                {
+                    return true;
+                }
+            }
+            instruction = default;
+            return false;
+        }
+
+        private static async ValueTask WriteAsync(Stream stream, ReadOnlySequence<byte> data, CancellationToken cancellation)
+        {
+            foreach (ReadOnlyMemory<byte> segment in data)
+            {
+                await stream.WriteAsync(segment, cancellation);
+            }
+        }
+
+        /// <summary>
+        /// Sends <paramref name="data"/> as one text message, a frame per segment rather than copied together. A send
+        /// that does not finish within SendTimeout aborts the WebSocket.
+        /// </summary>
+        private async Task SendAsync(ReadOnlySequence<byte> data, CancellationToken cancellation)
+        {
+            await _sendLock.WaitAsync(cancellation);
+            try
+            {
+                using var timeout = CancellationTokenSource.CreateLinkedTokenSource(cancellation);
+                timeout.CancelAfter(_options.SendTimeout);
+
+                ReadOnlyMemory<byte> previous = default;
+                bool first = true;
+                foreach (ReadOnlyMemory<byte> segment in data)
+                {
+                    if (segment.IsEmpty)
+                    {
+                        continue;
+                    }
+                    if (!first)
+                    {
+                        await _socket.SendAsync(previous, WebSocketMessageType.Text, endOfMessage: false, timeout.Token);
+                    }
+                    previous = segment;
+                    first = false;
+                }
+                await _socket.SendAsync(previous, WebSocketMessageType.Text, endOfMessage: true, timeout.Token);
+            }
+            finally
+            {
+                _sendLock.Release();
+            }
+        }
+
+        /// <summary>
+        /// Closes the WebSocket with a Guacamole status code as the reason, which is what Guacamole.WebSocketTunnel
+        /// reports to the page (and the close code it falls back on when there is none).
+        /// </summary>
+        public static async Task CloseAsync(WebSocket socket, int status, CancellationToken cancellation)
+        {
+            if (socket.State != WebSocketState.Open && socket.State != WebSocketState.CloseReceived)
+            {
+                return;
+            }
+
+            WebSocketCloseStatus closeStatus = status switch
+            {
+                GuacamoleProtocol.Success => WebSocketCloseStatus.NormalClosure,
+                GuacamoleProtocol.ClientBadRequest => WebSocketCloseStatus.ProtocolError,
+                GuacamoleProtocol.ResourceNotFound => WebSocketCloseStatus.ProtocolError,
+                GuacamoleProtocol.ClientTooMany => WebSocketCloseStatus.PolicyViolation,
+                GuacamoleProtocol.ServerBusy => WebSocketCloseStatus.PolicyViolation,
+                _ => WebSocketCloseStatus.InternalServerError,
+            };
+            try
+            {
+                await socket.CloseOutputAsync(closeStatus, status.ToString(System.Globalization.CultureInfo.InvariantCulture), cancellation);
+            }
+            catch (Exception e) when (e is WebSocketException || e is OperationCanceledException || e is IOException)
+            {
+            }
+        }
+    }
+}
@@ -0,0 +1,104 @@
+using cs_instrumentation;
+using Microsoft.AspNetCore.Builder;
+using Microsoft.AspNetCore.Http;
+using Microsoft.Extensions.DependencyInjection;
+using Microsoft.Extensions.Hosting;
+using System.Diagnostics;
+using System.Threading;
+using System.Threading.Tasks;
+using Vs2019AspNetWebPackTest1.Guacamole;
+
+namespace Vs2019AspNetWebPackTest1
+{
+    /// <summary>
+    /// The request counts and latencies of the app, in the same form as the console test harnesses report theirs:
+    /// as the "Vs2019AspNetWebPackTest1" EventCounters (dotnet-counters monitor -n Vs2019AspNetWebPackTest1 --counters
+    /// Vs2019AspNetWebPackTest1), and as JSON lines in the file named by DN_METRICS_JSON when it is set. Recording a
+    /// request is two counter adds and a histogram add; nothing is logged per request. WebSocket requests are only
+    /// counted: they last as long as their session, which the guacamole-sessions gauge tracks.
+    /// </summary>
+    public static class HttpMetrics
+    {
+        public const string RegistryName = "Vs2019AspNetWebPackTest1";
+
+        public static IServiceCollection AddHttpMetrics(this IServiceCollection services)
+        {
+            services.AddSingleton(_ =>
+            {
+                var registry = new MetricRegistry(RegistryName);
+                registry.GetGauge("guacamole-sessions", "Guacamole sessions", read: () => GuacamoleTunnel.ActiveSessions);
+                return registry;
+            });
+            services.AddHostedService<MetricsExport>();
+            return services;
+        }
+
+        /// <summary>Goes right after UseStartupTimings, to time each request through the whole pipeline.</summary>
+        public static IApplicationBuilder UseHttpMetrics(this IApplicationBuilder app)
+        {
+            MetricRegistry registry = app.ApplicationServices.GetRequiredService<MetricRegistry>();
+            Counter requests = registry.GetCounter("requests", "Requests");
+            Counter serverErrors = registry.GetCounter("server-errors", "Responses with a 5xx status");
+            Gauge active = registry.GetGauge("active-requests", "Requests in progress");
+            LatencyHistogram latency = registry.GetHistogram("request");
+            Counter webSockets = registry.GetCounter("websocket-requests", "WebSocket requests");
+
+            return app.Use(async (context, next) =>
+            {
+                if (context.WebSockets.IsWebSocketRequest)
+                {
+                    webSockets.Increment();
+                    await next();
+                    return;
+                }
+
+                long start = Stopwatch.GetTimestamp();
+                active.Add(1);
+                bool failed = true;
+                try
+                {
+                    await next();
+                    failed = context.Response.StatusCode >= 500;
+                }
+                finally
+                {
+                    // An exception becomes a 500 in the exception handler, further in or out.
+                    active.Add(-1);
+                    latency.RecordTicks(Stopwatch.GetTimestamp() - start);
+                    requests.Increment();
+                    if (failed)
+                    {
+                        serverErrors.Increment();
+                    }
+                }
+            });
+        }
+
+        /// <summary>Publishes the registry while the host runs.</summary>
+        private sealed class MetricsExport : IHostedService
+        {
+            private readonly MetricRegistry _registry;
+            private MetricsEventSource? _eventSource;
+            private MetricsJsonWriter? _json;
+
+            public MetricsExport(MetricRegistry registry)
+            {
+                _registry = registry;
+            }
+
+            public Task StartAsync(CancellationToken cancellationToken)
+            {
+                _eventSource = new MetricsEventSource(_registry);
+                _json = MetricsJsonWriter.FromEnvironment(_registry);
+                return Task.CompletedTask;
+            }
+
+            public Task StopAsync(CancellationToken cancellationToken)
+            {
+                _json?.Dispose();
+                _eventSource?.Dispose();
+                return Task.CompletedTask;
+            }
+        }
+    }
+}
@@ -13,7 +13,12 @@ namespace Vs2019AspNetWebPackTest1
     {
         public static void Main(string[] args)
         {
-            CreateHostBuilder(args).Build().Run();
+            StartupTimings.Begin();
+            using IHost host = CreateHostBuilder(args).Build();
+            StartupTimings.HostBuilt();
+            host.Start();
+            StartupTimings.HostStarted();
+            host.WaitForShutdown();
         }
 
         public static IHostBuilder CreateHostBuilder(string[] args) =>
@@ -3,13 +3,6 @@
 // Web App
 import "core-js/es/promise";
 import "@fortawesome/fontawesome-free/js/all";
-import "prismjs";
-import "prismjs/components/prism-json";
-import "prismjs/components/prism-bash";
-import "prismjs/plugins/line-numbers/prism-line-numbers";
-import "prismjs/plugins/autolinker/prism-autolinker";
-import "prismjs/plugins/command-line/prism-command-line";
-import "prismjs/plugins/normalize-whitespace/prism-normalize-whitespace";
 import "buefy";
 
 // Codes
@@ -26,27 +19,22 @@ let d1 = new Date(2017, 0, 1);
 //console.log("Test1 - " + Moment().format("M - D （dd）")) // => 12月３日（日）
 
 
-// @ts-ignore
-Prism.plugins.NormalizeWhitespace.setDefaults({
-    'remove-trailing': true,
-    'remove-indent': false,
-    'left-trim': true,
-    'right-trim': true,
-    'indent': 0,
-    'remove-initial-line-feed': false,
-});
-
-//Prism.plugins.customClass.prefix('prism-');
+// Prism and its plugins are a chunk of their own, only loaded by the pages that have code to highlight.
+if (document.querySelector('code[class*="language-"]'))
+{
+    import(/* webpackChunkName: "prism" */ "./DnPrism").catch(x =>
+    {
+        console.log(x);
+    });
+}
 
-import { Greeter, TestClass1, TestClass2 } from "./DnLib";
+import { FrameCoalescingTunnel, Greeter, Http, HttpClient, TestClass1, TestClass2 } from "./DnLib";
 
 TestClass2.Hello2("neko");
 
 let abc = TestClass2.GetMoment();
 
 
-import Guacamole from "guacamole-common-js";
-
 
 //import * as Guacamole from "./guacamole-common";
 
@@ -81,9 +69,13 @@ export class Tom
         Tom.HtmlGetTestAsync();
     }
 
-    public static GuacamoleTest1(display: HTMLElement): void
+    public static async GuacamoleTest1(display: HTMLElement): Promise<void>
     {
-        const tunnel = new Guacamole.WebSocketTunnel("Model.WebSocketUrl");
+        // The remote desktop client is only downloaded when a page opens a session.
+        const { default: Guacamole } = await import(/* webpackChunkName: "guacamole" */ "guacamole-common-js");
+
+        // Instructions are applied once per animation frame, not as they arrive.
+        const tunnel = new FrameCoalescingTunnel(new Guacamole.WebSocketTunnel("/guacamole/websocket-tunnel"));
 
         // @ts-ignore
         // eslint-disable-next-line @typescript-eslint/no-explicit-any
@@ -96,6 +88,11 @@ export class Tom
         // Instantiate client, using a WebSocket tunnel for communications.
         // @ts-ignore
         const guac = new Guacamole.Client(tunnel);
+        tunnel.onstats = function (stats): void
+        {
+            console.log(`Display: ${stats.framesPerSecond} fps (guacd ${stats.serverFramesPerSecond}), ${stats.instructionsPerFrame} instructions/frame, ` +
+                `${stats.droppedImages} images dropped, input to paint ${stats.inputToPaintMs ?? "-"} ms (max ${stats.maxInputToPaintMs ?? "-"} ms)`);
+        };
 
         // Add client to display div
         //display.appendChild(guac.getDisplay().getElement());
@@ -122,13 +119,16 @@ export class Tom
         console.log("#1");
         try
         {
-            const html = await Axios.get("/");
+            const html = await Http.get<string>("/", { responseType: "text" });
 
-            console.log(html);
+            console.log(html.data.length + " chars from " + html.timing.source + " in " + Math.round(html.timing.durationMs) + " ms");
         }
         catch (e)
         {
-            console.log(e);
+            if (!HttpClient.isAbort(e))
+            {
+                console.log(e);
+            }
         }
         console.log("#2");
     }
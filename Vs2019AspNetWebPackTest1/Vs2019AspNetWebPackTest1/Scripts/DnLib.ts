@@ -3,7 +3,8 @@
 ////import { default as $ } from "jquery";
 ////import { default as Moment } from "moment";
 
-import { Moment } from "./DnImports";
+import type { AxiosResponse, CancelTokenSource } from "axios";
+import { Axios, Moment } from "./DnImports";
 
 //Moment
 
@@ -68,4 +69,886 @@ export class TestClass1
     }
 }
 
+/** What FrameCoalescingTunnel measured over the last second. */
+export interface DisplayStats
+{
+    /** Frames drawn on the display, counted by the client's answers to guacd's syncs, which it sends once drawn. */
+    framesPerSecond: number;
+    /** Frames guacd sent (its sync instructions), of which several can be drawn as one. */
+    serverFramesPerSecond: number;
+    instructionsPerFrame: number;
+    /** Images not drawn because a later one in the same frame replaced them. */
+    droppedImages: number;
+    /** From a mouse, key or touch event sent to the drawing of the first frame received after it; null without input. */
+    inputToPaintMs: number | null;
+    maxInputToPaintMs: number | null;
+}
+
+interface QueuedInstruction
+{
+    opcode: string;
+    args: string[];
+    dropped: boolean;
+    /** When the input that this sync is the first answer to was sent. */
+    inputSent?: number;
+}
+
+interface PendingSync
+{
+    timestamp: string;
+    inputSent?: number;
+}
+
+interface ImageStream
+{
+    img: number;
+    blobs: number[];
+    end: number;
+    layer: string;
+    mask: number;
+    mimetype: string;
+    x: string;
+    y: string;
+}
+
+/**
+ * A Guacamole.Tunnel in front of another that hands the instructions it receives to the client once per animation
+ * frame instead of one by one as they arrive, so that the drawing of a busy session happens at the browser's pace:
+ * the client answers guacd's sync only when the frame is applied, and guacd, which waits for those answers, sends
+ * less. Only whole frames are handed over: what follows the last sync waits for the next animation frame. Within a
+ * frame, an image that a later one of the same size replaces at the same place is never decoded.
+ *
+ *   const tunnel = new FrameCoalescingTunnel(new Guacamole.WebSocketTunnel(url));
+ *   const client = new Guacamole.Client(tunnel);
+ *   tunnel.onstats = stats => ...;
+ */
+export class FrameCoalescingTunnel
+{
+    // Guacamole.Tunnel.State.CLOSED, and the channel masks of Guacamole.Layer that replace what is under the image.
+    private static readonly StateClosed = 2;
+    private static readonly MaskSrc = 0xC;
+    private static readonly MaskOver = 0xE;
+
+    // Can be between the images for the earlier to be dropped: none of them draws anything or reads a layer.
+    private static readonly Neutral: { [opcode: string]: boolean } = { "img": true, "blob": true, "end": true, "sync": true, "nop": true };
+
+    // While the page is hidden there are no animation frames; the session still has to answer guacd.
+    private static readonly HiddenFlushMs = 250;
+
+    // eslint-disable-next-line @typescript-eslint/no-explicit-any
+    private readonly inner: any;
+
+    private queue: QueuedInstruction[] = [];
+    private frameRequest: number | null = null;
+    private flushTimer: number | null = null;
+    private inputSent: number | null = null;
+    private pendingSyncs: PendingSync[] = [];
+    private statsTimer: number | null = null;
+
+    private frames = 0;
+    private serverFrames = 0;
+    private instructions = 0;
+    private droppedImages = 0;
+    private latencies: number[] = [];
+
+    public state = 0;
+    public uuid: string | null = null;
+    public oninstruction: ((opcode: string, args: string[]) => void) | null = null;
+    public onstatechange: ((state: number) => void) | null = null;
+    // eslint-disable-next-line @typescript-eslint/no-explicit-any
+    public onerror: ((status: any) => void) | null = null;
+    public onuuid: ((uuid: string) => void) | null = null;
+    public onstats: ((stats: DisplayStats) => void) | null = null;
+
+    // eslint-disable-next-line @typescript-eslint/no-explicit-any
+    constructor(inner: any)
+    {
+        this.inner = inner;
+
+        inner.oninstruction = (opcode: string, args: string[]): void =>
+        {
+            const instruction: QueuedInstruction = { opcode: opcode, args: args, dropped: false };
+            if (opcode === "sync" && this.inputSent !== null)
+            {
+                instruction.inputSent = this.inputSent;
+                this.inputSent = null;
+            }
+            this.queue.push(instruction);
+            this.schedule();
+        };
+
+        inner.onstatechange = (state: number): void =>
+        {
+            this.state = state;
+            if (state === FrameCoalescingTunnel.StateClosed)
+            {
+                // What came before the close, an error instruction for one, is still the client's to see.
+                this.flush(true);
+                this.stopStats();
+            }
+            this.onstatechange?.(state);
+        };
+
+        inner.onerror = (status: unknown): void => this.onerror?.(status);
+
+        inner.onuuid = (uuid: string): void =>
+        {
+            this.uuid = uuid;
+            this.onuuid?.(uuid);
+        };
+    }
+
+    public connect(data: string): void
+    {
+        this.inner.connect(data);
+        this.startStats();
+    }
+
+    public disconnect(): void
+    {
+        this.inner.disconnect();
+    }
+
+    // eslint-disable-next-line @typescript-eslint/no-explicit-any
+    public sendMessage(...elements: any[]): void
+    {
+        const opcode = elements[0];
+        if (this.inputSent === null && (opcode === "mouse" || opcode === "key" || opcode === "touch"))
+        {
+            this.inputSent = performance.now();
+        }
+        else if (opcode === "sync")
+        {
+            this.frameDrawn(String(elements[1]));
+        }
+        this.inner.sendMessage(...elements);
+    }
+
+    public isConnected(): boolean
+    {
+        return this.inner.isConnected();
+    }
+
+    private schedule(): void
+    {
+        if (this.frameRequest !== null || this.flushTimer !== null)
+        {
+            return;
+        }
+        // The page can be hidden while an animation frame is pending, which then never comes: the timer races it.
+        if (!document.hidden)
+        {
+            this.frameRequest = window.requestAnimationFrame(() => this.flush(false));
+        }
+        this.flushTimer = window.setTimeout(() => this.flush(false), FrameCoalescingTunnel.HiddenFlushMs);
+    }
+
+    private cancelSchedule(): void
+    {
+        if (this.frameRequest !== null)
+        {
+            window.cancelAnimationFrame(this.frameRequest);
+            this.frameRequest = null;
+        }
+        if (this.flushTimer !== null)
+        {
+            window.clearTimeout(this.flushTimer);
+            this.flushTimer = null;
+        }
+    }
+
+    /** Hands the client the queued frames; all: also what follows the last sync. */
+    private flush(all: boolean): void
+    {
+        this.cancelSchedule();
+
+        let end = this.queue.length;
+        while (!all && end > 0 && this.queue[end - 1].opcode !== "sync")
+        {
+            end--;
+        }
+        if (end === 0)
+        {
+            return;
+        }
+        const batch = this.queue.slice(0, end);
+        this.queue = this.queue.slice(end);
+
+        this.dropReplacedImages(batch);
+
+        for (let i = 0; i < batch.length; i++)
+        {
+            const instruction = batch[i];
+            if (instruction.dropped)
+            {
+                continue;
+            }
+            if (instruction.opcode === "sync")
+            {
+                this.serverFrames++;
+                this.pendingSyncs.push({ timestamp: instruction.args[0], inputSent: instruction.inputSent });
+            }
+            this.instructions++;
+            this.oninstruction?.(instruction.opcode, instruction.args);
+        }
+    }
+
+    /**
+     * Counts a frame as drawn when the client answers its sync, which it does once the display has drawn it. The
+     * client skips the answer to a sync with the timestamp of the one before, so an answer settles every sync up to
+     * the one it names.
+     */
+    private frameDrawn(timestamp: string): void
+    {
+        let inputSent: number | null = null;
+        let settled = 0;
+        while (settled < this.pendingSyncs.length)
+        {
+            const sync = this.pendingSyncs[settled++];
+            if (sync.inputSent !== undefined && inputSent === null)
+            {
+                inputSent = sync.inputSent;
+            }
+            if (sync.timestamp === timestamp)
+            {
+                break;
+            }
+        }
+        this.pendingSyncs = this.pendingSyncs.slice(settled);
+
+        this.frames++;
+        if (inputSent !== null)
+        {
+            this.latencies.push(performance.now() - inputSent);
+        }
+    }
+
+    /**
+     * Marks the instructions of each image stream that a later image in the batch replaces: same layer, position
+     * and size, drawn with a mask that does not blend with what is under it, and nothing in between that could draw
+     * on or read the layer. Only streams that begin and end within the batch count.
+     */
+    private dropReplacedImages(batch: QueuedInstruction[]): void
+    {
+        const open: { [stream: string]: ImageStream } = {};
+        const complete: ImageStream[] = [];
+        let hasImages = false;
+
+        for (let i = 0; i < batch.length; i++)
+        {
+            const args = batch[i].args;
+            switch (batch[i].opcode)
+            {
+                case "img":
+                    // img: stream, mask, layer, mimetype, x, y
+                    open[args[0]] = { img: i, blobs: [], end: -1, layer: args[2], mask: parseInt(args[1], 10), mimetype: args[3], x: args[4], y: args[5] };
+                    hasImages = true;
+                    break;
+                case "blob":
+                    if (open[args[0]])
+                    {
+                        open[args[0]].blobs.push(i);
+                    }
+                    break;
+                case "end":
+                    if (open[args[0]])
+                    {
+                        open[args[0]].end = i;
+                        complete.push(open[args[0]]);
+                        delete open[args[0]];
+                    }
+                    break;
+            }
+        }
+        if (!hasImages || complete.length < 2)
+        {
+            return;
+        }
+
+        const sizes: (string | null)[] = [];
+        for (let i = 0; i < complete.length; i++)
+        {
+            const image = complete[i];
+            sizes.push(image.blobs.length === 0 ? null : FrameCoalescingTunnel.imageSize(image.mimetype, batch[image.blobs[0]].args[1]));
+        }
+
+        for (let i = 0; i < complete.length; i++)
+        {
+            const earlier = complete[i];
+            if (sizes[i] === null)
+            {
+                continue;
+            }
+            for (let j = i + 1; j < complete.length; j++)
+            {
+                const later = complete[j];
+                if (later.layer !== earlier.layer || later.x !== earlier.x || later.y !== earlier.y || sizes[j] !== sizes[i] ||
+                    !FrameCoalescingTunnel.replaces(later) || !FrameCoalescingTunnel.isNeutral(batch, earlier.img, later.img))
+                {
+                    continue;
+                }
+                batch[earlier.img].dropped = true;
+                for (let k = 0; k < earlier.blobs.length; k++)
+                {
+                    batch[earlier.blobs[k]].dropped = true;
+                }
+                batch[earlier.end].dropped = true;
+                this.droppedImages++;
+                break;
+            }
+        }
+    }
+
+    private static replaces(image: ImageStream): boolean
+    {
+        // Over an opaque image is a copy; a PNG can have transparent pixels.
+        return image.mask === FrameCoalescingTunnel.MaskSrc || (image.mask === FrameCoalescingTunnel.MaskOver && image.mimetype === "image/jpeg");
+    }
+
+    private static isNeutral(batch: QueuedInstruction[], from: number, to: number): boolean
+    {
+        for (let i = from + 1; i < to; i++)
+        {
+            if (!FrameCoalescingTunnel.Neutral[batch[i].opcode])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** "width x height" from the header in the first blob of a PNG or JPEG, or null. */
+    public static imageSize(mimetype: string, base64: string): string | null
+    {
+        let bytes: string;
+        try
+        {
+            bytes = window.atob(base64);
+        }
+        catch (e)
+        {
+            return null;
+        }
+        const u16 = (i: number): number => (bytes.charCodeAt(i) << 8) | bytes.charCodeAt(i + 1);
+
+        if (mimetype === "image/png")
+        {
+            // The signature, then IHDR: length, type, width and height as 32-bit big-endian.
+            if (bytes.length < 24 || bytes.substr(12, 4) !== "IHDR")
+            {
+                return null;
+            }
+            return (u16(16) * 65536 + u16(18)) + "x" + (u16(20) * 65536 + u16(22));
+        }
+
+        if (mimetype === "image/jpeg")
+        {
+            // The segments after SOI, up to the start of frame, which has the height and then the width.
+            let i = 2;
+            while (i + 9 <= bytes.length && bytes.charCodeAt(i) === 0xFF)
+            {
+                const marker = bytes.charCodeAt(i + 1);
+                if (marker >= 0xC0 && marker <= 0xCF && marker !== 0xC4 && marker !== 0xC8 && marker !== 0xCC)
+                {
+                    return u16(i + 7) + "x" + u16(i + 5);
+                }
+                i += 2 + u16(i + 2);
+            }
+        }
+        return null;
+    }
+
+    private startStats(): void
+    {
+        this.stopStats();
+        this.statsTimer = window.setInterval(() => this.reportStats(), 1000);
+    }
+
+    private stopStats(): void
+    {
+        if (this.statsTimer !== null)
+        {
+            window.clearInterval(this.statsTimer);
+            this.statsTimer = null;
+        }
+    }
+
+    private reportStats(): void
+    {
+        const latencies = this.latencies.sort((x, y) => x - y);
+        const stats: DisplayStats = {
+            framesPerSecond: this.frames,
+            serverFramesPerSecond: this.serverFrames,
+            instructionsPerFrame: this.frames === 0 ? 0 : Math.round(this.instructions / this.frames),
+            droppedImages: this.droppedImages,
+            inputToPaintMs: latencies.length === 0 ? null : Math.round(latencies[Math.floor(latencies.length / 2)]),
+            maxInputToPaintMs: latencies.length === 0 ? null : Math.round(latencies[latencies.length - 1])
+        };
+        this.frames = 0;
+        this.serverFrames = 0;
+        this.instructions = 0;
+        this.droppedImages = 0;
+        this.latencies = [];
+        this.onstats?.(stats);
+    }
+}
+
+/** How a response was obtained, and how long it took. */
+export interface HttpTiming
+{
+    url: string;
+    /**
+     * network: a request was made; revalidated: a request made with the validators of a cached response, answered
+     * with 304; memory, indexeddb: from the cache, no request; shared: the response of an identical request that
+     * was already in flight.
+     */
+    source: "network" | "revalidated" | "memory" | "indexeddb" | "shared";
+    status: number;
+    /** performance.now() when get() was called. */
+    startTime: number;
+    durationMs: number;
+    /** The browser's timing of the request, when one was made: DNS, connection, time to first byte and so on. */
+    resource: PerformanceResourceTiming | null;
+}
+
+export interface HttpResponse<T>
+{
+    data: T;
+    status: number;
+    headers: { [name: string]: string };
+    timing: HttpTiming;
+}
+
+export interface HttpGetOptions
+{
+    responseType?: "json" | "text";
+    /** Aborts this call; an identical request shared with other calls is only aborted when all of them are. */
+    signal?: AbortSignal;
+}
+
+interface CachedResponse
+{
+    url: string;
+    data: unknown;
+    status: number;
+    headers: { [name: string]: string };
+    etag: string | null;
+    lastModified: string | null;
+    /** Date.now() until which it is used without asking the server; 0 to always revalidate. */
+    freshUntil: number;
+    storedAt: number;
+}
+
+interface FetchResult
+{
+    response: AxiosResponse;
+    /** For a 304, the cached response it confirmed, which the body of the 304 is not; null for a 200. */
+    revalidated: CachedResponse | null;
+}
+
+interface InFlight
+{
+    promise: Promise<FetchResult>;
+    cancel: CancelTokenSource;
+    waiting: number;
+}
+
+/**
+ * GET through Axios, with what the dashboards need to not repeat round trips:
+ *
+ * - identical GETs in flight at the same time make one request;
+ * - responses with an ETag, a Last-Modified or a max-age are kept in memory and in IndexedDB, so that they outlive
+ *   the page, used as they are while Cache-Control says they are fresh and revalidated after that;
+ * - every request can be aborted with an AbortSignal, and all of them are when the page is left;
+ * - every response says where it came from and how long it took, and onrequest sees them all.
+ *
+ *   const response = await Http.get<Item[]>("/api/items", { signal: controller.signal });
+ *   console.log(response.timing.source, response.timing.durationMs);
+ */
+export class HttpClient
+{
+    private static readonly DatabaseName = "DnHttpCache";
+    private static readonly StoreName = "responses";
+    // Entries not used for this long are removed from IndexedDB when the page opens it.
+    private static readonly MaxStoredAgeMs = 7 * 24 * 60 * 60 * 1000;
+
+    private readonly maxMemoryEntries: number;
+    // Object keys keep their insertion order, oldest first, which is the order they are evicted in.
+    private memory: { [key: string]: CachedResponse } = {};
+    private memoryCount = 0;
+    private inFlight: { [key: string]: InFlight } = {};
+    private database: Promise<IDBDatabase | null> | null = null;
+    private page = new AbortController();
+
+    public onrequest: ((timing: HttpTiming) => void) | null = null;
+
+    constructor(maxMemoryEntries: number = 200)
+    {
+        this.maxMemoryEntries = maxMemoryEntries;
+
+        // Leaving the page aborts what it still waits for; coming back to it from the back/forward cache starts over.
+        window.addEventListener("pagehide", () => this.abortAll());
+
+        // A full buffer (250 entries by default) records nothing more, and a polling page fills it. The entries are
+        // only read right after their request, so the old ones can go.
+        performance.addEventListener("resourcetimingbufferfull", () => performance.clearResourceTimings());
+    }
+
+    /** Aborts every request in flight, as leaving the page does. */
+    public abortAll(): void
+    {
+        const page = this.page;
+        this.page = new AbortController();
+        page.abort();
+    }
+
+    public static isAbort(e: unknown): boolean
+    {
+        return e instanceof Error && e.name === "AbortError";
+    }
+
+    public async get<T>(url: string, options: HttpGetOptions = {}): Promise<HttpResponse<T>>
+    {
+        const startTime = performance.now();
+        const responseType = options.responseType || "json";
+        const absoluteUrl = HttpClient.resolve(url);
+        const key = responseType + " " + absoluteUrl;
+
+        const signals = [this.page.signal];
+        if (options.signal)
+        {
+            signals.push(options.signal);
+        }
+        HttpClient.throwIfAborted(signals);
+
+        let cached: CachedResponse | null = this.memory[key] || null;
+        let source: HttpTiming["source"] = "memory";
+        if (!cached)
+        {
+            cached = await this.load(key);
+            source = "indexeddb";
+            HttpClient.throwIfAborted(signals);
+        }
+        if (cached && cached.freshUntil > Date.now())
+        {
+            this.remember(key, cached);
+            return this.complete<T>(cached.data as T, cached.status, cached.headers, absoluteUrl, source, startTime, false);
+        }
+
+        let request = this.inFlight[key];
+        const shared = request !== undefined;
+        if (!request)
+        {
+            request = this.fetch(key, absoluteUrl, responseType, cached);
+        }
+
+        request.waiting++;
+        let result: FetchResult;
+        try
+        {
+            result = await HttpClient.withAbort(request.promise, signals);
+        }
+        catch (e)
+        {
+            if (--request.waiting === 0 && HttpClient.isAbort(e) && this.inFlight[key] === request)
+            {
+                // Nobody else waits for it.
+                request.cancel.cancel();
+            }
+            throw e;
+        }
+        request.waiting--;
+
+        // From the result rather than the memory cache, which may have evicted it since.
+        const entry = result.revalidated;
+        if (entry)
+        {
+            return this.complete<T>(entry.data as T, entry.status, entry.headers, absoluteUrl, shared ? "shared" : "revalidated", startTime, !shared);
+        }
+        const response = result.response;
+        return this.complete<T>(response.data, response.status, response.headers, absoluteUrl, shared ? "shared" : "network", startTime, !shared);
+    }
+
+    // The one request for all the identical calls; it stores what it gets.
+    private fetch(key: string, url: string, responseType: "json" | "text", cached: CachedResponse | null): InFlight
+    {
+        const cancel = Axios.CancelToken.source();
+        const headers: { [name: string]: string } = {};
+        if (cached && cached.etag)
+        {
+            headers["If-None-Match"] = cached.etag;
+        }
+        else if (cached && cached.lastModified)
+        {
+            headers["If-Modified-Since"] = cached.lastModified;
+        }
+
+        const promise = Axios.get(url, {
+            responseType: responseType,
+            headers: headers,
+            cancelToken: cancel.token,
+            validateStatus: status => (status >= 200 && status < 300) || status === 304
+        }).then((response): FetchResult =>
+        {
+            if (response.status === 304 && cached)
+            {
+                // Still the same: fresh again for as long as the new headers say.
+                const revalidated = HttpClient.toCached(url, cached.data, cached.status, { ...cached.headers, ...response.headers }) || cached;
+                this.store(key, revalidated);
+                return { response: response, revalidated: revalidated };
+            }
+            const entry = HttpClient.toCached(url, response.data, response.status, response.headers);
+            if (entry)
+            {
+                this.store(key, entry);
+            }
+            return { response: response, revalidated: null };
+        });
+
+        const request: InFlight = { promise: promise, cancel: cancel, waiting: 0 };
+        this.inFlight[key] = request;
+        const done = (): void =>
+        {
+            if (this.inFlight[key] === request)
+            {
+                delete this.inFlight[key];
+            }
+        };
+        promise.then(done, done);
+        return request;
+    }
+
+    private complete<T>(data: T, status: number, headers: { [name: string]: string }, url: string, source: HttpTiming["source"], startTime: number, requested: boolean): HttpResponse<T>
+    {
+        const resource = requested ? HttpClient.findResourceTiming(url, startTime) : null;
+
+        const timing: HttpTiming = { url: url, source: source, status: status, startTime: startTime, durationMs: performance.now() - startTime, resource: resource };
+        this.onrequest?.(timing);
+        return { data: data, status: status, headers: headers, timing: timing };
+    }
+
+    // The browser's entry for the request of a call that started at startTime: the first for the URL that started
+    // after the call did, rather than the latest, which can be the request of a call that overlaps this one.
+    private static findResourceTiming(url: string, startTime: number): PerformanceResourceTiming | null
+    {
+        const entries = performance.getEntriesByName(url, "resource");
+        for (let i = 0; i < entries.length; i++)
+        {
+            if (entries[i].startTime >= startTime)
+            {
+                return entries[i] as PerformanceResourceTiming;
+            }
+        }
+        return null;
+    }
+
+    /**
+     * The cache entry for a response, or null when it must not be kept: no-store, or nothing to know when it changes
+     * (neither a validator nor a max-age). no-cache, or a max-age of 0, is kept but always revalidated.
+     */
+    private static toCached(url: string, data: unknown, status: number, headers: { [name: string]: string }): CachedResponse | null
+    {
+        if (status !== 200)
+        {
+            return null;
+        }
+        const cacheControl = (headers["cache-control"] || "").toLowerCase();
+        if (/(^|,)\s*no-store\b/.test(cacheControl))
+        {
+            return null;
+        }
+
+        const etag = headers["etag"] || null;
+        const lastModified = headers["last-modified"] || null;
+        const maxAge = /(^|,)\s*max-age\s*=\s*"?(\d+)/.exec(cacheControl);
+        if (!etag && !lastModified && !maxAge)
+        {
+            return null;
+        }
+
+        const now = Date.now();
+        let freshUntil = 0;
+        if (maxAge && !/(^|,)\s*no-cache\b/.test(cacheControl))
+        {
+            // Minus the time it has already spent in shared caches on the way.
+            const age = parseInt(headers["age"] || "0", 10) || 0;
+            freshUntil = now + (parseInt(maxAge[2], 10) - age) * 1000;
+        }
+
+        const kept: { [name: string]: string } = {};
+        const names = ["content-type", "cache-control", "etag", "last-modified"];
+        for (let i = 0; i < names.length; i++)
+        {
+            if (headers[names[i]] !== undefined)
+            {
+                kept[names[i]] = headers[names[i]];
+            }
+        }
+        return { url: url, data: data, status: status, headers: kept, etag: etag, lastModified: lastModified, freshUntil: freshUntil, storedAt: now };
+    }
+
+    private remember(key: string, entry: CachedResponse): void
+    {
+        if (this.memory[key])
+        {
+            delete this.memory[key];
+        }
+        else if (++this.memoryCount > this.maxMemoryEntries)
+        {
+            delete this.memory[Object.keys(this.memory)[0]];
+            this.memoryCount--;
+        }
+        this.memory[key] = entry;
+    }
+
+    private store(key: string, entry: CachedResponse): void
+    {
+        this.remember(key, entry);
+        this.openDatabase().then(database =>
+        {
+            if (database)
+            {
+                const transaction = database.transaction(HttpClient.StoreName, "readwrite");
+                transaction.objectStore(HttpClient.StoreName).put(entry, key);
+            }
+        }).catch(e => console.log(e));
+    }
+
+    private async load(key: string): Promise<CachedResponse | null>
+    {
+        const database = await this.openDatabase();
+        if (!database)
+        {
+            return null;
+        }
+        try
+        {
+            const entry = await HttpClient.request<CachedResponse | undefined>(
+                database.transaction(HttpClient.StoreName, "readonly").objectStore(HttpClient.StoreName).get(key));
+            return entry || null;
+        }
+        catch (e)
+        {
+            return null;
+        }
+    }
+
+    // Null where there is no IndexedDB (a private window of some browsers): then the cache is in memory only.
+    private openDatabase(): Promise<IDBDatabase | null>
+    {
+        if (!this.database)
+        {
+            this.database = new Promise<IDBDatabase | null>(resolve =>
+            {
+                let open: IDBOpenDBRequest;
+                try
+                {
+                    open = window.indexedDB.open(HttpClient.DatabaseName, 1);
+                }
+                catch (e)
+                {
+                    resolve(null);
+                    return;
+                }
+                open.onupgradeneeded = () => open.result.createObjectStore(HttpClient.StoreName);
+                open.onsuccess = () =>
+                {
+                    HttpClient.prune(open.result);
+                    resolve(open.result);
+                };
+                open.onerror = () => resolve(null);
+                open.onblocked = () => resolve(null);
+            });
+        }
+        return this.database;
+    }
+
+    private static prune(database: IDBDatabase): void
+    {
+        const oldest = Date.now() - HttpClient.MaxStoredAgeMs;
+        const cursor = database.transaction(HttpClient.StoreName, "readwrite").objectStore(HttpClient.StoreName).openCursor();
+        cursor.onsuccess = () =>
+        {
+            const current = cursor.result;
+            if (current)
+            {
+                if ((current.value as CachedResponse).storedAt < oldest)
+                {
+                    current.delete();
+                }
+                current.continue();
+            }
+        };
+    }
+
+    private static request<T>(request: IDBRequest): Promise<T>
+    {
+        return new Promise<T>((resolve, reject) =>
+        {
+            request.onsuccess = () => resolve(request.result as T);
+            request.onerror = () => reject(request.error);
+        });
+    }
+
+    // The same URL however it is written, which the resource timing entries are also named by.
+    private static resolve(url: string): string
+    {
+        const a = document.createElement("a");
+        a.href = url;
+        return a.href;
+    }
+
+    private static abortError(): Error
+    {
+        const e = new Error("The request was aborted.");
+        e.name = "AbortError";
+        return e;
+    }
+
+    private static throwIfAborted(signals: AbortSignal[]): void
+    {
+        for (let i = 0; i < signals.length; i++)
+        {
+            if (signals[i].aborted)
+            {
+                throw HttpClient.abortError();
+            }
+        }
+    }
+
+    // The promise, or an AbortError as soon as one of the signals is aborted, without waiting for the promise.
+    private static withAbort<T>(promise: Promise<T>, signals: AbortSignal[]): Promise<T>
+    {
+        return new Promise<T>((resolve, reject) =>
+        {
+            const onAbort = (): void =>
+            {
+                cleanUp();
+                reject(HttpClient.abortError());
+            };
+            const cleanUp = (): void =>
+            {
+                for (let i = 0; i < signals.length; i++)
+                {
+                    signals[i].removeEventListener("abort", onAbort);
+                }
+            };
+            for (let i = 0; i < signals.length; i++)
+            {
+                signals[i].addEventListener("abort", onAbort);
+            }
+            promise.then(value =>
+            {
+                cleanUp();
+                resolve(value);
+            }, e =>
+            {
+                cleanUp();
+                reject(Axios.isCancel(e) ? HttpClient.abortError() : e);
+            });
+        });
+    }
+}
 
+/** The client the pages share, so that they share its cache and its requests in flight. */
+export const Http = new HttpClient();
@@ -0,0 +1,21 @@
+﻿// Syntax highlighting, loaded by DnApp.ts with import() when a page has code blocks. Prism highlights the page
+// by itself once the chunk has run, after the plugins and the settings below are in place.
+import "prismjs";
+import "prismjs/components/prism-json";
+import "prismjs/components/prism-bash";
+import "prismjs/plugins/line-numbers/prism-line-numbers";
+import "prismjs/plugins/autolinker/prism-autolinker";
+import "prismjs/plugins/command-line/prism-command-line";
+import "prismjs/plugins/normalize-whitespace/prism-normalize-whitespace";
+
+// @ts-ignore
+Prism.plugins.NormalizeWhitespace.setDefaults({
+    'remove-trailing': true,
+    'remove-indent': false,
+    'left-trim': true,
+    'right-trim': true,
+    'indent': 0,
+    'remove-initial-line-feed': false,
+});
+
+//Prism.plugins.customClass.prefix('prism-');
@@ -1,33 +1,87 @@
 using Microsoft.AspNetCore.Builder;
 using Microsoft.AspNetCore.Hosting;
+using Microsoft.AspNetCore.Mvc;
+using Microsoft.AspNetCore.ResponseCompression;
 using Microsoft.Extensions.Configuration;
 using Microsoft.Extensions.DependencyInjection;
 using Microsoft.Extensions.Hosting;
 using System;
 using System.Collections.Generic;
+using System.IO.Compression;
 using System.Linq;
 using System.Threading.Tasks;
+using Vs2019AspNetWebPackTest1.Guacamole;
 
 namespace Vs2019AspNetWebPackTest1
 {
     public class Startup
     {
-        public Startup(IConfiguration configuration)
+        /// <summary>The cache profile of the pages that are the same for every request (see HomeController).</summary>
+        public const string StaticPageCacheProfile = "StaticPage";
+
+        public Startup(IConfiguration configuration, IWebHostEnvironment environment)
         {
             Configuration = configuration;
+            Environment = environment;
         }
 
         public IConfiguration Configuration { get; }
 
+        public IWebHostEnvironment Environment { get; }
+
         // This method gets called by the runtime. Use this method to add services to the container.
         public void ConfigureServices(IServiceCollection services)
         {
-            services.AddControllersWithViews();
+            using IDisposable timing = StartupTimings.MeasureServices();
+
+            IMvcBuilder mvc = services.AddControllersWithViews(options =>
+            {
+                // Cached for a minute by UseResponseCaching (and by browsers and proxies), keyed on the host and the path
+                // only: the pages read no query string, so a query string must not make another copy of them. Never
+                // cached in Development, where the views and bundles change under the running app.
+                options.CacheProfiles.Add(StaticPageCacheProfile, Environment.IsDevelopment()
+                    ? new CacheProfile { Location = ResponseCacheLocation.None, NoStore = true }
+                    : new CacheProfile { Location = ResponseCacheLocation.Any, Duration = 60 });
+            });
+#if DEBUG
+            // The views are compiled into the assembly at build time; only a Debug build run in Development also
+            // recompiles the ones edited while it runs.
+            if (Environment.IsDevelopment())
+            {
+                mvc.AddRazorRuntimeCompilation();
+            }
+#endif
+            services.AddSingleton<BundleManifest>();
+
+            // For the views and anything without a precompressed file; the bundles are compressed at build time.
+            services.AddResponseCompression(options =>
+            {
+                options.EnableForHttps = true;
+                options.Providers.Add<BrotliCompressionProvider>();
+                options.Providers.Add<GzipCompressionProvider>();
+            });
+            // Brotli at its default quality takes longer than it saves on a response compressed on every request.
+            services.Configure<BrotliCompressionProviderOptions>(options => options.Level = CompressionLevel.Fastest);
+            services.Configure<GzipCompressionProviderOptions>(options => options.Level = CompressionLevel.Fastest);
+
+            // The cached pages are a few KB each; anything large is a static file and is not cached in memory.
+            services.AddResponseCaching(options =>
+            {
+                options.MaximumBodySize = 1024 * 1024;
+                options.SizeLimit = 32 * 1024 * 1024;
+            });
+
+            services.Configure<GuacamoleOptions>(Configuration.GetSection(GuacamoleOptions.Section));
+
+            services.AddHttpMetrics();
         }
 
         // This method gets called by the runtime. Use this method to configure the HTTP request pipeline.
         public void Configure(IApplicationBuilder app, IWebHostEnvironment env)
         {
+            app.UseStartupTimings();
+            app.UseHttpMetrics();
+
             if (env.IsDevelopment())
             {
                 app.UseDeveloperExceptionPage();
@@ -36,7 +90,14 @@ namespace Vs2019AspNetWebPackTest1
             {
                 app.UseExceptionHandler("/Home/Error");
             }
-            app.UseStaticFiles();
+            app.UseResponseCompression();
+            app.UsePrecompressedStaticFiles();
+
+            // Inside UseResponseCompression, so one uncompressed copy of a page is kept and compressed per request.
+            app.UseResponseCaching();
+
+            // Pings every session, so that proxies keep idle remote desktops open and dead browsers are noticed.
+            app.UseWebSockets(new WebSocketOptions { KeepAliveInterval = TimeSpan.FromSeconds(30) });
 
             app.UseRouting();
 
@@ -47,6 +108,7 @@ namespace Vs2019AspNetWebPackTest1
                 endpoints.MapControllerRoute(
                     name: "default",
                     pattern: "{controller=Home}/{action=Index}/{id?}");
+                endpoints.MapGuacamoleTunnel("/guacamole/websocket-tunnel");
             });
         }
     }
@@ -0,0 +1,91 @@
+using Microsoft.AspNetCore.Builder;
+using Microsoft.AspNetCore.Http;
+using Microsoft.Extensions.DependencyInjection;
+using Microsoft.Extensions.Logging;
+using System;
+using System.Diagnostics;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Vs2019AspNetWebPackTest1
+{
+    /// <summary>
+    /// Where the time goes from the start of the process to the first byte of the first response: the runtime up to
+    /// Main, building the host (of which Startup.ConfigureServices), starting it (Startup.Configure and Kestrel), and
+    /// the first request. Logged once, as one line with named values, when the first response starts, so that the
+    /// cold start of each release can be compared by making it a first request.
+    /// </summary>
+    public static class StartupTimings
+    {
+        private static readonly Stopwatch _sinceMain = Stopwatch.StartNew();
+
+        private static TimeSpan _runtime;
+        private static TimeSpan _hostBuilt;
+        private static TimeSpan _services;
+        private static TimeSpan _hostStarted;
+        private static int _firstRequestSeen;
+
+        /// <summary>Called first thing in Main.</summary>
+        public static void Begin()
+        {
+            _sinceMain.Restart();
+            using Process process = Process.GetCurrentProcess();
+            _runtime = DateTime.Now - process.StartTime;
+        }
+
+        public static void HostBuilt() => _hostBuilt = _sinceMain.Elapsed;
+
+        public static void HostStarted() => _hostStarted = _sinceMain.Elapsed;
+
+        /// <summary>Times Startup.ConfigureServices, which runs while the host is built.</summary>
+        public static IDisposable MeasureServices() => new ServicesScope(_sinceMain.Elapsed);
+
+        /// <summary>Goes first in the pipeline, to see the first request come in and its response start.</summary>
+        public static IApplicationBuilder UseStartupTimings(this IApplicationBuilder app)
+        {
+            ILogger logger = app.ApplicationServices.GetRequiredService<ILoggerFactory>().CreateLogger(typeof(StartupTimings).FullName!);
+
+            return app.Use(async (context, next) =>
+            {
+                if (Volatile.Read(ref _firstRequestSeen) != 0 || Interlocked.Exchange(ref _firstRequestSeen, 1) != 0)
+                {
+                    await next();
+                    return;
+                }
+
+                TimeSpan requestStarted = _sinceMain.Elapsed;
+                HttpRequest request = context.Request;
+                context.Response.OnStarting(() =>
+                {
+                    TimeSpan firstByte = _sinceMain.Elapsed;
+                    logger.LogInformation(
+                        "Startup: runtime {RuntimeMs:F0} ms, host build {HostBuildMs:F0} ms (services {ServicesMs:F0} ms), host start {HostStartMs:F0} ms; " +
+                        "first request {Method} {Path} {FirstRequestMs:F0} ms to first byte ({IdleMs:F0} ms after startup), {TimeToFirstByteMs:F0} ms after the process started",
+                        _runtime.TotalMilliseconds,
+                        _hostBuilt.TotalMilliseconds,
+                        _services.TotalMilliseconds,
+                        (_hostStarted - _hostBuilt).TotalMilliseconds,
+                        request.Method,
+                        request.Path.Value,
+                        (firstByte - requestStarted).TotalMilliseconds,
+                        (requestStarted - _hostStarted).TotalMilliseconds,
+                        (_runtime + firstByte).TotalMilliseconds);
+                    return Task.CompletedTask;
+                });
+                await next();
+            });
+        }
+
+        private sealed class ServicesScope : IDisposable
+        {
+            private readonly TimeSpan _started;
+
+            public ServicesScope(TimeSpan started)
+            {
+                _started = started;
+            }
+
+            public void Dispose() => _services = _sinceMain.Elapsed - _started;
+        }
+    }
+}
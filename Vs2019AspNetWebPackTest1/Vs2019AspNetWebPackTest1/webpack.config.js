@@ -1,65 +1,183 @@
 /// <binding Clean='Run - Development' ProjectOpened='Watch - Development' />
 const path = require("path");
+const webpack = require("webpack");
 const MiniCssExtractPlugin = require('mini-css-extract-plugin');
+const CssMinimizerPlugin = require('css-minimizer-webpack-plugin');
+const TerserPlugin = require('terser-webpack-plugin');
 
 // https://www.npmjs.com/package/webpack-utf8-bom
 var BomPlugin = require('webpack-utf8-bom');
 
-// From: https://bulma.io/documentation/customize/with-webpack/
-module.exports = {
-    mode: "development",
-    //mode: "production",
-    devtool: "inline-source-map",
-    entry: path.resolve(__dirname, "Scripts/DnApp.ts"),
-    optimization: {
-        moduleIds: 'deterministic',
-    },
-    output: {
-        filename: "bundle.js",
-        path: path.resolve(__dirname, "wwwroot/js"),
-        library: {
-            name: "Hoge",
-            type: "umd",
-        }
-    },
-    target: ['web', 'es3'],
-    module: {
-        rules: [
-            {
-                test: /\.ts$/,
-                loader: "ts-loader",
-                include: path.join(__dirname, "Scripts"),
+const BundleReportPlugin = require("./Build/bundle-report");
+
+// Development: one bundle.js in wwwroot/js, as the Visual Studio bindings above expect.
+// Production (webpack --mode production): two builds into wwwroot/dist, a legacy ES3 one and a modern ES2017 one
+// for browsers that understand <script type="module">. Both are minified and tree-shaken, the vendors are split
+// into chunks with content hashes so that they stay cached across deployments, and each build writes
+// <flavor>.json with the files of the entry point in load order for _Layout.cshtml to reference.
+// npm run build:prod then writes the .br and .gz files PrecompressedStaticFiles.cs serves (Build/precompress.js).
+// A production build fails when the entry point is over the size budgets in package.json, and
+// webpack --mode production --env report (npm run build:report) also breaks the sizes down per module and package;
+// see Build/bundle-report.js.
+module.exports = (env, argv) =>
+{
+    if (argv.mode !== "production")
+    {
+        return createConfig("development", "legacy", env);
+    }
+    return [createConfig("production", "legacy", env), createConfig("production", "modern", env)];
+};
+
+function createConfig(mode, flavor, env)
+{
+    const production = mode === "production";
+    const modern = flavor === "modern";
+
+    // From: https://bulma.io/documentation/customize/with-webpack/
+    return {
+        name: flavor,
+        mode: mode,
+        devtool: production ? "source-map" : "inline-source-map",
+        entry: {
+            app: path.resolve(__dirname, "Scripts/DnApp.ts"),
+        },
+        optimization: {
+            moduleIds: 'deterministic',
+            chunkIds: 'deterministic',
+            splitChunks: production ? {
+                chunks: "all",
+                cacheGroups: {
+                    // The large libraries each get a chunk of their own, so that upgrading one leaves the hashes of the others alone.
+                    corejs: { test: /[\\/]node_modules[\\/]core-js[\\/]/, name: "vendor-corejs", priority: 30 },
+                    fontawesome: { test: /[\\/]node_modules[\\/]@fortawesome[\\/]/, name: "vendor-fontawesome", priority: 30 },
+                    buefy: { test: /[\\/]node_modules[\\/](buefy|vue)[\\/]/, name: "vendor-buefy", priority: 30 },
+                    vendors: { test: /[\\/]node_modules[\\/]/, name: "vendors", chunks: "initial", priority: 10 },
+                    defaultVendors: false,
+                    default: false,
+                },
+            } : false,
+            minimizer: [
+                new TerserPlugin({
+                    terserOptions: {
+                        ecma: modern ? 2017 : 5,
+                        ie8: !modern,
+                        safari10: true,
+                    },
+                }),
+                new CssMinimizerPlugin(),
+            ],
+        },
+        output: production ? {
+            filename: flavor + "/[name].[contenthash:8].js",
+            chunkFilename: flavor + "/[name].[contenthash:8].js",
+            path: path.resolve(__dirname, "wwwroot/dist"),
+            publicPath: "/dist/",
+            // Its own chunk loading global for each build, in case a browser runs both (Safari 10.1 ignores nomodule).
+            uniqueName: "DnApp-" + flavor,
+            // Removes the files of earlier builds of this flavor, leaving those of the other build alone.
+            clean: {
+                keep: file => !file.startsWith(flavor + "/"),
             },
-            {
-                test: /\.scss$/,
-                use: [
-                    MiniCssExtractPlugin.loader,
-                    {
-                        loader: 'css-loader'
+            // The entry chunk is loaded after the vendor chunks it depends on, so it sets window.Hoge itself rather than
+            // through the UMD wrapper, which only works for a bundle that is a single file.
+            library: {
+                name: "Hoge",
+                type: "window",
+            },
+        } : {
+            filename: "bundle.js",
+            chunkFilename: "[name].bundle.js",
+            path: path.resolve(__dirname, "wwwroot/js"),
+            publicPath: "/js/",
+            library: {
+                name: "Hoge",
+                type: "umd",
+            }
+        },
+        target: ['web', modern ? 'es2017' : 'es3'],
+        module: {
+            rules: [
+                {
+                    test: /\.ts$/,
+                    loader: "ts-loader",
+                    include: path.join(__dirname, "Scripts"),
+                    options: {
+                        compilerOptions: modern ? { target: "ES2017", lib: ["dom", "es2017"] } : {},
                     },
-                    {
-                        loader: 'sass-loader',
-                        options: {
-                            sourceMap: true,
-                            // options...
+                },
+                {
+                    test: /\.scss$/,
+                    use: [
+                        MiniCssExtractPlugin.loader,
+                        {
+                            loader: 'css-loader'
+                        },
+                        {
+                            loader: 'sass-loader',
+                            options: {
+                                sourceMap: true,
+                                // options...
+                            }
                         }
-                    }
-                ]
-            }]
-    },
-    resolve: {
-        extensions: [".ts", ".js"],
-        modules: [
-            "node_modules",
-            path.resolve(__dirname, "Scripts")
-        ]
-    },
-    plugins: [
-        new MiniCssExtractPlugin({
-            filename: 'css/mystyles.css'
-        }),
-        new BomPlugin(true),
-    ]
-};
+                    ]
+                }]
+        },
+        resolve: {
+            extensions: [".ts", ".js"],
+            modules: [
+                "node_modules",
+                path.resolve(__dirname, "Scripts")
+            ],
+            // Every browser that runs the modern build has Promise.
+            alias: modern ? { "core-js/es/promise": false } : {},
+        },
+        plugins: [
+            new MiniCssExtractPlugin({
+                filename: production ? flavor + '/css/[name].[contenthash:8].css' : 'css/mystyles.css',
+                chunkFilename: production ? flavor + '/css/[name].[contenthash:8].css' : 'css/[name].css',
+            }),
+            // Moment has every locale behind a require() webpack cannot see through; keep the one the app uses.
+            new webpack.ContextReplacementPlugin(/moment[\\/]locale$/, /^\.\/ja$/),
+            new BomPlugin(true),
+        ].concat(production ? [
+            new EntrypointManifestPlugin(flavor + ".json"),
+            new BundleReportPlugin({
+                flavor: flavor,
+                report: !!(env && env.report),
+                scriptsDir: path.join(__dirname, "Scripts"),
+                budgets: require("./package.json").bundleBudgets,
+                outputDir: path.resolve(__dirname, "obj/webpack"),
+            }),
+        ] : []),
+    };
+}
 
+// Writes the files of each entry point, in the order they have to be loaded, as { "app": { "js": [...], "css": [...] } }.
+class EntrypointManifestPlugin
+{
+    constructor(filename)
+    {
+        this.filename = filename;
+    }
 
+    apply(compiler)
+    {
+        const { Compilation, sources } = compiler.webpack;
+        compiler.hooks.thisCompilation.tap("EntrypointManifestPlugin", compilation =>
+        {
+            compilation.hooks.processAssets.tap({ name: "EntrypointManifestPlugin", stage: Compilation.PROCESS_ASSETS_STAGE_REPORT }, () =>
+            {
+                const manifest = {};
+                for (const [name, entrypoint] of compilation.entrypoints)
+                {
+                    const files = entrypoint.getFiles().filter(file => !file.endsWith(".map"));
+                    manifest[name] = {
+                        js: files.filter(file => file.endsWith(".js")),
+                        css: files.filter(file => file.endsWith(".css")),
+                    };
+                }
+                compilation.emitAsset(this.filename, new sources.RawSource(JSON.stringify(manifest, null, 2)));
+            });
+        });
+    }
+}
@@ -0,0 +1,445 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net;
+using System.Net.Sockets;
+using System.Threading;
+using cs_instrumentation;
+
+namespace cs_dns_load_test1
+{
+    public enum LoadProtocol
+    {
+        Udp,
+        Tcp,
+    }
+
+    public sealed class LoadOptions
+    {
+        public IPEndPoint Server { get; set; } = new IPEndPoint(IPAddress.Loopback, 54);
+        public LoadProtocol Protocol { get; set; } = LoadProtocol.Udp;
+
+        /// <summary>The total send rate, in queries per second.</summary>
+        public double Rate { get; set; } = 10000;
+
+        public TimeSpan Duration { get; set; } = TimeSpan.FromSeconds(10);
+
+        /// <summary>An answer later than this is counted as lost (and late).</summary>
+        public TimeSpan Timeout { get; set; } = TimeSpan.FromSeconds(1);
+
+        /// <summary>Sender threads, each sending Rate / SenderThreads on its own sockets or connections.</summary>
+        public int SenderThreads { get; set; } = 1;
+
+        /// <summary>TCP connections per sender thread; UDP picks its socket count from the rate and timeout.</summary>
+        public int ConnectionsPerThread { get; set; } = 4;
+
+        /// <summary>Creates the query generator of sender thread #i.</summary>
+        public Func<int, QueryGenerator> Queries { get; set; }
+    }
+
+    public sealed class LoadResult
+    {
+        public long Sent;
+        public long SendErrors;
+        public long Answered;
+        public long Late;
+        public long Unmatched;
+        public readonly long[] ResponseCodes = new long[16];
+        public TimeSpan Elapsed;
+
+        /// <summary>How far the senders fell behind their schedule, at worst.</summary>
+        public TimeSpan MaxScheduleLag;
+
+        /// <summary>From the time a query was due, not the time it was sent, so that falling behind is not hidden.</summary>
+        public LatencyHistogram Latency = new LatencyHistogram("latency");
+
+        public double SentPerSecond => Sent / Elapsed.TotalSeconds;
+        public double AnsweredPerSecond => Answered / Elapsed.TotalSeconds;
+        public double LossPercent => Sent == 0 ? 0 : 100.0 * (Sent - Answered) / Sent;
+    }
+
+    /// <summary>
+    /// An open-loop load generator: each sender thread sends its queries at fixed times whatever the server
+    /// does, and matches the answers by transaction ID on receive threads. A query without an answer within the
+    /// timeout is lost.
+    /// </summary>
+    public static class LoadGenerator
+    {
+        public static LoadResult Run(LoadOptions options) => Run(options, null, null);
+
+        /// <summary>
+        /// Also exports the run, while it goes, as <paramref name="run"/>/latency, /sent, /answered and /late of
+        /// <paramref name="registry"/>.
+        /// </summary>
+        public static LoadResult Run(LoadOptions options, MetricRegistry registry, string run)
+        {
+            if (options.Queries == null) throw new ArgumentException("No query generator.", nameof(options));
+            if (options.Rate <= 0 || options.SenderThreads <= 0) throw new ArgumentOutOfRangeException(nameof(options));
+
+            var result = new LoadResult();
+            double ratePerThread = options.Rate / options.SenderThreads;
+            long timeoutTicks = (long)(options.Timeout.TotalSeconds * Stopwatch.Frequency);
+
+            // Each channel has 65536 IDs; have enough of them that no ID comes back around within twice the timeout,
+            // however few TCP connections were asked for.
+            int channelsPerThread = Math.Max(1, (int)Math.Ceiling(ratePerThread * options.Timeout.TotalSeconds * 2 / 65536));
+            if (options.Protocol == LoadProtocol.Tcp)
+            {
+                channelsPerThread = Math.Max(options.ConnectionsPerThread, channelsPerThread);
+            }
+
+            var senders = new List<Sender>();
+            try
+            {
+                for (int i = 0; i < options.SenderThreads; i++)
+                {
+                    var channels = new Channel[channelsPerThread];
+                    for (int j = 0; j < channels.Length; j++)
+                    {
+                        channels[j] = options.Protocol == LoadProtocol.Tcp ?
+                            (Channel)new TcpChannel(options.Server, result, timeoutTicks) :
+                            new UdpChannel(options.Server, result, timeoutTicks);
+                    }
+                    senders.Add(new Sender(channels, options.Queries(i), ratePerThread));
+                }
+
+                if (registry != null)
+                {
+                    result.Latency = registry.GetHistogram(run + "/latency");
+                    Sender[] all = senders.ToArray();
+                    registry.AddPolledCounter(run + "/sent", () =>
+                    {
+                        long sent = 0;
+                        foreach (Sender sender in all) sent += Volatile.Read(ref sender.Sent);
+                        return sent;
+                    });
+                    registry.AddPolledCounter(run + "/answered", () => Interlocked.Read(ref result.Answered));
+                    registry.AddPolledCounter(run + "/late", () => Interlocked.Read(ref result.Late));
+                }
+
+                foreach (Sender sender in senders)
+                {
+                    foreach (Channel channel in sender.Channels)
+                    {
+                        channel.StartReceiving();
+                    }
+                }
+
+                long start = Stopwatch.GetTimestamp();
+                long end = start + (long)(options.Duration.TotalSeconds * Stopwatch.Frequency);
+                var threads = new List<Thread>();
+                for (int i = 0; i < senders.Count; i++)
+                {
+                    Sender sender = senders[i];
+                    var thread = new Thread(() => sender.Run(start, end)) { IsBackground = true, Name = $"Sender #{i}" };
+                    thread.Start();
+                    threads.Add(thread);
+                }
+                foreach (Thread thread in threads)
+                {
+                    thread.Join();
+                }
+                result.Elapsed = TimeSpan.FromSeconds((Stopwatch.GetTimestamp() - start) / (double)Stopwatch.Frequency);
+
+                // Give the last queries their full timeout.
+                Thread.Sleep(options.Timeout);
+
+                foreach (Sender sender in senders)
+                {
+                    result.Sent += sender.Sent;
+                    result.SendErrors += sender.SendErrors;
+                    long lag = sender.MaxLagTicks;
+                    var lagSpan = TimeSpan.FromSeconds(lag / (double)Stopwatch.Frequency);
+                    if (lagSpan > result.MaxScheduleLag) result.MaxScheduleLag = lagSpan;
+                }
+                return result;
+            }
+            finally
+            {
+                foreach (Sender sender in senders)
+                {
+                    foreach (Channel channel in sender.Channels)
+                    {
+                        channel.Dispose();
+                    }
+                }
+            }
+        }
+
+        sealed class Sender
+        {
+            public readonly Channel[] Channels;
+            readonly QueryGenerator queries;
+            readonly double ticksPerQuery;
+            public long Sent;
+            public long SendErrors;
+            public long MaxLagTicks;
+
+            public Sender(Channel[] channels, QueryGenerator queries, double rate)
+            {
+                Channels = channels;
+                this.queries = queries;
+                ticksPerQuery = Stopwatch.Frequency / rate;
+            }
+
+            public void Run(long start, long end)
+            {
+                Span<byte> query = stackalloc byte[512];
+                long sequence = 0;
+                while (true)
+                {
+                    long due = start + (long)(sequence * ticksPerQuery);
+                    if (due >= end)
+                    {
+                        return;
+                    }
+
+                    long now = Stopwatch.GetTimestamp();
+                    if (due > now)
+                    {
+                        WaitUntil(due);
+                    }
+                    else if (now - due > MaxLagTicks)
+                    {
+                        MaxLagTicks = now - due;
+                    }
+
+                    Channel channel = Channels[sequence % Channels.Length];
+                    ushort id = channel.Reserve(due);
+                    int length = queries.Write(id, query);
+                    if (channel.Send(query.Slice(0, length)))
+                    {
+                        Sent++;
+                    }
+                    else
+                    {
+                        channel.Cancel(id);
+                        SendErrors++;
+                    }
+                    sequence++;
+                }
+            }
+
+            static void WaitUntil(long due)
+            {
+                long remaining;
+                while ((remaining = due - Stopwatch.GetTimestamp()) > 0)
+                {
+                    // Sleep while more than 2 ms away, then spin: Thread.Sleep(1) often takes longer than 1 ms.
+                    if (remaining > Stopwatch.Frequency / 500)
+                    {
+                        Thread.Sleep(1);
+                    }
+                    else
+                    {
+                        Thread.SpinWait(20);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// A socket or connection with its own ID space. The sender stores the due time of ID i in slot i; the
+        /// receiver takes it back out with an exchange, so an answer is counted once.
+        /// </summary>
+        abstract class Channel : IDisposable
+        {
+            readonly long[] dueTimes = new long[65536];
+            readonly LoadResult result;
+            readonly long timeoutTicks;
+            int nextId;
+            Thread receiver;
+            protected volatile bool disposed;
+
+            protected Channel(LoadResult result, long timeoutTicks)
+            {
+                this.result = result;
+                this.timeoutTicks = timeoutTicks;
+                nextId = Environment.TickCount & 0xFFFF;
+            }
+
+            public ushort Reserve(long due)
+            {
+                ushort id = (ushort)nextId++;
+                Volatile.Write(ref dueTimes[id], due);
+                return id;
+            }
+
+            public void Cancel(ushort id)
+            {
+                Volatile.Write(ref dueTimes[id], 0);
+            }
+
+            public abstract bool Send(ReadOnlySpan<byte> query);
+
+            public void StartReceiving()
+            {
+                receiver = new Thread(ReceiveLoop) { IsBackground = true, Name = "Receiver" };
+                receiver.Start();
+            }
+
+            protected abstract void ReceiveLoop();
+
+            protected void OnAnswer(ReadOnlySpan<byte> answer)
+            {
+                long now = Stopwatch.GetTimestamp();
+                if (answer.Length < 12)
+                {
+                    Interlocked.Increment(ref result.Unmatched);
+                    return;
+                }
+
+                ushort id = BinaryPrimitives.ReadUInt16BigEndian(answer);
+                long due = Interlocked.Exchange(ref dueTimes[id], 0);
+                if (due == 0)
+                {
+                    Interlocked.Increment(ref result.Unmatched); // Duplicate, or for a cancelled query.
+                    return;
+                }
+                if (now - due > timeoutTicks)
+                {
+                    Interlocked.Increment(ref result.Late);
+                    return;
+                }
+
+                Interlocked.Increment(ref result.Answered);
+                Interlocked.Increment(ref result.ResponseCodes[answer[3] & 0x0F]);
+                result.Latency.RecordTicks(now - due);
+            }
+
+            public virtual void Dispose()
+            {
+                disposed = true;
+                receiver?.Join();
+            }
+        }
+
+        sealed class UdpChannel : Channel
+        {
+            readonly Socket socket;
+
+            public UdpChannel(IPEndPoint server, LoadResult result, long timeoutTicks)
+                : base(result, timeoutTicks)
+            {
+                socket = new Socket(server.AddressFamily, SocketType.Dgram, ProtocolType.Udp);
+                socket.ReceiveBufferSize = 4 * 1024 * 1024;
+                socket.ReceiveTimeout = 100;
+                socket.Connect(server);
+            }
+
+            public override bool Send(ReadOnlySpan<byte> query)
+            {
+                try
+                {
+                    return socket.Send(query) == query.Length;
+                }
+                catch (SocketException)
+                {
+                    return false; // ECONNREFUSED from an earlier ICMP, ENOBUFS...
+                }
+            }
+
+            protected override void ReceiveLoop()
+            {
+                var buffer = new byte[4096];
+                while (!disposed)
+                {
+                    int length;
+                    try
+                    {
+                        length = socket.Receive(buffer);
+                    }
+                    catch (SocketException)
+                    {
+                        continue; // Timeout, or a refused send reported here.
+                    }
+                    OnAnswer(new ReadOnlySpan<byte>(buffer, 0, length));
+                }
+            }
+
+            public override void Dispose()
+            {
+                base.Dispose();
+                socket.Dispose();
+            }
+        }
+
+        /// <summary>One connection carrying pipelined, length-prefixed queries (RFC 7766).</summary>
+        sealed class TcpChannel : Channel
+        {
+            readonly Socket socket;
+            readonly byte[] frame = new byte[2 + 512];
+
+            public TcpChannel(IPEndPoint server, LoadResult result, long timeoutTicks)
+                : base(result, timeoutTicks)
+            {
+                socket = new Socket(server.AddressFamily, SocketType.Stream, ProtocolType.Tcp) { NoDelay = true };
+                socket.ReceiveTimeout = 100;
+                socket.Connect(server);
+            }
+
+            public override bool Send(ReadOnlySpan<byte> query)
+            {
+                BinaryPrimitives.WriteUInt16BigEndian(frame, (ushort)query.Length);
+                query.CopyTo(frame.AsSpan(2));
+                try
+                {
+                    socket.Send(frame, 0, 2 + query.Length, SocketFlags.None);
+                    return true;
+                }
+                catch (SocketException)
+                {
+                    return false;
+                }
+            }
+
+            protected override void ReceiveLoop()
+            {
+                var buffer = new byte[2 + 65535];
+                int filled = 0;
+                while (!disposed)
+                {
+                    int read;
+                    try
+                    {
+                        read = socket.Receive(buffer, filled, buffer.Length - filled, SocketFlags.None);
+                    }
+                    catch (SocketException ex) when (ex.SocketErrorCode == SocketError.TimedOut || ex.SocketErrorCode == SocketError.WouldBlock)
+                    {
+                        continue;
+                    }
+                    catch (SocketException)
+                    {
+                        return; // The server closed or reset the connection: its queries will time out.
+                    }
+                    if (read == 0)
+                    {
+                        return;
+                    }
+                    filled += read;
+
+                    int offset = 0;
+                    while (filled - offset >= 2)
+                    {
+                        int length = BinaryPrimitives.ReadUInt16BigEndian(buffer.AsSpan(offset));
+                        if (filled - offset < 2 + length)
+                        {
+                            break;
+                        }
+                        OnAnswer(buffer.AsSpan(offset + 2, length));
+                        offset += 2 + length;
+                    }
+                    Buffer.BlockCopy(buffer, offset, buffer, 0, filled - offset);
+                    filled -= offset;
+                }
+            }
+
+            public override void Dispose()
+            {
+                base.Dispose();
+                socket.Dispose();
+            }
+        }
+    }
+}
@@ -0,0 +1,205 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Net;
+using cs_instrumentation;
+
+namespace cs_dns_load_test1
+{
+    class Program
+    {
+        const int RcodeServerFailure = 2;
+
+        const string Usage =
+@"usage: cs-dns-load-test1 [suite] [options]
+  --server <ip:port>        default 127.0.0.1:54
+  --proto udp|tcp|udp,tcp   default udp; TCP needs cs-dns-server-test1 without reuseport and with
+                            --tcp-listeners <n>, its reuseport mode is UDP only
+  --scenario hit|miss|trace:<file>
+                            hit: Zipf over --names names (cache hits), miss: a new name per query
+                            (cs-dns-server-test1 answers n{i}.<zone> and NXDOMAIN under the zone)
+  --rate <qps>              open-loop send rate, default 10000
+  --duration <seconds>      default 10
+  --threads <n>             sender threads, default 1
+  --connections <n>         TCP connections per sender thread, default 4
+  --names <n>               names for the hit scenario, default 1000
+  --zipf <s>                Zipf exponent for the hit scenario, default 1.0
+  --zone <name>             default example.com
+  --type <type>             default A
+  --timeout <ms>            answers later than this are lost, default 1000
+  --no-edns                 send queries without an OPT record
+  --max-loss <percent>      exit with 1 when the loss is higher
+  --max-p99 <ms>            exit with 1 when the p99 latency is higher
+suite runs hit and miss over each --proto with the other options. A run whose answers are all SERVFAIL fails:
+the server does not serve the zone, so hit and miss would measure the same thing.
+DN_METRICS_JSON=<file> also writes each run's counters and latencies as JSON lines, once a second, and
+dotnet-counters monitor -n cs-dns-load-test1 --counters DnsLoadTest shows them live.";
+
+        static int Main(string[] args)
+        {
+            var options = new LoadOptions();
+            bool suite = false;
+            var protocols = new List<LoadProtocol> { LoadProtocol.Udp };
+            string scenario = "hit";
+            int names = 1000;
+            double zipf = 1.0;
+            string zone = "example.com";
+            string type = "A";
+            bool edns = true;
+            double maxLoss = double.NaN;
+            double maxP99 = double.NaN;
+
+            try
+            {
+                for (int i = 0; i < args.Length; i++)
+                {
+                    switch (args[i])
+                    {
+                        case "suite": suite = true; break;
+                        case "--server": options.Server = IPEndPoint.Parse(args[++i]); break;
+                        case "--proto": protocols = ParseProtocols(args[++i]); break;
+                        case "--scenario": scenario = args[++i]; break;
+                        case "--rate": options.Rate = double.Parse(args[++i], CultureInfo.InvariantCulture); break;
+                        case "--duration": options.Duration = TimeSpan.FromSeconds(double.Parse(args[++i], CultureInfo.InvariantCulture)); break;
+                        case "--threads": options.SenderThreads = int.Parse(args[++i]); break;
+                        case "--connections": options.ConnectionsPerThread = int.Parse(args[++i]); break;
+                        case "--names": names = int.Parse(args[++i]); break;
+                        case "--zipf": zipf = double.Parse(args[++i], CultureInfo.InvariantCulture); break;
+                        case "--zone": zone = args[++i]; break;
+                        case "--type": type = args[++i]; break;
+                        case "--timeout": options.Timeout = TimeSpan.FromMilliseconds(double.Parse(args[++i], CultureInfo.InvariantCulture)); break;
+                        case "--no-edns": edns = false; break;
+                        case "--max-loss": maxLoss = double.Parse(args[++i], CultureInfo.InvariantCulture); break;
+                        case "--max-p99": maxP99 = double.Parse(args[++i], CultureInfo.InvariantCulture); break;
+                        default: throw new FormatException($"Unknown option '{args[i]}'.");
+                    }
+                }
+            }
+            catch (Exception ex) when (ex is FormatException || ex is IndexOutOfRangeException)
+            {
+                Console.Error.WriteLine(ex.Message);
+                Console.Error.WriteLine(Usage);
+                return 2;
+            }
+
+            ushort queryType = QueryGenerator.ParseType(type);
+            Func<string, Func<int, QueryGenerator>> scenarios = name =>
+            {
+                if (name == "hit") return i => new ZipfQueryGenerator(zone, names, zipf, queryType, edns, (ulong)(i + 1) * 0x9E3779B97F4A7C15UL);
+                if (name == "miss") return i => new UniqueQueryGenerator(zone, queryType, edns, (ulong)(i + 1) * 0x9E3779B97F4A7C15UL ^ (ulong)Environment.TickCount64);
+                if (name.StartsWith("trace:")) return TraceQueryGenerator.Load(name.Substring(6), edns);
+                throw new FormatException($"Unknown scenario '{name}'.");
+            };
+
+            var runs = new List<(LoadProtocol, string)>();
+            foreach (LoadProtocol p in protocols)
+            {
+                if (suite)
+                {
+                    runs.Add((p, "hit"));
+                    runs.Add((p, "miss"));
+                }
+                else
+                {
+                    runs.Add((p, scenario));
+                }
+            }
+
+            Console.WriteLine($"# {options.Server}, {options.Rate:F0} qps for {options.Duration.TotalSeconds:F0} s, {options.SenderThreads} thread(s), timeout {options.Timeout.TotalMilliseconds:F0} ms");
+            Console.WriteLine($"{"run",-16} {"sent",10} {"qps",10} {"answered",10} {"loss%",7} {"late",7} {"p50",9} {"p99",9} {"p99.9",9} {"max",9}  rcodes");
+
+            var registry = new MetricRegistry("DnsLoadTest");
+            using MetricsJsonWriter json = MetricsJsonWriter.FromEnvironment(registry);
+            using MetricsEventSource eventSource = new MetricsEventSource(registry);
+
+            int exitCode = 0;
+            foreach ((LoadProtocol runProtocol, string runScenario) in runs)
+            {
+                options.Protocol = runProtocol;
+                options.Queries = scenarios(runScenario);
+                string label = $"{runProtocol.ToString().ToLowerInvariant()}/{(runScenario.StartsWith("trace:") ? "trace" : runScenario)}";
+
+                LoadResult result;
+                try
+                {
+                    result = LoadGenerator.Run(options, registry, label);
+                }
+                catch (System.Net.Sockets.SocketException ex)
+                {
+                    Console.WriteLine($"{label,-16} {ex.Message}");
+                    exitCode = 1;
+                    continue;
+                }
+
+                Console.WriteLine($"{label,-16} {result.Sent,10} {result.SentPerSecond,10:F0} {result.Answered,10} {result.LossPercent,7:F2} {result.Late,7} " +
+                    $"{Milliseconds(result.Latency, 50),9} {Milliseconds(result.Latency, 99),9} {Milliseconds(result.Latency, 99.9),9} " +
+                    $"{(result.Latency.Count == 0 ? "-" : (result.Latency.MaxNanoseconds / 1e6).ToString("F3")),9}  {ResponseCodes(result)}");
+                if (result.SendErrors != 0)
+                {
+                    Console.WriteLine($"{"",-16} {result.SendErrors} send(s) failed and were not counted as sent");
+                }
+                if (result.MaxScheduleLag > options.Timeout)
+                {
+                    Console.WriteLine($"{"",-16} the senders fell {result.MaxScheduleLag.TotalMilliseconds:F0} ms behind: the rate is too high for this client");
+                }
+
+                if (result.Answered != 0 && result.ResponseCodes[RcodeServerFailure] == result.Answered)
+                {
+                    Console.WriteLine($"{"",-16} FAIL: every answer was SERVFAIL: is the server authoritative for {zone}?");
+                    exitCode = 1;
+                }
+                if (result.LossPercent > maxLoss)
+                {
+                    Console.WriteLine($"{"",-16} FAIL: loss {result.LossPercent:F2}% > {maxLoss}%");
+                    exitCode = 1;
+                }
+                if (result.Latency.GetPercentileNanoseconds(99) / 1e6 > maxP99)
+                {
+                    Console.WriteLine($"{"",-16} FAIL: p99 {result.Latency.GetPercentileNanoseconds(99) / 1e6:F3} ms > {maxP99} ms");
+                    exitCode = 1;
+                }
+            }
+            return exitCode;
+        }
+
+        // "udp", "tcp" or both, comma-separated.
+        static List<LoadProtocol> ParseProtocols(string value)
+        {
+            var protocols = new List<LoadProtocol>();
+            foreach (string name in value.Split(','))
+            {
+                LoadProtocol protocol = name switch
+                {
+                    "udp" => LoadProtocol.Udp,
+                    "tcp" => LoadProtocol.Tcp,
+                    _ => throw new FormatException($"Unknown protocol '{name}'."),
+                };
+                if (!protocols.Contains(protocol))
+                {
+                    protocols.Add(protocol);
+                }
+            }
+            return protocols;
+        }
+
+        static string Milliseconds(LatencyHistogram histogram, double percentile)
+        {
+            return histogram.Count == 0 ? "-" : (histogram.GetPercentileNanoseconds(percentile) / 1e6).ToString("F3");
+        }
+
+        // "NOERROR=123 SERVFAIL=4"
+        static string ResponseCodes(LoadResult result)
+        {
+            string[] names = { "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED" };
+            var parts = new List<string>();
+            for (int i = 0; i < result.ResponseCodes.Length; i++)
+            {
+                if (result.ResponseCodes[i] != 0)
+                {
+                    parts.Add($"{(i < names.Length ? names[i] : "RCODE" + i)}={result.ResponseCodes[i]}");
+                }
+            }
+            return string.Join(" ", parts);
+        }
+    }
+}
@@ -0,0 +1,277 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+
+namespace cs_dns_load_test1
+{
+    /// <summary>
+    /// Writes the next query into a buffer. One instance per sender thread: the random state and the trace
+    /// position are not shared.
+    /// </summary>
+    public abstract class QueryGenerator
+    {
+        public const ushort TypeA = 1;
+
+        const ushort TypeOpt = 41;
+        const ushort ClassIn = 1;
+        const ushort EdnsUdpPayloadSize = 1232;
+
+        readonly bool edns;
+
+        protected QueryGenerator(bool edns)
+        {
+            this.edns = edns;
+        }
+
+        /// <summary>Writes a query with transaction ID <paramref name="id"/> and returns its length.</summary>
+        public abstract int Write(ushort id, Span<byte> destination);
+
+        /// <summary>Writes the header, the question and, with EDNS, an OPT record.</summary>
+        protected int WriteQuery(ushort id, ReadOnlySpan<byte> wireName, ushort type, Span<byte> destination)
+        {
+            BinaryPrimitives.WriteUInt16BigEndian(destination, id);
+            destination[2] = 0x01; // RD
+            destination[3] = 0;
+            BinaryPrimitives.WriteUInt16BigEndian(destination.Slice(4), 1);
+            destination.Slice(6, 4).Clear();
+            BinaryPrimitives.WriteUInt16BigEndian(destination.Slice(10), (ushort)(edns ? 1 : 0));
+
+            wireName.CopyTo(destination.Slice(12));
+            int length = 12 + wireName.Length;
+            BinaryPrimitives.WriteUInt16BigEndian(destination.Slice(length), type);
+            BinaryPrimitives.WriteUInt16BigEndian(destination.Slice(length + 2), ClassIn);
+            length += 4;
+
+            if (edns)
+            {
+                destination[length] = 0;
+                BinaryPrimitives.WriteUInt16BigEndian(destination.Slice(length + 1), TypeOpt);
+                BinaryPrimitives.WriteUInt16BigEndian(destination.Slice(length + 3), EdnsUdpPayloadSize);
+                destination.Slice(length + 5, 6).Clear();
+                length += 11;
+            }
+            return length;
+        }
+
+        /// <summary>Encodes a dotted name such as "www.example.com" in wire format.</summary>
+        public static byte[] EncodeName(string name)
+        {
+            name = name.TrimEnd('.');
+            var result = new List<byte>(name.Length + 2);
+            if (name.Length != 0)
+            {
+                foreach (string label in name.Split('.'))
+                {
+                    if (label.Length == 0 || label.Length > 63)
+                    {
+                        throw new FormatException($"'{name}' has an empty or too long label.");
+                    }
+                    result.Add((byte)label.Length);
+                    foreach (char c in label)
+                    {
+                        result.Add((byte)c);
+                    }
+                }
+            }
+            result.Add(0);
+            if (result.Count > 255)
+            {
+                throw new FormatException($"'{name}' is too long.");
+            }
+            return result.ToArray();
+        }
+
+        /// <summary>Parses a type mnemonic such as "AAAA" or a number.</summary>
+        public static ushort ParseType(string type)
+        {
+            switch (type.ToUpperInvariant())
+            {
+                case "A": return 1;
+                case "NS": return 2;
+                case "CNAME": return 5;
+                case "SOA": return 6;
+                case "PTR": return 12;
+                case "MX": return 15;
+                case "TXT": return 16;
+                case "AAAA": return 28;
+                case "SRV": return 33;
+                case "ANY": return 255;
+                default:
+                    if (type.StartsWith("TYPE", StringComparison.OrdinalIgnoreCase))
+                    {
+                        type = type.Substring(4);
+                    }
+                    return ushort.Parse(type);
+            }
+        }
+
+        /// <summary>xorshift64*: cheap, and good enough to pick names.</summary>
+        protected static ulong NextRandom(ref ulong state)
+        {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 2685821657736338717UL;
+        }
+    }
+
+    /// <summary>
+    /// Names "n0.zone" to "n{count-1}.zone" picked with a Zipf distribution of exponent <c>s</c> (0 is uniform), so
+    /// a handful of names carry most of the traffic and a response cache mostly hits.
+    /// </summary>
+    public sealed class ZipfQueryGenerator : QueryGenerator
+    {
+        readonly byte[][] names;
+        readonly double[] cumulative;
+        readonly ushort type;
+        ulong random;
+
+        public ZipfQueryGenerator(string zone, int count, double s, ushort type, bool edns, ulong seed)
+            : base(edns)
+        {
+            if (count <= 0) throw new ArgumentOutOfRangeException(nameof(count));
+
+            names = new byte[count][];
+            cumulative = new double[count];
+            double sum = 0;
+            for (int i = 0; i < count; i++)
+            {
+                names[i] = EncodeName($"n{i}.{zone}");
+                sum += 1.0 / Math.Pow(i + 1, s);
+                cumulative[i] = sum;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                cumulative[i] /= sum;
+            }
+
+            this.type = type;
+            random = seed | 1;
+        }
+
+        public override int Write(ushort id, Span<byte> destination)
+        {
+            double u = (NextRandom(ref random) >> 11) * (1.0 / (1UL << 53));
+            int index = Array.BinarySearch(cumulative, u);
+            if (index < 0) index = Math.Min(~index, names.Length - 1);
+            return WriteQuery(id, names[index], type, destination);
+        }
+    }
+
+    /// <summary>
+    /// A fresh random name under the zone for every query ("m" and 16 hex digits), so no response cache can hit.
+    /// </summary>
+    public sealed class UniqueQueryGenerator : QueryGenerator
+    {
+        const int LabelLength = 17;
+
+        readonly byte[] name;
+        readonly ushort type;
+        ulong random;
+
+        public UniqueQueryGenerator(string zone, ushort type, bool edns, ulong seed)
+            : base(edns)
+        {
+            byte[] zoneName = EncodeName(zone);
+            name = new byte[1 + LabelLength + zoneName.Length];
+            name[0] = LabelLength;
+            name[1] = (byte)'m';
+            zoneName.CopyTo(name, 1 + LabelLength);
+            this.type = type;
+            random = seed | 1;
+        }
+
+        public override int Write(ushort id, Span<byte> destination)
+        {
+            ulong value = NextRandom(ref random);
+            for (int i = 0; i < 16; i++)
+            {
+                name[2 + i] = (byte)"0123456789abcdef"[(int)(value >> (i * 4)) & 0xF];
+            }
+            return WriteQuery(id, name, type, destination);
+        }
+    }
+
+    /// <summary>
+    /// Replays a trace in order, looping at its end. Each line is "name [type]", and blank lines, lines starting with
+    /// '#' and comments starting with ";;" or "; " are skipped. The first column of multi-column lines also works, and
+    /// so do dig's question lines, such as ";www.example.com. IN A", whose ';' is dropped.
+    /// </summary>
+    public sealed class TraceQueryGenerator : QueryGenerator
+    {
+        readonly byte[][] names;
+        readonly ushort[] types;
+        int next;
+
+        TraceQueryGenerator(byte[][] names, ushort[] types, int start, bool edns)
+            : base(edns)
+        {
+            this.names = names;
+            this.types = types;
+            next = start % names.Length;
+        }
+
+        public int Count => names.Length;
+
+        public override int Write(ushort id, Span<byte> destination)
+        {
+            int i = next;
+            next = i + 1 == names.Length ? 0 : i + 1;
+            return WriteQuery(id, names[i], types[i], destination);
+        }
+
+        /// <summary>Reads a trace once and returns a factory of generators that share it, each starting elsewhere.</summary>
+        public static Func<int, QueryGenerator> Load(string path, bool edns)
+        {
+            var names = new List<byte[]>();
+            var types = new List<ushort>();
+            int lineNumber = 0;
+            foreach (string line in File.ReadLines(path))
+            {
+                lineNumber++;
+                string trimmed = line.Trim();
+                if (trimmed.Length > 1 && trimmed[0] == ';' && trimmed[1] != ';' && !char.IsWhiteSpace(trimmed[1]))
+                {
+                    trimmed = trimmed.Substring(1); // A dig question line.
+                }
+                if (trimmed.Length == 0 || trimmed[0] == '#' || trimmed[0] == ';')
+                {
+                    continue;
+                }
+
+                string[] fields = trimmed.Split(new[] { ' ', '\t' }, StringSplitOptions.RemoveEmptyEntries);
+                try
+                {
+                    names.Add(EncodeName(fields[0]));
+                    types.Add(ParseType(FindType(fields)));
+                }
+                catch (FormatException ex)
+                {
+                    throw new FormatException($"{path}:{lineNumber}: {ex.Message}", ex);
+                }
+            }
+            if (names.Count == 0)
+            {
+                throw new FormatException($"{path}: no queries.");
+            }
+
+            byte[][] nameArray = names.ToArray();
+            ushort[] typeArray = types.ToArray();
+            return index => new TraceQueryGenerator(nameArray, typeArray, index * 7919, edns);
+        }
+
+        // "name A", "name IN A" or just "name".
+        static string FindType(string[] fields)
+        {
+            for (int i = fields.Length - 1; i >= 1; i--)
+            {
+                if (!fields[i].Equals("IN", StringComparison.OrdinalIgnoreCase) && !char.IsDigit(fields[i][0]))
+                {
+                    return fields[i];
+                }
+            }
+            return "A";
+        }
+    }
+}
@@ -0,0 +1,149 @@
+﻿using System;
+using System.Globalization;
+using System.IO;
+using System.Net;
+using System.Text;
+using System.Threading;
+using cs_instrumentation;
+
+namespace cs_dns_server_test1
+{
+    /// <summary>
+    /// Publishes <see cref="DnsServerMetrics"/>, if given a port, as a Prometheus text endpoint at
+    /// http://+:port/metrics, per socket. It only reads the metrics when scraped. The EventCounters come from the
+    /// registry of the metrics, through <see cref="MetricsEventSource"/>.
+    /// </summary>
+    public sealed class DnsMetricsExporter : IDisposable
+    {
+        readonly DnsServerMetrics metrics;
+        readonly HttpListener httpListener;
+        readonly Thread httpThread;
+
+        public DnsMetricsExporter(DnsServerMetrics metrics, int prometheusPort = 0)
+        {
+            this.metrics = metrics ?? throw new ArgumentNullException(nameof(metrics));
+            if (prometheusPort != 0)
+            {
+                httpListener = new HttpListener();
+                httpListener.Prefixes.Add($"http://+:{prometheusPort}/metrics/");
+                httpListener.Start();
+                httpThread = new Thread(ServeHttp) { IsBackground = true, Name = "Prometheus Exporter" };
+                httpThread.Start();
+            }
+        }
+
+        public void Dispose()
+        {
+            if (httpListener != null)
+            {
+                httpListener.Close();
+                httpThread.Join();
+            }
+        }
+
+        void ServeHttp()
+        {
+            while (true)
+            {
+                HttpListenerContext context;
+                try
+                {
+                    context = httpListener.GetContext();
+                }
+                catch (Exception) when (!httpListener.IsListening)
+                {
+                    return;
+                }
+                catch (HttpListenerException)
+                {
+                    continue;
+                }
+
+                try
+                {
+                    byte[] body = Encoding.UTF8.GetBytes(FormatPrometheus());
+                    context.Response.ContentType = "text/plain; version=0.0.4";
+                    context.Response.ContentLength64 = body.Length;
+                    context.Response.OutputStream.Write(body, 0, body.Length);
+                    context.Response.Close();
+                }
+                catch (Exception ex) when (ex is HttpListenerException || ex is IOException)
+                {
+                    // The scraper went away.
+                }
+            }
+        }
+
+        /// <summary>Formats the metrics in the Prometheus text exposition format.</summary>
+        public string FormatPrometheus()
+        {
+            ListenerMetrics[] listeners = metrics.Listeners;
+            var text = new StringBuilder();
+
+            Counter(text, listeners, "dns_received_total", "Datagrams received.", l => l.Received);
+            Counter(text, listeners, "dns_answered_total", "Answers sent.", l => l.Answered);
+            Counter(text, listeners, "dns_unanswered_total", "Queries the handler did not answer.", l => l.Unanswered);
+            Counter(text, listeners, "dns_handler_errors_total", "Queries whose handler threw.", l => l.HandlerErrors);
+            Counter(text, listeners, "dns_send_errors_total", "Answers the kernel refused to send.", l => l.SendErrors);
+            Counter(text, listeners, "dns_kernel_drops_total", "Datagrams dropped by a full receive queue.", l => l.KernelDrops);
+            Counter(text, listeners, "dns_batches_total", "recvmmsg calls that returned datagrams.", l => l.Batches);
+            Gauge(text, listeners, "dns_queue_depth", "Datagrams returned by the last recvmmsg.", l => l.QueueDepth);
+            Gauge(text, listeners, "dns_queue_depth_max", "Most datagrams returned by one recvmmsg.", l => l.MaxQueueDepth);
+            Summary(text, listeners, "dns_receive_to_send_seconds", "From receiving a query to sending its answer.", l => l.ReceiveToSend);
+            Summary(text, listeners, "dns_handler_seconds", "Time spent in the query handler.", l => l.Handler);
+
+            DnsResponseCache cache = metrics.Cache;
+            if (cache != null)
+            {
+                text.Append("# HELP dns_cache_hits_total Queries answered from the response cache.\n# TYPE dns_cache_hits_total counter\n");
+                text.Append("dns_cache_hits_total ").Append(cache.Hits).Append('\n');
+                text.Append("# HELP dns_cache_misses_total Queries the response cache could not answer.\n# TYPE dns_cache_misses_total counter\n");
+                text.Append("dns_cache_misses_total ").Append(cache.Misses).Append('\n');
+            }
+            return text.ToString();
+        }
+
+        static void Counter(StringBuilder text, ListenerMetrics[] listeners, string name, string help, Func<ListenerMetrics, long> value)
+        {
+            Header(text, name, help, "counter");
+            foreach (ListenerMetrics listener in listeners)
+            {
+                text.Append(name).Append("{socket=\"").Append(listener.Name).Append("\"} ").Append(value(listener)).Append('\n');
+            }
+        }
+
+        static void Gauge(StringBuilder text, ListenerMetrics[] listeners, string name, string help, Func<ListenerMetrics, long> value)
+        {
+            Header(text, name, help, "gauge");
+            foreach (ListenerMetrics listener in listeners)
+            {
+                text.Append(name).Append("{socket=\"").Append(listener.Name).Append("\"} ").Append(value(listener)).Append('\n');
+            }
+        }
+
+        static void Summary(StringBuilder text, ListenerMetrics[] listeners, string name, string help, Func<ListenerMetrics, LatencyHistogram> histogram)
+        {
+            Header(text, name, help, "summary");
+            foreach (ListenerMetrics listener in listeners)
+            {
+                LatencyHistogram h = histogram(listener);
+                foreach (double quantile in new[] { 0.5, 0.9, 0.99, 0.999 })
+                {
+                    text.Append(name).Append("{socket=\"").Append(listener.Name).Append("\",quantile=\"")
+                        .Append(quantile.ToString(CultureInfo.InvariantCulture)).Append("\"} ")
+                        .Append(Seconds(h.GetPercentileNanoseconds(quantile * 100))).Append('\n');
+                }
+                text.Append(name).Append("_sum{socket=\"").Append(listener.Name).Append("\"} ").Append(Seconds(h.SumNanoseconds)).Append('\n');
+                text.Append(name).Append("_count{socket=\"").Append(listener.Name).Append("\"} ").Append(h.Count).Append('\n');
+            }
+        }
+
+        static void Header(StringBuilder text, string name, string help, string type)
+        {
+            text.Append("# HELP ").Append(name).Append(' ').Append(help).Append('\n');
+            text.Append("# TYPE ").Append(name).Append(' ').Append(type).Append('\n');
+        }
+
+        static string Seconds(double nanoseconds) => (nanoseconds / 1e9).ToString("G6", CultureInfo.InvariantCulture);
+    }
+}
@@ -0,0 +1,264 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Threading;
+using cs_instrumentation;
+
+namespace cs_dns_server_test1
+{
+    /// <summary>
+    /// Encoded responses keyed by question name (ignoring case), type, class and the DO bit, so a hit is answered
+    /// by copying bytes and patching the transaction ID, the RD/CD flags, the question's spelling and the OPT
+    /// record for the querier's EDNS. Reads take no locks: entries are immutable and sit in a fixed array of
+    /// 4-way buckets, which bounds the memory, and an insert replaces the free, expired or least recently used
+    /// entry of its bucket. Entries live for the smallest TTL of their records, capped at the maximum TTL;
+    /// answers without records use the negative TTL. Truncated answers and failures are not cached.
+    /// </summary>
+    public sealed class DnsResponseCache
+    {
+        const int Ways = 4;
+
+        sealed class Entry
+        {
+            public readonly int Hash;
+            public readonly ushort Type;
+            public readonly ushort Class;
+            public readonly bool DnssecOk;
+            public readonly byte[] Response;
+            /// <summary>Offset of the OPT record, which the writer always puts last, or -1.</summary>
+            public readonly int OptOffset;
+            public readonly int NameLength;
+            public readonly long ExpiresAt;
+            public long LastUsed;
+
+            public Entry(int hash, in DnsQuery query, byte[] response, int optOffset, long now, uint ttl)
+            {
+                Hash = hash;
+                Type = query.Type;
+                Class = query.Class;
+                DnssecOk = query.DnssecOk;
+                Response = response;
+                OptOffset = optOffset;
+                NameLength = query.Name.Length;
+                ExpiresAt = now + ttl * 1000L;
+                LastUsed = now;
+            }
+
+            /// <summary>The question name, as the response copied it after the header.</summary>
+            public ReadOnlySpan<byte> Name => new ReadOnlySpan<byte>(Response, DnsQuery.HeaderSize, NameLength);
+        }
+
+        readonly Entry[] entries;
+        readonly int bucketMask;
+        readonly uint maxTtl;
+        readonly uint negativeTtl;
+        // Striped per core: every listener counts every lookup.
+        readonly Counter hits = new Counter("cache-hits");
+        readonly Counter misses = new Counter("cache-misses");
+
+        /// <param name="capacity">The maximum number of entries, rounded up to a power of two.</param>
+        /// <param name="maxTtl">The longest time, in seconds, an answer is reused.</param>
+        /// <param name="negativeTtl">How long, in seconds, an answer without records (NXDOMAIN, NODATA) is reused.</param>
+        public DnsResponseCache(int capacity = 65536, uint maxTtl = 3600, uint negativeTtl = 60)
+        {
+            if (capacity < Ways) throw new ArgumentOutOfRangeException(nameof(capacity));
+
+            int buckets = 1;
+            while (buckets * Ways < capacity) buckets <<= 1;
+            entries = new Entry[buckets * Ways];
+            bucketMask = buckets - 1;
+            this.maxTtl = maxTtl;
+            this.negativeTtl = negativeTtl;
+        }
+
+        public int Capacity => entries.Length;
+        public long Hits => hits.Value;
+        public long Misses => misses.Value;
+
+        /// <summary>Writes the cached answer to <paramref name="query"/>, patched for it, into <paramref name="response"/>.</summary>
+        /// <returns>The length of the response, or 0 on a miss.</returns>
+        public int TryWrite(in DnsQuery query, Span<byte> response)
+        {
+            long now = Environment.TickCount64;
+            int hash = Hash(query);
+            int first = (hash & bucketMask) * Ways;
+            for (int i = first; i < first + Ways; i++)
+            {
+                Entry entry = Volatile.Read(ref entries[i]);
+                if (entry == null || !Matches(entry, hash, query) || entry.ExpiresAt <= now)
+                {
+                    continue;
+                }
+
+                int length = Patch(entry, query, response);
+                if (length == 0)
+                {
+                    break; // Too big for this querier: let the handler truncate it.
+                }
+                entry.LastUsed = now;
+                hits.Increment();
+                return length;
+            }
+
+            misses.Increment();
+            return 0;
+        }
+
+        /// <summary>Caches <paramref name="response"/>, the answer the handler wrote to <paramref name="query"/>, if it may be reused.</summary>
+        public void Add(in DnsQuery query, ReadOnlySpan<byte> response)
+        {
+            if (!TryGetTtl(response, query.Question.Length, out uint ttl, out int optOffset) || ttl == 0)
+            {
+                return;
+            }
+
+            long now = Environment.TickCount64;
+            int hash = Hash(query);
+            var entry = new Entry(hash, query, response.ToArray(), optOffset, now, ttl);
+
+            // Replace the same question, or a free slot, or an expired entry, or the least recently used one.
+            int first = (hash & bucketMask) * Ways;
+            int victim = first;
+            Entry victimEntry = Volatile.Read(ref entries[first]);
+            for (int i = first; i < first + Ways; i++)
+            {
+                Entry current = Volatile.Read(ref entries[i]);
+                if (current == null || current.ExpiresAt <= now || Matches(current, hash, query))
+                {
+                    victim = i;
+                    victimEntry = current;
+                    break;
+                }
+                if (current.LastUsed < victimEntry.LastUsed)
+                {
+                    victim = i;
+                    victimEntry = current;
+                }
+            }
+
+            // If another thread replaced the victim first, its entry is as good as ours.
+            Interlocked.CompareExchange(ref entries[victim], entry, victimEntry);
+        }
+
+        public void Clear()
+        {
+            for (int i = 0; i < entries.Length; i++)
+            {
+                Volatile.Write(ref entries[i], null);
+            }
+        }
+
+        static bool Matches(Entry entry, int hash, in DnsQuery query)
+        {
+            return entry.Hash == hash && entry.Type == query.Type && entry.Class == query.Class &&
+                entry.DnssecOk == query.DnssecOk && DnsWire.NameEquals(entry.Name, query.Name);
+        }
+
+        static int Patch(Entry entry, in DnsQuery query, Span<byte> response)
+        {
+            byte[] cached = entry.Response;
+            bool hasOpt = entry.OptOffset >= 0;
+            int length = !hasOpt ? cached.Length : query.HasEdns ? cached.Length : entry.OptOffset;
+            int finalLength = !hasOpt && query.HasEdns ? length + DnsWire.OptRecordSize : length;
+            if (finalLength > query.MaxResponseSize || finalLength > response.Length)
+            {
+                return 0;
+            }
+
+            new ReadOnlySpan<byte>(cached, 0, length).CopyTo(response);
+            BinaryPrimitives.WriteUInt16BigEndian(response, query.Id);
+            response[2] = (byte)((response[2] & ~0x01) | (query.RecursionDesired ? 0x01 : 0));
+            response[3] = (byte)((response[3] & ~0x10) | (query.CheckingDisabled ? 0x10 : 0));
+            query.Question.CopyTo(response.Slice(DnsQuery.HeaderSize)); // The querier's spelling (0x20 randomization).
+
+            if (hasOpt != query.HasEdns)
+            {
+                ushort additionalCount = BinaryPrimitives.ReadUInt16BigEndian(response.Slice(10));
+                if (query.HasEdns)
+                {
+                    DnsWire.WriteOptRecord(response.Slice(length));
+                    additionalCount++;
+                }
+                else
+                {
+                    additionalCount--;
+                }
+                BinaryPrimitives.WriteUInt16BigEndian(response.Slice(10), additionalCount);
+            }
+            return finalLength;
+        }
+
+        /// <summary>
+        /// Gets how long <paramref name="response"/> may be reused, and where its OPT record is.
+        /// </summary>
+        /// <returns>false if it must not be cached: truncated, not NOERROR/NXDOMAIN, or not laid out as the writer does.</returns>
+        bool TryGetTtl(ReadOnlySpan<byte> response, int questionLength, out uint ttl, out int optOffset)
+        {
+            ttl = 0;
+            optOffset = -1;
+            if (response.Length < DnsQuery.HeaderSize || (response[2] & 0x02) != 0)
+            {
+                return false;
+            }
+            var responseCode = (DnsResponseCode)(response[3] & 0x0F);
+            if (responseCode != DnsResponseCode.NoError && responseCode != DnsResponseCode.NameError)
+            {
+                return false;
+            }
+
+            int records = BinaryPrimitives.ReadUInt16BigEndian(response.Slice(6)) +
+                BinaryPrimitives.ReadUInt16BigEndian(response.Slice(8)) +
+                BinaryPrimitives.ReadUInt16BigEndian(response.Slice(10));
+            uint minTtl = uint.MaxValue;
+            int offset = DnsQuery.HeaderSize + questionLength;
+            for (int i = 0; i < records; i++)
+            {
+                int recordOffset = offset;
+                int nameLength = DnsWire.GetNameLength(response.Slice(offset), allowCompression: true);
+                if (nameLength < 0 || offset + nameLength + 10 > response.Length)
+                {
+                    return false;
+                }
+                offset += nameLength;
+                ushort type = BinaryPrimitives.ReadUInt16BigEndian(response.Slice(offset));
+                uint recordTtl = BinaryPrimitives.ReadUInt32BigEndian(response.Slice(offset + 4));
+                offset += 10 + BinaryPrimitives.ReadUInt16BigEndian(response.Slice(offset + 8));
+                if (offset > response.Length)
+                {
+                    return false;
+                }
+
+                if (type == DnsQuery.TypeOpt)
+                {
+                    if (i != records - 1)
+                    {
+                        return false;
+                    }
+                    optOffset = recordOffset;
+                }
+                else
+                {
+                    minTtl = Math.Min(minTtl, recordTtl);
+                }
+            }
+            if (offset != response.Length)
+            {
+                return false;
+            }
+
+            ttl = minTtl == uint.MaxValue ? negativeTtl : Math.Min(minTtl, maxTtl);
+            return true;
+        }
+
+        /// <summary>FNV-1a over the lower-cased name, then the type.</summary>
+        static int Hash(in DnsQuery query)
+        {
+            uint hash = 2166136261;
+            foreach (byte b in query.Name)
+            {
+                hash = (hash ^ DnsWire.ToLower(b)) * 16777619;
+            }
+            hash = (hash ^ query.Type) * 16777619;
+            return (int)(hash ^ (hash >> 16));
+        }
+    }
+}
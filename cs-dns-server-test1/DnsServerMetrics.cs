@@ -0,0 +1,170 @@
+﻿using System;
+using System.Threading;
+using cs_instrumentation;
+
+namespace cs_dns_server_test1
+{
+    /// <summary>
+    /// The counters and histograms of one socket (or of the ARSoft server). They are updated without locks: the
+    /// owning thread adds a whole batch at once, and readers may see a batch partially applied.
+    /// </summary>
+    public sealed class ListenerMetrics
+    {
+        long received;
+        long answered;
+        long unanswered;
+        long handlerErrors;
+        long sendErrors;
+        long kernelDrops;
+        long batches;
+        long queueDepth;
+        long maxQueueDepth;
+
+        public ListenerMetrics(string name)
+        {
+            Name = name;
+            ReceiveToSend = new LatencyHistogram(name + "/recv->send");
+            Handler = new LatencyHistogram(name + "/handler");
+        }
+
+        public string Name { get; }
+
+        /// <summary>From the return of recvmmsg to the return of the sendmmsg that carried the answer.</summary>
+        public LatencyHistogram ReceiveToSend { get; }
+
+        /// <summary>The time spent in the query handler, per query. Only the recvmmsg listeners record it.</summary>
+        public LatencyHistogram Handler { get; }
+
+        public long Received => Interlocked.Read(ref received);
+        public long Answered => Interlocked.Read(ref answered);
+
+        /// <summary>Queries the handler chose not to answer.</summary>
+        public long Unanswered => Interlocked.Read(ref unanswered);
+
+        public long HandlerErrors => Interlocked.Read(ref handlerErrors);
+
+        /// <summary>Answers sendmmsg refused (ENOBUFS, unreachable peer...).</summary>
+        public long SendErrors => Interlocked.Read(ref sendErrors);
+
+        /// <summary>Datagrams the kernel dropped because the socket's receive queue was full (SO_RXQ_OVFL).</summary>
+        public long KernelDrops => Interlocked.Read(ref kernelDrops);
+
+        public long Batches => Interlocked.Read(ref batches);
+
+        /// <summary>The number of datagrams the last recvmmsg returned: how many were queued, up to the batch size.</summary>
+        public long QueueDepth => Interlocked.Read(ref queueDepth);
+
+        public long MaxQueueDepth => Interlocked.Read(ref maxQueueDepth);
+
+        /// <summary>Adds the totals of one receive batch.</summary>
+        public void RecordBatch(int received, int answered, int unanswered, int handlerErrors, int sendErrors)
+        {
+            Interlocked.Add(ref this.received, received);
+            if (answered != 0) Interlocked.Add(ref this.answered, answered);
+            if (unanswered != 0) Interlocked.Add(ref this.unanswered, unanswered);
+            if (handlerErrors != 0) Interlocked.Add(ref this.handlerErrors, handlerErrors);
+            if (sendErrors != 0) Interlocked.Add(ref this.sendErrors, sendErrors);
+            Interlocked.Increment(ref batches);
+            Interlocked.Exchange(ref queueDepth, received);
+            if (received > Interlocked.Read(ref maxQueueDepth)) Interlocked.Exchange(ref maxQueueDepth, received);
+        }
+
+        /// <summary>Records one query answered outside of a batch, as the ARSoft server does.</summary>
+        public void RecordQuery(bool isAnswered)
+        {
+            Interlocked.Increment(ref received);
+            Interlocked.Increment(ref isAnswered ? ref answered : ref unanswered);
+        }
+
+        /// <summary>Sets the kernel's drop count, which SO_RXQ_OVFL reports as a running total.</summary>
+        public void SetKernelDrops(long total)
+        {
+            Interlocked.Exchange(ref kernelDrops, total);
+        }
+    }
+
+    /// <summary>
+    /// The metrics of all the sockets of a server, exported by <see cref="DnsMetricsExporter"/> and, through
+    /// <paramref name="registry"/> if given, by the shared exporters (the totals, and each socket's histograms).
+    /// </summary>
+    public sealed class DnsServerMetrics
+    {
+        readonly object gate = new object();
+        readonly MetricRegistry registry;
+        ListenerMetrics[] listeners = Array.Empty<ListenerMetrics>();
+
+        public DnsServerMetrics(DnsResponseCache cache = null, MetricRegistry registry = null)
+        {
+            Cache = cache;
+            this.registry = registry;
+
+            if (registry != null)
+            {
+                registry.AddPolledCounter("received", () => Received, "Queries Received");
+                registry.AddPolledCounter("answered", () => Answered, "Answers Sent");
+                registry.AddPolledCounter("drops", () => Drops, "Kernel and Send Drops");
+                registry.GetGauge("queue-depth", "Queue Depth (deepest socket)", read: () => MaxQueueDepth);
+                if (cache != null)
+                {
+                    registry.AddPolledCounter("cache-hits", () => cache.Hits, "Cache Hits");
+                    registry.AddPolledCounter("cache-misses", () => cache.Misses, "Cache Misses");
+                }
+            }
+        }
+
+        public DnsResponseCache Cache { get; }
+
+        /// <summary>A snapshot of the listeners; the array is replaced, never modified.</summary>
+        public ListenerMetrics[] Listeners => Volatile.Read(ref listeners);
+
+        /// <summary>Gets the metrics named <paramref name="name"/>, adding them the first time.</summary>
+        public ListenerMetrics GetOrAddListener(string name)
+        {
+            lock (gate)
+            {
+                foreach (ListenerMetrics listener in listeners)
+                {
+                    if (listener.Name == name) return listener;
+                }
+
+                var added = new ListenerMetrics(name);
+                var copy = new ListenerMetrics[listeners.Length + 1];
+                listeners.CopyTo(copy, 0);
+                copy[listeners.Length] = added;
+                Volatile.Write(ref listeners, copy);
+
+                registry?.AddHistogram(added.ReceiveToSend);
+                registry?.AddHistogram(added.Handler);
+                return added;
+            }
+        }
+
+        public long Received => Sum(l => l.Received);
+        public long Answered => Sum(l => l.Answered);
+        public long Drops => Sum(l => l.KernelDrops + l.SendErrors);
+
+        /// <summary>The <see cref="ListenerMetrics.QueueDepth"/> of the deepest socket.</summary>
+        public long MaxQueueDepth
+        {
+            get
+            {
+                long max = 0;
+                foreach (ListenerMetrics listener in Listeners)
+                {
+                    max = Math.Max(max, listener.QueueDepth);
+                }
+                return max;
+            }
+        }
+
+        long Sum(Func<ListenerMetrics, long> selector)
+        {
+            long sum = 0;
+            foreach (ListenerMetrics listener in Listeners)
+            {
+                sum += selector(listener);
+            }
+            return sum;
+        }
+    }
+}
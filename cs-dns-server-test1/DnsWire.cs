@@ -0,0 +1,497 @@
+﻿using System;
+using System.Buffers.Binary;
+
+namespace cs_dns_server_test1
+{
+    public enum DnsResponseCode : byte
+    {
+        NoError = 0,
+        FormatError = 1,
+        ServerFailure = 2,
+        NameError = 3,
+        NotImplemented = 4,
+        Refused = 5,
+    }
+
+    public enum DnsSection
+    {
+        Answer,
+        Authority,
+        Additional,
+    }
+
+    /// <summary>Answers a parsed query by adding records to <paramref name="response"/>.</summary>
+    public delegate void DnsQueryHandler(in DnsQuery query, ref DnsResponseWriter response);
+
+    /// <summary>
+    /// The header, the single question and the EDNS OPT record of a query, parsed in place: the spans point
+    /// into the received datagram and nothing else is copied or allocated.
+    /// </summary>
+    public readonly ref struct DnsQuery
+    {
+        public const int HeaderSize = 12;
+        public const ushort TypeOpt = 41;
+
+        /// <summary>The limit for a UDP answer to a query without EDNS, and the smallest one EDNS may ask for.</summary>
+        public const int MinUdpPayloadSize = 512;
+
+        /// <summary>The largest UDP answer we send, whatever the query's EDNS payload size (RFC 6891 section 6.2.5).</summary>
+        public const int MaxUdpPayloadSize = 4096;
+
+        /// <summary>The whole query datagram.</summary>
+        public readonly ReadOnlySpan<byte> Message;
+
+        /// <summary>The question exactly as received: name, type and class.</summary>
+        public readonly ReadOnlySpan<byte> Question;
+
+        /// <summary>The question name in wire format (length-prefixed labels and the root label), never compressed.</summary>
+        public readonly ReadOnlySpan<byte> Name;
+
+        public readonly ushort Id;
+        public readonly byte Opcode;
+        public readonly bool RecursionDesired;
+        public readonly bool CheckingDisabled;
+        public readonly ushort Type;
+        public readonly ushort Class;
+
+        public readonly bool HasEdns;
+        public readonly ushort EdnsUdpPayloadSize;
+        public readonly byte EdnsVersion;
+        public readonly bool DnssecOk;
+
+        /// <summary>The offset of the OPT record in <see cref="Message"/>, or -1.</summary>
+        public readonly int EdnsOffset;
+
+        DnsQuery(ReadOnlySpan<byte> message, int nameLength, bool hasEdns, ushort ednsUdpPayloadSize, byte ednsVersion, bool dnssecOk, int ednsOffset)
+        {
+            Message = message;
+            Question = message.Slice(HeaderSize, nameLength + 4);
+            Name = message.Slice(HeaderSize, nameLength);
+            Id = BinaryPrimitives.ReadUInt16BigEndian(message);
+            Opcode = (byte)((message[2] >> 3) & 0x0F);
+            RecursionDesired = (message[2] & 0x01) != 0;
+            CheckingDisabled = (message[3] & 0x10) != 0;
+            Type = BinaryPrimitives.ReadUInt16BigEndian(message.Slice(HeaderSize + nameLength));
+            Class = BinaryPrimitives.ReadUInt16BigEndian(message.Slice(HeaderSize + nameLength + 2));
+            HasEdns = hasEdns;
+            EdnsUdpPayloadSize = ednsUdpPayloadSize;
+            EdnsVersion = ednsVersion;
+            DnssecOk = dnssecOk;
+            EdnsOffset = ednsOffset;
+        }
+
+        /// <summary>The largest response this query allows over UDP.</summary>
+        public int MaxResponseSize => HasEdns ? Math.Clamp((int)EdnsUdpPayloadSize, MinUdpPayloadSize, MaxUdpPayloadSize) : MinUdpPayloadSize;
+
+        /// <summary>Whether the question name is <paramref name="wireName"/>, ignoring ASCII case.</summary>
+        public bool NameEquals(ReadOnlySpan<byte> wireName)
+        {
+            return DnsWire.NameEquals(Name, wireName);
+        }
+
+        /// <summary>
+        /// Parses a query with exactly one question. The answer and authority sections must be empty; the additional
+        /// section is only looked at for an OPT record.
+        /// </summary>
+        /// <returns>false if <paramref name="message"/> is not such a query.</returns>
+        public static bool TryParse(ReadOnlySpan<byte> message, out DnsQuery query)
+        {
+            query = default;
+            if (message.Length < HeaderSize || (message[2] & 0x80) != 0)
+            {
+                return false; // Too short, or a response.
+            }
+            if (BinaryPrimitives.ReadUInt16BigEndian(message.Slice(4)) != 1 ||
+                BinaryPrimitives.ReadUInt16BigEndian(message.Slice(6)) != 0 ||
+                BinaryPrimitives.ReadUInt16BigEndian(message.Slice(8)) != 0)
+            {
+                return false;
+            }
+
+            int nameLength = DnsWire.GetNameLength(message.Slice(HeaderSize), allowCompression: false);
+            if (nameLength < 0 || HeaderSize + nameLength + 4 > message.Length)
+            {
+                return false;
+            }
+
+            bool hasEdns = false;
+            ushort payloadSize = 0;
+            byte version = 0;
+            bool dnssecOk = false;
+            int ednsOffset = -1;
+
+            int offset = HeaderSize + nameLength + 4;
+            int additionalCount = BinaryPrimitives.ReadUInt16BigEndian(message.Slice(10));
+            for (int i = 0; i < additionalCount; i++)
+            {
+                int recordOffset = offset;
+                int ownerLength = DnsWire.GetNameLength(message.Slice(offset), allowCompression: true);
+                if (ownerLength < 0 || offset + ownerLength + 10 > message.Length)
+                {
+                    return false;
+                }
+                offset += ownerLength;
+
+                ushort type = BinaryPrimitives.ReadUInt16BigEndian(message.Slice(offset));
+                ushort @class = BinaryPrimitives.ReadUInt16BigEndian(message.Slice(offset + 2));
+                uint ttl = BinaryPrimitives.ReadUInt32BigEndian(message.Slice(offset + 4));
+                int dataLength = BinaryPrimitives.ReadUInt16BigEndian(message.Slice(offset + 8));
+                offset += 10 + dataLength;
+                if (offset > message.Length)
+                {
+                    return false;
+                }
+
+                if (type == TypeOpt)
+                {
+                    if (hasEdns || ownerLength != 1)
+                    {
+                        return false; // More than one OPT, or an OPT not owned by the root (RFC 6891 section 6.1.1).
+                    }
+                    hasEdns = true;
+                    payloadSize = @class;
+                    version = (byte)(ttl >> 16);
+                    dnssecOk = (ttl & 0x8000) != 0;
+                    ednsOffset = recordOffset;
+                }
+            }
+
+            query = new DnsQuery(message, nameLength, hasEdns, payloadSize, version, dnssecOk, ednsOffset);
+            return true;
+        }
+    }
+
+    /// <summary>
+    /// Writes a response straight into a send buffer: the header and the question copied from the query, then
+    /// records in section order, then an OPT record if the query had one. A record that does not fit in the
+    /// size the query allows is left out and the response is marked truncated.
+    /// </summary>
+    public ref struct DnsResponseWriter
+    {
+        /// <summary>A compression pointer to the question name, which always starts right after the header.</summary>
+        const ushort QuestionNamePointer = 0xC000 | DnsQuery.HeaderSize;
+
+        readonly Span<byte> buffer;
+        readonly ushort @class;
+        readonly bool addOpt;
+        readonly int limit;
+        int length;
+        DnsSection section;
+        ushort answerCount;
+        ushort authorityCount;
+        ushort additionalCount;
+
+        public DnsResponseWriter(Span<byte> buffer, in DnsQuery query)
+        {
+            this.buffer = buffer;
+            @class = query.Class;
+            addOpt = query.HasEdns;
+            limit = Math.Min(buffer.Length, query.MaxResponseSize) - (addOpt ? DnsWire.OptRecordSize : 0);
+            section = DnsSection.Answer;
+            answerCount = authorityCount = additionalCount = 0;
+
+            if (limit < DnsQuery.HeaderSize + query.Question.Length)
+            {
+                throw new ArgumentException("The buffer is too small for the question.", nameof(buffer));
+            }
+
+            BinaryPrimitives.WriteUInt16BigEndian(buffer, query.Id);
+            buffer[2] = (byte)(0x80 | (query.Opcode << 3) | (query.RecursionDesired ? 0x01 : 0));
+            buffer[3] = (byte)(query.CheckingDisabled ? 0x10 : 0);
+            BinaryPrimitives.WriteUInt16BigEndian(buffer.Slice(4), 1);
+            query.Question.CopyTo(buffer.Slice(DnsQuery.HeaderSize));
+            length = DnsQuery.HeaderSize + query.Question.Length;
+        }
+
+        public DnsResponseCode ResponseCode
+        {
+            get => (DnsResponseCode)(buffer[3] & 0x0F);
+            set => buffer[3] = (byte)((buffer[3] & 0xF0) | ((byte)value & 0x0F));
+        }
+
+        public bool Authoritative
+        {
+            get => (buffer[2] & 0x04) != 0;
+            set => buffer[2] = (byte)(value ? buffer[2] | 0x04 : buffer[2] & ~0x04);
+        }
+
+        public bool RecursionAvailable
+        {
+            get => (buffer[3] & 0x80) != 0;
+            set => buffer[3] = (byte)(value ? buffer[3] | 0x80 : buffer[3] & ~0x80);
+        }
+
+        public bool Truncated => (buffer[2] & 0x02) != 0;
+
+        /// <summary>Adds a record owned by the question name.</summary>
+        /// <returns>false if the record did not fit and the response is now truncated.</returns>
+        public bool AddRecord(DnsSection section, ushort type, uint ttl, ReadOnlySpan<byte> data)
+        {
+            return AddRecord(section, default, type, ttl, data);
+        }
+
+        /// <summary>Adds a record owned by <paramref name="wireName"/>, or by the question name if it is empty.</summary>
+        /// <returns>false if the record did not fit and the response is now truncated.</returns>
+        public bool AddRecord(DnsSection section, ReadOnlySpan<byte> wireName, ushort type, uint ttl, ReadOnlySpan<byte> data)
+        {
+            if (section < this.section)
+            {
+                throw new InvalidOperationException("Records must be added in section order.");
+            }
+            this.section = section;
+
+            if (Truncated)
+            {
+                return false;
+            }
+
+            int ownerLength = wireName.IsEmpty ? 2 : wireName.Length;
+            if (length + ownerLength + 10 + data.Length > limit)
+            {
+                buffer[2] |= 0x02;
+                return false;
+            }
+
+            Span<byte> record = buffer.Slice(length);
+            if (wireName.IsEmpty)
+            {
+                BinaryPrimitives.WriteUInt16BigEndian(record, QuestionNamePointer);
+            }
+            else
+            {
+                wireName.CopyTo(record);
+            }
+            record = record.Slice(ownerLength);
+            BinaryPrimitives.WriteUInt16BigEndian(record, type);
+            BinaryPrimitives.WriteUInt16BigEndian(record.Slice(2), @class);
+            BinaryPrimitives.WriteUInt32BigEndian(record.Slice(4), ttl);
+            BinaryPrimitives.WriteUInt16BigEndian(record.Slice(8), (ushort)data.Length);
+            data.CopyTo(record.Slice(10));
+            length += ownerLength + 10 + data.Length;
+
+            switch (section)
+            {
+                case DnsSection.Answer: answerCount++; break;
+                case DnsSection.Authority: authorityCount++; break;
+                default: additionalCount++; break;
+            }
+            return true;
+        }
+
+        /// <summary>Adds an A record for the question name.</summary>
+        public bool AddA(uint ttl, ReadOnlySpan<byte> address)
+        {
+            if (address.Length != 4) throw new ArgumentException("An IPv4 address is 4 bytes.", nameof(address));
+            return AddRecord(DnsSection.Answer, DnsWire.TypeA, ttl, address);
+        }
+
+        /// <summary>Adds an AAAA record for the question name.</summary>
+        public bool AddAaaa(uint ttl, ReadOnlySpan<byte> address)
+        {
+            if (address.Length != 16) throw new ArgumentException("An IPv6 address is 16 bytes.", nameof(address));
+            return AddRecord(DnsSection.Answer, DnsWire.TypeAaaa, ttl, address);
+        }
+
+        /// <summary>Writes the section counts and the OPT record.</summary>
+        /// <returns>The length of the response.</returns>
+        public int Finish()
+        {
+            if (addOpt)
+            {
+                length += DnsWire.WriteOptRecord(buffer.Slice(length));
+                additionalCount++;
+            }
+
+            BinaryPrimitives.WriteUInt16BigEndian(buffer.Slice(6), answerCount);
+            BinaryPrimitives.WriteUInt16BigEndian(buffer.Slice(8), authorityCount);
+            BinaryPrimitives.WriteUInt16BigEndian(buffer.Slice(10), additionalCount);
+            return length;
+        }
+    }
+
+    public static class DnsWire
+    {
+        public const ushort TypeA = 1;
+        public const ushort TypeNs = 2;
+        public const ushort TypeCname = 5;
+        public const ushort TypeSoa = 6;
+        public const ushort TypeMx = 15;
+        public const ushort TypeTxt = 16;
+        public const ushort TypeAaaa = 28;
+        public const ushort ClassIn = 1;
+
+        /// <summary>The EDNS payload size we advertise.</summary>
+        public const ushort UdpPayloadSize = 1232;
+
+        public const int OptRecordSize = 11;
+
+        const int MaxNameLength = 255;
+        const int MaxLabelLength = 63;
+
+        /// <summary>
+        /// Wraps <paramref name="handler"/> as a <see cref="DnsDatagramHandler"/>. Queries that are not a single
+        /// question get FORMERR, other opcodes than QUERY get NOTIMP, and anything that is not a query is dropped.
+        /// With a <paramref name="cache"/>, the handler only sees the queries the cache cannot answer, and its
+        /// answers are cached.
+        /// </summary>
+        public static DnsDatagramHandler CreateDatagramHandler(DnsQueryHandler handler, DnsResponseCache cache = null)
+        {
+            if (handler == null) throw new ArgumentNullException(nameof(handler));
+
+            return (ReadOnlySpan<byte> message, Span<byte> response) =>
+            {
+                if (!DnsQuery.TryParse(message, out DnsQuery query))
+                {
+                    return WriteHeaderOnly(message, response, DnsResponseCode.FormatError);
+                }
+
+                if (query.Opcode == 0 && cache != null)
+                {
+                    int cachedLength = cache.TryWrite(query, response);
+                    if (cachedLength != 0)
+                    {
+                        return cachedLength;
+                    }
+                }
+
+                var writer = new DnsResponseWriter(response, query);
+                if (query.Opcode != 0)
+                {
+                    writer.ResponseCode = DnsResponseCode.NotImplemented;
+                    return writer.Finish();
+                }
+
+                handler(query, ref writer);
+                int length = writer.Finish();
+                cache?.Add(query, response.Slice(0, length));
+                return length;
+            };
+        }
+
+        /// <summary>
+        /// Writes a response with no sections and <paramref name="responseCode"/>, for a message that could not be
+        /// parsed as a query.
+        /// </summary>
+        /// <returns>The length of the response, or 0 if <paramref name="message"/> is too short or not a query.</returns>
+        public static int WriteHeaderOnly(ReadOnlySpan<byte> message, Span<byte> response, DnsResponseCode responseCode)
+        {
+            if (message.Length < DnsQuery.HeaderSize || (message[2] & 0x80) != 0)
+            {
+                return 0;
+            }
+
+            message.Slice(0, DnsQuery.HeaderSize).CopyTo(response);
+            response[2] = (byte)(0x80 | (message[2] & 0x79)); // QR, keep OPCODE and RD
+            response[3] = (byte)responseCode;
+            response.Slice(4, 8).Clear();
+            return DnsQuery.HeaderSize;
+        }
+
+        /// <summary>
+        /// Gets the length of the wire-format name at the start of <paramref name="data"/>: its labels and the root
+        /// label, or up to and including a compression pointer if <paramref name="allowCompression"/>.
+        /// </summary>
+        /// <returns>The length, or -1 if the name is malformed or runs past the end of <paramref name="data"/>.</returns>
+        public static int GetNameLength(ReadOnlySpan<byte> data, bool allowCompression)
+        {
+            int offset = 0;
+            while (true)
+            {
+                if (offset >= data.Length)
+                {
+                    return -1;
+                }
+
+                int label = data[offset];
+                if (label == 0)
+                {
+                    offset++;
+                    return offset <= MaxNameLength ? offset : -1;
+                }
+                if ((label & 0xC0) == 0xC0)
+                {
+                    return allowCompression && offset + 2 <= data.Length ? offset + 2 : -1;
+                }
+                if (label > MaxLabelLength)
+                {
+                    return -1;
+                }
+
+                offset += 1 + label;
+                if (offset > MaxNameLength)
+                {
+                    return -1;
+                }
+            }
+        }
+
+        /// <summary>Compares two uncompressed wire-format names, ignoring ASCII case.</summary>
+        public static bool NameEquals(ReadOnlySpan<byte> x, ReadOnlySpan<byte> y)
+        {
+            if (x.Length != y.Length)
+            {
+                return false;
+            }
+            for (int i = 0; i < x.Length; i++)
+            {
+                // Length bytes are at most 63, so folding them like letters is harmless.
+                if (ToLower(x[i]) != ToLower(y[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// <summary>Encodes a dotted name such as "www.example.com" in wire format.</summary>
+        public static byte[] EncodeName(string name)
+        {
+            if (name == null) throw new ArgumentNullException(nameof(name));
+
+            name = name.TrimEnd('.');
+            var result = new byte[name.Length == 0 ? 1 : name.Length + 2];
+            int offset = 0;
+            if (name.Length != 0)
+            {
+                foreach (string label in name.Split('.'))
+                {
+                    if (label.Length == 0 || label.Length > MaxLabelLength)
+                    {
+                        throw new ArgumentException($"'{name}' has an empty or too long label.", nameof(name));
+                    }
+                    result[offset++] = (byte)label.Length;
+                    foreach (char c in label)
+                    {
+                        if (c > 0x7F) throw new ArgumentException($"'{name}' is not an ASCII name.", nameof(name));
+                        result[offset++] = (byte)c;
+                    }
+                }
+            }
+            result[offset] = 0;
+            if (result.Length > MaxNameLength)
+            {
+                throw new ArgumentException($"'{name}' is too long.", nameof(name));
+            }
+            return result;
+        }
+
+        /// <summary>
+        /// Writes an OPT record: root owner, our payload size, extended RCODE 0, version 0, no flags and no options.
+        /// </summary>
+        /// <returns><see cref="OptRecordSize"/>.</returns>
+        public static int WriteOptRecord(Span<byte> destination)
+        {
+            Span<byte> opt = destination.Slice(0, OptRecordSize);
+            opt[0] = 0;
+            BinaryPrimitives.WriteUInt16BigEndian(opt.Slice(1), DnsQuery.TypeOpt);
+            BinaryPrimitives.WriteUInt16BigEndian(opt.Slice(3), UdpPayloadSize);
+            opt.Slice(5).Clear();
+            return OptRecordSize;
+        }
+
+        internal static byte ToLower(byte b)
+        {
+            return (uint)(b - 'A') <= 'Z' - 'A' ? (byte)(b | 0x20) : b;
+        }
+    }
+}
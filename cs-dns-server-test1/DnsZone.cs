@@ -0,0 +1,159 @@
+﻿using System;
+using System.Buffers.Binary;
+
+namespace cs_dns_server_test1
+{
+    public enum DnsZoneMatch
+    {
+        /// <summary>Not under the zone: REFUSED.</summary>
+        OutOfZone,
+        /// <summary>The zone's own name, which has only the SOA: NODATA.</summary>
+        Apex,
+        /// <summary>One of the n{i} names.</summary>
+        Name,
+        /// <summary>Any other name under the zone: NXDOMAIN.</summary>
+        NoSuchName,
+    }
+
+    /// <summary>
+    /// The zone the fast path answers for with authority: "n0.zone" to "n{count-1}.zone" each have one A record, the
+    /// names cs-dns-load-test1's hit scenario asks for. Other names under the zone are NXDOMAIN and other types
+    /// NODATA, both with the zone's SOA for negative caching; names outside the zone are REFUSED. The index is parsed
+    /// out of the first label, so a lookup neither hashes nor allocates.
+    /// </summary>
+    public sealed class DnsZone
+    {
+        // Serial, refresh, retry, expire and minimum.
+        const int SoaTimersSize = 20;
+
+        readonly byte[] zoneName;
+        readonly byte[] addresses;
+        readonly byte[] soa;
+        readonly uint ttl;
+        readonly uint negativeTtl;
+
+        /// <param name="zone">The zone, such as "example.com".</param>
+        /// <param name="count">The number of "n{i}" names, at most 2^24: n{i} is 10.{i >> 16}.{i >> 8}.{i}.</param>
+        /// <param name="ttl">The TTL of the A records.</param>
+        /// <param name="negativeTtl">The TTL and the minimum of the SOA, which is how long NXDOMAIN and NODATA are cached.</param>
+        public DnsZone(string zone, int count, uint ttl = 300, uint negativeTtl = 60)
+        {
+            if (count < 0 || count > 1 << 24) throw new ArgumentOutOfRangeException(nameof(count));
+
+            Name = zone.TrimEnd('.');
+            Count = count;
+            zoneName = DnsWire.EncodeName(Name);
+            this.ttl = ttl;
+            this.negativeTtl = negativeTtl;
+
+            addresses = new byte[count * 4];
+            for (int i = 0; i < count; i++)
+            {
+                addresses[i * 4] = 10;
+                addresses[i * 4 + 1] = (byte)(i >> 16);
+                addresses[i * 4 + 2] = (byte)(i >> 8);
+                addresses[i * 4 + 3] = (byte)i;
+            }
+
+            byte[] primary = DnsWire.EncodeName("ns." + Name);
+            byte[] mailbox = DnsWire.EncodeName("hostmaster." + Name);
+            soa = new byte[primary.Length + mailbox.Length + SoaTimersSize];
+            primary.CopyTo(soa, 0);
+            mailbox.CopyTo(soa, primary.Length);
+            Span<byte> timers = soa.AsSpan(primary.Length + mailbox.Length);
+            BinaryPrimitives.WriteUInt32BigEndian(timers, 1);
+            BinaryPrimitives.WriteUInt32BigEndian(timers.Slice(4), 3600);
+            BinaryPrimitives.WriteUInt32BigEndian(timers.Slice(8), 600);
+            BinaryPrimitives.WriteUInt32BigEndian(timers.Slice(12), 86400);
+            BinaryPrimitives.WriteUInt32BigEndian(timers.Slice(16), negativeTtl);
+        }
+
+        public string Name { get; }
+
+        public int Count { get; }
+
+        public uint Ttl => ttl;
+
+        public uint NegativeTtl => negativeTtl;
+
+        /// <summary>The address of n{<paramref name="index"/>}.</summary>
+        public ReadOnlySpan<byte> GetAddress(int index) => new ReadOnlySpan<byte>(addresses, index * 4, 4);
+
+        /// <summary>Finds where the uncompressed wire-format <paramref name="name"/> is in the zone.</summary>
+        /// <param name="index">The i of n{i}, for <see cref="DnsZoneMatch.Name"/>.</param>
+        public DnsZoneMatch Match(ReadOnlySpan<byte> name, out int index)
+        {
+            index = -1;
+
+            // Walk the labels down to the length of the zone's name: comparing the tail at any other offset could
+            // match inside a label.
+            int offset = 0;
+            while (name.Length - offset > zoneName.Length)
+            {
+                offset += 1 + name[offset];
+            }
+            if (name.Length - offset != zoneName.Length || !DnsWire.NameEquals(name.Slice(offset), zoneName))
+            {
+                return DnsZoneMatch.OutOfZone;
+            }
+            if (offset == 0)
+            {
+                return DnsZoneMatch.Apex;
+            }
+            if (offset != 1 + name[0] || !TryParseIndex(name.Slice(1, name[0]), out index))
+            {
+                return DnsZoneMatch.NoSuchName;
+            }
+            return DnsZoneMatch.Name;
+        }
+
+        /// <summary>A <see cref="DnsQueryHandler"/>.</summary>
+        public void Answer(in DnsQuery query, ref DnsResponseWriter response)
+        {
+            int index = -1;
+            DnsZoneMatch match = query.Class == DnsWire.ClassIn ? Match(query.Name, out index) : DnsZoneMatch.OutOfZone;
+            if (match == DnsZoneMatch.OutOfZone)
+            {
+                response.ResponseCode = DnsResponseCode.Refused;
+                return;
+            }
+
+            response.Authoritative = true;
+            if (match == DnsZoneMatch.Name && query.Type == DnsWire.TypeA)
+            {
+                response.AddA(ttl, GetAddress(index));
+                return;
+            }
+            if (match == DnsZoneMatch.NoSuchName)
+            {
+                response.ResponseCode = DnsResponseCode.NameError;
+            }
+            AddSoa(ref response); // NXDOMAIN, or NODATA.
+        }
+
+        void AddSoa(ref DnsResponseWriter response)
+        {
+            response.AddRecord(DnsSection.Authority, zoneName, DnsWire.TypeSoa, negativeTtl, soa);
+        }
+
+        /// <summary>Parses "n" and a decimal number without leading zeros that is less than <see cref="Count"/>.</summary>
+        bool TryParseIndex(ReadOnlySpan<byte> label, out int index)
+        {
+            index = 0;
+            if (label.Length < 2 || label.Length > 9 || (label[0] | 0x20) != 'n' || (label[1] == '0' && label.Length > 2))
+            {
+                return false;
+            }
+            for (int i = 1; i < label.Length; i++)
+            {
+                int digit = label[i] - '0';
+                if ((uint)digit > 9)
+                {
+                    return false;
+                }
+                index = index * 10 + digit;
+            }
+            return index < Count;
+        }
+    }
+}
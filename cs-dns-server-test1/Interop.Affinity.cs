@@ -0,0 +1,19 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        /// <summary>Room for 1024 CPUs, like glibc's cpu_set_t.</summary>
+        internal const int CpuSetSize = 128;
+
+        /// <summary>Gets the CPUs the calling thread may run on.</summary>
+        [DllImport(Libraries.Libc, EntryPoint = "sched_getaffinity", SetLastError = true)]
+        internal static extern unsafe int SchedGetAffinity(int pid, nint cpuSetSize, byte* mask);
+
+        /// <summary>Restricts the calling thread (pid 0) to the CPUs in <paramref name="mask"/>.</summary>
+        [DllImport(Libraries.Libc, EntryPoint = "sched_setaffinity", SetLastError = true)]
+        internal static extern unsafe int SchedSetAffinity(int pid, nint cpuSetSize, byte* mask);
+    }
+}
@@ -0,0 +1,103 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Libraries
+    {
+        internal const string Libc = "libc";
+    }
+
+    internal static partial class Sys
+    {
+        internal const int AF_INET = 2;
+        internal const int AF_INET6 = 10;
+        internal const int SOCK_DGRAM = 2;
+        internal const int SOCK_CLOEXEC = 0x80000;
+        internal const int SOL_SOCKET = 1;
+        internal const int SO_RCVBUF = 8;
+        internal const int SO_SNDBUF = 7;
+        internal const int SO_REUSEPORT = 15;
+        internal const int SO_RXQ_OVFL = 40;
+        internal const int IPPROTO_IPV6 = 41;
+        internal const int IPV6_V6ONLY = 26;
+        internal const int MSG_WAITFORONE = 0x10000;
+        internal const int MSG_DONTWAIT = 0x40;
+        internal const int SHUT_RDWR = 2;
+
+        internal const int EINTR = 4;
+        internal const int EAGAIN = 11;
+
+        /// <summary>Big enough for a sockaddr_in6.</summary>
+        internal const int SocketAddressSize = 28;
+
+        [StructLayout(LayoutKind.Sequential)]
+        internal unsafe struct IOVector
+        {
+            internal byte* Base;
+            internal nuint Count;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        internal unsafe struct MessageHeader
+        {
+            internal byte* SocketAddress;
+            internal uint SocketAddressLen;
+            internal IOVector* IOVectors;
+            internal nuint IOVectorCount;
+            internal byte* ControlBuffer;
+            internal nuint ControlBufferLen;
+            internal int Flags;
+        }
+
+        /// <summary>struct cmsghdr, followed by the data.</summary>
+        [StructLayout(LayoutKind.Sequential)]
+        internal struct ControlMessageHeader
+        {
+            internal nuint Length;
+            internal int Level;
+            internal int Type;
+        }
+
+        /// <summary>CMSG_SPACE(sizeof(uint)): a header and one 32-bit value, padded to 8 bytes.</summary>
+        internal const int ControlMessageUInt32Space = 24;
+
+        /// <summary>struct mmsghdr: a message header plus the number of bytes the kernel moved for it.</summary>
+        [StructLayout(LayoutKind.Sequential)]
+        internal struct MultiMessageHeader
+        {
+            internal MessageHeader Header;
+            internal uint Length;
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "socket", SetLastError = true)]
+        internal static extern int Socket(int domain, int type, int protocol);
+
+        [DllImport(Libraries.Libc, EntryPoint = "setsockopt", SetLastError = true)]
+        internal static extern unsafe int SetSockOpt(int socket, int level, int option, int* value, int valueLen);
+
+        [DllImport(Libraries.Libc, EntryPoint = "bind", SetLastError = true)]
+        internal static extern unsafe int Bind(int socket, byte* address, int addressLen);
+
+        /// <summary>Receives up to <paramref name="count"/> datagrams in one call.</summary>
+        /// <returns>The number of datagrams received, or -1 on error.</returns>
+        [DllImport(Libraries.Libc, EntryPoint = "recvmmsg", SetLastError = true)]
+        internal static extern unsafe int ReceiveMultipleMessages(int socket, MultiMessageHeader* messages, uint count, int flags, IntPtr timeout);
+
+        /// <summary>Sends up to <paramref name="count"/> datagrams in one call.</summary>
+        /// <returns>The number of datagrams sent, or -1 on error.</returns>
+        [DllImport(Libraries.Libc, EntryPoint = "sendmmsg", SetLastError = true)]
+        internal static extern unsafe int SendMultipleMessages(int socket, MultiMessageHeader* messages, uint count, int flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "shutdown", SetLastError = true)]
+        internal static extern int Shutdown(int socket, int how);
+
+        [DllImport(Libraries.Libc, EntryPoint = "close", SetLastError = true)]
+        internal static extern int Close(int fd);
+
+        internal static unsafe int SetSockOpt(int socket, int level, int option, int value)
+        {
+            return SetSockOpt(socket, level, option, &value, sizeof(int));
+        }
+    }
+}
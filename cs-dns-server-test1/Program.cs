@@ -1,30 +1,178 @@
 ﻿using System;
 using System.Net;
+using System.Threading;
 using System.Threading.Tasks;
 using ARSoft.Tools.Net;
 using ARSoft.Tools.Net.Dns;
+using cs_instrumentation;
 
 namespace cs_dns_server_test1
 {
     class Program
     {
+        // --quiet: no queries-per-second line on the console.
+        static bool quiet;
+
+        static ListenerMetrics arsoftMetrics;
+
+        static DnsZone zone;
+        static SoaRecord zoneSoa;
+
         static void Main(string[] args)
         {
-            DnsServer svr = new DnsServer(new IPEndPoint(IPAddress.Any, 54), 256, 0);
+            bool reusePort = false;
+            int metricsPort = 0;
+            // The DnsServer concurrency: pending UDP receives and TCP accepts. TCP is off unless asked for.
+            int udpListeners = 256;
+            int tcpListeners = 0;
+            // The fast path's zone; the defaults are the names cs-dns-load-test1 asks for.
+            string zoneName = "example.com";
+            int zoneNames = 1000;
+            for (int i = 0; i < args.Length; i++)
+            {
+                switch (args[i])
+                {
+                    case "reuseport": reusePort = true; break;
+                    case "--quiet": quiet = true; break;
+                    case "--metrics-port": metricsPort = int.Parse(args[++i]); break;
+                    case "--udp-listeners": udpListeners = int.Parse(args[++i]); break;
+                    case "--tcp-listeners": tcpListeners = int.Parse(args[++i]); break;
+                    case "--zone": zoneName = args[++i]; break;
+                    case "--names": zoneNames = int.Parse(args[++i]); break;
+                    default:
+                        Console.Error.WriteLine("usage: cs-dns-server-test1 [reuseport] [--quiet] [--metrics-port <port>] [--udp-listeners <n>] [--tcp-listeners <n>] [--zone <name>] [--names <n>]");
+                        return;
+                }
+            }
+
+            zone = new DnsZone(zoneName, zoneNames);
+            zoneSoa = new SoaRecord(DomainName.Parse(zone.Name), (int)zone.NegativeTtl, DomainName.Parse("ns." + zone.Name),
+                DomainName.Parse("hostmaster." + zone.Name), 1, 3600, 600, 86400, (int)zone.NegativeTtl);
+            DnsResponseCache cache = reusePort ? new DnsResponseCache() : null;
+            MetricRegistry registry = new MetricRegistry("DnsServerTest");
+            DnsServerMetrics metrics = new DnsServerMetrics(cache, registry);
+
+            // dotnet-counters monitor -n cs-dns-server-test1 --counters DnsServerTest, or scrape http://host:port/metrics,
+            // or DN_METRICS_JSON=<file> for the same numbers as JSON lines.
+            using (MetricsEventSource eventSource = new MetricsEventSource(registry))
+            using (MetricsJsonWriter json = MetricsJsonWriter.FromEnvironment(registry))
+            using (DnsMetricsExporter exporter = new DnsMetricsExporter(metrics, metricsPort))
+            {
+                if (!quiet)
+                {
+                    StartConsoleReport(metrics);
+                }
+
+                if (reusePort)
+                {
+                    // One SO_REUSEPORT socket and pinned recvmmsg/sendmmsg loop per CPU.
+                    using (ReusePortDnsServer fast = new ReusePortDnsServer(new IPEndPoint(IPAddress.Any, 54),
+                        DnsWire.CreateDatagramHandler(Fast_QueryReceived, cache), metrics: metrics))
+                    {
+                        fast.Start();
 
-            svr.Start();
+                        Console.Write(">");
+                        Console.ReadLine();
 
-            svr.QueryReceived += Svr_QueryReceived;
+                        fast.Stop();
+                    }
+                    return;
+                }
 
-            Console.Write(">");
-            Console.ReadLine();
+                arsoftMetrics = metrics.GetOrAddListener("arsoft");
 
-            svr.Stop();
+                DnsServer svr = new DnsServer(new IPEndPoint(IPAddress.Any, 54), udpListeners, tcpListeners);
+
+                svr.Start();
+
+                svr.QueryReceived += Svr_QueryReceived;
+
+                Console.Write(">");
+                Console.ReadLine();
+
+                svr.Stop();
+            }
+        }
+
+        // DnsServer's own parsing and writing happen outside of the handler, so the ARSoft listener only counts
+        // queries, once the response is set.
+        private static Task Svr_QueryReceived(object sender, QueryReceivedEventArgs eventArgs)
+        {
+            if (eventArgs.Query is DnsMessage query)
+            {
+                eventArgs.Response = AnswerFromZone(query);
+            }
+            arsoftMetrics.RecordQuery(eventArgs.Response != null);
+            return Task.CompletedTask;
+        }
+
+        // What DnsZone.Answer writes on the fast path, as a DnsMessage.
+        static DnsMessage AnswerFromZone(DnsMessage query)
+        {
+            DnsMessage response = query.CreateResponseInstance();
+            if (response.Questions.Count != 1)
+            {
+                response.ReturnCode = ReturnCode.FormatError;
+                return response;
+            }
+
+            DnsQuestion question = response.Questions[0];
+            DnsZoneMatch match = DnsZoneMatch.OutOfZone;
+            int index = -1;
+            if (question.RecordClass == RecordClass.INet)
+            {
+                try
+                {
+                    match = zone.Match(DnsWire.EncodeName(question.Name.ToString()), out index);
+                }
+                catch (ArgumentException)
+                {
+                    // Not an ASCII name: not one of ours.
+                }
+            }
+            if (match == DnsZoneMatch.OutOfZone)
+            {
+                response.ReturnCode = ReturnCode.Refused;
+                return response;
+            }
+
+            response.IsAuthoritiveAnswer = true;
+            if (match == DnsZoneMatch.Name && question.RecordType == RecordType.A)
+            {
+                response.AnswerRecords.Add(new ARecord(question.Name, (int)zone.Ttl, new IPAddress(zone.GetAddress(index))));
+                return response;
+            }
+            response.ReturnCode = match == DnsZoneMatch.NoSuchName ? ReturnCode.NxDomain : ReturnCode.NoError;
+            response.AuthorityRecords.Add(zoneSoa);
+            return response;
+        }
+
+        // A line a second from the counters, rather than a line per query: the console's lock would serialize the
+        // handlers and its writes would be most of what they measure.
+        static void StartConsoleReport(DnsServerMetrics metrics)
+        {
+            new Thread(() =>
+            {
+                long lastReceived = 0, lastAnswered = 0;
+                while (true)
+                {
+                    Thread.Sleep(1000);
+                    long received = metrics.Received, answered = metrics.Answered;
+                    if (received != lastReceived)
+                    {
+                        Console.WriteLine($"{received - lastReceived} queries/s, {answered - lastAnswered} answers/s");
+                    }
+                    lastReceived = received;
+                    lastAnswered = answered;
+                }
+            })
+            { IsBackground = true, Name = "Console Report" }.Start();
         }
 
-        private static async Task Svr_QueryReceived(object sender, QueryReceivedEventArgs eventArgs)
+        // n{i}.zone has an A record, see DnsZone; the cache keeps the answers.
+        private static void Fast_QueryReceived(in DnsQuery query, ref DnsResponseWriter response)
         {
-            Console.WriteLine("a");
+            zone.Answer(query, ref response);
         }
     }
 }
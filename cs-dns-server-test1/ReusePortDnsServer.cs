@@ -0,0 +1,399 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.ComponentModel;
+using System.Diagnostics;
+using System.Net;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+namespace cs_dns_server_test1
+{
+    /// <summary>Answers one UDP query by writing the response datagram to <paramref name="response"/>.</summary>
+    /// <returns>The length of the response, or 0 to send nothing.</returns>
+    public delegate int DnsDatagramHandler(ReadOnlySpan<byte> query, Span<byte> response);
+
+    /// <summary>
+    /// A UDP front end for Linux that binds one SO_REUSEPORT socket per CPU, so the kernel spreads the queries
+    /// over them, and serves each socket from a thread pinned to its CPU. Datagrams are received and sent in
+    /// batches with recvmmsg/sendmmsg, out of buffers allocated once per socket, and each query is answered by a
+    /// synchronous <see cref="DnsDatagramHandler"/> on the receiving thread, so nothing is allocated per query.
+    /// With <see cref="DnsServerMetrics"/>, each socket times its handler calls and answers and counts its
+    /// batches and drops, named by its index.
+    /// </summary>
+    public sealed class ReusePortDnsServer : IDisposable
+    {
+        /// <summary>The receive and send slot size; larger queries are truncated by the kernel.</summary>
+        public const int MaxDatagramSize = 4096;
+
+        public const int DefaultBatchSize = 64;
+
+        const int SocketReceiveBufferSize = 4 * 1024 * 1024;
+
+        readonly IPEndPoint endPoint;
+        readonly DnsDatagramHandler handler;
+        readonly int socketCount;
+        readonly int batchSize;
+        readonly DnsServerMetrics metrics;
+        Listener[] listeners;
+        volatile bool stopping;
+
+        /// <param name="socketCount">The number of sockets, or 0 for one per CPU this process may run on.</param>
+        public ReusePortDnsServer(IPEndPoint endPoint, DnsDatagramHandler handler, int socketCount = 0, int batchSize = DefaultBatchSize,
+            DnsServerMetrics metrics = null)
+        {
+            if (!RuntimeInformation.IsOSPlatform(OSPlatform.Linux))
+            {
+                throw new PlatformNotSupportedException("SO_REUSEPORT load balancing and recvmmsg require Linux.");
+            }
+            if (batchSize <= 0) throw new ArgumentOutOfRangeException(nameof(batchSize));
+            if (socketCount < 0) throw new ArgumentOutOfRangeException(nameof(socketCount));
+
+            this.endPoint = endPoint ?? throw new ArgumentNullException(nameof(endPoint));
+            this.handler = handler ?? throw new ArgumentNullException(nameof(handler));
+            this.socketCount = socketCount;
+            this.batchSize = batchSize;
+            this.metrics = metrics;
+        }
+
+        public int SocketCount => listeners?.Length ?? 0;
+
+        public void Start()
+        {
+            if (listeners != null) throw new InvalidOperationException("The server is already started.");
+
+            int[] cpus = GetAllowedCpus();
+            var started = new Listener[socketCount != 0 ? socketCount : cpus.Length];
+
+            // Bind every socket before starting any thread, so a bind error leaves nothing running.
+            try
+            {
+                for (int i = 0; i < started.Length; i++)
+                {
+                    started[i] = new Listener(this, OpenSocket(endPoint), cpus[i % cpus.Length],
+                        metrics?.GetOrAddListener(i.ToString(CultureInfo.InvariantCulture)));
+                }
+            }
+            catch
+            {
+                foreach (Listener listener in started)
+                {
+                    listener?.CloseSocket();
+                }
+                throw;
+            }
+
+            stopping = false;
+            listeners = started;
+            for (int i = 0; i < started.Length; i++)
+            {
+                started[i].Start(i);
+            }
+        }
+
+        public void Stop()
+        {
+            Listener[] running = listeners;
+            if (running == null) return;
+
+            // shutdown() wakes up a thread blocked in recvmmsg, even on an unconnected UDP socket.
+            stopping = true;
+            foreach (Listener listener in running)
+            {
+                Interop.Sys.Shutdown(listener.Socket, Interop.Sys.SHUT_RDWR);
+            }
+            foreach (Listener listener in running)
+            {
+                listener.Join();
+                listener.CloseSocket();
+            }
+            listeners = null;
+        }
+
+        public void Dispose()
+        {
+            Stop();
+        }
+
+        static unsafe int OpenSocket(IPEndPoint endPoint)
+        {
+            bool isV6 = endPoint.AddressFamily == AddressFamily.InterNetworkV6;
+            int socket = Interop.Sys.Socket(isV6 ? Interop.Sys.AF_INET6 : Interop.Sys.AF_INET,
+                Interop.Sys.SOCK_DGRAM | Interop.Sys.SOCK_CLOEXEC, 0);
+            if (socket < 0) throw new Win32Exception(Marshal.GetLastWin32Error());
+
+            try
+            {
+                if (Interop.Sys.SetSockOpt(socket, Interop.Sys.SOL_SOCKET, Interop.Sys.SO_REUSEPORT, 1) != 0)
+                {
+                    throw new Win32Exception(Marshal.GetLastWin32Error());
+                }
+                if (isV6 && endPoint.Address.Equals(IPAddress.IPv6Any))
+                {
+                    Interop.Sys.SetSockOpt(socket, Interop.Sys.IPPROTO_IPV6, Interop.Sys.IPV6_V6ONLY, 0);
+                }
+
+                // Best effort: the kernel caps this at net.core.rmem_max.
+                Interop.Sys.SetSockOpt(socket, Interop.Sys.SOL_SOCKET, Interop.Sys.SO_RCVBUF, SocketReceiveBufferSize);
+
+                // Have recvmmsg report how many datagrams the full receive queue dropped.
+                Interop.Sys.SetSockOpt(socket, Interop.Sys.SOL_SOCKET, Interop.Sys.SO_RXQ_OVFL, 1);
+
+                byte* address = stackalloc byte[Interop.Sys.SocketAddressSize];
+                int addressLength = WriteSocketAddress(endPoint, address);
+                if (Interop.Sys.Bind(socket, address, addressLength) != 0)
+                {
+                    throw new Win32Exception(Marshal.GetLastWin32Error());
+                }
+                return socket;
+            }
+            catch
+            {
+                Interop.Sys.Close(socket);
+                throw;
+            }
+        }
+
+        /// <summary>Writes a sockaddr_in or sockaddr_in6 for <paramref name="endPoint"/> and returns its length.</summary>
+        static unsafe int WriteSocketAddress(IPEndPoint endPoint, byte* address)
+        {
+            new Span<byte>(address, Interop.Sys.SocketAddressSize).Clear();
+            address[2] = (byte)(endPoint.Port >> 8);
+            address[3] = (byte)endPoint.Port;
+
+            if (endPoint.AddressFamily == AddressFamily.InterNetworkV6)
+            {
+                *(ushort*)address = Interop.Sys.AF_INET6;
+                endPoint.Address.TryWriteBytes(new Span<byte>(address + 8, 16), out _);
+                *(uint*)(address + 24) = (uint)endPoint.Address.ScopeId;
+                return 28;
+            }
+
+            *(ushort*)address = Interop.Sys.AF_INET;
+            endPoint.Address.TryWriteBytes(new Span<byte>(address + 4, 4), out _);
+            return 16;
+        }
+
+        /// <summary>Gets the CPUs this process may run on, in order.</summary>
+        static unsafe int[] GetAllowedCpus()
+        {
+            byte* mask = stackalloc byte[Interop.Sys.CpuSetSize];
+            var cpus = new List<int>();
+            if (Interop.Sys.SchedGetAffinity(0, Interop.Sys.CpuSetSize, mask) == 0)
+            {
+                for (int cpu = 0; cpu < Interop.Sys.CpuSetSize * 8; cpu++)
+                {
+                    if ((mask[cpu / 8] & (1 << (cpu % 8))) != 0) cpus.Add(cpu);
+                }
+            }
+            if (cpus.Count == 0)
+            {
+                for (int cpu = 0; cpu < Environment.ProcessorCount; cpu++) cpus.Add(cpu);
+            }
+            return cpus.ToArray();
+        }
+
+        /// <summary>One socket and the pinned thread that serves it.</summary>
+        sealed class Listener
+        {
+            readonly ReusePortDnsServer owner;
+            readonly int cpu;
+            readonly ListenerMetrics metrics;
+            Thread thread;
+            bool handlerErrorLogged;
+
+            public Listener(ReusePortDnsServer owner, int socket, int cpu, ListenerMetrics metrics)
+            {
+                this.owner = owner;
+                this.cpu = cpu;
+                this.metrics = metrics;
+                Socket = socket;
+            }
+
+            public int Socket { get; private set; }
+
+            public void Start(int index)
+            {
+                thread = new Thread(Run) { IsBackground = true, Name = $"DNS Listener #{index} (CPU {cpu})" };
+                thread.Start();
+            }
+
+            public void Join()
+            {
+                thread?.Join();
+            }
+
+            public void CloseSocket()
+            {
+                if (Socket >= 0)
+                {
+                    Interop.Sys.Close(Socket);
+                    Socket = -1;
+                }
+            }
+
+            unsafe void Run()
+            {
+                PinToCpu();
+
+                int batch = owner.batchSize;
+                DnsDatagramHandler handler = owner.handler;
+
+                // One block per listener: the receive and send headers and vectors, the peer addresses, the
+                // SO_RXQ_OVFL control messages and the datagram slots. The received peer addresses are reused as the
+                // destinations of the answers.
+                int headersSize = batch * sizeof(Interop.Sys.MultiMessageHeader);
+                int vectorsSize = batch * sizeof(Interop.Sys.IOVector);
+                int addressesSize = batch * Interop.Sys.SocketAddressSize;
+                int controlSize = batch * Interop.Sys.ControlMessageUInt32Space;
+                int slotsSize = batch * MaxDatagramSize;
+                IntPtr block = Marshal.AllocHGlobal(2 * headersSize + 2 * vectorsSize + addressesSize + controlSize + 2 * slotsSize);
+                try
+                {
+                    var rxHeaders = (Interop.Sys.MultiMessageHeader*)block;
+                    var txHeaders = (Interop.Sys.MultiMessageHeader*)((byte*)rxHeaders + headersSize);
+                    var rxVectors = (Interop.Sys.IOVector*)((byte*)txHeaders + headersSize);
+                    var txVectors = (Interop.Sys.IOVector*)((byte*)rxVectors + vectorsSize);
+                    byte* addresses = (byte*)txVectors + vectorsSize;
+                    byte* controls = addresses + addressesSize;
+                    byte* rxSlots = controls + controlSize;
+                    byte* txSlots = rxSlots + slotsSize;
+
+                    for (int i = 0; i < batch; i++)
+                    {
+                        rxVectors[i].Base = rxSlots + i * MaxDatagramSize;
+                        rxVectors[i].Count = MaxDatagramSize;
+                        rxHeaders[i] = default;
+                        rxHeaders[i].Header.IOVectors = &rxVectors[i];
+                        rxHeaders[i].Header.IOVectorCount = 1;
+
+                        txVectors[i].Base = txSlots + i * MaxDatagramSize;
+                        txHeaders[i] = default;
+                        txHeaders[i].Header.IOVectors = &txVectors[i];
+                        txHeaders[i].Header.IOVectorCount = 1;
+                    }
+
+                    while (!owner.stopping)
+                    {
+                        for (int i = 0; i < batch; i++)
+                        {
+                            rxHeaders[i].Header.SocketAddress = addresses + i * Interop.Sys.SocketAddressSize;
+                            rxHeaders[i].Header.SocketAddressLen = Interop.Sys.SocketAddressSize;
+                            rxHeaders[i].Header.ControlBuffer = metrics != null ? controls + i * Interop.Sys.ControlMessageUInt32Space : null;
+                            rxHeaders[i].Header.ControlBufferLen = metrics != null ? (nuint)Interop.Sys.ControlMessageUInt32Space : 0;
+                            rxHeaders[i].Header.Flags = 0;
+                        }
+
+                        // Blocks for the first datagram, then takes whatever else is already queued.
+                        int received = Interop.Sys.ReceiveMultipleMessages(Socket, rxHeaders, (uint)batch, Interop.Sys.MSG_WAITFORONE, IntPtr.Zero);
+                        if (owner.stopping)
+                        {
+                            break; // The shutdown() that woke us up also shows up as an empty datagram.
+                        }
+                        if (received <= 0)
+                        {
+                            if (received == 0) break;
+                            int errno = Marshal.GetLastWin32Error();
+                            if (errno == Interop.Sys.EINTR || errno == Interop.Sys.EAGAIN) continue;
+                            Console.Error.WriteLine($"recvmmsg: {new Win32Exception(errno).Message}");
+                            break;
+                        }
+
+                        long receivedAt = metrics != null ? Stopwatch.GetTimestamp() : 0;
+                        int answers = 0;
+                        int handlerErrors = 0;
+                        int sendErrors = 0;
+                        for (int i = 0; i < received; i++)
+                        {
+                            var query = new ReadOnlySpan<byte>(rxVectors[i].Base, (int)rxHeaders[i].Length);
+                            int length;
+                            try
+                            {
+                                long start = metrics != null ? Stopwatch.GetTimestamp() : 0;
+                                length = handler(query, new Span<byte>(txVectors[answers].Base, MaxDatagramSize));
+                                if (metrics != null) metrics.Handler.RecordTicks(Stopwatch.GetTimestamp() - start);
+                            }
+                            catch (Exception ex)
+                            {
+                                // Only the first one: a handler that throws on every query would otherwise put the
+                                // console's lock on the hot path of every listener. The metrics count the rest.
+                                if (!handlerErrorLogged)
+                                {
+                                    handlerErrorLogged = true;
+                                    Console.Error.WriteLine(ex);
+                                }
+                                handlerErrors++;
+                                length = 0;
+                            }
+                            if (length <= 0) continue;
+
+                            txVectors[answers].Count = (nuint)length;
+                            txHeaders[answers].Header.SocketAddress = rxHeaders[i].Header.SocketAddress;
+                            txHeaders[answers].Header.SocketAddressLen = rxHeaders[i].Header.SocketAddressLen;
+                            answers++;
+                        }
+
+                        for (int sent = 0; sent < answers;)
+                        {
+                            int n = Interop.Sys.SendMultipleMessages(Socket, txHeaders + sent, (uint)(answers - sent), 0);
+                            if (n > 0)
+                            {
+                                sent += n;
+                            }
+                            else if (n < 0 && Marshal.GetLastWin32Error() == Interop.Sys.EINTR)
+                            {
+                                continue;
+                            }
+                            else
+                            {
+                                sent++; // Drop the datagram the kernel refused (ENOBUFS, unreachable peer...).
+                                sendErrors++;
+                            }
+                        }
+
+                        if (metrics != null)
+                        {
+                            metrics.ReceiveToSend.RecordTicks(Stopwatch.GetTimestamp() - receivedAt, answers - sendErrors);
+                            metrics.RecordBatch(received, answers - sendErrors, received - answers - handlerErrors, handlerErrors, sendErrors);
+                            RecordKernelDrops(rxHeaders, received);
+                        }
+                    }
+                }
+                finally
+                {
+                    Marshal.FreeHGlobal(block);
+                }
+            }
+
+            /// <summary>Picks up the latest SO_RXQ_OVFL total, which the kernel stamps on the datagrams queued after a drop.</summary>
+            unsafe void RecordKernelDrops(Interop.Sys.MultiMessageHeader* headers, int count)
+            {
+                for (int i = count - 1; i >= 0; i--)
+                {
+                    if (headers[i].Header.ControlBufferLen < (nuint)(sizeof(Interop.Sys.ControlMessageHeader) + sizeof(uint)))
+                    {
+                        continue;
+                    }
+
+                    var control = (Interop.Sys.ControlMessageHeader*)headers[i].Header.ControlBuffer;
+                    if (control->Level == Interop.Sys.SOL_SOCKET && control->Type == Interop.Sys.SO_RXQ_OVFL)
+                    {
+                        metrics.SetKernelDrops(*(uint*)(control + 1));
+                        return;
+                    }
+                }
+            }
+
+            unsafe void PinToCpu()
+            {
+                byte* mask = stackalloc byte[Interop.Sys.CpuSetSize];
+                new Span<byte>(mask, Interop.Sys.CpuSetSize).Clear();
+                mask[cpu / 8] = (byte)(1 << (cpu % 8));
+
+                // Pid 0 is the calling thread. Not being pinned only costs locality, so failures are ignored.
+                Interop.Sys.SchedSetAffinity(0, Interop.Sys.CpuSetSize, mask);
+            }
+        }
+    }
+}
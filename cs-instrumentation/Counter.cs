@@ -0,0 +1,118 @@
+﻿using System;
+using System.Threading;
+
+namespace cs_instrumentation
+{
+    /// <summary>
+    /// A count that many threads add to at once. Each add is one interlocked add to a cell of the current processor,
+    /// each cell in a cache line (and the one next to it, which the CPU prefetches together) of its own, so that
+    /// threads on different cores do not contend; reading sums the cells. Monotonic unless given negative values.
+    /// A counter can also export a total kept elsewhere, read from a callback.
+    /// </summary>
+    public sealed class Counter
+    {
+        // Longs per cell: 128 bytes.
+        const int CellStride = 16;
+
+        readonly long[] cells;
+        readonly int cellMask;
+        readonly Func<long> read;
+
+        public Counter(string name, string displayName = null, Func<long> read = null)
+        {
+            Name = name;
+            DisplayName = displayName ?? name;
+            this.read = read;
+
+            int cellCount = 1;
+            while (cellCount < Environment.ProcessorCount && cellCount < 64)
+            {
+                cellCount <<= 1;
+            }
+            cellMask = cellCount - 1;
+            // One more cell: the first one shares its line with the array header.
+            cells = new long[(cellCount + 1) * CellStride];
+        }
+
+        public string Name { get; }
+
+        public string DisplayName { get; }
+
+        public void Increment()
+        {
+            Interlocked.Increment(ref cells[CellIndex()]);
+        }
+
+        public void Add(long value)
+        {
+            Interlocked.Add(ref cells[CellIndex()], value);
+        }
+
+        public long Value
+        {
+            get
+            {
+                if (read != null)
+                {
+                    return read();
+                }
+
+                long sum = 0;
+                for (int i = CellStride; i < cells.Length; i += CellStride)
+                {
+                    sum += Volatile.Read(ref cells[i]);
+                }
+                return sum;
+            }
+        }
+
+        int CellIndex()
+        {
+#if NET5_0_OR_GREATER
+            // Cached by the runtime and refreshed every few calls, so it costs a few nanoseconds.
+            int cell = Thread.GetCurrentProcessorId();
+#else
+            // Still spreads the threads, only without following them from core to core.
+            int cell = Environment.CurrentManagedThreadId;
+#endif
+            return ((cell & cellMask) + 1) * CellStride;
+        }
+
+        public override string ToString() => $"{Name} = {Value}";
+    }
+
+    /// <summary>A value that goes up and down, set by the code or read from a callback when it is exported.</summary>
+    public sealed class Gauge
+    {
+        readonly Func<double> read;
+        long value;
+
+        public Gauge(string name, string displayName = null, string units = null, Func<double> read = null)
+        {
+            Name = name;
+            DisplayName = displayName ?? name;
+            Units = units;
+            this.read = read;
+        }
+
+        public string Name { get; }
+
+        public string DisplayName { get; }
+
+        public string Units { get; }
+
+        public void Set(long value)
+        {
+            Volatile.Write(ref this.value, value);
+        }
+
+        public void Add(long delta)
+        {
+            Interlocked.Add(ref value, delta);
+        }
+
+        public double Value => read != null ? read() : Volatile.Read(ref value);
+
+        public override string ToString() => $"{Name} = {Value}";
+    }
+}
@@ -0,0 +1,77 @@
+﻿using System;
+using System.Diagnostics.Tracing;
+using System.Threading;
+
+namespace cs_instrumentation
+{
+    /// <summary>
+    /// Records how long the runtime suspends the managed threads for each GC, from its own events (from the start of
+    /// the suspension to the end of the restart), into the "gc-pause" histogram of a registry. Works the same on
+    /// .NET Core 3.1 and .NET 5, which have no API for the pause times; the events are dispatched on a thread of
+    /// the runtime's, after the fact, so the pauses themselves are not made any longer.
+    /// </summary>
+    public sealed class GcPauseRecorder : EventListener
+    {
+        const string RuntimeEventSource = "Microsoft-Windows-DotNETRuntime";
+        const EventKeywords GcKeyword = (EventKeywords)0x1;
+        const int GCRestartEEEnd = 3;
+        const int GCSuspendEEBegin = 9;
+
+        readonly LatencyHistogram histogram;
+        EventSource runtime;
+        DateTime suspendStarted;
+        long totalPauseTicks;
+
+        GcPauseRecorder(MetricRegistry registry)
+        {
+            histogram = registry.GetHistogram("gc-pause");
+
+            // The runtime's source can have been announced by the base constructor, before the histogram was set.
+            EventSource source = Volatile.Read(ref runtime);
+            if (source != null)
+            {
+                EnableEvents(source, EventLevel.Informational, GcKeyword);
+            }
+        }
+
+        public static GcPauseRecorder Start(MetricRegistry registry) => new GcPauseRecorder(registry);
+
+        public LatencyHistogram Pauses => histogram;
+
+        public TimeSpan TotalPause => TimeSpan.FromTicks(Interlocked.Read(ref totalPauseTicks));
+
+        protected override void OnEventSourceCreated(EventSource eventSource)
+        {
+            if (eventSource.Name != RuntimeEventSource)
+            {
+                return;
+            }
+
+            Volatile.Write(ref runtime, eventSource);
+            if (histogram != null)
+            {
+                EnableEvents(eventSource, EventLevel.Informational, GcKeyword);
+            }
+        }
+
+        protected override void OnEventWritten(EventWrittenEventArgs eventData)
+        {
+            switch (eventData.EventId)
+            {
+                case GCSuspendEEBegin:
+                    suspendStarted = eventData.TimeStamp;
+                    break;
+
+                case GCRestartEEEnd:
+                    if (suspendStarted != default)
+                    {
+                        TimeSpan pause = eventData.TimeStamp - suspendStarted;
+                        suspendStarted = default;
+                        histogram.RecordNanoseconds(pause.Ticks * 100);
+                        Interlocked.Add(ref totalPauseTicks, pause.Ticks);
+                    }
+                    break;
+            }
+        }
+    }
+}
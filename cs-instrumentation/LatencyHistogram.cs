@@ -0,0 +1,231 @@
+﻿using System;
+using System.Diagnostics;
+using System.Numerics;
+using System.Threading;
+
+namespace cs_instrumentation
+{
+    /// <summary>
+    /// Thread-safe log-linear histogram of durations, laid out like HdrHistogram: each power of 2 is split into
+    /// 2^subBucketBits sub-buckets, so a recorded value is reported with at most 2^-subBucketBits relative error
+    /// (~6% with the default of 4 bits, ~0.8% with 7), from nanoseconds up to hours. Recording is a few interlocked
+    /// adds and never allocates or blocks.
+    /// </summary>
+    public sealed class LatencyHistogram
+    {
+        readonly int subBucketBits;
+        readonly long[] counts;
+        long count;
+        long sumNanoseconds;
+        long maxNanoseconds;
+
+        public string Name { get; }
+
+        public long Count => Interlocked.Read(ref count);
+
+        public LatencyHistogram(string name, int subBucketBits = 4)
+        {
+            if (subBucketBits < 1 || subBucketBits > 10)
+            {
+                throw new ArgumentOutOfRangeException(nameof(subBucketBits));
+            }
+
+            Name = name;
+            this.subBucketBits = subBucketBits;
+            counts = new long[(64 - subBucketBits + 1) << subBucketBits];
+        }
+
+        /// <summary>Records a duration given in Stopwatch ticks. Negative values are recorded as 0.</summary>
+        public void RecordTicks(long ticks)
+        {
+            RecordNanoseconds(ticks <= 0 ? 0 : (long)(ticks * (1_000_000_000.0 / Stopwatch.Frequency)));
+        }
+
+        /// <summary>Records <paramref name="occurrences"/> events that took the same number of Stopwatch ticks.</summary>
+        public void RecordTicks(long ticks, long occurrences)
+        {
+            RecordNanoseconds(ticks <= 0 ? 0 : (long)(ticks * (1_000_000_000.0 / Stopwatch.Frequency)), occurrences);
+        }
+
+        public void RecordNanoseconds(long nanoseconds, long occurrences = 1)
+        {
+            if (occurrences <= 0)
+            {
+                return;
+            }
+            if (nanoseconds < 0)
+            {
+                nanoseconds = 0;
+            }
+
+            Interlocked.Add(ref counts[GetIndex(nanoseconds)], occurrences);
+            Interlocked.Add(ref count, occurrences);
+            Interlocked.Add(ref sumNanoseconds, nanoseconds * occurrences);
+
+            long max;
+            while (nanoseconds > (max = Volatile.Read(ref maxNanoseconds)) &&
+                Interlocked.CompareExchange(ref maxNanoseconds, nanoseconds, max) != max)
+            {
+            }
+        }
+
+        /// <summary>Returns the value below which <paramref name="percentile"/> percent of the recorded values fall, in nanoseconds.</summary>
+        public long GetPercentileNanoseconds(double percentile)
+        {
+            return GetPercentile(counts, Count, Volatile.Read(ref maxNanoseconds), percentile);
+        }
+
+        public double MeanNanoseconds
+        {
+            get
+            {
+                long total = Count;
+                return total == 0 ? 0 : (double)Interlocked.Read(ref sumNanoseconds) / total;
+            }
+        }
+
+        public long MaxNanoseconds => Volatile.Read(ref maxNanoseconds);
+
+        public long SumNanoseconds => Interlocked.Read(ref sumNanoseconds);
+
+        /// <summary>
+        /// Copies the counts, while values are still being recorded: a value recorded during the copy may be in the
+        /// buckets but not yet in the totals, or the other way around.
+        /// </summary>
+        public HistogramSnapshot Snapshot()
+        {
+            var copy = new long[counts.Length];
+            for (int i = 0; i < copy.Length; i++)
+            {
+                copy[i] = Volatile.Read(ref counts[i]);
+            }
+            return new HistogramSnapshot(this, copy, Count, SumNanoseconds, MaxNanoseconds);
+        }
+
+        /// <summary>Formats count, mean and the usual percentiles in milliseconds.</summary>
+        public override string ToString()
+        {
+            return Format(Name, Count, MeanNanoseconds, GetPercentileNanoseconds, MaxNanoseconds);
+        }
+
+        internal static string Format(string name, long count, double mean, Func<double, long> percentile, long max)
+        {
+            return $"{name,-12} n = {count}, mean = {Ms(mean)}, p50 = {Ms(percentile(50))}, " +
+                $"p90 = {Ms(percentile(90))}, p99 = {Ms(percentile(99))}, " +
+                $"p99.9 = {Ms(percentile(99.9))}, max = {Ms(max)}";
+        }
+
+        static string Ms(double nanoseconds) => (nanoseconds / 1_000_000.0).ToString("F3") + " ms";
+
+        internal long GetPercentile(long[] counts, long total, long max, double percentile)
+        {
+            if (total == 0)
+            {
+                return 0;
+            }
+
+            long target = Math.Max(1, (long)Math.Ceiling(total * percentile / 100.0));
+            long cumulative = 0;
+            for (int i = 0; i < counts.Length; i++)
+            {
+                cumulative += Volatile.Read(ref counts[i]);
+                if (cumulative >= target)
+                {
+                    return Math.Min(GetUpperBound(i), max);
+                }
+            }
+            return max;
+        }
+
+        int GetIndex(long value)
+        {
+            int subBucketCount = 1 << subBucketBits;
+            if (value < subBucketCount)
+            {
+                return (int)value;
+            }
+
+            int shift = 63 - BitOperations.LeadingZeroCount((ulong)value) - subBucketBits;
+            return ((shift + 1) << subBucketBits) + (int)((value >> shift) & (subBucketCount - 1));
+        }
+
+        internal long GetUpperBound(int index)
+        {
+            long subBucketCount = 1L << subBucketBits;
+            int bucket = index >> subBucketBits;
+            long subBucket = index & (subBucketCount - 1);
+            if (bucket == 0)
+            {
+                return subBucket;
+            }
+            return ((subBucketCount + subBucket + 1) << (bucket - 1)) - 1;
+        }
+    }
+
+    /// <summary>
+    /// The counts of a <see cref="LatencyHistogram"/> at one time. Subtracting the previous snapshot gives the
+    /// values recorded in between, which is how interval percentiles are reported without stopping the recorders.
+    /// </summary>
+    public sealed class HistogramSnapshot
+    {
+        readonly LatencyHistogram histogram;
+        readonly long[] counts;
+
+        internal HistogramSnapshot(LatencyHistogram histogram, long[] counts, long count, long sumNanoseconds, long maxNanoseconds)
+        {
+            this.histogram = histogram;
+            this.counts = counts;
+            Count = count;
+            SumNanoseconds = sumNanoseconds;
+            MaxNanoseconds = maxNanoseconds;
+        }
+
+        public string Name => histogram.Name;
+
+        public long Count { get; }
+
+        public long SumNanoseconds { get; }
+
+        /// <summary>For an interval, the upper bound of its highest bucket: the exact maximum is only kept overall.</summary>
+        public long MaxNanoseconds { get; }
+
+        public double MeanNanoseconds => Count == 0 ? 0 : (double)SumNanoseconds / Count;
+
+        public long GetPercentileNanoseconds(double percentile)
+        {
+            return histogram.GetPercentile(counts, Count, MaxNanoseconds, percentile);
+        }
+
+        /// <summary>The values recorded since <paramref name="earlier"/>, a snapshot of the same histogram.</summary>
+        public HistogramSnapshot Since(HistogramSnapshot earlier)
+        {
+            if (earlier == null)
+            {
+                return this;
+            }
+            if (earlier.histogram != histogram)
+            {
+                throw new ArgumentException("The snapshots are of different histograms.", nameof(earlier));
+            }
+
+            var difference = new long[counts.Length];
+            long count = 0;
+            long max = 0;
+            for (int i = 0; i < counts.Length; i++)
+            {
+                difference[i] = Math.Max(0, counts[i] - earlier.counts[i]);
+                count += difference[i];
+                if (difference[i] != 0)
+                {
+                    max = Math.Min(histogram.GetUpperBound(i), MaxNanoseconds);
+                }
+            }
+            return new HistogramSnapshot(histogram, difference, count, Math.Max(0, SumNanoseconds - earlier.SumNanoseconds), max);
+        }
+
+        public override string ToString()
+        {
+            return LatencyHistogram.Format(Name, Count, MeanNanoseconds, GetPercentileNanoseconds, MaxNanoseconds);
+        }
+    }
+}
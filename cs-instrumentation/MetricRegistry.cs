@@ -0,0 +1,100 @@
+﻿using System;
+using System.Threading;
+
+namespace cs_instrumentation
+{
+    /// <summary>
+    /// The named counters, gauges and histograms of a process, for <see cref="MetricsEventSource"/> and
+    /// <see cref="MetricsJsonWriter"/> to export. Adding takes a lock and copies the list; recording and reading
+    /// never do, and the metrics can be kept in fields once added, so the hot paths only touch the metric itself.
+    /// </summary>
+    public sealed class MetricRegistry
+    {
+        readonly object gate = new object();
+        Counter[] counters = Array.Empty<Counter>();
+        Gauge[] gauges = Array.Empty<Gauge>();
+        LatencyHistogram[] histograms = Array.Empty<LatencyHistogram>();
+
+        public MetricRegistry(string name)
+        {
+            Name = name;
+        }
+
+        /// <summary>The name of the harness, as in the EventSource name and the JSON lines.</summary>
+        public string Name { get; }
+
+        /// <summary>Raised, under the registry's lock, for each metric added: a Counter, a Gauge or a LatencyHistogram.</summary>
+        public event Action<object> Added;
+
+        // Snapshots; the arrays are replaced, never modified.
+        public Counter[] Counters => Volatile.Read(ref counters);
+        public Gauge[] Gauges => Volatile.Read(ref gauges);
+        public LatencyHistogram[] Histograms => Volatile.Read(ref histograms);
+
+        /// <summary>Gets the counter named <paramref name="name"/>, adding it the first time.</summary>
+        public Counter GetCounter(string name, string displayName = null)
+        {
+            return GetOrAdd(ref counters, c => c.Name == name, () => new Counter(name, displayName));
+        }
+
+        /// <summary>
+        /// Exports a total that is already kept elsewhere (such as a sum of per-socket counts) as a counter, read
+        /// when exported.
+        /// </summary>
+        public Counter AddPolledCounter(string name, Func<long> read, string displayName = null)
+        {
+            return GetOrAdd(ref counters, c => c.Name == name, () => new Counter(name, displayName, read));
+        }
+
+        /// <summary>Gets the gauge named <paramref name="name"/>, adding it the first time; with <paramref name="read"/>, it is polled.</summary>
+        public Gauge GetGauge(string name, string displayName = null, string units = null, Func<double> read = null)
+        {
+            return GetOrAdd(ref gauges, g => g.Name == name, () => new Gauge(name, displayName, units, read));
+        }
+
+        /// <summary>Gets the histogram named <paramref name="name"/>, adding it the first time.</summary>
+        public LatencyHistogram GetHistogram(string name, int subBucketBits = 4)
+        {
+            return GetOrAdd(ref histograms, h => h.Name == name, () => new LatencyHistogram(name, subBucketBits));
+        }
+
+        /// <summary>Exports a histogram that is kept elsewhere, under its own name.</summary>
+        public void AddHistogram(LatencyHistogram histogram)
+        {
+            lock (gate)
+            {
+                Append(ref histograms, histogram);
+                Added?.Invoke(histogram);
+            }
+        }
+
+        T GetOrAdd<T>(ref T[] metrics, Func<T, bool> match, Func<T> create) where T : class
+        {
+            foreach (T metric in Volatile.Read(ref metrics))
+            {
+                if (match(metric)) return metric;
+            }
+
+            lock (gate)
+            {
+                foreach (T metric in metrics)
+                {
+                    if (match(metric)) return metric;
+                }
+
+                T added = create();
+                Append(ref metrics, added);
+                Added?.Invoke(added);
+                return added;
+            }
+        }
+
+        static void Append<T>(ref T[] array, T item)
+        {
+            var copy = new T[array.Length + 1];
+            array.CopyTo(copy, 0);
+            copy[array.Length] = item;
+            Volatile.Write(ref array, copy);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics.Tracing;
+
+namespace cs_instrumentation
+{
+    /// <summary>
+    /// Publishes a <see cref="MetricRegistry"/> as EventCounters under the registry's name, for dotnet-counters,
+    /// dotnet-trace or any EventPipe session (dotnet-counters monitor -n &lt;process&gt; --counters &lt;name&gt;):
+    /// a rate per counter, the value of each gauge, and the p50 and p99 of each histogram in microseconds. The
+    /// metrics are only read while a session listens, once per its refresh interval.
+    /// </summary>
+    public sealed class MetricsEventSource : EventSource
+    {
+        readonly MetricRegistry registry;
+        readonly List<DiagnosticCounter> counters = new List<DiagnosticCounter>();
+        // A metric added while the constructor lists the others is seen twice.
+        readonly HashSet<object> published = new HashSet<object>();
+
+        public MetricsEventSource(MetricRegistry registry)
+            : base(registry.Name)
+        {
+            this.registry = registry;
+
+            lock (counters)
+            {
+                registry.Added += Add;
+                foreach (Counter counter in registry.Counters) Add(counter);
+                foreach (Gauge gauge in registry.Gauges) Add(gauge);
+                foreach (LatencyHistogram histogram in registry.Histograms) Add(histogram);
+            }
+        }
+
+        void Add(object metric)
+        {
+            lock (counters)
+            {
+                if (!published.Add(metric))
+                {
+                    return;
+                }
+
+                switch (metric)
+                {
+                    case Counter counter:
+                        counters.Add(new IncrementingPollingCounter(counter.Name, this, () => counter.Value)
+                        {
+                            DisplayName = counter.DisplayName, DisplayRateTimeScale = TimeSpan.FromSeconds(1),
+                        });
+                        break;
+
+                    case Gauge gauge:
+                        counters.Add(new PollingCounter(gauge.Name, this, () => gauge.Value)
+                        {
+                            DisplayName = gauge.DisplayName, DisplayUnits = gauge.Units ?? "",
+                        });
+                        break;
+
+                    case LatencyHistogram histogram:
+                        counters.Add(new PollingCounter(histogram.Name + "-p50", this, () => histogram.GetPercentileNanoseconds(50) / 1000.0)
+                        {
+                            DisplayName = histogram.Name + " p50", DisplayUnits = "us",
+                        });
+                        counters.Add(new PollingCounter(histogram.Name + "-p99", this, () => histogram.GetPercentileNanoseconds(99) / 1000.0)
+                        {
+                            DisplayName = histogram.Name + " p99", DisplayUnits = "us",
+                        });
+                        break;
+                }
+            }
+        }
+
+        protected override void Dispose(bool disposing)
+        {
+            if (disposing)
+            {
+                registry.Added -= Add;
+                lock (counters)
+                {
+                    foreach (DiagnosticCounter counter in counters)
+                    {
+                        counter.Dispose();
+                    }
+                    counters.Clear();
+                }
+            }
+            base.Dispose(disposing);
+        }
+    }
+}
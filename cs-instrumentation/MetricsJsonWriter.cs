@@ -0,0 +1,243 @@
+﻿using System;
+using System.Collections;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Runtime;
+using System.Runtime.InteropServices;
+using System.Text.Json;
+using System.Threading;
+
+namespace cs_instrumentation
+{
+    /// <summary>
+    /// Writes a <see cref="MetricRegistry"/> to a JSON lines file from a background thread, one object per line:
+    ///
+    /// - "start": the machine, the runtime and its GC and JIT settings, the COMPlus_ and DOTNET_ variables that can
+    ///   override them, the command line;
+    /// - "sample", every interval: the process (RSS, managed heap, allocations, collections, GC pauses, CPU time,
+    ///   thread pool), each counter's total and rate, each gauge, and each histogram over the interval;
+    /// - "end", when disposed: one last sample, with the histograms over the whole run.
+    ///
+    /// Latencies are in microseconds, so that files from different harnesses, runs and machines can be put side by
+    /// side. The thread only reads the metrics, which costs the code being measured nothing but the memory traffic.
+    /// </summary>
+    public sealed class MetricsJsonWriter : IDisposable
+    {
+        /// <summary>The environment variables <see cref="FromEnvironment"/> reads.</summary>
+        public const string PathVariable = "DN_METRICS_JSON";
+        public const string IntervalVariable = "DN_METRICS_INTERVAL_MS";
+        /// <summary>A label written in every line, such as the configuration a driver runs the harness in.</summary>
+        public const string RunVariable = "DN_METRICS_RUN";
+
+        readonly MetricRegistry registry;
+        readonly TimeSpan interval;
+        readonly string run;
+        readonly Stream stream;
+        readonly Utf8JsonWriter json;
+        readonly Thread thread;
+        readonly ManualResetEventSlim stopping = new ManualResetEventSlim();
+        readonly Stopwatch elapsed = Stopwatch.StartNew();
+        readonly Process process = Process.GetCurrentProcess();
+
+        long[] lastCounts = Array.Empty<long>();
+        HistogramSnapshot[] lastHistograms = Array.Empty<HistogramSnapshot>();
+        TimeSpan lastElapsed;
+
+        public MetricsJsonWriter(MetricRegistry registry, string path, TimeSpan interval, string run = null)
+        {
+            this.registry = registry ?? throw new ArgumentNullException(nameof(registry));
+            this.interval = interval;
+            this.run = run;
+
+            stream = new FileStream(path, FileMode.Append, FileAccess.Write, FileShare.Read, 64 * 1024);
+            json = new Utf8JsonWriter(stream);
+            GcPauses = GcPauseRecorder.Start(registry);
+
+            WriteStart();
+            thread = new Thread(Run) { IsBackground = true, Name = "Metrics JSON Writer" };
+            thread.Start();
+        }
+
+        /// <summary>
+        /// A writer to the file named by DN_METRICS_JSON, every DN_METRICS_INTERVAL_MS (1000 by default), or null
+        /// when the variable is not set.
+        /// </summary>
+        public static MetricsJsonWriter FromEnvironment(MetricRegistry registry)
+        {
+            string path = Environment.GetEnvironmentVariable(PathVariable);
+            if (string.IsNullOrEmpty(path))
+            {
+                return null;
+            }
+
+            int intervalMs = int.TryParse(Environment.GetEnvironmentVariable(IntervalVariable), NumberStyles.None, CultureInfo.InvariantCulture, out int value) && value > 0
+                ? value : 1000;
+            return new MetricsJsonWriter(registry, path, TimeSpan.FromMilliseconds(intervalMs), Environment.GetEnvironmentVariable(RunVariable));
+        }
+
+        /// <summary>The GC pauses of the process, recorded into the registry as the "gc-pause" histogram.</summary>
+        public GcPauseRecorder GcPauses { get; }
+
+        public void Dispose()
+        {
+            if (stopping.IsSet)
+            {
+                return;
+            }
+            stopping.Set();
+            thread.Join();
+
+            WriteSample("end");
+            GcPauses.Dispose();
+            json.Dispose();
+            stream.Dispose();
+            process.Dispose();
+        }
+
+        void Run()
+        {
+            while (!stopping.Wait(interval))
+            {
+                try
+                {
+                    WriteSample("sample");
+                }
+                catch (IOException)
+                {
+                    // The disk is full or gone; the harness goes on without its metrics.
+                    return;
+                }
+            }
+        }
+
+        void WriteStart()
+        {
+            json.WriteStartObject();
+            WriteHeader("start");
+            json.WriteString("machine", Environment.MachineName);
+            json.WriteString("os", RuntimeInformation.OSDescription);
+            json.WriteString("runtime", RuntimeInformation.FrameworkDescription);
+            json.WriteNumber("processors", Environment.ProcessorCount);
+            json.WriteBoolean("serverGc", GCSettings.IsServerGC);
+            json.WriteBoolean("concurrentGc", AppContext.TryGetSwitch("System.GC.Concurrent", out bool concurrent) ? concurrent : true);
+            json.WriteString("gcLatencyMode", GCSettings.LatencyMode.ToString());
+            json.WriteBoolean("tieredCompilation", AppContext.TryGetSwitch("System.Runtime.TieredCompilation", out bool tiered) ? tiered : true);
+            json.WriteStartObject("runtimeVariables");
+            foreach (DictionaryEntry variable in Environment.GetEnvironmentVariables())
+            {
+                string name = (string)variable.Key;
+                if (name.StartsWith("COMPlus_", StringComparison.OrdinalIgnoreCase) || name.StartsWith("DOTNET_", StringComparison.OrdinalIgnoreCase))
+                {
+                    json.WriteString(name, (string)variable.Value);
+                }
+            }
+            json.WriteEndObject();
+            json.WriteString("commandLine", Environment.CommandLine);
+            json.WriteEndObject();
+            EndLine();
+        }
+
+        void WriteSample(string kind)
+        {
+            bool end = kind == "end";
+            TimeSpan now = elapsed.Elapsed;
+            double seconds = (now - lastElapsed).TotalSeconds;
+            lastElapsed = now;
+
+            json.WriteStartObject();
+            WriteHeader(kind);
+
+            process.Refresh();
+            json.WriteStartObject("process");
+            json.WriteNumber("rssBytes", process.WorkingSet64);
+            json.WriteNumber("peakRssBytes", process.PeakWorkingSet64);
+            json.WriteNumber("managedBytes", GC.GetTotalMemory(false));
+            json.WriteNumber("allocatedBytes", GC.GetTotalAllocatedBytes(false));
+            json.WriteNumber("gen0Collections", GC.CollectionCount(0));
+            json.WriteNumber("gen1Collections", GC.CollectionCount(1));
+            json.WriteNumber("gen2Collections", GC.CollectionCount(2));
+            json.WriteNumber("gcPauseTotalMs", GcPauses.TotalPause.TotalMilliseconds);
+            json.WriteNumber("cpuMs", process.TotalProcessorTime.TotalMilliseconds);
+            json.WriteNumber("threadPoolThreads", ThreadPool.ThreadCount);
+            json.WriteNumber("threadPoolQueue", ThreadPool.PendingWorkItemCount);
+            json.WriteEndObject();
+
+            Counter[] counters = registry.Counters;
+            if (lastCounts.Length < counters.Length)
+            {
+                Array.Resize(ref lastCounts, counters.Length);
+            }
+            json.WriteStartObject("counters");
+            for (int i = 0; i < counters.Length; i++)
+            {
+                long total = counters[i].Value;
+                json.WriteStartObject(counters[i].Name);
+                json.WriteNumber("total", total);
+                json.WriteNumber("perSecond", seconds > 0 ? Math.Round((total - lastCounts[i]) / seconds, 1) : 0);
+                json.WriteEndObject();
+                lastCounts[i] = total;
+            }
+            json.WriteEndObject();
+
+            json.WriteStartObject("gauges");
+            foreach (Gauge gauge in registry.Gauges)
+            {
+                json.WriteNumber(gauge.Name, gauge.Value);
+            }
+            json.WriteEndObject();
+
+            LatencyHistogram[] histograms = registry.Histograms;
+            if (lastHistograms.Length < histograms.Length)
+            {
+                Array.Resize(ref lastHistograms, histograms.Length);
+            }
+            json.WriteStartObject("histograms");
+            for (int i = 0; i < histograms.Length; i++)
+            {
+                HistogramSnapshot snapshot = histograms[i].Snapshot();
+                WriteHistogram(end ? snapshot : snapshot.Since(lastHistograms[i]));
+                lastHistograms[i] = snapshot;
+            }
+            json.WriteEndObject();
+
+            json.WriteEndObject();
+            EndLine();
+        }
+
+        void WriteHeader(string kind)
+        {
+            json.WriteString("time", DateTime.UtcNow.ToString("O", CultureInfo.InvariantCulture));
+            json.WriteString("harness", registry.Name);
+            if (run != null)
+            {
+                json.WriteString("run", run);
+            }
+            json.WriteString("event", kind);
+            json.WriteNumber("elapsedSeconds", Math.Round(elapsed.Elapsed.TotalSeconds, 3));
+        }
+
+        void WriteHistogram(HistogramSnapshot histogram)
+        {
+            json.WriteStartObject(histogram.Name);
+            json.WriteNumber("count", histogram.Count);
+            json.WriteNumber("meanUs", Microseconds(histogram.MeanNanoseconds));
+            json.WriteNumber("p50Us", Microseconds(histogram.GetPercentileNanoseconds(50)));
+            json.WriteNumber("p90Us", Microseconds(histogram.GetPercentileNanoseconds(90)));
+            json.WriteNumber("p99Us", Microseconds(histogram.GetPercentileNanoseconds(99)));
+            json.WriteNumber("p999Us", Microseconds(histogram.GetPercentileNanoseconds(99.9)));
+            json.WriteNumber("maxUs", Microseconds(histogram.MaxNanoseconds));
+            json.WriteEndObject();
+        }
+
+        void EndLine()
+        {
+            json.Flush();
+            json.Reset();
+            stream.WriteByte((byte)'\n');
+            stream.Flush();
+        }
+
+        static double Microseconds(double nanoseconds) => Math.Round(nanoseconds / 1000.0, 1);
+    }
+}
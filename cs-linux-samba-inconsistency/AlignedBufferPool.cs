@@ -0,0 +1,47 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Runtime.InteropServices;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// Chunk buffers that start on a 4096-byte boundary, as O_DIRECT and FILE_FLAG_NO_BUFFERING require. Each is
+    /// a slice of a pinned array (on the pinned object heap, so its address never changes), and returned buffers
+    /// are kept for the next Rent of the same size.
+    /// </summary>
+    public sealed class AlignedBufferPool
+    {
+        public const int Alignment = 4096;
+
+        public static AlignedBufferPool Shared { get; } = new AlignedBufferPool();
+
+        readonly ConcurrentDictionary<int, ConcurrentBag<byte[]>> free = new ConcurrentDictionary<int, ConcurrentBag<byte[]>>();
+
+        /// <summary>Returns an aligned buffer of exactly <paramref name="size"/> bytes.</summary>
+        public Memory<byte> Rent(int size)
+        {
+            if (!free.GetOrAdd(size, _ => new ConcurrentBag<byte[]>()).TryTake(out byte[] array))
+            {
+                array = GC.AllocateUninitializedArray<byte>(size + Alignment - 1, pinned: true);
+            }
+            return array.AsMemory(GetAlignedOffset(array), size);
+        }
+
+        public void Return(Memory<byte> buffer)
+        {
+            if (!MemoryMarshal.TryGetArray(buffer, out ArraySegment<byte> segment))
+            {
+                throw new ArgumentException("Not a buffer of this pool.", nameof(buffer));
+            }
+            free.GetOrAdd(buffer.Length, _ => new ConcurrentBag<byte[]>()).Add(segment.Array);
+        }
+
+        static unsafe int GetAlignedOffset(byte[] array)
+        {
+            fixed (byte* p = array)
+            {
+                return (int)((Alignment - ((long)p & (Alignment - 1))) & (Alignment - 1));
+            }
+        }
+    }
+}
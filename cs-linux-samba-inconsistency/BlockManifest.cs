@@ -0,0 +1,206 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// The XXH64 of every block of a file, taken from the data as it is written. Verification hashes what it reads
+    /// back and only generates the expected data again and compares bytes for the blocks whose hash differs.
+    /// </summary>
+    public sealed class BlockManifest
+    {
+        ulong[] hashes = Array.Empty<ulong>();
+
+        public int BlockSize { get; }
+
+        public BlockManifest(int blockSize)
+        {
+            if (blockSize <= 0 || blockSize % DataPattern.BlockSize != 0)
+            {
+                throw new ArgumentOutOfRangeException(nameof(blockSize));
+            }
+            BlockSize = blockSize;
+        }
+
+        /// <summary>Makes room for a file of <paramref name="size"/> bytes, reusing the array of the previous file.</summary>
+        public void Reset(long size)
+        {
+            long blocks = (size + BlockSize - 1) / BlockSize;
+            if (hashes.Length < blocks)
+            {
+                hashes = new ulong[blocks];
+            }
+        }
+
+        /// <summary>Hashes the blocks of <paramref name="data"/>, written at <paramref name="offset"/>, a multiple of the block size.</summary>
+        public void Add(long offset, ReadOnlySpan<byte> data)
+        {
+            long block = offset / BlockSize;
+            for (int i = 0; i < data.Length; i += BlockSize, block++)
+            {
+                hashes[block] = XxHash64.Hash(data.Slice(i, Math.Min(BlockSize, data.Length - i)));
+            }
+        }
+
+        /// <summary>
+        /// Checks <paramref name="read"/> bytes read back at <paramref name="offset"/>, where <paramref name="length"/>
+        /// were written, and adds anything wrong to <paramref name="report"/>. Returns the number of bad blocks.
+        /// </summary>
+        public int Verify(long offset, ReadOnlySpan<byte> actual, int read, int length, ulong seed, FileVersion previous, Span<byte> scratch, MismatchReport report)
+        {
+            int badBlocks = 0;
+            long block = offset / BlockSize;
+            for (int i = 0; i < length; i += BlockSize, block++)
+            {
+                int blockLength = Math.Min(BlockSize, length - i);
+                int available = Math.Clamp(read - i, 0, blockLength);
+                if (available == blockLength && XxHash64.Hash(actual.Slice(i, blockLength)) == hashes[block])
+                {
+                    continue;
+                }
+
+                badBlocks++;
+                Span<byte> expected = scratch.Slice(0, BlockSize);
+                Span<byte> stale = scratch.Slice(BlockSize, BlockSize);
+                DataPattern.Fill(seed, offset + i, expected.Slice(0, blockLength));
+                int staleLength = previous.Seed.HasValue ? (int)Math.Clamp(previous.Size - (offset + i), 0, blockLength) : 0;
+                if (staleLength != 0)
+                {
+                    DataPattern.Fill(previous.Seed.Value, offset + i, stale.Slice(0, staleLength));
+                }
+                report.Compare(offset + i, expected.Slice(0, available), actual.Slice(i, available), stale.Slice(0, Math.Min(staleLength, available)));
+                if (available < blockLength)
+                {
+                    report.Add(offset + i + available, blockLength - available, MismatchKind.Missing);
+                }
+            }
+            return badBlocks;
+        }
+    }
+
+    /// <summary>The seed and size a file was last written with, if any, to recognize its old data.</summary>
+    public struct FileVersion
+    {
+        public ulong? Seed;
+        public long Size;
+    }
+
+    public enum MismatchKind
+    {
+        /// <summary>Zeros where data was written: a hole, or a page that was never filled in.</summary>
+        Zeroed,
+
+        /// <summary>What the previous version of the file had there: a cache served old data.</summary>
+        Stale,
+
+        /// <summary>Neither zeros nor the old data, or a mix of them.</summary>
+        Corrupt,
+
+        /// <summary>Past the end of a file that came back too short.</summary>
+        Missing,
+    }
+
+    /// <summary>
+    /// The extents of a file that came back wrong. Mismatched blocks are classified a 512-byte sector at a time
+    /// (the unit caches and disks lose data in), and adjacent sectors of one kind are merged into one extent.
+    /// </summary>
+    public sealed class MismatchReport
+    {
+        const int SectorSize = 512;
+        const int MaxPrinted = 16;
+
+        readonly List<(long Offset, long Length, MismatchKind Kind)> extents = new List<(long, long, MismatchKind)>();
+
+        public int Count => extents.Count;
+
+        public void Clear()
+        {
+            extents.Clear();
+        }
+
+        /// <summary>Compares data read back at <paramref name="offset"/> with what was written there and what was there before.</summary>
+        public void Compare(long offset, ReadOnlySpan<byte> expected, ReadOnlySpan<byte> actual, ReadOnlySpan<byte> stale)
+        {
+            for (int s = 0; s < expected.Length; s += SectorSize)
+            {
+                int length = Math.Min(SectorSize, expected.Length - s);
+                ReadOnlySpan<byte> e = expected.Slice(s, length);
+                ReadOnlySpan<byte> a = actual.Slice(s, length);
+                if (e.SequenceEqual(a))
+                {
+                    continue;
+                }
+
+                // Only the bytes that differ count: a range that starts or ends inside the sector leaves the rest right.
+                ReadOnlySpan<byte> old = stale.Length >= s + length ? stale.Slice(s, length) : default;
+                bool zeroed = true, isStale = !old.IsEmpty;
+                int first = -1, last = 0;
+                for (int i = 0; i < length; i++)
+                {
+                    if (e[i] != a[i])
+                    {
+                        if (first < 0) first = i;
+                        last = i;
+                        zeroed &= a[i] == 0;
+                        isStale &= !old.IsEmpty && a[i] == old[i];
+                    }
+                }
+
+                MismatchKind kind = zeroed ? MismatchKind.Zeroed : isStale ? MismatchKind.Stale : MismatchKind.Corrupt;
+                Add(offset + s + first, last - first + 1, kind);
+            }
+        }
+
+        public void Add(long offset, long length, MismatchKind kind)
+        {
+            if (extents.Count != 0)
+            {
+                (long lastOffset, long lastLength, MismatchKind lastKind) = extents[extents.Count - 1];
+                if (lastKind == kind && offset - (lastOffset + lastLength) < SectorSize)
+                {
+                    extents[extents.Count - 1] = (lastOffset, offset + length - lastOffset, kind);
+                    return;
+                }
+            }
+            extents.Add((offset, length, kind));
+        }
+
+        /// <summary>Merges the reports of lanes that checked different chunks of one file.</summary>
+        public void AddRange(IEnumerable<MismatchReport> reports)
+        {
+            var all = new List<(long Offset, long Length, MismatchKind Kind)>();
+            foreach (MismatchReport report in reports)
+            {
+                all.AddRange(report.extents);
+            }
+            all.Sort((x, y) => x.Offset.CompareTo(y.Offset));
+            foreach ((long offset, long length, MismatchKind kind) in all)
+            {
+                Add(offset, length, kind);
+            }
+        }
+
+        /// <summary>One line per extent, indented, and a summary of the kinds.</summary>
+        public override string ToString()
+        {
+            var text = new StringBuilder();
+            var bytes = new long[4];
+            for (int i = 0; i < extents.Count; i++)
+            {
+                (long offset, long length, MismatchKind kind) = extents[i];
+                bytes[(int)kind] += length;
+                if (i < MaxPrinted)
+                {
+                    text.AppendLine($"    offset {offset:N0} length {length:N0}: {kind.ToString().ToLowerInvariant()}");
+                }
+            }
+            if (extents.Count > MaxPrinted)
+            {
+                text.AppendLine($"    ... {extents.Count - MaxPrinted} more extent(s)");
+            }
+            text.Append($"    {extents.Count} extent(s): {bytes[0]:N0} bytes zeroed, {bytes[1]:N0} stale, {bytes[2]:N0} corrupt, {bytes[3]:N0} missing");
+            return text.ToString();
+        }
+    }
+}
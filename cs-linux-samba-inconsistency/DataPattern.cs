@@ -0,0 +1,32 @@
+﻿using System;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// The contents of a test file: every 4096-byte block is the xoshiro256** output for the file's seed and the
+    /// block's index. Any range can be generated on its own, so a lane can write any chunk, and the data an
+    /// earlier version of the file had at an offset can be generated again to recognize stale reads.
+    /// </summary>
+    public static class DataPattern
+    {
+        public const int BlockSize = 4096;
+
+        /// <summary>Fills <paramref name="destination"/> with the data at <paramref name="offset"/>, a multiple of <see cref="BlockSize"/>.</summary>
+        public static void Fill(ulong seed, long offset, Span<byte> destination)
+        {
+            if (offset % BlockSize != 0)
+            {
+                throw new ArgumentOutOfRangeException(nameof(offset));
+            }
+
+            long block = offset / BlockSize;
+            while (!destination.IsEmpty)
+            {
+                int length = Math.Min(BlockSize, destination.Length);
+                new Xoshiro256StarStar(seed ^ ((ulong)block * 0xD1B54A32D192ED03UL)).Fill(destination.Slice(0, length));
+                destination = destination.Slice(length);
+                block++;
+            }
+        }
+    }
+}
@@ -0,0 +1,37 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Libraries
+    {
+        internal const string Libc = "libc";
+    }
+
+    internal static partial class Sys
+    {
+        internal const int O_RDONLY = 0x0000;
+        internal const int O_WRONLY = 0x0001;
+        internal const int O_CREAT = 0x0040;
+        internal const int O_TRUNC = 0x0200;
+        internal const int O_SYNC = 0x101000;
+        internal const int O_CLOEXEC = 0x80000;
+
+        internal const int POSIX_FADV_DONTNEED = 4;
+
+        /// <summary>O_DIRECT is one of the few flags whose value differs between the Linux architectures.</summary>
+        internal static int O_DIRECT => RuntimeInformation.ProcessArchitecture switch
+        {
+            Architecture.Arm => 0x10000,
+            Architecture.Arm64 => 0x10000,
+            _ => 0x4000,
+        };
+
+        [DllImport(Libraries.Libc, EntryPoint = "open", SetLastError = true)]
+        internal static extern int Open([MarshalAs(UnmanagedType.LPUTF8Str)] string path, int flags, int mode);
+
+        /// <summary>Returns an errno value rather than setting errno.</summary>
+        [DllImport(Libraries.Libc, EntryPoint = "posix_fadvise")]
+        internal static extern int PosixFAdvise(IntPtr fd, long offset, long length, int advice);
+    }
+}
@@ -2,27 +2,54 @@
 using System.IO;
 using System.Threading;
 using System.Threading.Tasks;
+using cs_instrumentation;
 
 namespace cs_linux_samba_inconsistency
 {
     class Program
     {
-        static async Task Main(string[] args)
+        static async Task<int> Main(string[] args)
         {
+            // dotnet-counters monitor -n cs-linux-samba-inconsistency --counters SambaTest; DN_METRICS_JSON=<file> also writes
+            // the counters and latencies as JSON lines.
+            var registry = new MetricRegistry("SambaTest");
+            using MetricsJsonWriter json = MetricsJsonWriter.FromEnvironment(registry);
+            using MetricsEventSource eventSource = new MetricsEventSource(registry);
+
+            if (args.Length != 0 && (args[0] == "stream" || args[0] == "stress"))
+            {
+                TestOptions options;
+                try
+                {
+                    options = ParseOptions(args);
+                }
+                catch (Exception ex) when (ex is FormatException || ex is IndexOutOfRangeException || ex is OverflowException)
+                {
+                    Console.Error.WriteLine(ex.Message);
+                    Console.Error.WriteLine("usage: cs-linux-samba-inconsistency stream|stress [--dir <dir>] [--files <n>] [--max-size <bytes>[K|M|G]] [--chunk-size <bytes>[K|M]] [--block-size <bytes>[K|M]] [--passes <n>] [--seed <n>]");
+                    Console.Error.WriteLine("  caching: [--write-through] [--direct] [--fsync] [--drop-cache]");
+                    Console.Error.WriteLine("  stress: [--mount <other mount of dir>]... [--workers <n>] [--queue-depth <n>] [--delay <ms>] [--duration <seconds>]");
+                    return 2;
+                }
+                long mismatches = args[0] == "stream" ? await StreamingTest.RunAsync(options, registry) : await StressTest.RunAsync(options, registry);
+                return mismatches == 0 ? 0 : 1;
+            }
+
             Random rand = new Random((int)DateTime.Now.Ticks);
             string dirName = @"\\lts\DataRoot\tmp\test1\";
 
             Directory.CreateDirectory(dirName);
 
-            while (true)
+            Counter files = registry.GetCounter("files");
+            Counter bytes = registry.GetCounter("bytes");
+            Counter different = registry.GetCounter("mismatches");
+            for (int pass = 0; ; pass++)
             {
                 for (int i = 0; i < 32; i++)
                 {
                     string fileName = $"test.{i:D4}.dat";
                     string filePath = Path.Combine(dirName, fileName);
 
-                    Console.WriteLine(filePath);
-
                     int size = rand.Next() % 10_000_000;
 
                     byte[] randomData = new byte[size];
@@ -43,10 +70,61 @@ namespace cs_linux_samba_inconsistency
                     int r = randomData.AsSpan().SequenceCompareTo(readData.AsSpan());
                     if (r != 0)
                     {
-                        Console.WriteLine($"*** Different !!!!!!!!!");
+                        different.Increment();
+                        Console.WriteLine($"*** Different !!!!!!!!! {filePath}");
                     }
+                    files.Increment();
+                    bytes.Add(size);
                 }
+                Console.WriteLine($"pass {pass}: {files.Value} file(s), {bytes.Value / 1e6:N0} MB, {different.Value} mismatch(es) so far");
+            }
+        }
+
+        static TestOptions ParseOptions(string[] args)
+        {
+            var options = new TestOptions();
+            for (int i = 1; i < args.Length; i++)
+            {
+                switch (args[i])
+                {
+                    case "--dir": options.Directory = args[++i]; break;
+                    case "--files": options.Files = int.Parse(args[++i]); break;
+                    case "--max-size": options.MaxSize = ParseSize(args[++i]); break;
+                    case "--chunk-size": options.ChunkSize = checked((int)ParseSize(args[++i])); break;
+                    case "--block-size": options.BlockSize = checked((int)ParseSize(args[++i])); break;
+                    case "--passes": options.Passes = int.Parse(args[++i]); break;
+                    case "--seed": options.Seed = ulong.Parse(args[++i]); break;
+                    case "--mount": options.OtherMounts.Add(args[++i]); break;
+                    case "--workers": options.Workers = int.Parse(args[++i]); break;
+                    case "--queue-depth": options.QueueDepth = int.Parse(args[++i]); break;
+                    case "--delay": options.ReadAfterWriteDelay = TimeSpan.FromMilliseconds(int.Parse(args[++i])); break;
+                    case "--duration": options.Duration = TimeSpan.FromSeconds(int.Parse(args[++i])); break;
+                    case "--write-through": options.WriteThrough = true; break;
+                    case "--direct": options.DirectIO = true; break;
+                    case "--fsync": options.Fsync = true; break;
+                    case "--drop-cache": options.DropCache = true; break;
+                    default: throw new FormatException($"Unknown option '{args[i]}'.");
+                }
+            }
+            options.Validate();
+            return options;
+        }
+
+        // "4096", "64K", "1M", "4G"
+        static long ParseSize(string text)
+        {
+            long multiplier = 1;
+            switch (char.ToUpperInvariant(text[text.Length - 1]))
+            {
+                case 'K': multiplier = 1L << 10; break;
+                case 'M': multiplier = 1L << 20; break;
+                case 'G': multiplier = 1L << 30; break;
+            }
+            if (multiplier != 1)
+            {
+                text = text.Substring(0, text.Length - 1);
             }
+            return checked(long.Parse(text) * multiplier);
         }
     }
 }
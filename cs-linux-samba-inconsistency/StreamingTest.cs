@@ -0,0 +1,157 @@
+﻿using System;
+using System.Diagnostics;
+using System.IO;
+using System.Threading.Tasks;
+using cs_instrumentation;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// Writes each file from its seed's <see cref="DataPattern"/> one pooled chunk at a time, then reads it back chunk
+    /// by chunk and checks it against the block manifest taken while writing. Memory use is two chunks and the
+    /// manifest, whatever the file sizes.
+    /// </summary>
+    public static class StreamingTest
+    {
+        public static async Task<long> RunAsync(TestOptions options, MetricRegistry registry)
+        {
+            options.Validate();
+
+            System.IO.Directory.CreateDirectory(options.Directory);
+
+            // Sizes and data seeds of every file in every pass come from this, so a run can be repeated with --seed.
+            ulong sequence = options.Seed;
+            long mismatches = 0;
+            Console.WriteLine($"seed {options.Seed}, {TestFile.DescribeMode(options)}");
+
+            Memory<byte> expected = AlignedBufferPool.Shared.Rent(options.ChunkSize);
+            Memory<byte> actual = AlignedBufferPool.Shared.Rent(options.ChunkSize);
+            var manifest = new BlockManifest(options.BlockSize);
+            var report = new MismatchReport();
+            byte[] scratch = new byte[2 * options.BlockSize];
+            var versions = new FileVersion[options.Files];
+            var latencies = new IoLatencies(registry);
+            Counter filesCounter = registry.GetCounter("files");
+            Counter bytesCounter = registry.GetCounter("bytes");
+            Counter mismatchesCounter = registry.GetCounter("mismatches");
+            try
+            {
+                for (int pass = 0; options.Passes == 0 || pass < options.Passes; pass++)
+                {
+                    long bytes = 0;
+                    Stopwatch writeTime = new Stopwatch(), readTime = new Stopwatch();
+                    HistogramSnapshot[] passStart = latencies.Snapshot();
+
+                    for (int i = 0; i < options.Files; i++)
+                    {
+                        string filePath = Path.Combine(options.Directory, $"test.{i:D4}.dat");
+                        long size = (long)(Xoshiro256StarStar.SplitMix64(ref sequence) % (ulong)Math.Max(1, options.MaxSize));
+                        ulong seed = Xoshiro256StarStar.SplitMix64(ref sequence);
+
+                        // The write time includes the barrier: that is where write-back caching pays.
+                        writeTime.Start();
+                        await WriteFileAsync(filePath, size, seed, expected, manifest, options, latencies);
+                        latencies.Barrier.RecordTicks(TestFile.CompleteWrite(filePath, size, options));
+                        writeTime.Stop();
+
+                        readTime.Start();
+                        report.Clear();
+                        (long badBlocks, long length) = await VerifyFileAsync(filePath, size, seed, versions[i], actual, manifest, scratch, report, options, latencies);
+                        readTime.Stop();
+
+                        if (badBlocks != 0 || length != size)
+                        {
+                            mismatches++;
+                            mismatchesCounter.Increment();
+                            Console.WriteLine($"*** Different !!!!!!!!! {filePath}: {badBlocks} bad block(s), length {length:N0} of {size:N0} (data seed {seed})");
+                            Console.WriteLine(report);
+                        }
+                        versions[i] = new FileVersion { Seed = seed, Size = size };
+                        bytes += size;
+                        filesCounter.Increment();
+                        bytesCounter.Add(size);
+                    }
+
+                    Console.WriteLine($"pass {pass}: {bytes / 1e6:N0} MB, write {bytes / 1e6 / writeTime.Elapsed.TotalSeconds:N1} MB/s, " +
+                        $"read and verify {bytes / 1e6 / readTime.Elapsed.TotalSeconds:N1} MB/s, {mismatches} mismatch(es) so far");
+                    latencies.Print(passStart);
+                }
+            }
+            finally
+            {
+                AlignedBufferPool.Shared.Return(expected);
+                AlignedBufferPool.Shared.Return(actual);
+            }
+            return mismatches;
+        }
+
+        /// <summary>Writes <paramref name="size"/> bytes of the data of <paramref name="seed"/> and fills in the manifest.</summary>
+        public static async Task WriteFileAsync(string path, long size, ulong seed, Memory<byte> chunk, BlockManifest manifest, TestOptions options, IoLatencies latencies)
+        {
+            manifest.Reset(size);
+            await using (FileStream f = TestFile.Create(path, options))
+            {
+                for (long position = 0; position < size; position += chunk.Length)
+                {
+                    int length = (int)Math.Min(chunk.Length, size - position);
+                    DataPattern.Fill(seed, position, chunk.Span.Slice(0, length));
+                    manifest.Add(position, chunk.Span.Slice(0, length));
+
+                    long start = Stopwatch.GetTimestamp();
+                    await f.WriteAsync(chunk.Slice(0, TestFile.IoLength(length, options)));
+                    latencies.Write.RecordTicks(Stopwatch.GetTimestamp() - start);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Reads the file back and checks it against the manifest, adding the extents that differ to
+        /// <paramref name="report"/>. Returns the number of bad blocks and the file's length.
+        /// </summary>
+        public static async Task<(long BadBlocks, long Length)> VerifyFileAsync(string path, long size, ulong seed, FileVersion previous,
+            Memory<byte> actual, BlockManifest manifest, byte[] scratch, MismatchReport report, TestOptions options, IoLatencies latencies)
+        {
+            long badBlocks = 0;
+            long fileLength;
+            await using (FileStream f = TestFile.OpenRead(path, options))
+            {
+                fileLength = f.Length;
+                for (long position = 0; position < size; position += actual.Length)
+                {
+                    int length = (int)Math.Min(actual.Length, size - position);
+
+                    long start = Stopwatch.GetTimestamp();
+                    int read = await ReadFullyAsync(f, actual.Slice(0, TestFile.IoLength(length, options)), options.DirectIO);
+                    latencies.Read.RecordTicks(Stopwatch.GetTimestamp() - start);
+
+                    badBlocks += manifest.Verify(position, actual.Span, read, length, seed, previous, scratch, report);
+                }
+            }
+            return (badBlocks, fileLength);
+        }
+
+        /// <summary>
+        /// A single read may return less than asked for before the end of the file; keep reading until it is full.
+        /// With <paramref name="direct"/> I/O a read can only continue from an aligned offset, so a short read that
+        /// stops elsewhere is the end of the file.
+        /// </summary>
+        public static async Task<int> ReadFullyAsync(Stream stream, Memory<byte> buffer, bool direct = false)
+        {
+            int total = 0;
+            while (total < buffer.Length)
+            {
+                int read = await stream.ReadAsync(buffer.Slice(total));
+                if (read == 0)
+                {
+                    break;
+                }
+                total += read;
+                if (direct && total % AlignedBufferPool.Alignment != 0)
+                {
+                    break;
+                }
+            }
+            return total;
+        }
+    }
+}
@@ -0,0 +1,302 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using cs_instrumentation;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// Several workers write and verify files at the same time, each keeping several chunk I/Os in flight, and
+    /// optionally read a file back through another mount than the one it was written through. Reports throughput
+    /// and how many files came back different.
+    /// </summary>
+    public static class StressTest
+    {
+        sealed class Totals
+        {
+            public long BytesWritten, Writes, BytesRead, Reads;
+            public long FilesVerified, FilesMismatched, BlocksMismatched;
+        }
+
+        // Per-I/O latencies over the whole run.
+        static IoLatencies latencies;
+
+        public static async Task<long> RunAsync(TestOptions options, MetricRegistry registry)
+        {
+            options.Validate();
+
+            var mounts = new List<string> { options.Directory };
+            mounts.AddRange(options.OtherMounts);
+            System.IO.Directory.CreateDirectory(options.Directory);
+
+            int workers = Math.Max(1, Math.Min(options.Workers, options.Files));
+            int queueDepth = Math.Max(1, options.QueueDepth);
+            Console.WriteLine($"seed {options.Seed}, {workers} worker(s) x queue depth {queueDepth}, {options.ChunkSize:N0} byte I/Os, " +
+                $"read-after-write delay {options.ReadAfterWriteDelay.TotalMilliseconds:N0} ms, {mounts.Count} mount(s), {TestFile.DescribeMode(options)}");
+
+            var totals = new Totals();
+            latencies = new IoLatencies(registry);
+            registry.AddPolledCounter("bytes-written", () => Interlocked.Read(ref totals.BytesWritten));
+            registry.AddPolledCounter("writes", () => Interlocked.Read(ref totals.Writes));
+            registry.AddPolledCounter("bytes-read", () => Interlocked.Read(ref totals.BytesRead));
+            registry.AddPolledCounter("reads", () => Interlocked.Read(ref totals.Reads));
+            registry.AddPolledCounter("files", () => Interlocked.Read(ref totals.FilesVerified));
+            registry.AddPolledCounter("mismatches", () => Interlocked.Read(ref totals.FilesMismatched));
+            using var cancel = new CancellationTokenSource();
+            ConsoleCancelEventHandler onCancel = (sender, e) =>
+            {
+                e.Cancel = true;
+                cancel.Cancel();
+            };
+            Console.CancelKeyPress += onCancel;
+
+            try
+            {
+                var tasks = new Task[workers];
+                for (int w = 0; w < workers; w++)
+                {
+                    int worker = w;
+                    tasks[w] = Task.Run(() => WorkerAsync(worker, workers, queueDepth, mounts, options, totals, cancel.Token));
+                }
+                Task all = Task.WhenAll(tasks);
+
+                Stopwatch elapsed = Stopwatch.StartNew();
+                var last = new Totals();
+                TimeSpan lastTime = TimeSpan.Zero;
+                while (await Task.WhenAny(all, Task.Delay(1000)) != all)
+                {
+                    TimeSpan now = elapsed.Elapsed;
+                    Report($"[{now.TotalSeconds,5:F0}s]", Snapshot(totals, last), now - lastTime);
+                    lastTime = now;
+
+                    // Not CancelAfter: its timer callback queues behind the workers' I/O in the thread pool, and on a
+                    // machine with one or two cores the run can go on long after the duration.
+                    if (options.Duration > TimeSpan.Zero && now >= options.Duration)
+                    {
+                        cancel.Cancel();
+                    }
+                }
+                await all;
+
+                Report("total", totals, elapsed.Elapsed);
+                latencies.Print();
+            }
+            finally
+            {
+                Console.CancelKeyPress -= onCancel;
+            }
+            return totals.FilesMismatched;
+        }
+
+        // Returns what happened since the previous snapshot, and keeps the current counts in it.
+        static Totals Snapshot(Totals totals, Totals last)
+        {
+            var current = new Totals
+            {
+                BytesWritten = Interlocked.Read(ref totals.BytesWritten),
+                Writes = Interlocked.Read(ref totals.Writes),
+                BytesRead = Interlocked.Read(ref totals.BytesRead),
+                Reads = Interlocked.Read(ref totals.Reads),
+                FilesVerified = Interlocked.Read(ref totals.FilesVerified),
+                FilesMismatched = Interlocked.Read(ref totals.FilesMismatched),
+                BlocksMismatched = Interlocked.Read(ref totals.BlocksMismatched),
+            };
+            var delta = new Totals
+            {
+                BytesWritten = current.BytesWritten - last.BytesWritten,
+                Writes = current.Writes - last.Writes,
+                BytesRead = current.BytesRead - last.BytesRead,
+                Reads = current.Reads - last.Reads,
+                FilesVerified = current.FilesVerified - last.FilesVerified,
+                FilesMismatched = current.FilesMismatched - last.FilesMismatched,
+                BlocksMismatched = current.BlocksMismatched - last.BlocksMismatched,
+            };
+            last.BytesWritten = current.BytesWritten;
+            last.Writes = current.Writes;
+            last.BytesRead = current.BytesRead;
+            last.Reads = current.Reads;
+            last.FilesVerified = current.FilesVerified;
+            last.FilesMismatched = current.FilesMismatched;
+            last.BlocksMismatched = current.BlocksMismatched;
+            return delta;
+        }
+
+        static void Report(string label, Totals t, TimeSpan time)
+        {
+            double seconds = Math.Max(time.TotalSeconds, 1e-9);
+            double rate = t.FilesVerified == 0 ? 0 : 100.0 * t.FilesMismatched / t.FilesVerified;
+            Console.WriteLine($"{label} write {t.BytesWritten / 1e6 / seconds,8:N1} MB/s {t.Writes / seconds,7:N0} IOPS | " +
+                $"read {t.BytesRead / 1e6 / seconds,8:N1} MB/s {t.Reads / seconds,7:N0} IOPS | " +
+                $"{t.FilesVerified} file(s) verified, {t.FilesMismatched} mismatched ({rate:F3}%), {t.BlocksMismatched} bad block(s)");
+        }
+
+        static async Task WorkerAsync(int worker, int workers, int queueDepth, List<string> mounts, TestOptions options, Totals totals, CancellationToken cancel)
+        {
+            ulong sequence = options.Seed ^ ((ulong)(worker + 1) * 0x9E3779B97F4A7C15UL);
+            var expected = new Memory<byte>[queueDepth];
+            var actual = new Memory<byte>[queueDepth];
+            for (int i = 0; i < queueDepth; i++)
+            {
+                expected[i] = AlignedBufferPool.Shared.Rent(options.ChunkSize);
+                actual[i] = AlignedBufferPool.Shared.Rent(options.ChunkSize);
+            }
+            var manifest = new BlockManifest(options.BlockSize);
+            var versions = new Dictionary<int, FileVersion>();
+            var lanes = new Lane[queueDepth];
+            for (int i = 0; i < queueDepth; i++)
+            {
+                lanes[i] = new Lane(options.BlockSize);
+            }
+
+            try
+            {
+                long iteration = 0;
+                for (int pass = 0; options.Passes == 0 || pass < options.Passes; pass++)
+                {
+                    for (int i = worker; i < options.Files; i += workers)
+                    {
+                        string fileName = $"test.{i:D4}.dat";
+                        string writePath = Path.Combine(mounts[(int)(iteration % mounts.Count)], fileName);
+                        string readPath = Path.Combine(mounts[(int)((iteration + 1) % mounts.Count)], fileName);
+                        iteration++;
+
+                        long size = (long)(Xoshiro256StarStar.SplitMix64(ref sequence) % (ulong)Math.Max(1, options.MaxSize));
+                        ulong seed = Xoshiro256StarStar.SplitMix64(ref sequence);
+
+                        await WriteFileAsync(writePath, size, seed, options, expected, manifest, totals, cancel);
+                        latencies.Barrier.RecordTicks(TestFile.CompleteWrite(writePath, size, options));
+                        if (options.ReadAfterWriteDelay > TimeSpan.Zero)
+                        {
+                            await Task.Delay(options.ReadAfterWriteDelay, cancel);
+                        }
+                        versions.TryGetValue(i, out FileVersion previous);
+                        (long badBlocks, long length, MismatchReport report) = await VerifyFileAsync(readPath, size, seed, previous, options, actual, manifest, lanes, totals);
+                        versions[i] = new FileVersion { Seed = seed, Size = size };
+
+                        Interlocked.Increment(ref totals.FilesVerified);
+                        if (badBlocks != 0 || length != size)
+                        {
+                            Interlocked.Increment(ref totals.FilesMismatched);
+                            Interlocked.Add(ref totals.BlocksMismatched, badBlocks);
+                            Console.WriteLine($"*** Different !!!!!!!!! {readPath} (written through {writePath}): {badBlocks} bad block(s), " +
+                                $"length {length:N0} of {size:N0} (data seed {seed}){Environment.NewLine}{report}");
+                        }
+                    }
+                }
+            }
+            catch (OperationCanceledException) when (cancel.IsCancellationRequested)
+            {
+                // The duration is over; the file in progress is not verified.
+            }
+            finally
+            {
+                for (int i = 0; i < queueDepth; i++)
+                {
+                    AlignedBufferPool.Shared.Return(expected[i]);
+                    AlignedBufferPool.Shared.Return(actual[i]);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Writes chunk c of the file on handle c % lanes, one handle per buffer, so that up to that many writes are
+        /// outstanding at once.
+        /// </summary>
+        static async Task WriteFileAsync(string path, long size, ulong seed, TestOptions options, Memory<byte>[] buffers, BlockManifest manifest,
+            Totals totals, CancellationToken cancel)
+        {
+            TestFile.Create(path, options).Dispose();
+            manifest.Reset(size);
+
+            int chunkSize = options.ChunkSize;
+            long chunks = (size + chunkSize - 1) / chunkSize;
+            int lanes = (int)Math.Min(buffers.Length, chunks);
+            var tasks = new Task[lanes];
+            for (int lane = 0; lane < lanes; lane++)
+            {
+                int l = lane;
+                tasks[lane] = Task.Run(async () =>
+                {
+                    await using FileStream f = TestFile.OpenWrite(path, options);
+                    for (long c = l; c < chunks; c += lanes)
+                    {
+                        long position = c * chunkSize;
+                        int count = (int)Math.Min(chunkSize, size - position);
+                        DataPattern.Fill(seed, position, buffers[l].Span.Slice(0, count));
+                        manifest.Add(position, buffers[l].Span.Slice(0, count));
+
+                        long start = Stopwatch.GetTimestamp();
+                        f.Position = position;
+                        await f.WriteAsync(buffers[l].Slice(0, TestFile.IoLength(count, options)), cancel);
+                        latencies.Write.RecordTicks(Stopwatch.GetTimestamp() - start);
+                        Interlocked.Add(ref totals.BytesWritten, count);
+                        Interlocked.Increment(ref totals.Writes);
+                    }
+                });
+            }
+            await Task.WhenAll(tasks);
+        }
+
+        // What a verifying lane needs besides its read buffer.
+        sealed class Lane
+        {
+            public readonly byte[] Scratch;
+            public readonly MismatchReport Report = new MismatchReport();
+
+            public Lane(int blockSize)
+            {
+                Scratch = new byte[2 * blockSize];
+            }
+        }
+
+        /// <summary>
+        /// Reads the chunks back the same way and checks them against the manifest. Returns the number of bad blocks,
+        /// the file length and the extents that differ.
+        /// </summary>
+        static async Task<(long BadBlocks, long Length, MismatchReport Report)> VerifyFileAsync(string path, long size, ulong seed, FileVersion previous,
+            TestOptions options, Memory<byte>[] actual, BlockManifest manifest, Lane[] laneState, Totals totals)
+        {
+            int chunkSize = options.ChunkSize;
+            long length = new FileInfo(path).Length;
+            long chunks = (size + chunkSize - 1) / chunkSize;
+            int lanes = (int)Math.Min(actual.Length, chunks);
+            long badBlocks = 0;
+            var tasks = new Task[lanes];
+            for (int lane = 0; lane < lanes; lane++)
+            {
+                int l = lane;
+                laneState[l].Report.Clear();
+                tasks[lane] = Task.Run(async () =>
+                {
+                    await using FileStream f = TestFile.OpenRead(path, options);
+                    for (long c = l; c < chunks; c += lanes)
+                    {
+                        long position = c * chunkSize;
+                        int count = (int)Math.Min(chunkSize, size - position);
+                        long start = Stopwatch.GetTimestamp();
+                        f.Position = position;
+                        int read = await StreamingTest.ReadFullyAsync(f, actual[l].Slice(0, TestFile.IoLength(count, options)), options.DirectIO);
+                        latencies.Read.RecordTicks(Stopwatch.GetTimestamp() - start);
+                        Interlocked.Add(ref totals.BytesRead, Math.Min(read, count));
+                        Interlocked.Increment(ref totals.Reads);
+
+                        int bad = manifest.Verify(position, actual[l].Span, read, count, seed, previous, laneState[l].Scratch, laneState[l].Report);
+                        Interlocked.Add(ref badBlocks, bad);
+                    }
+                });
+            }
+            await Task.WhenAll(tasks);
+
+            var report = new MismatchReport();
+            if (badBlocks != 0)
+            {
+                report.AddRange(laneState.Take(lanes).Select(state => state.Report));
+            }
+            return (badBlocks, length, report);
+        }
+    }
+}
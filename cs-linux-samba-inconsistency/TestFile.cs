@@ -0,0 +1,186 @@
+﻿using System;
+using System.Diagnostics;
+using System.IO;
+using System.Runtime.InteropServices;
+using cs_instrumentation;
+using Microsoft.Win32.SafeHandles;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// Opens test files with the caching options of a run, and puts the barrier between writing a file and
+    /// verifying it. Without them, the client page cache can serve the read-back without asking the server.
+    /// </summary>
+    public static class TestFile
+    {
+        // FILE_FLAG_NO_BUFFERING, which FileStream passes through on Windows.
+        const FileOptions NoBuffering = (FileOptions)0x20000000;
+
+        static readonly bool IsLinux = RuntimeInformation.IsOSPlatform(OSPlatform.Linux);
+        static readonly bool IsWindows = RuntimeInformation.IsOSPlatform(OSPlatform.Windows);
+
+        /// <summary>Describes the caching options, as printed at the start of a run.</summary>
+        public static string DescribeMode(TestOptions options)
+        {
+            if (!options.WriteThrough && !options.DirectIO && !options.Fsync && !options.DropCache)
+            {
+                return "cached";
+            }
+            string mode = "uncached:";
+            if (options.DirectIO) mode += IsWindows ? " no-buffering" : " O_DIRECT";
+            if (options.WriteThrough) mode += " write-through";
+            if (options.Fsync || options.DropCache) mode += " fsync";
+            if (options.DropCache) mode += IsLinux ? " drop-cache" : " (drop-cache unsupported here)";
+            return mode;
+        }
+
+        /// <summary>Creates or truncates the file.</summary>
+        public static FileStream Create(string path, TestOptions options)
+        {
+            return Open(path, FileMode.Create, FileAccess.Write, options);
+        }
+
+        /// <summary>Opens an existing file for writing, shared with the other lanes of a stress worker.</summary>
+        public static FileStream OpenWrite(string path, TestOptions options)
+        {
+            return Open(path, FileMode.Open, FileAccess.Write, options);
+        }
+
+        public static FileStream OpenRead(string path, TestOptions options)
+        {
+            return Open(path, FileMode.Open, FileAccess.Read, options);
+        }
+
+        /// <summary>
+        /// The number of bytes to transfer for <paramref name="count"/> bytes of data: direct I/O only moves whole
+        /// aligned blocks, so the tail of a file is written padded and truncated by <see cref="CompleteWrite"/>.
+        /// </summary>
+        public static int IoLength(int count, TestOptions options)
+        {
+            return options.DirectIO ? (count + AlignedBufferPool.Alignment - 1) & ~(AlignedBufferPool.Alignment - 1) : count;
+        }
+
+        /// <summary>
+        /// Sets the final length after padded direct writes, then, as asked, makes the file durable and evicts it
+        /// from the client cache. Returns the Stopwatch ticks it took.
+        /// </summary>
+        public static long CompleteWrite(string path, long size, TestOptions options)
+        {
+            long start = Stopwatch.GetTimestamp();
+            bool truncate = options.DirectIO && size % AlignedBufferPool.Alignment != 0;
+            if (!truncate && !options.Fsync && !options.DropCache)
+            {
+                return 0;
+            }
+
+            using (var f = new FileStream(path, FileMode.Open, FileAccess.Write, FileShare.ReadWrite, 1))
+            {
+                if (truncate)
+                {
+                    f.SetLength(size);
+                }
+                if (options.Fsync || options.DropCache)
+                {
+                    f.Flush(flushToDisk: true);
+                }
+                if (options.DropCache && IsLinux)
+                {
+                    // Only clean pages can be dropped, hence the fsync first.
+                    int error = Interop.Sys.PosixFAdvise(f.SafeFileHandle.DangerousGetHandle(), 0, 0, Interop.Sys.POSIX_FADV_DONTNEED);
+                    if (error != 0)
+                    {
+                        throw new IOException($"posix_fadvise(DONTNEED) on {path} failed: errno {error}");
+                    }
+                }
+            }
+            return Stopwatch.GetTimestamp() - start;
+        }
+
+        static FileStream Open(string path, FileMode mode, FileAccess access, TestOptions options)
+        {
+            FileOptions fileOptions = FileOptions.Asynchronous;
+            if (access == FileAccess.Read)
+            {
+                fileOptions |= FileOptions.SequentialScan;
+            }
+            if (access == FileAccess.Write && options.WriteThrough)
+            {
+                fileOptions |= FileOptions.WriteThrough;
+            }
+
+            if (options.DirectIO)
+            {
+                if (IsLinux)
+                {
+                    return OpenDirect(path, mode, access, options);
+                }
+                if (!IsWindows)
+                {
+                    throw new PlatformNotSupportedException("Direct I/O is only implemented on Linux and Windows.");
+                }
+                fileOptions |= NoBuffering;
+            }
+
+            // No FileStream buffer: every I/O is a whole chunk already.
+            return new FileStream(path, mode, access, FileShare.ReadWrite, 1, fileOptions);
+        }
+
+        // FileStream cannot ask for O_DIRECT, so open the descriptor here and wrap it.
+        static FileStream OpenDirect(string path, FileMode mode, FileAccess access, TestOptions options)
+        {
+            int flags = Interop.Sys.O_CLOEXEC | Interop.Sys.O_DIRECT;
+            flags |= access == FileAccess.Read ? Interop.Sys.O_RDONLY : Interop.Sys.O_WRONLY;
+            if (mode == FileMode.Create)
+            {
+                flags |= Interop.Sys.O_CREAT | Interop.Sys.O_TRUNC;
+            }
+            if (access == FileAccess.Write && options.WriteThrough)
+            {
+                flags |= Interop.Sys.O_SYNC;
+            }
+
+            int fd = Interop.Sys.Open(path, flags, 0x1B6); // 0666, less the umask
+            if (fd < 0)
+            {
+                int errno = Marshal.GetLastWin32Error();
+                throw new IOException($"open({path}, O_DIRECT) failed: errno {errno}" + (errno == 22 ? " (no direct I/O on this file system?)" : ""));
+            }
+            return new FileStream(new SafeFileHandle((IntPtr)fd, ownsHandle: true), access, 1, isAsync: false);
+        }
+    }
+
+    /// <summary>Per-I/O latencies of a pass or run, to tell cached from uncached modes apart.</summary>
+    public sealed class IoLatencies
+    {
+        /// <summary>With a registry, the histograms are its "write", "read" and "barrier", exported with the rest.</summary>
+        public IoLatencies(MetricRegistry registry = null)
+        {
+            Write = registry?.GetHistogram("write") ?? new LatencyHistogram("write");
+            Read = registry?.GetHistogram("read") ?? new LatencyHistogram("read");
+            Barrier = registry?.GetHistogram("barrier") ?? new LatencyHistogram("barrier");
+        }
+
+        public LatencyHistogram Write { get; }
+        public LatencyHistogram Read { get; }
+
+        /// <summary>Truncate, fsync and cache drop after each file; empty in the plain cached mode.</summary>
+        public LatencyHistogram Barrier { get; }
+
+        public HistogramSnapshot[] Snapshot() => new[] { Write.Snapshot(), Read.Snapshot(), Barrier.Snapshot() };
+
+        public void Print() => Print(null);
+
+        /// <summary>Prints what was recorded since <paramref name="earlier"/>, from <see cref="Snapshot"/>.</summary>
+        public void Print(HistogramSnapshot[] earlier)
+        {
+            HistogramSnapshot[] now = Snapshot();
+            Console.WriteLine($"  {now[0].Since(earlier?[0])}");
+            Console.WriteLine($"  {now[1].Since(earlier?[1])}");
+            HistogramSnapshot barrier = now[2].Since(earlier?[2]);
+            if (barrier.MaxNanoseconds != 0)
+            {
+                Console.WriteLine($"  {barrier}");
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+﻿using System;
+using System.Collections.Generic;
+
+namespace cs_linux_samba_inconsistency
+{
+    public sealed class TestOptions
+    {
+        public string Directory { get; set; } = @"\\lts\DataRoot\tmp\test1\";
+        public int Files { get; set; } = 32;
+
+        /// <summary>File sizes are picked uniformly in [0, MaxSize).</summary>
+        public long MaxSize { get; set; } = 10_000_000;
+
+        /// <summary>The size of each write and read; a multiple of <see cref="BlockSize"/>.</summary>
+        public int ChunkSize { get; set; } = 1024 * 1024;
+
+        /// <summary>The block size of the hash manifest, and so of a bad extent at worst; a multiple of 4096.</summary>
+        public int BlockSize { get; set; } = 64 * 1024;
+
+        /// <summary>0 runs until killed.</summary>
+        public int Passes { get; set; }
+
+        public ulong Seed { get; set; } = (ulong)DateTime.Now.Ticks;
+
+        // Caching. Each one takes a layer of client caching out of the read-back; see TestFile.
+
+        /// <summary>FileOptions.WriteThrough: O_SYNC on Linux, FILE_FLAG_WRITE_THROUGH on Windows.</summary>
+        public bool WriteThrough { get; set; }
+
+        /// <summary>O_DIRECT on Linux, FILE_FLAG_NO_BUFFERING on Windows, for both writing and reading.</summary>
+        public bool DirectIO { get; set; }
+
+        /// <summary>fsync (FlushFileBuffers) each file after writing it, before verifying it.</summary>
+        public bool Fsync { get; set; }
+
+        /// <summary>After the fsync, drop the file's pages from the page cache with posix_fadvise (Linux only).</summary>
+        public bool DropCache { get; set; }
+
+        // stress mode
+
+        /// <summary>
+        /// Other mounts of the same share as <see cref="Directory"/>, for instance through a second SMB client.
+        /// Files written through one mount are read back through the next.
+        /// </summary>
+        public List<string> OtherMounts { get; } = new List<string>();
+
+        /// <summary>Concurrent workers, each writing and verifying its own share of the files.</summary>
+        public int Workers { get; set; } = 8;
+
+        /// <summary>Outstanding I/Os per worker, each on its own handle to the file.</summary>
+        public int QueueDepth { get; set; } = 4;
+
+        /// <summary>The wait between closing a written file and opening it to read it back.</summary>
+        public TimeSpan ReadAfterWriteDelay { get; set; }
+
+        /// <summary>Zero runs until <see cref="Passes"/> or until killed.</summary>
+        public TimeSpan Duration { get; set; }
+
+        /// <summary>Throws <see cref="FormatException"/> if the sizes do not fit together.</summary>
+        public void Validate()
+        {
+            if (BlockSize <= 0 || BlockSize % DataPattern.BlockSize != 0)
+            {
+                throw new FormatException($"The block size must be a positive multiple of {DataPattern.BlockSize}.");
+            }
+            if (ChunkSize <= 0 || ChunkSize % BlockSize != 0)
+            {
+                throw new FormatException($"The chunk size must be a positive multiple of the block size ({BlockSize}).");
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Numerics;
+using System.Runtime.InteropServices;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// xoshiro256** (Blackman and Vigna). The test data is this generator's output (see <see cref="DataPattern"/>),
+    /// so a file can be verified by generating it again instead of keeping a copy in memory.
+    /// </summary>
+    public struct Xoshiro256StarStar
+    {
+        ulong s0, s1, s2, s3;
+
+        public Xoshiro256StarStar(ulong seed)
+        {
+            // Expand the seed with SplitMix64, as the authors recommend: the state must not be all zeros.
+            s0 = SplitMix64(ref seed);
+            s1 = SplitMix64(ref seed);
+            s2 = SplitMix64(ref seed);
+            s3 = SplitMix64(ref seed);
+        }
+
+        public ulong NextUInt64()
+        {
+            ulong result = BitOperations.RotateLeft(s1 * 5, 7) * 9;
+            ulong t = s1 << 17;
+
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = BitOperations.RotateLeft(s3, 45);
+
+            return result;
+        }
+
+        /// <summary>
+        /// Fills <paramref name="destination"/> with the next output, 8 bytes per step in little-endian order.
+        /// Filling 8 and then 8 bytes gives the same data as filling 16 at once; a tail shorter than 8 bytes
+        /// discards the rest of its step.
+        /// </summary>
+        public void Fill(Span<byte> destination)
+        {
+            // NextUInt64 on locals: the JIT keeps them in registers, not the fields.
+            Span<ulong> words = MemoryMarshal.Cast<byte, ulong>(destination);
+            ulong a = s0, b = s1, c = s2, d = s3;
+            for (int i = 0; i < words.Length; i++)
+            {
+                ulong result = BitOperations.RotateLeft(b * 5, 7) * 9;
+                ulong t = b << 17;
+                c ^= a;
+                d ^= b;
+                b ^= c;
+                a ^= d;
+                c ^= t;
+                d = BitOperations.RotateLeft(d, 45);
+                words[i] = BitConverter.IsLittleEndian ? result : BinaryPrimitives.ReverseEndianness(result);
+            }
+            s0 = a;
+            s1 = b;
+            s2 = c;
+            s3 = d;
+
+            Span<byte> tail = destination.Slice(words.Length * sizeof(ulong));
+            if (!tail.IsEmpty)
+            {
+                Span<byte> last = stackalloc byte[sizeof(ulong)];
+                BinaryPrimitives.WriteUInt64LittleEndian(last, NextUInt64());
+                last.Slice(0, tail.Length).CopyTo(tail);
+            }
+        }
+
+        public static ulong SplitMix64(ref ulong state)
+        {
+            ulong z = state += 0x9E3779B97F4A7C15UL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+            return z ^ (z >> 31);
+        }
+    }
+}
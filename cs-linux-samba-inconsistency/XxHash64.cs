@@ -0,0 +1,105 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Numerics;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+
+namespace cs_linux_samba_inconsistency
+{
+    /// <summary>
+    /// XXH64 (Yann Collet), one-shot over a span. Several times faster than generating and comparing the data
+    /// again, which is what makes a per-block manifest worth having.
+    /// </summary>
+    public static class XxHash64
+    {
+        const ulong Prime1 = 0x9E3779B185EBCA87UL;
+        const ulong Prime2 = 0xC2B2AE3D27D4EB4FUL;
+        const ulong Prime3 = 0x165667B19E3779F9UL;
+        const ulong Prime4 = 0x85EBCA77C2B2AE63UL;
+        const ulong Prime5 = 0x27D4EB2F165667C5UL;
+
+        public static ulong Hash(ReadOnlySpan<byte> data, ulong seed = 0)
+        {
+            int length = data.Length;
+            ulong h;
+
+            if (length >= 32)
+            {
+                ulong v1 = seed + Prime1 + Prime2;
+                ulong v2 = seed + Prime2;
+                ulong v3 = seed;
+                ulong v4 = seed - Prime1;
+
+                // Whole stripes as words, without the bounds checks of slicing 32 bytes at a time.
+                ReadOnlySpan<ulong> words = MemoryMarshal.Cast<byte, ulong>(data.Slice(0, length & ~31));
+                for (int i = 0; i < words.Length; i += 4)
+                {
+                    v1 = Round(v1, ToLittleEndian(words[i]));
+                    v2 = Round(v2, ToLittleEndian(words[i + 1]));
+                    v3 = Round(v3, ToLittleEndian(words[i + 2]));
+                    v4 = Round(v4, ToLittleEndian(words[i + 3]));
+                }
+                data = data.Slice(length & ~31);
+
+                h = BitOperations.RotateLeft(v1, 1) + BitOperations.RotateLeft(v2, 7) +
+                    BitOperations.RotateLeft(v3, 12) + BitOperations.RotateLeft(v4, 18);
+                h = MergeRound(h, v1);
+                h = MergeRound(h, v2);
+                h = MergeRound(h, v3);
+                h = MergeRound(h, v4);
+            }
+            else
+            {
+                h = seed + Prime5;
+            }
+
+            h += (ulong)length;
+
+            while (data.Length >= 8)
+            {
+                h ^= Round(0, BinaryPrimitives.ReadUInt64LittleEndian(data));
+                h = BitOperations.RotateLeft(h, 27) * Prime1 + Prime4;
+                data = data.Slice(8);
+            }
+            if (data.Length >= 4)
+            {
+                h ^= BinaryPrimitives.ReadUInt32LittleEndian(data) * Prime1;
+                h = BitOperations.RotateLeft(h, 23) * Prime2 + Prime3;
+                data = data.Slice(4);
+            }
+            foreach (byte b in data)
+            {
+                h ^= b * Prime5;
+                h = BitOperations.RotateLeft(h, 11) * Prime1;
+            }
+
+            h ^= h >> 33;
+            h *= Prime2;
+            h ^= h >> 29;
+            h *= Prime3;
+            h ^= h >> 32;
+            return h;
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        static ulong ToLittleEndian(ulong value)
+        {
+            return BitConverter.IsLittleEndian ? value : BinaryPrimitives.ReverseEndianness(value);
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        static ulong Round(ulong accumulator, ulong input)
+        {
+            accumulator += input * Prime2;
+            accumulator = BitOperations.RotateLeft(accumulator, 31);
+            return accumulator * Prime1;
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        static ulong MergeRound(ulong accumulator, ulong value)
+        {
+            accumulator ^= Round(0, value);
+            return accumulator * Prime1 + Prime4;
+        }
+    }
+}
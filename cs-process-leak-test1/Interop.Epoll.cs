@@ -0,0 +1,81 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Libraries
+    {
+        internal const string Libc = "libc";
+    }
+
+    internal static partial class Sys
+    {
+        // Linux syscall number of pidfd_open(2). Syscalls added after 4.x use the same number on every architecture.
+        private const long SYS_pidfd_open = 434;
+
+        /// <summary>
+        /// Obtains a file descriptor that refers to the process <paramref name="pid"/>.
+        /// The descriptor becomes readable when the process terminates (Linux 5.3+).
+        /// </summary>
+        /// <returns>The pidfd, or -1 on error (errno=ENOSYS on older kernels, ESRCH if the process does not exist).</returns>
+        internal static int PidfdOpen(int pid)
+        {
+            return (int)PidfdOpenSyscall(SYS_pidfd_open, pid, 0);
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "syscall", SetLastError = true)]
+        private static extern long PidfdOpenSyscall(long number, int pid, uint flags);
+
+        internal const int EPOLL_CLOEXEC = 0x80000;
+
+        internal const int EPOLL_CTL_ADD = 1;
+        internal const int EPOLL_CTL_DEL = 2;
+        internal const int EPOLL_CTL_MOD = 3;
+
+        internal const uint EPOLLIN = 0x001;
+        internal const uint EPOLLERR = 0x008;
+        internal const uint EPOLLHUP = 0x010;
+        internal const uint EPOLLRDHUP = 0x2000;
+        internal const uint EPOLLONESHOT = 1u << 30;
+
+        // struct epoll_event is declared __attribute__((packed)) on x86 and x86-64 only, so the
+        // size and the offset of the data union differ between architectures.
+        private static readonly bool s_epollEventIsPacked =
+            RuntimeInformation.ProcessArchitecture == Architecture.X64 ||
+            RuntimeInformation.ProcessArchitecture == Architecture.X86;
+
+        /// <summary>Size in bytes of one native struct epoll_event.</summary>
+        internal static readonly int EpollEventSize = s_epollEventIsPacked ? 12 : 16;
+
+        private static readonly int s_epollEventDataOffset = s_epollEventIsPacked ? 4 : 8;
+
+        [DllImport(Libraries.Libc, EntryPoint = "epoll_create1", SetLastError = true)]
+        internal static extern int EpollCreate1(int flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "epoll_ctl", SetLastError = true)]
+        private static extern unsafe int EpollCtl(int epfd, int op, int fd, byte* ev);
+
+        [DllImport(Libraries.Libc, EntryPoint = "epoll_wait", SetLastError = true)]
+        internal static extern unsafe int EpollWait(int epfd, byte* events, int maxevents, int timeout);
+
+        [DllImport(Libraries.Libc, EntryPoint = "close", SetLastError = true)]
+        internal static extern int Close(int fd);
+
+        /// <summary>Adds, modifies or removes <paramref name="fd"/> in the interest list of an epoll instance.</summary>
+        internal static unsafe int EpollCtl(int epfd, int op, int fd, uint events, ulong data)
+        {
+            byte* ev = stackalloc byte[16];
+            *(uint*)ev = events;
+            *(ulong*)(ev + s_epollEventDataOffset) = data;
+            return EpollCtl(epfd, op, fd, op == EPOLL_CTL_DEL ? null : ev);
+        }
+
+        /// <summary>Reads entry <paramref name="index"/> of an event buffer filled by <see cref="EpollWait"/>.</summary>
+        internal static unsafe void GetEpollEvent(byte* events, int index, out uint eventMask, out ulong data)
+        {
+            byte* ev = events + (index * EpollEventSize);
+            eventMask = *(uint*)ev;
+            data = *(ulong*)(ev + s_epollEventDataOffset);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        internal static partial class Fcntl
+        {
+            private const int F_DUPFD_CLOEXEC = 1030;
+            private const int F_SETFD = 2;
+            private const int FD_CLOEXEC = 1;
+            private const int F_GETFL = 3;
+            private const int F_SETFL = 4;
+            private const int O_NONBLOCK = 0x800;
+
+            /// <summary>Sets or clears O_NONBLOCK on <paramref name="fd"/>.</summary>
+            /// <returns>0 on success, -1 on error.</returns>
+            internal static int SetIsNonBlocking(int fd, bool isNonBlocking)
+            {
+                int flags = FcntlCore(fd, F_GETFL, 0);
+                if (flags < 0)
+                {
+                    return -1;
+                }
+
+                int newFlags = isNonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+                return newFlags == flags ? 0 : FcntlCore(fd, F_SETFL, newFlags);
+            }
+
+            /// <summary>Duplicates <paramref name="fd"/> onto the lowest free descriptor not below <paramref name="minimumFd"/>, with FD_CLOEXEC set.</summary>
+            /// <returns>The new descriptor, or -1 on error.</returns>
+            internal static int DuplicateCloseOnExec(int fd, int minimumFd)
+            {
+                return FcntlCore(fd, F_DUPFD_CLOEXEC, minimumFd);
+            }
+
+            /// <summary>Sets FD_CLOEXEC on <paramref name="fd"/>, the only descriptor flag.</summary>
+            /// <returns>0 on success, -1 on error.</returns>
+            internal static int SetCloseOnExec(int fd)
+            {
+                return FcntlCore(fd, F_SETFD, FD_CLOEXEC);
+            }
+
+            [DllImport(Libraries.Libc, EntryPoint = "fcntl", SetLastError = true)]
+            private static extern int FcntlCore(int fd, int cmd, int arg);
+        }
+    }
+}
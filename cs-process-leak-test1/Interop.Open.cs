@@ -0,0 +1,20 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        private const int O_RDONLY = 0;
+
+        /// <summary>Opens the file at the NUL-terminated <paramref name="path"/> for reading.</summary>
+        /// <returns>The descriptor, or -1 on error (errno=ENOENT once a /proc entry's process is gone).</returns>
+        internal static unsafe int OpenReadOnly(byte* path)
+        {
+            return Open(path, O_RDONLY | O_CLOEXEC);
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "open", SetLastError = true)]
+        private static extern unsafe int Open(byte* path, int flags);
+    }
+}
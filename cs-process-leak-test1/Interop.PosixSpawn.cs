@@ -0,0 +1,281 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        private const int O_CLOEXEC = 0x80000;
+
+        private const short POSIX_SPAWN_SETSIGDEF = 0x04;
+        private const short POSIX_SPAWN_SETSIGMASK = 0x08;
+
+        // posix_spawn_file_actions_t, posix_spawnattr_t and sigset_t are opaque; reserve more than glibc uses (80, 336 and 128 bytes).
+        private const int PosixSpawnFileActionsSize = 256;
+        private const int PosixSpawnAttrSize = 512;
+        private const int SigSetSize = 128;
+
+        /// <summary>0 until probed, then 1 if posix_spawn_file_actions_addchdir_np (glibc 2.29+) exists, otherwise -1.</summary>
+        private static int s_posixSpawnChdirSupported;
+
+        /// <summary>Whether <see cref="PosixSpawnProcess(string, byte**, byte**, string, bool, bool, bool, out int, out int, out int, out int)"/> can start a child in another working directory.</summary>
+        internal static unsafe bool PosixSpawnSupportsChdir
+        {
+            get
+            {
+                if (s_posixSpawnChdirSupported == 0)
+                {
+                    byte* fileActions = stackalloc byte[PosixSpawnFileActionsSize];
+                    PosixSpawnFileActionsInit(fileActions);
+                    try
+                    {
+                        PosixSpawnFileActionsAddChdir(fileActions, "/");
+                        s_posixSpawnChdirSupported = 1;
+                    }
+                    catch (EntryPointNotFoundException)
+                    {
+                        s_posixSpawnChdirSupported = -1;
+                    }
+                    finally
+                    {
+                        PosixSpawnFileActionsDestroy(fileActions);
+                    }
+                }
+                return s_posixSpawnChdirSupported > 0;
+            }
+        }
+
+        /// <summary>
+        /// Starts a child with posix_spawn, which glibc implements with CLONE_VFORK: the parent's address space
+        /// is not copied, so the cost doesn't grow with the size of the managed heap.
+        /// The child gets the same setup as with ForkAndExecProcess, except that credentials can't be changed.
+        /// </summary>
+        /// <returns>0 on success, otherwise the platform errno.</returns>
+        internal static unsafe int PosixSpawnProcess(
+            string filename, string[] argv, IDictionary<string, string> environment, string cwd,
+            bool redirectStdin, bool redirectStdout, bool redirectStderr,
+            out int lpChildPid, out int stdinFd, out int stdoutFd, out int stderrFd)
+        {
+            SpawnArena arena = SpawnArena.Rent();
+            try
+            {
+                arena.Encode(argv, environment, out byte** argvPtr, out byte** envpPtr);
+                return PosixSpawnProcess(
+                    filename, argvPtr, envpPtr, cwd,
+                    redirectStdin, redirectStdout, redirectStderr,
+                    out lpChildPid, out stdinFd, out stdoutFd, out stderrFd);
+            }
+            finally
+            {
+                SpawnArena.Return(arena);
+            }
+        }
+
+        /// <summary>Starts a child with posix_spawn from already marshalled, null-terminated argv and envp arrays.</summary>
+        /// <returns>0 on success, otherwise the platform errno.</returns>
+        internal static unsafe int PosixSpawnProcess(
+            string filename, byte** argv, byte** envp, string cwd,
+            bool redirectStdin, bool redirectStdout, bool redirectStderr,
+            out int lpChildPid, out int stdinFd, out int stdoutFd, out int stderrFd)
+        {
+            lpChildPid = -1;
+            stdinFd = stdoutFd = stderrFd = -1;
+
+            // [0] is the read end and [1] the write end of each pipe.
+            int* stdinPipe = stackalloc int[2] { -1, -1 };
+            int* stdoutPipe = stackalloc int[2] { -1, -1 };
+            int* stderrPipe = stackalloc int[2] { -1, -1 };
+            byte* fileActions = stackalloc byte[PosixSpawnFileActionsSize];
+            byte* attr = stackalloc byte[PosixSpawnAttrSize];
+            byte* signals = stackalloc byte[SigSetSize];
+            bool fileActionsInitialized = false, attrInitialized = false;
+
+            try
+            {
+                // The parent's ends must not leak into other children, so all pipes are close-on-exec;
+                // dup2 onto 0/1/2 in the child clears the flag on the child's copy.
+                if ((redirectStdin && Pipe2(stdinPipe, O_CLOEXEC) != 0) ||
+                    (redirectStdout && Pipe2(stdoutPipe, O_CLOEXEC) != 0) ||
+                    (redirectStderr && Pipe2(stderrPipe, O_CLOEXEC) != 0))
+                {
+                    return Marshal.GetLastWin32Error();
+                }
+
+                int error = PosixSpawnFileActionsInit(fileActions);
+                if (error != 0)
+                {
+                    return error;
+                }
+                fileActionsInitialized = true;
+
+                if ((redirectStdin && (error = PosixSpawnFileActionsAddDup2(fileActions, stdinPipe[0], 0)) != 0) ||
+                    (redirectStdout && (error = PosixSpawnFileActionsAddDup2(fileActions, stdoutPipe[1], 1)) != 0) ||
+                    (redirectStderr && (error = PosixSpawnFileActionsAddDup2(fileActions, stderrPipe[1], 2)) != 0) ||
+                    (cwd != null && (error = PosixSpawnFileActionsAddChdir(fileActions, cwd)) != 0))
+                {
+                    return error;
+                }
+
+                error = PosixSpawnAttrInit(attr);
+                if (error != 0)
+                {
+                    return error;
+                }
+                attrInitialized = true;
+
+                error = SetChildSignalState(attr, signals);
+                if (error != 0)
+                {
+                    return error;
+                }
+
+                error = PosixSpawn(out int childPid, filename, fileActions, attr, argv, envp);
+                if (error != 0)
+                {
+                    return error;
+                }
+
+                lpChildPid = childPid;
+                stdinFd = stdinPipe[1];
+                stdinPipe[1] = -1;
+                stdoutFd = stdoutPipe[0];
+                stdoutPipe[0] = -1;
+                stderrFd = stderrPipe[0];
+                stderrPipe[0] = -1;
+                return 0;
+            }
+            finally
+            {
+                if (attrInitialized)
+                {
+                    PosixSpawnAttrDestroy(attr);
+                }
+                if (fileActionsInitialized)
+                {
+                    PosixSpawnFileActionsDestroy(fileActions);
+                }
+
+                // Close the child's ends, and the parent's ends if the spawn failed.
+                for (int i = 0; i < 2; i++)
+                {
+                    CloseIfOpen(stdinPipe[i]);
+                    CloseIfOpen(stdoutPipe[i]);
+                    CloseIfOpen(stderrPipe[i]);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Starts a child with posix_spawn that shares our stdin, stdout and stderr and gets
+        /// <paramref name="fd"/> as descriptor <paramref name="targetFd"/>, without the close-on-exec flag.
+        /// </summary>
+        /// <returns>0 on success, otherwise the platform errno.</returns>
+        internal static unsafe int PosixSpawnWithDescriptor(
+            string filename, byte** argv, byte** envp, int fd, int targetFd, out int lpChildPid)
+        {
+            lpChildPid = -1;
+
+            byte* fileActions = stackalloc byte[PosixSpawnFileActionsSize];
+            byte* attr = stackalloc byte[PosixSpawnAttrSize];
+            byte* signals = stackalloc byte[SigSetSize];
+
+            int error = PosixSpawnFileActionsInit(fileActions);
+            if (error != 0)
+            {
+                return error;
+            }
+            try
+            {
+                error = PosixSpawnFileActionsAddDup2(fileActions, fd, targetFd);
+                if (error != 0)
+                {
+                    return error;
+                }
+
+                error = PosixSpawnAttrInit(attr);
+                if (error != 0)
+                {
+                    return error;
+                }
+                try
+                {
+                    error = SetChildSignalState(attr, signals);
+                    if (error == 0)
+                    {
+                        error = PosixSpawn(out lpChildPid, filename, fileActions, attr, argv, envp);
+                    }
+                    return error;
+                }
+                finally
+                {
+                    PosixSpawnAttrDestroy(attr);
+                }
+            }
+            finally
+            {
+                PosixSpawnFileActionsDestroy(fileActions);
+            }
+        }
+
+        /// <summary>
+        /// Like ForkAndExecProcess: the runtime's signal handlers must not stay installed in the child,
+        /// and the child starts with nothing blocked.
+        /// </summary>
+        private static unsafe int SetChildSignalState(byte* attr, byte* signals)
+        {
+            SigFillSet(signals);
+            PosixSpawnAttrSetSigDefault(attr, signals);
+            SigEmptySet(signals);
+            PosixSpawnAttrSetSigMask(attr, signals);
+            return PosixSpawnAttrSetFlags(attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+        }
+
+        private static void CloseIfOpen(int fd)
+        {
+            if (fd >= 0)
+            {
+                Close(fd);
+            }
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "pipe2", SetLastError = true)]
+        private static extern unsafe int Pipe2(int* pipefd, int flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawn")]
+        private static extern unsafe int PosixSpawn(out int pid, string path, byte* fileActions, byte* attrp, byte** argv, byte** envp);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawn_file_actions_init")]
+        private static extern unsafe int PosixSpawnFileActionsInit(byte* fileActions);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawn_file_actions_destroy")]
+        private static extern unsafe int PosixSpawnFileActionsDestroy(byte* fileActions);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawn_file_actions_adddup2")]
+        private static extern unsafe int PosixSpawnFileActionsAddDup2(byte* fileActions, int fd, int newfd);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawn_file_actions_addchdir_np")]
+        private static extern unsafe int PosixSpawnFileActionsAddChdir(byte* fileActions, string path);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawnattr_init")]
+        private static extern unsafe int PosixSpawnAttrInit(byte* attr);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawnattr_destroy")]
+        private static extern unsafe int PosixSpawnAttrDestroy(byte* attr);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawnattr_setflags")]
+        private static extern unsafe int PosixSpawnAttrSetFlags(byte* attr, short flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawnattr_setsigdefault")]
+        private static extern unsafe int PosixSpawnAttrSetSigDefault(byte* attr, byte* sigdefault);
+
+        [DllImport(Libraries.Libc, EntryPoint = "posix_spawnattr_setsigmask")]
+        private static extern unsafe int PosixSpawnAttrSetSigMask(byte* attr, byte* sigmask);
+
+        [DllImport(Libraries.Libc, EntryPoint = "sigemptyset")]
+        private static extern unsafe int SigEmptySet(byte* set);
+
+        [DllImport(Libraries.Libc, EntryPoint = "sigfillset")]
+        private static extern unsafe int SigFillSet(byte* set);
+    }
+}
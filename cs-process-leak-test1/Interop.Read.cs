@@ -0,0 +1,18 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        /// <summary>Reads up to <paramref name="count"/> bytes from <paramref name="fd"/>.</summary>
+        /// <returns>The number of bytes read, 0 at end of file, or -1 on error (errno=EAGAIN if a non-blocking fd has no data).</returns>
+        internal static unsafe int Read(int fd, byte* buffer, int count)
+        {
+            return (int)ReadCore(fd, buffer, (IntPtr)count);
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "read", SetLastError = true)]
+        private static extern unsafe IntPtr ReadCore(int fd, byte* buffer, IntPtr count);
+    }
+}
@@ -0,0 +1,43 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        // struct dirent of 64-bit glibc and musl: d_ino (8), d_off (8), d_reclen (2), d_type (1), then d_name.
+        // 32-bit glibc's readdir returns 32-bit d_ino and d_off, so the offset is only known on 64-bit Linux.
+        private const int DirentNameOffset = 19;
+
+        /// <summary>Whether <see cref="ReadDir"/> knows the layout of struct dirent; if not, enumerate managed.</summary>
+        internal static readonly bool CanReadDir =
+            RuntimeInformation.IsOSPlatform(OSPlatform.Linux) && IntPtr.Size == 8;
+
+        /// <summary>Opens the directory at the NUL-terminated <paramref name="path"/>.</summary>
+        /// <returns>The DIR*, or IntPtr.Zero on error.</returns>
+        [DllImport(Libraries.Libc, EntryPoint = "opendir", SetLastError = true)]
+        internal static extern unsafe IntPtr OpenDir(byte* path);
+
+        /// <summary>
+        /// Reads the next entry of <paramref name="dir"/>.  The returned name points into libc's buffer for the
+        /// directory and stays valid until the next call on it.
+        /// </summary>
+        /// <returns>The NUL-terminated name of the entry, or null at the end of the directory.</returns>
+        internal static unsafe byte* ReadDir(IntPtr dir)
+        {
+            if (!CanReadDir)
+            {
+                throw new PlatformNotSupportedException();
+            }
+
+            byte* entry = ReadDirCore(dir);
+            return entry == null ? null : entry + DirentNameOffset;
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "closedir")]
+        internal static extern int CloseDir(IntPtr dir);
+
+        [DllImport(Libraries.Libc, EntryPoint = "readdir", SetLastError = true)]
+        private static extern unsafe byte* ReadDirCore(IntPtr dir);
+    }
+}
@@ -0,0 +1,152 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        private const int AF_UNIX = 1;
+        private const int SOCK_SEQPACKET = 5;
+        private const int SOCK_CLOEXEC = 0x80000;
+        private const int SOL_SOCKET = 1;
+        private const int SCM_RIGHTS = 1;
+        private const int SHUT_WR = 1;
+
+        private const int MSG_PEEK = 0x2;
+        private const int MSG_TRUNC = 0x20;
+        private const int MSG_NOSIGNAL = 0x4000;
+        private const int MSG_CMSG_CLOEXEC = 0x40000000;
+
+        /// <summary>Room for the cmsghdr and up to 8 descriptors.</summary>
+        private const int ControlBufferSize = 64;
+
+        [StructLayout(LayoutKind.Sequential)]
+        private unsafe struct IOVector
+        {
+            public byte* Base;
+            public IntPtr Count;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        private unsafe struct MessageHeader
+        {
+            public byte* Name;
+            public uint NameLength;
+            public IOVector* IOVectors;
+            public IntPtr IOVectorCount;
+            public byte* ControlBuffer;
+            public IntPtr ControlBufferLength;
+            public int Flags;
+        }
+
+        // struct cmsghdr { size_t cmsg_len; int cmsg_level; int cmsg_type; unsigned char data[]; }, aligned to size_t.
+        private static int CmsgAlign(int length) => (length + IntPtr.Size - 1) & ~(IntPtr.Size - 1);
+        private static int CmsgHeaderSize => CmsgAlign(IntPtr.Size + 2 * sizeof(int));
+
+        /// <summary>Creates a connected pair of close-on-exec SOCK_SEQPACKET Unix sockets, which keep message boundaries.</summary>
+        /// <returns>0 on success, otherwise -1 with errno set.</returns>
+        internal static unsafe int SeqPacketSocketPair(int* fds)
+        {
+            return SocketPairCore(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds);
+        }
+
+        /// <summary>Sends one message, passing <paramref name="fdCount"/> descriptors along with it.</summary>
+        /// <returns>The number of bytes sent, or -1 with errno set.</returns>
+        internal static unsafe int SendMessage(int socket, byte* buffer, int length, int* fds, int fdCount)
+        {
+            System.Diagnostics.Debug.Assert(CmsgHeaderSize + CmsgAlign(fdCount * sizeof(int)) <= ControlBufferSize);
+
+            byte* control = stackalloc byte[ControlBufferSize];
+            var iov = new IOVector { Base = buffer, Count = (IntPtr)length };
+            var header = new MessageHeader { IOVectors = &iov, IOVectorCount = (IntPtr)1 };
+
+            if (fdCount > 0)
+            {
+                new Span<byte>(control, ControlBufferSize).Clear();
+                *(IntPtr*)control = (IntPtr)(CmsgHeaderSize + fdCount * sizeof(int));
+                ((int*)(control + IntPtr.Size))[0] = SOL_SOCKET;
+                ((int*)(control + IntPtr.Size))[1] = SCM_RIGHTS;
+                Buffer.MemoryCopy(fds, control + CmsgHeaderSize, ControlBufferSize - CmsgHeaderSize, fdCount * sizeof(int));
+                header.ControlBuffer = control;
+                header.ControlBufferLength = (IntPtr)(CmsgHeaderSize + CmsgAlign(fdCount * sizeof(int)));
+            }
+
+            return (int)SendMsg(socket, &header, MSG_NOSIGNAL);
+        }
+
+        /// <summary>
+        /// Receives one message. Descriptors passed with it are stored in <paramref name="fds"/> (close-on-exec);
+        /// any beyond <paramref name="maxFds"/> are closed.
+        /// </summary>
+        /// <returns>The number of bytes received, 0 if the peer closed the connection, or -1 with errno set.</returns>
+        internal static unsafe int ReceiveMessage(int socket, byte* buffer, int length, int* fds, int maxFds, out int fdCount)
+        {
+            fdCount = 0;
+            byte* control = stackalloc byte[ControlBufferSize];
+            var iov = new IOVector { Base = buffer, Count = (IntPtr)length };
+            var header = new MessageHeader
+            {
+                IOVectors = &iov,
+                IOVectorCount = (IntPtr)1,
+                ControlBuffer = control,
+                ControlBufferLength = (IntPtr)ControlBufferSize,
+            };
+
+            int received = (int)RecvMsg(socket, &header, MSG_CMSG_CLOEXEC);
+            if (received < 0)
+            {
+                return -1;
+            }
+
+            // A single SCM_RIGHTS message is all that's ever sent.
+            long controlLength = (long)header.ControlBufferLength;
+            if (controlLength >= CmsgHeaderSize &&
+                ((int*)(control + IntPtr.Size))[0] == SOL_SOCKET &&
+                ((int*)(control + IntPtr.Size))[1] == SCM_RIGHTS)
+            {
+                int count = (int)(((long)*(IntPtr*)control - CmsgHeaderSize) / sizeof(int));
+                int* receivedFds = (int*)(control + CmsgHeaderSize);
+                for (int i = 0; i < count; i++)
+                {
+                    if (i < maxFds)
+                    {
+                        fds[fdCount++] = receivedFds[i];
+                    }
+                    else
+                    {
+                        Close(receivedFds[i]);
+                    }
+                }
+            }
+            return received;
+        }
+
+        /// <summary>Returns the size of the next message without consuming it, 0 if the peer closed the connection, or -1 with errno set.</summary>
+        internal static unsafe int PeekMessageLength(int socket)
+        {
+            byte dummy;
+            return (int)Recv(socket, &dummy, (IntPtr)0, MSG_PEEK | MSG_TRUNC);
+        }
+
+        /// <summary>Shuts down the sending direction of <paramref name="socket"/>: the peer receives end of file, but can still reply.</summary>
+        internal static int ShutdownSend(int socket)
+        {
+            return Shutdown(socket, SHUT_WR);
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "socketpair", SetLastError = true)]
+        private static extern unsafe int SocketPairCore(int domain, int type, int protocol, int* fds);
+
+        [DllImport(Libraries.Libc, EntryPoint = "sendmsg", SetLastError = true)]
+        private static extern unsafe IntPtr SendMsg(int socket, MessageHeader* message, int flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "recvmsg", SetLastError = true)]
+        private static extern unsafe IntPtr RecvMsg(int socket, MessageHeader* message, int flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "recv", SetLastError = true)]
+        private static extern unsafe IntPtr Recv(int socket, byte* buffer, IntPtr length, int flags);
+
+        [DllImport(Libraries.Libc, EntryPoint = "shutdown", SetLastError = true)]
+        private static extern int Shutdown(int socket, int how);
+    }
+}
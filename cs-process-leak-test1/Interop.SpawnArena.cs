@@ -0,0 +1,201 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using System.Text;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        /// <summary>
+        /// Native memory for the argv and envp arrays handed to ForkAndExecProcess.
+        /// The pointer arrays and the null-terminated UTF-8 strings they reference share a single block that is
+        /// kept per thread and reused by the next spawn, so once the block is large enough a spawn doesn't allocate.
+        /// The environment encoded from a ProcessStartInfo is cached separately and only rebuilt when it changes.
+        /// </summary>
+        internal sealed unsafe class SpawnArena
+        {
+            /// <summary>Blocks larger than this are freed instead of being kept for the next spawn on the thread.</summary>
+            private const int MaxRetainedBlockSize = 1024 * 1024;
+            private const int MinBlockSize = 4096;
+
+            [ThreadStatic]
+            private static SpawnArena t_cachedArena;
+
+            private byte* _block;
+            private int _blockSize;
+
+            // The encoded environment and the entries it was encoded from.
+            private byte* _environmentBlock;
+            private int _environmentBlockSize;
+            private string[] _environmentKeys;
+            private string[] _environmentValues;
+
+            /// <summary>Gets the calling thread's arena, or a new one if the thread's arena is in use.</summary>
+            internal static SpawnArena Rent()
+            {
+                SpawnArena arena = t_cachedArena;
+                if (arena != null)
+                {
+                    t_cachedArena = null;
+                    return arena;
+                }
+                return new SpawnArena();
+            }
+
+            /// <summary>Gives an arena back to the calling thread once the pointers it handed out are no longer used.</summary>
+            internal static void Return(SpawnArena arena)
+            {
+                if (arena._blockSize > MaxRetainedBlockSize)
+                {
+                    FreeBlock(ref arena._block, ref arena._blockSize);
+                }
+                t_cachedArena = arena;
+            }
+
+            ~SpawnArena()
+            {
+                FreeBlock(ref _block, ref _blockSize);
+                FreeBlock(ref _environmentBlock, ref _environmentBlockSize);
+            }
+
+            /// <summary>Encodes <paramref name="argv"/> and <paramref name="envp"/> (entries of the form "name=value").</summary>
+            internal void Encode(string[] argv, string[] envp, out byte** argvPtr, out byte** envpPtr)
+            {
+                int pointersSize = sizeof(IntPtr) * (argv.Length + 1 + envp.Length + 1);
+                EnsureCapacity(ref _block, ref _blockSize, pointersSize + GetEncodedSize(argv) + GetEncodedSize(envp));
+
+                byte* end = _block + _blockSize;
+                argvPtr = (byte**)_block;
+                envpPtr = argvPtr + argv.Length + 1;
+                byte* data = WriteArray(argv, argvPtr, _block + pointersSize, end);
+                WriteArray(envp, envpPtr, data, end);
+            }
+
+            /// <summary>
+            /// Encodes <paramref name="argv"/> and <paramref name="environment"/>. The environment block is reused
+            /// as long as the dictionary holds the same entries as when it was last encoded.
+            /// </summary>
+            internal void Encode(string[] argv, IDictionary<string, string> environment, out byte** argvPtr, out byte** envpPtr)
+            {
+                int pointersSize = sizeof(IntPtr) * (argv.Length + 1);
+                EnsureCapacity(ref _block, ref _blockSize, pointersSize + GetEncodedSize(argv));
+
+                argvPtr = (byte**)_block;
+                WriteArray(argv, argvPtr, _block + pointersSize, _block + _blockSize);
+
+                if (!EnvironmentMatches(environment))
+                {
+                    EncodeEnvironment(environment);
+                }
+                envpPtr = (byte**)_environmentBlock;
+            }
+
+            private bool EnvironmentMatches(IDictionary<string, string> environment)
+            {
+                // Same count and every cached entry present with the same value means the same set of entries.
+                if (_environmentKeys == null || environment.Count != _environmentKeys.Length)
+                {
+                    return false;
+                }
+
+                for (int i = 0; i < _environmentKeys.Length; i++)
+                {
+                    if (!environment.TryGetValue(_environmentKeys[i], out string value) ||
+                        !string.Equals(value, _environmentValues[i], StringComparison.Ordinal))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            private void EncodeEnvironment(IDictionary<string, string> environment)
+            {
+                var keys = new string[environment.Count];
+                var values = new string[keys.Length];
+                int count = 0;
+                int dataSize = 0;
+                foreach (KeyValuePair<string, string> pair in environment)
+                {
+                    keys[count] = pair.Key;
+                    values[count] = pair.Value;
+                    count++;
+                    dataSize += Encoding.UTF8.GetByteCount(pair.Key) + 1 + Encoding.UTF8.GetByteCount(pair.Value ?? string.Empty) + 1;
+                }
+
+                int pointersSize = sizeof(IntPtr) * (count + 1);
+                EnsureCapacity(ref _environmentBlock, ref _environmentBlockSize, pointersSize + dataSize);
+
+                byte** envpPtr = (byte**)_environmentBlock;
+                byte* data = _environmentBlock + pointersSize;
+                byte* end = _environmentBlock + _environmentBlockSize;
+                for (int i = 0; i < count; i++)
+                {
+                    envpPtr[i] = data;
+                    data = WriteChars(keys[i], data, end);
+                    *data++ = (byte)'=';
+                    data = WriteChars(values[i] ?? string.Empty, data, end);
+                    *data++ = (byte)'\0';
+                }
+                envpPtr[count] = null;
+
+                _environmentKeys = keys;
+                _environmentValues = values;
+            }
+
+            private static int GetEncodedSize(string[] values)
+            {
+                int size = 0;
+                foreach (string value in values)
+                {
+                    size += Encoding.UTF8.GetByteCount(value) + 1; // +1 for null termination
+                }
+                return size;
+            }
+
+            /// <summary>Copies <paramref name="values"/> to <paramref name="data"/> and stores a pointer to each in <paramref name="arrPtr"/>.</summary>
+            /// <returns>The end of the written data.</returns>
+            private static byte* WriteArray(string[] values, byte** arrPtr, byte* data, byte* end)
+            {
+                for (int i = 0; i < values.Length; i++)
+                {
+                    arrPtr[i] = data;
+                    data = WriteChars(values[i], data, end);
+                    *data++ = (byte)'\0'; // null terminate
+                }
+                arrPtr[values.Length] = null; // null terminate the array
+                return data;
+            }
+
+            private static byte* WriteChars(string value, byte* data, byte* end)
+            {
+                fixed (char* chars = value)
+                {
+                    return data + Encoding.UTF8.GetBytes(chars, value.Length, data, (int)(end - data));
+                }
+            }
+
+            private static void EnsureCapacity(ref byte* block, ref int blockSize, int requiredSize)
+            {
+                if (requiredSize > blockSize)
+                {
+                    int newSize = Math.Max(Math.Max(requiredSize, MinBlockSize), blockSize * 2);
+                    FreeBlock(ref block, ref blockSize);
+                    block = (byte*)Marshal.AllocHGlobal(newSize);
+                    blockSize = newSize;
+                }
+            }
+
+            private static void FreeBlock(ref byte* block, ref int blockSize)
+            {
+                if (block != null)
+                {
+                    Marshal.FreeHGlobal((IntPtr)block);
+                    block = null;
+                    blockSize = 0;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,76 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+internal static partial class Interop
+{
+    internal static partial class Sys
+    {
+        private const int WNOHANG = 1;
+
+        /// <summary>Waits for the child <paramref name="pid"/> to change state, blocking unless WNOHANG is given.</summary>
+        /// <returns>The pid, 0 with WNOHANG if the child is still running, or -1 with errno set.</returns>
+        [DllImport(Libraries.Libc, EntryPoint = "waitpid", SetLastError = true)]
+        internal static extern int WaitPid(int pid, out int status, int options);
+
+        /// <summary>struct timeval.</summary>
+        [StructLayout(LayoutKind.Sequential)]
+        internal struct TimeValue
+        {
+            public IntPtr Seconds;
+            public IntPtr Microseconds;
+
+            public TimeSpan ToTimeSpan() =>
+                new TimeSpan((long)Seconds * TimeSpan.TicksPerSecond + (long)Microseconds * (TimeSpan.TicksPerMillisecond / 1000));
+        }
+
+        /// <summary>struct rusage, as filled in by wait4.</summary>
+        [StructLayout(LayoutKind.Sequential)]
+        internal struct ResourceUsage
+        {
+            public TimeValue UserTime;
+            public TimeValue SystemTime;
+            /// <summary>Peak resident set size, in kilobytes.</summary>
+            public IntPtr MaxResidentSetSize;
+            public IntPtr IntegralSharedMemorySize;
+            public IntPtr IntegralUnsharedDataSize;
+            public IntPtr IntegralUnsharedStackSize;
+            public IntPtr MinorFaults;
+            public IntPtr MajorFaults;
+            public IntPtr Swaps;
+            public IntPtr BlockInputOperations;
+            public IntPtr BlockOutputOperations;
+            public IntPtr MessagesSent;
+            public IntPtr MessagesReceived;
+            public IntPtr SignalsReceived;
+            public IntPtr VoluntaryContextSwitches;
+            public IntPtr InvoluntaryContextSwitches;
+        }
+
+        /// <summary>
+        /// Like <see cref="WaitPidExitedNoHang"/>, but with wait4, so the child's resource usage comes with its
+        /// exit status at no extra cost. It can't be queried any more once the child is reaped.
+        /// </summary>
+        /// <returns>The pid if the child was reaped, 0 if it's still running, or -1 with errno set.</returns>
+        internal static int WaitPidExitedNoHang(int pid, out int exitCode, out ResourceUsage usage)
+        {
+            int result;
+            int status;
+            while ((result = Wait4(pid, out status, WNOHANG, out usage)) < 0 && GetLastError() == Error.EINTR)
+            {
+            }
+
+            exitCode = result > 0 ? DecodeExitStatus(status) : 0;
+            return result;
+        }
+
+        /// <summary>Same convention as SystemNative_WaitPidExitedNoHang: a signal-terminated child exits with 128 + signal.</summary>
+        internal static int DecodeExitStatus(int status)
+        {
+            int termSignal = status & 0x7f;
+            return termSignal == 0 ? (status >> 8) & 0xff : 128 + termSignal;
+        }
+
+        [DllImport(Libraries.Libc, EntryPoint = "wait4", SetLastError = true)]
+        internal static extern int Wait4(int pid, out int status, int options, out ResourceUsage usage);
+    }
+}
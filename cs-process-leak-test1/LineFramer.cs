@@ -0,0 +1,212 @@
+﻿// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+// See the LICENSE file in the project root for more information.
+
+using System;
+using System.Buffers;
+using System.Text;
+
+namespace MyDiagnostics
+{
+    /// <summary>Receives a line without its terminator. The span is only valid for the duration of the call.</summary>
+    internal delegate void LineCallback(ReadOnlySpan<char> line);
+
+    /// <summary>
+    /// Splits a byte stream into lines as it arrives in chunks.
+    /// A line is a sequence of characters followed by a carriage return ('\r'), a line feed ('\n'), or a
+    /// carriage return immediately followed by a line feed; the terminator is not part of the line.
+    /// </summary>
+    /// <remarks>
+    /// For encodings in which '\r' and '\n' are single bytes that never occur inside a multi-byte sequence
+    /// (UTF-8 and single-byte code pages) the terminators are searched in the raw bytes, and each line's bytes are
+    /// decoded once straight into the line buffer. Other encodings are decoded first and searched as characters.
+    /// Both searches use the vectorized Span IndexOfAny. All buffers come from the shared array pools.
+    /// </remarks>
+    internal sealed class LineFramer : IDisposable
+    {
+        private const int InitialLineBufferSize = 256;
+
+        private readonly Encoding _encoding;
+        private readonly Decoder _decoder;
+        private readonly bool _scanBytes;
+        private readonly LineCallback _lineCallback;
+
+        // Characters of the line that hasn't been terminated yet.
+        private char[] _line;
+        private int _lineLength;
+        // Scratch space for the character path.
+        private char[] _decoded;
+
+        // The last chunk ended with '\r', so a '\n' at the start of the next one belongs to it.
+        private bool _lastCarriageReturn;
+
+        internal LineFramer(Encoding encoding, LineCallback lineCallback)
+        {
+            _encoding = encoding;
+            _decoder = encoding.GetDecoder();
+            _scanBytes = encoding is UTF8Encoding || encoding.IsSingleByte;
+            _lineCallback = lineCallback;
+            _line = ArrayPool<char>.Shared.Rent(InitialLineBufferSize);
+        }
+
+        /// <summary>Consumes the next chunk of the stream, calling back for every line completed by it.</summary>
+        internal void Append(ReadOnlySpan<byte> bytes)
+        {
+            if (_scanBytes)
+            {
+                AppendBytes(bytes);
+            }
+            else
+            {
+                int maxChars = _encoding.GetMaxCharCount(bytes.Length);
+                if (_decoded == null || _decoded.Length < maxChars)
+                {
+                    ReturnBuffer(ref _decoded);
+                    _decoded = ArrayPool<char>.Shared.Rent(maxChars);
+                }
+                int charCount = _decoder.GetChars(bytes, _decoded, flush: false);
+                AppendChars(new ReadOnlySpan<char>(_decoded, 0, charCount));
+            }
+        }
+
+        /// <summary>Ends the stream: the unterminated rest, if any, is reported as the last line.</summary>
+        internal void Complete()
+        {
+            EnsureLineCapacity(_encoding.GetMaxCharCount(0) + 2);
+            _lineLength += _decoder.GetChars(ReadOnlySpan<byte>.Empty, _line.AsSpan(_lineLength), flush: true);
+            if (_lineLength != 0)
+            {
+                EmitLine();
+            }
+        }
+
+        private void AppendBytes(ReadOnlySpan<byte> bytes)
+        {
+            while (!bytes.IsEmpty)
+            {
+                if (_lastCarriageReturn)
+                {
+                    // skip a beginning '\n' character of new block if last block ended with '\r'
+                    _lastCarriageReturn = false;
+                    if (bytes[0] == (byte)'\n')
+                    {
+                        bytes = bytes.Slice(1);
+                        continue;
+                    }
+                }
+
+                int index = bytes.IndexOfAny((byte)'\r', (byte)'\n');
+                if (index < 0)
+                {
+                    Decode(bytes, flush: false);
+                    return;
+                }
+
+                Decode(bytes.Slice(0, index), flush: true);
+                EmitLine();
+
+                if (bytes[index] == (byte)'\r')
+                {
+                    if (index + 1 == bytes.Length)
+                    {
+                        // The '\n' may be the first byte of the next chunk.
+                        _lastCarriageReturn = true;
+                    }
+                    else if (bytes[index + 1] == (byte)'\n')
+                    {
+                        // skip the "\n" character following "\r" character
+                        index++;
+                    }
+                }
+                bytes = bytes.Slice(index + 1);
+            }
+        }
+
+        private void AppendChars(ReadOnlySpan<char> chars)
+        {
+            while (!chars.IsEmpty)
+            {
+                if (_lastCarriageReturn)
+                {
+                    _lastCarriageReturn = false;
+                    if (chars[0] == '\n')
+                    {
+                        chars = chars.Slice(1);
+                        continue;
+                    }
+                }
+
+                int index = chars.IndexOfAny('\r', '\n');
+                if (index < 0)
+                {
+                    AppendToLine(chars);
+                    return;
+                }
+
+                AppendToLine(chars.Slice(0, index));
+                EmitLine();
+
+                if (chars[index] == '\r')
+                {
+                    if (index + 1 == chars.Length)
+                    {
+                        _lastCarriageReturn = true;
+                    }
+                    else if (chars[index + 1] == '\n')
+                    {
+                        index++;
+                    }
+                }
+                chars = chars.Slice(index + 1);
+            }
+        }
+
+        private void Decode(ReadOnlySpan<byte> bytes, bool flush)
+        {
+            EnsureLineCapacity(_encoding.GetMaxCharCount(bytes.Length));
+            _lineLength += _decoder.GetChars(bytes, _line.AsSpan(_lineLength), flush);
+        }
+
+        private void AppendToLine(ReadOnlySpan<char> chars)
+        {
+            EnsureLineCapacity(chars.Length);
+            chars.CopyTo(_line.AsSpan(_lineLength));
+            _lineLength += chars.Length;
+        }
+
+        private void EmitLine()
+        {
+            // Reset first: the callback may throw, and the line must not be reported again.
+            int length = _lineLength;
+            _lineLength = 0;
+            _lineCallback(new ReadOnlySpan<char>(_line, 0, length));
+        }
+
+        private void EnsureLineCapacity(int additional)
+        {
+            int required = _lineLength + additional;
+            if (required > _line.Length)
+            {
+                char[] larger = ArrayPool<char>.Shared.Rent(Math.Max(required, _line.Length * 2));
+                _line.AsSpan(0, _lineLength).CopyTo(larger);
+                ArrayPool<char>.Shared.Return(_line);
+                _line = larger;
+            }
+        }
+
+        private static void ReturnBuffer(ref char[] buffer)
+        {
+            if (buffer != null)
+            {
+                ArrayPool<char>.Shared.Return(buffer);
+                buffer = null;
+            }
+        }
+
+        public void Dispose()
+        {
+            ReturnBuffer(ref _line);
+            ReturnBuffer(ref _decoded);
+        }
+    }
+}
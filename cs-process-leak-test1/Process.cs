@@ -4,6 +4,7 @@
 
 using Microsoft.Win32.SafeHandles;
 using System;
+using System.Buffers;
 using System.Collections.Generic;
 using System.Collections.ObjectModel;
 using System.ComponentModel;
@@ -123,6 +124,8 @@ namespace MyDiagnostics
 
     public delegate void DataReceivedEventHandler(object sender, DataReceivedEventArgs e);
 
+    public delegate void DataSpanReceivedEventHandler(object sender, ReadOnlySpan<char> data);
+
     public class DataReceivedEventArgs : EventArgs
     {
         private readonly string _data;
@@ -139,48 +142,37 @@ namespace MyDiagnostics
     }
 
 
-    internal sealed class AsyncStreamReader : IDisposable
+    internal sealed class AsyncStreamReader : IProcessPipeSink, IDisposable
     {
-        private const int DefaultBufferSize = 1024;  // Byte buffer size
+        // Reads start with a small buffer, which doubles each time a read fills it so that a chatty child
+        // is drained with few, large reads.
+        private const int MinBufferSize = 4096;
+        private const int MaxBufferSize = 256 * 1024;
 
         private readonly Stream _stream;
-        private readonly Decoder _decoder;
-        private readonly byte[] _byteBuffer;
-        private readonly char[] _charBuffer;
+        private readonly LineFramer _framer;
 
-        // Delegate to call user function.
-        private readonly Action<string> _userCallBack;
+        // Delegates to call user functions.
+        private readonly LineCallback _userCallBack;
+        private readonly Action _userEndOfStreamCallBack;
 
         private readonly CancellationTokenSource _cts;
         private Task _readToBufferTask;
-        private readonly Queue<string> _messageQueue;
-        private StringBuilder _sb;
-        private bool _bLastCarriageReturn;
+        private ProcessPipeReactor.Registration _reactorRegistration;
         private bool _cancelOperation;
 
-        // Cache the last position scanned in sb when searching for lines.
-        private int _currentLinePos;
-
-        // Creates a new AsyncStreamReader for the given stream. The
-        // character encoding is set by encoding and the buffer size,
-        // in number of 16-bit characters, is set by bufferSize.
-        internal AsyncStreamReader(Stream stream, Action<string> callback, Encoding encoding)
+        // Creates a new AsyncStreamReader for the given stream. Lines are decoded with
+        // encoding and passed to callback; endOfStreamCallback is called once at EOF.
+        internal AsyncStreamReader(Stream stream, LineCallback callback, Action endOfStreamCallback, Encoding encoding)
         {
-            System.Diagnostics.Debug.Assert(stream != null && encoding != null && callback != null, "Invalid arguments!");
+            System.Diagnostics.Debug.Assert(stream != null && encoding != null && callback != null && endOfStreamCallback != null, "Invalid arguments!");
             System.Diagnostics.Debug.Assert(stream.CanRead, "Stream must be readable!");
 
             _stream = stream;
             _userCallBack = callback;
-            _decoder = encoding.GetDecoder();
-            _byteBuffer = new byte[DefaultBufferSize];
-
-            // This is the maximum number of chars we can get from one iteration in loop inside ReadBuffer.
-            // Used so ReadBuffer can tell when to copy data into a user's char[] directly, instead of our internal char[].
-            int maxCharsPerBuffer = encoding.GetMaxCharCount(DefaultBufferSize);
-            _charBuffer = new char[maxCharsPerBuffer];
-
+            _userEndOfStreamCallBack = endOfStreamCallback;
+            _framer = new LineFramer(encoding, OnLine);
             _cts = new CancellationTokenSource();
-            _messageQueue = new Queue<string>();
         }
 
         // User calls BeginRead to start the asynchronous read
@@ -188,14 +180,19 @@ namespace MyDiagnostics
         {
             _cancelOperation = false;
 
-            if (_sb == null)
+            if (_readToBufferTask == null)
             {
-                _sb = new StringBuilder(DefaultBufferSize);
-                _readToBufferTask = Task.Run((Func<Task>)ReadBufferAsync);
-            }
-            else
-            {
-                FlushMessageQueue(rethrowInNewThread: false);
+                // With the reactor, the pipe is read on the shared epoll thread and the stream itself is never read.
+                if (Process.CaptureMode == ProcessCaptureMode.Reactor &&
+                    _stream is FileStream fileStream &&
+                    (_reactorRegistration = ProcessPipeReactor.Register(fileStream.SafeFileHandle, this)) != null)
+                {
+                    _readToBufferTask = _reactorRegistration.Completion;
+                }
+                else
+                {
+                    _readToBufferTask = Task.Run((Func<Task>)ReadBufferAsync);
+                }
             }
         }
 
@@ -204,172 +201,125 @@ namespace MyDiagnostics
             _cancelOperation = true;
         }
 
-        // This is the async callback function. Only one thread could/should call this.
-        private async Task ReadBufferAsync()
+        private void OnLine(ReadOnlySpan<char> line)
         {
-            while (true)
+            // Lines that arrive while the operation is canceled are dropped.
+            if (!_cancelOperation)
             {
-                try
-                {
-                    int bytesRead = await _stream.ReadAsync(new Memory<byte>(_byteBuffer), _cts.Token).ConfigureAwait(false);
-                    if (bytesRead == 0)
-                        break;
-
-                    int charLen = _decoder.GetChars(_byteBuffer, 0, bytesRead, _charBuffer, 0);
-                    _sb.Append(_charBuffer, 0, charLen);
-                    MoveLinesFromStringBuilderToMessageQueue();
-                }
-                catch (IOException)
-                {
-                    // We should ideally consume errors from operations getting cancelled
-                    // so that we don't crash the unsuspecting parent with an unhandled exc.
-                    // This seems to come in 2 forms of exceptions (depending on platform and scenario),
-                    // namely OperationCanceledException and IOException (for errorcode that we don't
-                    // map explicitly).
-                    break; // Treat this as EOF
-                }
-                catch (OperationCanceledException)
-                {
-                    // We should consume any OperationCanceledException from child read here
-                    // so that we don't crash the parent with an unhandled exc
-                    break; // Treat this as EOF
-                }
-
-                // If user's delegate throws exception we treat this as EOF and
-                // completing without processing current buffer content
-                if (FlushMessageQueue(rethrowInNewThread: true))
-                {
-                    return;
-                }
+                _userCallBack(line);
             }
-
-            // We're at EOF, process current buffer content and flush message queue.
-            lock (_messageQueue)
-            {
-                if (_sb.Length != 0)
-                {
-                    _messageQueue.Enqueue(_sb.ToString());
-                    _sb.Length = 0;
-                }
-                _messageQueue.Enqueue(null);
-            }
-
-            FlushMessageQueue(rethrowInNewThread: true);
         }
 
-        // Read lines stored in StringBuilder and the buffer we just read into.
-        // A line is defined as a sequence of characters followed by
-        // a carriage return ('\r'), a line feed ('\n'), or a carriage return
-        // immediately followed by a line feed. The resulting string does not
-        // contain the terminating carriage return and/or line feed. The returned
-        // value is null if the end of the input stream has been reached.
-        private void MoveLinesFromStringBuilderToMessageQueue()
+        // This is the async callback function. Only one thread could/should call this.
+        private async Task ReadBufferAsync()
         {
-            int currentIndex = _currentLinePos;
-            int lineStart = 0;
-            int len = _sb.Length;
-
-            // skip a beginning '\n' character of new block if last block ended 
-            // with '\r'
-            if (_bLastCarriageReturn && (len > 0) && _sb[0] == '\n')
-            {
-                currentIndex = 1;
-                lineStart = 1;
-                _bLastCarriageReturn = false;
-            }
-
-            while (currentIndex < len)
+            byte[] buffer = ArrayPool<byte>.Shared.Rent(MinBufferSize);
+            try
             {
-                char ch = _sb[currentIndex];
-                // Note the following common line feed chars:
-                // \n - UNIX   \r\n - DOS   \r - Mac
-                if (ch == '\r' || ch == '\n')
+                while (true)
                 {
-                    string line = _sb.ToString(lineStart, currentIndex - lineStart);
-                    lineStart = currentIndex + 1;
-                    // skip the "\n" character following "\r" character
-                    if ((ch == '\r') && (lineStart < len) && (_sb[lineStart] == '\n'))
+                    int bytesRead;
+                    try
+                    {
+                        bytesRead = await _stream.ReadAsync(new Memory<byte>(buffer), _cts.Token).ConfigureAwait(false);
+                        if (bytesRead == 0)
+                            break;
+                    }
+                    catch (IOException)
                     {
-                        lineStart++;
-                        currentIndex++;
+                        // We should ideally consume errors from operations getting cancelled
+                        // so that we don't crash the unsuspecting parent with an unhandled exc.
+                        // This seems to come in 2 forms of exceptions (depending on platform and scenario),
+                        // namely OperationCanceledException and IOException (for errorcode that we don't
+                        // map explicitly).
+                        break; // Treat this as EOF
+                    }
+                    catch (OperationCanceledException)
+                    {
+                        // We should consume any OperationCanceledException from child read here
+                        // so that we don't crash the parent with an unhandled exc
+                        break; // Treat this as EOF
                     }
 
-                    lock (_messageQueue)
+                    // If user's delegate throws exception we treat this as EOF and
+                    // completing without processing current buffer content
+                    if (!NotifyUser(new ReadOnlySpan<byte>(buffer, 0, bytesRead), endOfStream: false))
                     {
-                        _messageQueue.Enqueue(line);
+                        return;
+                    }
+
+                    if (bytesRead == buffer.Length && buffer.Length < MaxBufferSize)
+                    {
+                        ArrayPool<byte>.Shared.Return(buffer);
+                        buffer = null;
+                        buffer = ArrayPool<byte>.Shared.Rent(Math.Min(bytesRead * 2, MaxBufferSize));
                     }
                 }
-                currentIndex++;
-            }
-            if ((len > 0) && _sb[len - 1] == '\r')
-            {
-                _bLastCarriageReturn = true;
+
+                // We're at EOF, process current buffer content.
+                NotifyUser(ReadOnlySpan<byte>.Empty, endOfStream: true);
             }
-            // Keep the rest characters which can't form a new line in string builder.
-            if (lineStart < len)
+            finally
             {
-                if (lineStart == 0)
-                {
-                    // we found no breaklines, in this case we cache the position
-                    // so next time we don't have to restart from the beginning
-                    _currentLinePos = currentIndex;
-                }
-                else
+                if (buffer != null)
                 {
-                    _sb.Remove(0, lineStart);
-                    _currentLinePos = 0;
+                    ArrayPool<byte>.Shared.Return(buffer);
                 }
-            }
-            else
-            {
-                _sb.Length = 0;
-                _currentLinePos = 0;
+                _framer.Dispose();
             }
         }
 
-        // If everything runs without exception, returns false.
-        // If an exception occurs and rethrowInNewThread is true, returns true.
-        // If an exception occurs and rethrowInNewThread is false, the exception propagates.
-        private bool FlushMessageQueue(bool rethrowInNewThread)
+        // Passes the bytes read (or EOF) to the framer, which invokes the user's callback for each line.
+        // If everything runs without exception, returns true. If the user's callback throws, the exception is
+        // rethrown on a thread pool thread and false is returned.
+        private bool NotifyUser(ReadOnlySpan<byte> data, bool endOfStream)
         {
             try
             {
-                // Keep going until we're out of data to process.
-                while (true)
+                if (!endOfStream)
                 {
-                    // Get the next line (if there isn't one, we're done) and 
-                    // invoke the user's callback with it.
-                    string line;
-                    lock (_messageQueue)
-                    {
-                        if (_messageQueue.Count == 0)
-                        {
-                            break;
-                        }
-                        line = _messageQueue.Dequeue();
-                    }
-
+                    _framer.Append(data);
+                }
+                else
+                {
+                    _framer.Complete();
                     if (!_cancelOperation)
                     {
-                        _userCallBack(line); // invoked outside of the lock
+                        _userEndOfStreamCallBack();
                     }
                 }
-                return false;
+                return true;
             }
             catch (Exception e)
             {
-                // If rethrowInNewThread is true, we can't let the exception propagate synchronously on this thread,
-                // so propagate it in a thread pool thread and return true to indicate to the caller that this failed.
-                // Otherwise, let the exception propagate.
-                if (rethrowInNewThread)
-                {
-                    ThreadPool.QueueUserWorkItem(edi => ((ExceptionDispatchInfo)edi).Throw(), ExceptionDispatchInfo.Capture(e));
-                    return true;
-                }
-                throw;
+                // We can't let the exception propagate synchronously on this thread,
+                // so propagate it in a thread pool thread and return false to indicate to the caller that this failed.
+                ThreadPool.QueueUserWorkItem(edi => ((ExceptionDispatchInfo)edi).Throw(), ExceptionDispatchInfo.Capture(e));
+                return false;
             }
         }
 
+        // Called on the reactor thread for each chunk read from the pipe.
+        bool IProcessPipeSink.OnData(ReadOnlySpan<byte> data)
+        {
+            return NotifyUser(data, endOfStream: false);
+        }
+
+        // Called on the reactor thread once the pipe hit EOF or the registration was disposed.
+        void IProcessPipeSink.OnCompleted(bool endOfStream)
+        {
+            if (endOfStream)
+            {
+                NotifyUser(ReadOnlySpan<byte>.Empty, endOfStream: true);
+                _framer.Dispose();
+            }
+            // Otherwise the registration was disposed, possibly by a line callback that is still running inside
+            // the framer, so its buffers are left to the GC instead of being returned to the pool.
+        }
+
+        // Completes at EOF. This is awaited by Process.WaitForExitAsync.
+        internal Task EOF => _readToBufferTask ?? Task.CompletedTask;
+
         // Wait until we hit EOF. This is called from Process.WaitForExit
         // We will lose some information if we don't do this.
         internal void WaitUtilEOF()
@@ -377,13 +327,13 @@ namespace MyDiagnostics
             if (_readToBufferTask != null)
             {
                 _readToBufferTask.GetAwaiter().GetResult();
-                _readToBufferTask = null;
             }
         }
 
         public void Dispose()
         {
             _cts.Cancel();
+            _reactorRegistration?.Dispose();
         }
     }
 
@@ -587,6 +537,12 @@ namespace MyDiagnostics
         public event DataReceivedEventHandler OutputDataReceived;
         public event DataReceivedEventHandler ErrorDataReceived;
 
+        // Raised for each line read after BeginOutputReadLine/BeginErrorReadLine, before the DataReceived events.
+        // The span refers to an internal buffer and is only valid during the call; no string is allocated
+        // for the line unless a DataReceived handler is registered too. Not raised at end of stream.
+        public event DataSpanReceivedEventHandler OutputSpanReceived;
+        public event DataSpanReceivedEventHandler ErrorSpanReceived;
+
         // Abstract the stream details
         internal AsyncStreamReader _output;
         internal AsyncStreamReader _error;
@@ -898,6 +854,12 @@ namespace MyDiagnostics
         {
             get
             {
+                // An exited child's peak was captured when it was reaped.
+                if (TryGetExitPeakWorkingSet(out long peakWorkingSet))
+                {
+                    return peakWorkingSet;
+                }
+
                 EnsureState(State.HaveProcessInfo);
                 return _processInfo.WorkingSetPeak;
             }
@@ -908,6 +870,11 @@ namespace MyDiagnostics
         {
             get
             {
+                if (TryGetExitPeakWorkingSet(out long peakWorkingSet))
+                {
+                    return unchecked((int)peakWorkingSet);
+                }
+
                 EnsureState(State.HaveProcessInfo);
                 return unchecked((int)_processInfo.WorkingSetPeak);
             }
@@ -1458,7 +1425,7 @@ namespace MyDiagnostics
                     {
                         EnsureState(State.HaveNonExitedId);
                     }
-                    //_processInfo = ProcessManager.GetProcessInfo(_processId, _machineName);
+                    _processInfo = ProcessManager.GetProcessInfo(_processId, _machineName);
                     if (_processInfo == null)
                     {
                         throw new InvalidOperationException("SR.NoProcessInfo");
@@ -1853,6 +1820,26 @@ namespace MyDiagnostics
             return exited;
         }
 
+        /// <summary>
+        /// Returns a task that completes when the associated process has exited and, if output is read
+        /// asynchronously, all of it has been delivered. No thread is blocked while waiting.
+        /// </summary>
+        /// <param name="cancellationToken">A token that cancels the wait, not the process.</param>
+        public async Task WaitForExitAsync(CancellationToken cancellationToken = default)
+        {
+            // Because this method has no timeout, validate the state up front rather than on first await.
+            EnsureState(State.Associated);
+
+            cancellationToken.ThrowIfCancellationRequested();
+
+            await WaitForExitCoreAsync(cancellationToken).ConfigureAwait(false);
+
+            if (_watchForExit)
+            {
+                RaiseOnExited();
+            }
+        }
+
         /// <devdoc>
         /// <para>
         /// Instructs the <see cref='System.Diagnostics.Process'/> component to start
@@ -1885,7 +1872,7 @@ namespace MyDiagnostics
                 }
 
                 Stream s = _standardOutput.BaseStream;
-                _output = new AsyncStreamReader(s, OutputReadNotifyUser, _standardOutput.CurrentEncoding);
+                _output = new AsyncStreamReader(s, OutputReadNotifyUser, OutputEndOfStreamNotifyUser, _standardOutput.CurrentEncoding);
             }
             _output.BeginReadLine();
         }
@@ -1925,7 +1912,7 @@ namespace MyDiagnostics
                 }
 
                 Stream s = _standardError.BaseStream;
-                _error = new AsyncStreamReader(s, ErrorReadNotifyUser, _standardError.CurrentEncoding);
+                _error = new AsyncStreamReader(s, ErrorReadNotifyUser, ErrorEndOfStreamNotifyUser, _standardError.CurrentEncoding);
             }
             _error.BeginReadLine();
         }
@@ -1970,6 +1957,31 @@ namespace MyDiagnostics
             _pendingErrorRead = false;
         }
 
+        internal void OutputReadNotifyUser(ReadOnlySpan<char> line)
+        {
+            OutputSpanReceived?.Invoke(this, line);
+
+            // Only pay for the string if someone wants it.
+            if (OutputDataReceived != null)
+            {
+                OutputReadNotifyUser(new string(line));
+            }
+        }
+
+        internal void OutputEndOfStreamNotifyUser() => OutputReadNotifyUser((string)null);
+
+        internal void ErrorReadNotifyUser(ReadOnlySpan<char> line)
+        {
+            ErrorSpanReceived?.Invoke(this, line);
+
+            if (ErrorDataReceived != null)
+            {
+                ErrorReadNotifyUser(new string(line));
+            }
+        }
+
+        internal void ErrorEndOfStreamNotifyUser() => ErrorReadNotifyUser((string)null);
+
         internal void OutputReadNotifyUser(string data)
         {
             // To avoid race between remove handler and raising the event
@@ -0,0 +1,199 @@
+﻿// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+// See the LICENSE file in the project root for more information.
+
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace MyDiagnostics
+{
+    /// <summary>
+    /// Notifies waiters of non-child process exit through pidfds (Linux 5.3+).
+    /// A single epoll thread is shared by every watched process, so waiting does not
+    /// consume a thread pool work item per process and exit is observed as soon as the
+    /// kernel reports it instead of on the next polling interval.
+    /// </summary>
+    internal static class ProcessExitReactor
+    {
+        /// <summary>AppContext switch that forces the kill(pid, 0) polling loop.</summary>
+        private const string DisableSwitchName = "MyDiagnostics.Process.DisablePidfdExitNotification";
+
+        /// <summary>Maximum number of events drained from epoll per wakeup.</summary>
+        private const int EventBufferCount = 64;
+
+        /// <summary>Protects the registration table and lazy initialization.</summary>
+        private static readonly object s_gate = new object();
+        /// <summary>Outstanding registrations, keyed by the value stored in the epoll event data.</summary>
+        private static readonly Dictionary<ulong, Registration> s_registrations = new Dictionary<ulong, Registration>();
+
+        private static ulong s_nextRegistrationId;
+        private static int s_epollFd = -1;
+        /// <summary>Cleared once pidfd or epoll is found not to work; the caller then falls back to polling.</summary>
+        private static volatile bool s_supported = !IsDisabledBySwitch();
+
+        /// <summary>Whether pidfd-based notification may currently be attempted.</summary>
+        internal static bool IsSupported => s_supported;
+
+        /// <summary>
+        /// Starts watching <paramref name="processId"/> for exit on behalf of <paramref name="waitState"/>.
+        /// </summary>
+        /// <returns>
+        /// A task that completes when the process exits (after <see cref="ProcessWaitState"/> has been
+        /// notified) or when <paramref name="cancellationToken"/> is canceled; or null if a pidfd could not
+        /// be used for this process, in which case the caller should poll.
+        /// </returns>
+        internal static Task WaitForExitAsync(ProcessWaitState waitState, int processId, CancellationToken cancellationToken)
+        {
+            if (!s_supported || cancellationToken.IsCancellationRequested || !EnsureInitialized())
+            {
+                return null;
+            }
+
+            int pidfd = Interop.Sys.PidfdOpen(processId);
+            if (pidfd < 0)
+            {
+                Interop.Error error = Interop.Sys.GetLastError();
+                if (error == Interop.Error.ENOSYS || error == Interop.Error.EPERM)
+                {
+                    // Kernel without pidfd_open, or blocked by a seccomp filter.
+                    s_supported = false;
+                }
+                // ESRCH: the process is already gone; polling will observe that immediately.
+                return null;
+            }
+
+            var registration = new Registration(waitState, pidfd);
+            lock (s_gate)
+            {
+                registration.Id = ++s_nextRegistrationId;
+                s_registrations.Add(registration.Id, registration);
+            }
+
+            if (Interop.Sys.EpollCtl(s_epollFd, Interop.Sys.EPOLL_CTL_ADD, pidfd,
+                    Interop.Sys.EPOLLIN | Interop.Sys.EPOLLONESHOT, registration.Id) != 0)
+            {
+                lock (s_gate)
+                {
+                    s_registrations.Remove(registration.Id);
+                }
+                Interop.Sys.Close(pidfd);
+                return null;
+            }
+
+            if (cancellationToken.CanBeCanceled)
+            {
+                registration.CancellationRegistration = cancellationToken.Register(
+                    s => Complete((Registration)s, exited: false), registration);
+            }
+
+            return registration.Task;
+        }
+
+        private static bool EnsureInitialized()
+        {
+            if (s_epollFd >= 0)
+            {
+                return true;
+            }
+
+            lock (s_gate)
+            {
+                if (s_epollFd < 0 && s_supported)
+                {
+                    int epollFd = Interop.Sys.EpollCreate1(Interop.Sys.EPOLL_CLOEXEC);
+                    if (epollFd < 0)
+                    {
+                        s_supported = false;
+                        return false;
+                    }
+
+                    var thread = new Thread(EventLoop)
+                    {
+                        IsBackground = true,
+                        Name = ".NET Process Exit Reactor"
+                    };
+                    s_epollFd = epollFd;
+                    thread.Start();
+                }
+                return s_epollFd >= 0;
+            }
+        }
+
+        private static unsafe void EventLoop()
+        {
+            byte* events = stackalloc byte[EventBufferCount * Interop.Sys.EpollEventSize];
+
+            while (true)
+            {
+                int count = Interop.Sys.EpollWait(s_epollFd, events, EventBufferCount, -1);
+                if (count < 0)
+                {
+                    Interop.Error error = Interop.Sys.GetLastError();
+                    if (error == Interop.Error.EINTR)
+                    {
+                        continue;
+                    }
+                    Environment.FailFast("Error while waiting for process exit notifications. errno = " + error);
+                }
+
+                for (int i = 0; i < count; i++)
+                {
+                    Interop.Sys.GetEpollEvent(events, i, out _, out ulong id);
+
+                    Registration registration;
+                    lock (s_gate)
+                    {
+                        s_registrations.TryGetValue(id, out registration);
+                    }
+
+                    // A pidfd only ever reports readable (or error) once its process has terminated.
+                    if (registration != null)
+                    {
+                        Complete(registration, exited: true);
+                    }
+                }
+            }
+        }
+
+        /// <summary>Retires a registration exactly once, either because the process exited or because the wait was canceled.</summary>
+        private static void Complete(Registration registration, bool exited)
+        {
+            lock (s_gate)
+            {
+                if (!s_registrations.Remove(registration.Id))
+                {
+                    return; // Already completed by the other path.
+                }
+            }
+
+            Interop.Sys.EpollCtl(s_epollFd, Interop.Sys.EPOLL_CTL_DEL, registration.Pidfd, 0, 0);
+            Interop.Sys.Close(registration.Pidfd);
+            registration.CancellationRegistration.Dispose();
+
+            registration.WaitState.OnReactorWaitCompleted(registration.Task, exited);
+            registration.TrySetResult(true);
+        }
+
+        private static bool IsDisabledBySwitch()
+        {
+            return AppContext.TryGetSwitch(DisableSwitchName, out bool disabled) && disabled;
+        }
+
+        private sealed class Registration : TaskCompletionSource<bool>
+        {
+            internal readonly ProcessWaitState WaitState;
+            internal readonly int Pidfd;
+            internal ulong Id;
+            internal CancellationTokenRegistration CancellationRegistration;
+
+            internal Registration(ProcessWaitState waitState, int pidfd)
+                : base(TaskCreationOptions.RunContinuationsAsynchronously)
+            {
+                WaitState = waitState;
+                Pidfd = pidfd;
+            }
+        }
+    }
+}
@@ -0,0 +1,497 @@
+﻿// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+// See the LICENSE file in the project root for more information.
+
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Text;
+using System.Threading;
+
+namespace MyDiagnostics
+{
+    internal static partial class ProcessManager
+    {
+        /// <summary>Gets the <see cref="ProcessInfo"/> of a local process from /proc.</summary>
+        /// <returns>The process info, or null if the process is gone.</returns>
+        internal static ProcessInfo GetProcessInfo(int processId, string machineName)
+        {
+            if (machineName != "." && machineName != null)
+            {
+                throw new PlatformNotSupportedException("SR.RemoteMachinesNotSupported");
+            }
+
+            ProcFsReader reader = ProcFsReader.Rent();
+            try
+            {
+                var processInfo = new ProcessInfo();
+                return reader.TryRefreshProcessInfo(processId, processInfo, includeThreads: true) ? processInfo : null;
+            }
+            finally
+            {
+                ProcFsReader.Return(reader);
+            }
+        }
+
+        /// <summary>
+        /// Refreshes <paramref name="processInfos"/>[i] from /proc/<paramref name="processIds"/>[i] for every i,
+        /// reusing the existing objects and one set of buffers for the whole batch.  Null entries get a new
+        /// <see cref="ProcessInfo"/>; entries whose process is gone are set to null.
+        /// </summary>
+        /// <returns>The number of processes that were refreshed.</returns>
+        internal static int RefreshProcessInfos(ReadOnlySpan<int> processIds, ProcessInfo[] processInfos, bool includeThreads)
+        {
+            if (processInfos.Length < processIds.Length)
+            {
+                throw new ArgumentException("SR.ProcessInfosTooShort", nameof(processInfos));
+            }
+
+            int refreshed = 0;
+            ProcFsReader reader = ProcFsReader.Rent();
+            try
+            {
+                for (int i = 0; i < processIds.Length; i++)
+                {
+                    ProcessInfo processInfo = processInfos[i] ?? new ProcessInfo();
+                    if (reader.TryRefreshProcessInfo(processIds[i], processInfo, includeThreads))
+                    {
+                        processInfos[i] = processInfo;
+                        refreshed++;
+                    }
+                    else
+                    {
+                        processInfos[i] = null;
+                    }
+                }
+            }
+            finally
+            {
+                ProcFsReader.Return(reader);
+            }
+            return refreshed;
+        }
+    }
+
+    /// <summary>
+    /// Reads /proc/[pid]/stat, /proc/[pid]/status and /proc/[pid]/task/[tid]/stat.  Each file is read with a single
+    /// read() into the reader's buffer and parsed in place with <see cref="SpanStringParser"/>; the paths are built
+    /// on the stack and each thread keeps a reader, so refreshing a process allocates nothing unless its name
+    /// changed or it gained threads.
+    /// </summary>
+    internal sealed class ProcFsReader
+    {
+        /// <summary>Large enough for any stat file and for status on all but very wide machines.</summary>
+        private const int InitialBufferSize = 4096;
+
+        /// <summary>Buffers larger than this are dropped instead of being kept for the next read on the thread.</summary>
+        private const int MaxRetainedBufferSize = 64 * 1024;
+
+        /// <summary>"/proc/" + pid + "/task/" + tid + "/status" + NUL, with room to spare.</summary>
+        private const int MaxPathLength = 64;
+
+        [ThreadStatic]
+        private static ProcFsReader t_cachedReader;
+
+        private byte[] _bytes = new byte[InitialBufferSize];
+        private char[] _chars = new char[InitialBufferSize];
+        private readonly List<int> _threadIds = new List<int>();
+
+        /// <summary>Gets the calling thread's reader, or a new one if the thread's reader is in use.</summary>
+        internal static ProcFsReader Rent()
+        {
+            ProcFsReader reader = t_cachedReader;
+            if (reader != null)
+            {
+                t_cachedReader = null;
+                return reader;
+            }
+            return new ProcFsReader();
+        }
+
+        /// <summary>Gives a reader back to the calling thread once the spans it handed out are no longer used.</summary>
+        internal static void Return(ProcFsReader reader)
+        {
+            if (reader._bytes.Length > MaxRetainedBufferSize)
+            {
+                reader._bytes = new byte[InitialBufferSize];
+                reader._chars = new char[InitialBufferSize];
+            }
+            t_cachedReader = reader;
+        }
+
+        /// <summary>The fields of /proc/[pid]/stat we use.  <see cref="comm"/> points into the reader's buffer.</summary>
+        internal ref struct ParsedStat
+        {
+            internal int pid;
+            internal ReadOnlySpan<char> comm;
+            internal char state;
+            internal int ppid;
+            internal int session;
+            internal ulong utime;
+            internal ulong stime;
+            internal long nice;
+            internal int numThreads;
+            internal ulong starttime;
+            internal ulong vsize;
+            internal long rss;
+        }
+
+        /// <summary>The fields of /proc/[pid]/status we use, in bytes.</summary>
+        internal struct ParsedStatus
+        {
+            internal int Threads;
+            internal ulong VmPeak;
+            internal ulong VmSize;
+            internal ulong VmHWM;
+            internal ulong VmRSS;
+            internal ulong VmData;
+            internal ulong VmSwap;
+        }
+
+        /// <summary>
+        /// Fills <paramref name="processInfo"/> from /proc/<paramref name="pid"/>, and its thread list from the
+        /// process's tasks if <paramref name="includeThreads"/> is true.
+        /// </summary>
+        /// <returns>false if the process is gone.</returns>
+        internal bool TryRefreshProcessInfo(int pid, ProcessInfo processInfo, bool includeThreads)
+        {
+            // status is read first: comm below points into the shared buffer.
+            if (!TryReadStatusFile(pid, out ParsedStatus status) ||
+                !TryReadStatFile(pid, -1, out ParsedStat stat))
+            {
+                return false;
+            }
+
+            processInfo.ProcessId = pid;
+            if (!stat.comm.SequenceEqual(processInfo.ProcessName))
+            {
+                processInfo.ProcessName = new string(stat.comm);
+            }
+            processInfo.BasePriority = (int)stat.nice;
+            processInfo.SessionId = stat.session;
+            processInfo.VirtualBytes = (long)status.VmSize;
+            processInfo.VirtualBytesPeak = (long)status.VmPeak;
+            processInfo.WorkingSet = (long)status.VmRSS;
+            processInfo.WorkingSetPeak = (long)status.VmHWM;
+            processInfo.PrivateBytes = (long)status.VmData;
+            processInfo.PageFileBytes = (long)status.VmSwap;
+            processInfo.PoolPagedBytes = (long)status.VmSwap;
+
+            List<ThreadInfo> threads = processInfo._threadInfoList;
+            int count = 0;
+            if (includeThreads && TryReadThreadIds(pid, _threadIds))
+            {
+                foreach (int tid in _threadIds)
+                {
+                    if (!TryReadStatFile(pid, tid, out ParsedStat threadStat))
+                    {
+                        continue; // The thread exited after we listed it.
+                    }
+
+                    ThreadInfo thread;
+                    if (count < threads.Count)
+                    {
+                        thread = threads[count];
+                    }
+                    else
+                    {
+                        thread = new ThreadInfo();
+                        threads.Add(thread);
+                    }
+                    count++;
+
+                    thread._processId = pid;
+                    thread._threadId = (ulong)tid;
+                    thread._basePriority = processInfo.BasePriority;
+                    thread._currentPriority = (int)threadStat.nice;
+                    thread._startAddress = IntPtr.Zero;
+                    thread._threadState = ToThreadState(threadStat.state);
+                    thread._threadWaitReason = ThreadWaitReason.Unknown;
+                }
+            }
+            threads.RemoveRange(count, threads.Count - count);
+
+            return true;
+        }
+
+        /// <summary>Reads /proc/<paramref name="pid"/>/stat, or the stat of task <paramref name="tid"/> if it is not -1.</summary>
+        /// <returns>false if the process or thread is gone.</returns>
+        internal unsafe bool TryReadStatFile(int pid, int tid, out ParsedStat result)
+        {
+            result = default;
+
+            byte* path = stackalloc byte[MaxPathLength];
+            BuildPath(path, pid, tid, "stat");
+            if (!TryReadFile(path, out ReadOnlySpan<char> contents))
+            {
+                return false;
+            }
+
+            var parser = new SpanStringParser(contents, ' ');
+            result.pid = parser.ParseNextInt32();
+            result.comm = parser.MoveAndExtractNextInOuterParens();
+            result.state = parser.ParseNextChar();
+            result.ppid = parser.ParseNextInt32();
+            parser.MoveNextOrFail(); // pgrp
+            result.session = parser.ParseNextInt32();
+            parser.MoveNextOrFail(7); // tty_nr, tpgid, flags, minflt, cminflt, majflt, cmajflt
+            result.utime = parser.ParseNextUInt64();
+            result.stime = parser.ParseNextUInt64();
+            parser.MoveNextOrFail(3); // cutime, cstime, priority
+            result.nice = parser.ParseNextInt64();
+            result.numThreads = parser.ParseNextInt32();
+            parser.MoveNextOrFail(); // itrealvalue
+            result.starttime = parser.ParseNextUInt64();
+            result.vsize = parser.ParseNextUInt64();
+            result.rss = parser.ParseNextInt64();
+            return true;
+        }
+
+        /// <summary>Reads /proc/<paramref name="pid"/>/status.</summary>
+        /// <returns>false if the process is gone.</returns>
+        internal unsafe bool TryReadStatusFile(int pid, out ParsedStatus result)
+        {
+            result = default;
+
+            byte* path = stackalloc byte[MaxPathLength];
+            BuildPath(path, pid, -1, "status");
+            if (!TryReadFile(path, out ReadOnlySpan<char> contents))
+            {
+                return false;
+            }
+
+            // Lines look like "VmHWM:\t    2048 kB" or "Threads:\t4".
+            var lines = new SpanStringParser(contents, '\n', skipEmpty: true);
+            while (lines.MoveNext())
+            {
+                ReadOnlySpan<char> line = lines.ExtractCurrent();
+                int colon = line.IndexOf(':');
+                if (colon <= 0)
+                {
+                    continue;
+                }
+
+                ReadOnlySpan<char> name = line.Slice(0, colon);
+                ReadOnlySpan<char> value = line.Slice(colon + 1);
+                if (name[0] == 'V' && name.Length > 2 && name[1] == 'm')
+                {
+                    if (Is(name, "VmPeak")) result.VmPeak = ParseStatusBytes(value);
+                    else if (Is(name, "VmSize")) result.VmSize = ParseStatusBytes(value);
+                    else if (Is(name, "VmHWM")) result.VmHWM = ParseStatusBytes(value);
+                    else if (Is(name, "VmRSS")) result.VmRSS = ParseStatusBytes(value);
+                    else if (Is(name, "VmData")) result.VmData = ParseStatusBytes(value);
+                    else if (Is(name, "VmSwap")) result.VmSwap = ParseStatusBytes(value);
+                }
+                else if (Is(name, "Threads"))
+                {
+                    result.Threads = new SpanStringParser(value.Trim(), ' ', skipEmpty: true).ParseNextInt32();
+                }
+            }
+            return true;
+        }
+
+        /// <summary>Replaces the contents of <paramref name="threadIds"/> with the ids of the tasks of <paramref name="pid"/>.</summary>
+        /// <returns>false if the process is gone.</returns>
+        internal unsafe bool TryReadThreadIds(int pid, List<int> threadIds)
+        {
+            threadIds.Clear();
+
+            if (!Interop.Sys.CanReadDir)
+            {
+                return TryReadThreadIdsManaged(pid, threadIds);
+            }
+
+            byte* path = stackalloc byte[MaxPathLength];
+            BuildPath(path, pid, -1, "task");
+            IntPtr dir = Interop.Sys.OpenDir(path);
+            if (dir == IntPtr.Zero)
+            {
+                return false;
+            }
+
+            try
+            {
+                byte* name;
+                while ((name = Interop.Sys.ReadDir(dir)) != null)
+                {
+                    // Skips "." and "..".
+                    int tid = 0;
+                    byte* p = name;
+                    for (; *p >= '0' && *p <= '9'; p++)
+                    {
+                        tid = tid * 10 + (*p - '0');
+                    }
+                    if (p != name && *p == 0)
+                    {
+                        threadIds.Add(tid);
+                    }
+                }
+            }
+            finally
+            {
+                Interop.Sys.CloseDir(dir);
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// <see cref="TryReadThreadIds"/> through Directory, where the layout of struct dirent is not known.
+        /// </summary>
+        private static bool TryReadThreadIdsManaged(int pid, List<int> threadIds)
+        {
+            try
+            {
+                foreach (string taskDirectory in Directory.EnumerateDirectories("/proc/" + pid.ToString(CultureInfo.InvariantCulture) + "/task"))
+                {
+                    if (int.TryParse(Path.GetFileName(taskDirectory), NumberStyles.None, CultureInfo.InvariantCulture, out int tid))
+                    {
+                        threadIds.Add(tid);
+                    }
+                }
+            }
+            catch (IOException)
+            {
+                return false; // DirectoryNotFoundException: the process is gone.
+            }
+            catch (UnauthorizedAccessException)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Reads the whole file at <paramref name="path"/> with one read() and decodes it into the char buffer.
+        /// /proc files are generated on read, so a file that fills the buffer is read again into a bigger one.
+        /// </summary>
+        private unsafe bool TryReadFile(byte* path, out ReadOnlySpan<char> contents)
+        {
+            contents = default;
+
+            int length;
+            while (true)
+            {
+                int fd;
+                while ((fd = Interop.Sys.OpenReadOnly(path)) < 0 && Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                {
+                }
+                if (fd < 0)
+                {
+                    return false; // ENOENT: the process (or thread) is gone.
+                }
+
+                fixed (byte* buffer = _bytes)
+                {
+                    while ((length = Interop.Sys.Read(fd, buffer, _bytes.Length)) < 0 &&
+                        Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                    {
+                    }
+                }
+                Interop.Sys.Close(fd);
+
+                if (length < 0)
+                {
+                    return false; // ESRCH: it exited between open and read.
+                }
+                if (length < _bytes.Length)
+                {
+                    break;
+                }
+
+                _bytes = new byte[_bytes.Length * 2];
+            }
+
+            // The name of a process may be UTF-8; everything else is ASCII.
+            if (_chars.Length < length)
+            {
+                _chars = new char[_bytes.Length];
+            }
+            int charCount = Encoding.UTF8.GetChars(new ReadOnlySpan<byte>(_bytes, 0, length), _chars);
+            contents = new ReadOnlySpan<char>(_chars, 0, charCount);
+            return true;
+        }
+
+        /// <summary>Writes "/proc/[pid]/[file]" or "/proc/[pid]/task/[tid]/[file]" and a NUL to <paramref name="path"/>.</summary>
+        private static unsafe void BuildPath(byte* path, int pid, int tid, string file)
+        {
+            int length = Append(path, 0, "/proc/");
+            length = Append(path, length, pid);
+            if (tid != -1)
+            {
+                length = Append(path, length, "/task/");
+                length = Append(path, length, tid);
+            }
+            length = Append(path, length, "/");
+            length = Append(path, length, file);
+            path[length] = 0;
+        }
+
+        private static unsafe int Append(byte* path, int length, string value)
+        {
+            foreach (char c in value)
+            {
+                path[length++] = (byte)c;
+            }
+            return length;
+        }
+
+        private static unsafe int Append(byte* path, int length, int value)
+        {
+            if (value < 0)
+            {
+                throw new ArgumentOutOfRangeException(nameof(value));
+            }
+
+            int digits = 1;
+            for (int v = value / 10; v != 0; v /= 10)
+            {
+                digits++;
+            }
+            for (int i = length + digits - 1; i >= length; i--)
+            {
+                path[i] = (byte)('0' + value % 10);
+                value /= 10;
+            }
+            return length + digits;
+        }
+
+        private static bool Is(ReadOnlySpan<char> name, string expected)
+        {
+            return name.SequenceEqual(expected);
+        }
+
+        /// <summary>Parses a status value such as "    2048 kB".</summary>
+        private static ulong ParseStatusBytes(ReadOnlySpan<char> value)
+        {
+            var parser = new SpanStringParser(value.Trim(), ' ', skipEmpty: true);
+            ulong result = parser.ParseNextUInt64();
+            if (parser.MoveNext() && Is(parser.ExtractCurrent(), "kB"))
+            {
+                result = checked(result * 1024);
+            }
+            return result;
+        }
+
+        /// <summary>Maps the state letter of a stat file to the closest <see cref="ThreadState"/>.</summary>
+        private static ThreadState ToThreadState(char state)
+        {
+            switch (state)
+            {
+                case 'R':
+                    return ThreadState.Running;
+                case 'S': // interruptible sleep
+                case 'D': // uninterruptible sleep
+                case 'I': // idle kernel thread
+                default:
+                    return ThreadState.WaitSleepJoin;
+                case 'T': // stopped by a signal
+                case 't': // stopped by a tracer
+                    return ThreadState.Suspended;
+                case 'Z': // zombie
+                case 'X': // dead
+                    return ThreadState.Stopped;
+            }
+        }
+    }
+}
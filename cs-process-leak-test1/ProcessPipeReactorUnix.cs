@@ -0,0 +1,256 @@
+﻿// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+// See the LICENSE file in the project root for more information.
+
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.Win32.SafeHandles;
+
+namespace MyDiagnostics
+{
+    /// <summary>Consumer of the data read from a pipe registered with <see cref="ProcessPipeReactor"/>.</summary>
+    internal interface IProcessPipeSink
+    {
+        /// <summary>Called on the reactor thread with the next chunk of data. Returning false ends the registration.</summary>
+        bool OnData(ReadOnlySpan<byte> data);
+
+        /// <summary>Called exactly once when the registration ends; <paramref name="endOfStream"/> is false if it was disposed before EOF.</summary>
+        void OnCompleted(bool endOfStream);
+    }
+
+    /// <summary>
+    /// Reads the redirected output pipes of any number of children from one epoll thread.
+    /// Ready data is read into a single buffer owned by that thread and handed to the pipe's
+    /// <see cref="IProcessPipeSink"/>, so a pipe costs no thread pool work item, pending read or buffer of its own.
+    /// Sinks run on the reactor thread and must not block.
+    /// </summary>
+    internal static class ProcessPipeReactor
+    {
+        /// <summary>Size of the buffer the reactor thread reads into.</summary>
+        private const int ReadBufferSize = 64 * 1024;
+        /// <summary>Maximum number of reads from one pipe per wakeup, so one chatty child can't starve the others.</summary>
+        private const int MaxReadsPerEvent = 16;
+        /// <summary>Maximum number of events drained from epoll per wakeup.</summary>
+        private const int EventBufferCount = 256;
+
+        /// <summary>Protects the registration table and lazy initialization.</summary>
+        private static readonly object s_gate = new object();
+        /// <summary>Outstanding registrations, keyed by the value stored in the epoll event data.</summary>
+        private static readonly Dictionary<ulong, Registration> s_registrations = new Dictionary<ulong, Registration>();
+
+        private static ulong s_nextRegistrationId;
+        private static int s_epollFd = -1;
+        private static bool s_failed;
+
+        /// <summary>
+        /// Starts reading <paramref name="handle"/> on the reactor thread. The handle is kept open until the
+        /// registration ends, and is switched to non-blocking mode.
+        /// </summary>
+        /// <returns>The registration, or null if the reactor is unavailable and the caller should read the stream itself.</returns>
+        internal static Registration Register(SafeFileHandle handle, IProcessPipeSink sink)
+        {
+            if (!EnsureInitialized())
+            {
+                return null;
+            }
+
+            bool addedRef = false;
+            handle.DangerousAddRef(ref addedRef);
+            int fd = (int)handle.DangerousGetHandle();
+
+            if (Interop.Sys.Fcntl.SetIsNonBlocking(fd, true) != 0)
+            {
+                handle.DangerousRelease();
+                return null;
+            }
+
+            var registration = new Registration(handle, fd, sink);
+            lock (s_gate)
+            {
+                registration.Id = ++s_nextRegistrationId;
+                s_registrations.Add(registration.Id, registration);
+            }
+
+            // Level-triggered: data left behind after MaxReadsPerEvent is reported again on the next wakeup.
+            if (Interop.Sys.EpollCtl(s_epollFd, Interop.Sys.EPOLL_CTL_ADD, fd,
+                    Interop.Sys.EPOLLIN | Interop.Sys.EPOLLRDHUP, registration.Id) != 0)
+            {
+                lock (s_gate)
+                {
+                    s_registrations.Remove(registration.Id);
+                }
+                Interop.Sys.Fcntl.SetIsNonBlocking(fd, false);
+                handle.DangerousRelease();
+                return null;
+            }
+
+            return registration;
+        }
+
+        private static bool EnsureInitialized()
+        {
+            if (s_epollFd >= 0)
+            {
+                return true;
+            }
+
+            lock (s_gate)
+            {
+                if (s_epollFd < 0 && !s_failed)
+                {
+                    int epollFd = Interop.Sys.EpollCreate1(Interop.Sys.EPOLL_CLOEXEC);
+                    if (epollFd < 0)
+                    {
+                        s_failed = true;
+                        return false;
+                    }
+
+                    var thread = new Thread(EventLoop)
+                    {
+                        IsBackground = true,
+                        Name = ".NET Process Pipe Reactor"
+                    };
+                    s_epollFd = epollFd;
+                    thread.Start();
+                }
+                return s_epollFd >= 0;
+            }
+        }
+
+        private static unsafe void EventLoop()
+        {
+            byte* events = stackalloc byte[EventBufferCount * Interop.Sys.EpollEventSize];
+            byte[] buffer = new byte[ReadBufferSize];
+
+            while (true)
+            {
+                int count = Interop.Sys.EpollWait(s_epollFd, events, EventBufferCount, -1);
+                if (count < 0)
+                {
+                    Interop.Error error = Interop.Sys.GetLastError();
+                    if (error == Interop.Error.EINTR)
+                    {
+                        continue;
+                    }
+                    Environment.FailFast("Error while waiting for process pipe notifications. errno = " + error);
+                }
+
+                for (int i = 0; i < count; i++)
+                {
+                    Interop.Sys.GetEpollEvent(events, i, out _, out ulong id);
+
+                    Registration registration;
+                    lock (s_gate)
+                    {
+                        s_registrations.TryGetValue(id, out registration);
+                    }
+
+                    // Whatever the event mask, reading tells us whether there is data, EOF or an error.
+                    registration?.ReadAvailable(buffer);
+                }
+            }
+        }
+
+        /// <summary>A pipe being read by the reactor.</summary>
+        internal sealed class Registration : IDisposable
+        {
+            private readonly SafeFileHandle _handle;
+            private readonly int _fd;
+            private readonly IProcessPipeSink _sink;
+            private readonly TaskCompletionSource<bool> _completion =
+                new TaskCompletionSource<bool>(TaskCreationOptions.RunContinuationsAsynchronously);
+            // Protects the fd and the sink; read under it by the reactor, disposed under it by anyone.
+            private readonly object _lock = new object();
+            private bool _completed;
+
+            internal ulong Id;
+
+            internal Registration(SafeFileHandle handle, int fd, IProcessPipeSink sink)
+            {
+                _handle = handle;
+                _fd = fd;
+                _sink = sink;
+            }
+
+            /// <summary>Completes once the registration ended and the sink was told so.</summary>
+            internal Task Completion => _completion.Task;
+
+            internal unsafe void ReadAvailable(byte[] buffer)
+            {
+                lock (_lock)
+                {
+                    fixed (byte* pBuffer = buffer)
+                    {
+                        for (int reads = 0; reads < MaxReadsPerEvent && !_completed; reads++)
+                        {
+                            int bytesRead = Interop.Sys.Read(_fd, pBuffer, buffer.Length);
+                            if (bytesRead > 0)
+                            {
+                                if (!_sink.OnData(new ReadOnlySpan<byte>(pBuffer, bytesRead)))
+                                {
+                                    Complete(endOfStream: false);
+                                }
+                                continue;
+                            }
+
+                            if (bytesRead < 0)
+                            {
+                                Interop.Error error = Interop.Sys.GetLastError();
+                                if (error == Interop.Error.EAGAIN)
+                                {
+                                    return; // Drained; wait for the next notification.
+                                }
+                                if (error == Interop.Error.EINTR)
+                                {
+                                    continue;
+                                }
+                            }
+
+                            // EOF, or a read error which we treat as EOF like the stream reader does.
+                            Complete(endOfStream: true);
+                        }
+                    }
+                }
+            }
+
+            /// <summary>Stops reading before EOF. The handle is released, so its owner may close it afterwards.</summary>
+            public void Dispose()
+            {
+                lock (_lock)
+                {
+                    Complete(endOfStream: false);
+                }
+            }
+
+            private void Complete(bool endOfStream)
+            {
+                System.Diagnostics.Debug.Assert(Monitor.IsEntered(_lock));
+                if (_completed)
+                {
+                    return;
+                }
+                _completed = true;
+
+                lock (s_gate)
+                {
+                    s_registrations.Remove(Id);
+                }
+
+                // Remove the fd from the interest list before the handle may close it and the number gets reused.
+                Interop.Sys.EpollCtl(s_epollFd, Interop.Sys.EPOLL_CTL_DEL, _fd, 0, 0);
+                _handle.DangerousRelease();
+
+                try
+                {
+                    _sink.OnCompleted(endOfStream);
+                }
+                finally
+                {
+                    _completion.TrySetResult(true);
+                }
+            }
+        }
+    }
+}
@@ -12,6 +12,7 @@ using System.Runtime.InteropServices;
 using System.Security;
 using System.Text;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace MyDiagnostics
 {
@@ -339,6 +340,239 @@ namespace MyDiagnostics
         }
     }
 
+    /// <summary>
+    /// Provides the <see cref="StringParser"/> operations over a span of characters, such as the contents of a
+    /// /proc file decoded into a pooled buffer.  Components are returned as slices of that span and numbers are
+    /// parsed in place, so nothing is allocated per field.
+    /// </summary>
+    internal ref struct SpanStringParser
+    {
+        /// <summary>The characters being parsed.</summary>
+        private readonly ReadOnlySpan<char> _buffer;
+
+        /// <summary>The separator character used to separate subcomponents of the larger span.</summary>
+        private readonly char _separator;
+
+        /// <summary>true if empty subcomponents should be skipped; false to treat them as valid entries.</summary>
+        private readonly bool _skipEmpty;
+
+        /// <summary>The starting index from which to parse the current entry.</summary>
+        private int _startIndex;
+
+        /// <summary>The ending index that represents the next index after the last character that's part of the current entry.</summary>
+        private int _endIndex;
+
+        /// <summary>Initialize the SpanStringParser.</summary>
+        /// <param name="buffer">The characters to parse.</param>
+        /// <param name="separator">The separator character used to separate subcomponents of <paramref name="buffer"/>.</param>
+        /// <param name="skipEmpty">true if empty subcomponents should be skipped; false to treat them as valid entries.  Defaults to false.</param>
+        public SpanStringParser(ReadOnlySpan<char> buffer, char separator, bool skipEmpty = false)
+        {
+            _buffer = buffer;
+            _separator = separator;
+            _skipEmpty = skipEmpty;
+            _startIndex = -1;
+            _endIndex = -1;
+        }
+
+        /// <summary>Moves to the next component of the span.</summary>
+        /// <returns>true if there is a next component to be parsed; otherwise, false.</returns>
+        public bool MoveNext()
+        {
+            while (true)
+            {
+                if (_endIndex >= _buffer.Length)
+                {
+                    _startIndex = _endIndex;
+                    return false;
+                }
+
+                _startIndex = _endIndex + 1;
+                int nextSeparator = _buffer.Slice(_startIndex).IndexOf(_separator);
+                _endIndex = nextSeparator >= 0 ? _startIndex + nextSeparator : _buffer.Length;
+
+                if (!_skipEmpty || _endIndex >= _startIndex + 1)
+                {
+                    return true;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Moves to the next component of the span.  If there isn't one, it throws an exception.
+        /// </summary>
+        public void MoveNextOrFail()
+        {
+            if (!MoveNext())
+            {
+                ThrowForInvalidData();
+            }
+        }
+
+        /// <summary>Moves to the next component of the span and returns it.</summary>
+        public ReadOnlySpan<char> MoveAndExtractNext()
+        {
+            MoveNextOrFail();
+            return _buffer.Slice(_startIndex, _endIndex - _startIndex);
+        }
+
+        /// <summary>
+        /// Moves to the next component of the span, which must be enclosed in the only set of top-level parentheses
+        /// in the span.  The extracted value will be everything between (not including) those parentheses.
+        /// </summary>
+        public ReadOnlySpan<char> MoveAndExtractNextInOuterParens()
+        {
+            // Move to the next position
+            MoveNextOrFail();
+
+            // After doing so, we should be sitting at a the opening paren.
+            if (_startIndex >= _buffer.Length || _buffer[_startIndex] != '(')
+            {
+                ThrowForInvalidData();
+            }
+
+            // Since we only allow for one top-level set of parentheses, find the last
+            // parenthesis in the span; it's paired with the opening one we just found.
+            int lastParen = _buffer.LastIndexOf(')');
+            if (lastParen == -1 || lastParen < _startIndex)
+            {
+                ThrowForInvalidData();
+            }
+
+            // Extract the contents of the parens, then move our ending position to be after the paren
+            ReadOnlySpan<char> result = _buffer.Slice(_startIndex + 1, lastParen - _startIndex - 1);
+            _endIndex = lastParen + 1;
+
+            return result;
+        }
+
+        /// <summary>Gets the current subcomponent of the span.</summary>
+        public ReadOnlySpan<char> ExtractCurrent()
+        {
+            if (_startIndex == -1)
+            {
+                throw new InvalidOperationException();
+            }
+            return _buffer.Slice(_startIndex, _endIndex - _startIndex);
+        }
+
+        /// <summary>Gets the current subcomponent and all remaining components of the span.</summary>
+        public ReadOnlySpan<char> ExtractCurrentToEnd()
+        {
+            if (_startIndex == -1)
+            {
+                throw new InvalidOperationException();
+            }
+            return _buffer.Slice(_startIndex);
+        }
+
+        /// <summary>Moves past the next <paramref name="count"/> components without looking at them.</summary>
+        public void MoveNextOrFail(int count)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                MoveNextOrFail();
+            }
+        }
+
+        /// <summary>Moves to the next component and parses it as an Int32.</summary>
+        public int ParseNextInt32()
+        {
+            long result = ParseNextInt64();
+            if (result < int.MinValue || result > int.MaxValue)
+            {
+                ThrowForInvalidData();
+            }
+            return (int)result;
+        }
+
+        /// <summary>Moves to the next component and parses it as an Int64.</summary>
+        public long ParseNextInt64()
+        {
+            MoveNextOrFail();
+            ReadOnlySpan<char> value = _buffer.Slice(_startIndex, _endIndex - _startIndex);
+
+            bool negative = false;
+            long result = 0;
+            int i = 0;
+
+            if (value.Length != 0 && value[0] == '-')
+            {
+                negative = true;
+                i++;
+            }
+            if (i == value.Length)
+            {
+                ThrowForInvalidData();
+            }
+
+            for (; i < value.Length; i++)
+            {
+                int d = value[i] - '0';
+                if (d < 0 || d > 9)
+                {
+                    ThrowForInvalidData();
+                }
+                result = negative ? checked((result * 10) - d) : checked((result * 10) + d);
+            }
+
+            return result;
+        }
+
+        /// <summary>Moves to the next component and parses it as a UInt32.</summary>
+        public uint ParseNextUInt32()
+        {
+            ulong result = ParseNextUInt64();
+            if (result > uint.MaxValue)
+            {
+                ThrowForInvalidData();
+            }
+            return (uint)result;
+        }
+
+        /// <summary>Moves to the next component and parses it as a UInt64.</summary>
+        public ulong ParseNextUInt64()
+        {
+            MoveNextOrFail();
+            ReadOnlySpan<char> value = _buffer.Slice(_startIndex, _endIndex - _startIndex);
+            if (value.IsEmpty)
+            {
+                ThrowForInvalidData();
+            }
+
+            ulong result = 0;
+            for (int i = 0; i < value.Length; i++)
+            {
+                int d = value[i] - '0';
+                if (d < 0 || d > 9)
+                {
+                    ThrowForInvalidData();
+                }
+                result = checked((result * 10ul) + (ulong)d);
+            }
+
+            return result;
+        }
+
+        /// <summary>Moves to the next component and parses it as a Char.</summary>
+        public char ParseNextChar()
+        {
+            MoveNextOrFail();
+
+            if (_endIndex - _startIndex != 1)
+            {
+                ThrowForInvalidData();
+            }
+            return _buffer[_startIndex];
+        }
+
+        /// <summary>Throws unconditionally for invalid data.</summary>
+        private static void ThrowForInvalidData()
+        {
+            throw new InvalidDataException();
+        }
+    }
+
     // Class of safe handle which uses 0 or -1 as an invalid handle.
     public abstract class SafeHandleZeroOrMinusOneIsInvalid : SafeHandle
     {
@@ -427,8 +661,31 @@ namespace MyDiagnostics
         }
     }
 
+    /// <summary>How Process.Start creates child processes.</summary>
+    public enum ProcessSpawnMode
+    {
+        /// <summary>Always fork and exec through SystemNative_ForkAndExecProcess.</summary>
+        Fork,
+        /// <summary>Use posix_spawn unless the start needs fork (credentials, or a working directory the libc can't set).</summary>
+        PosixSpawn,
+        /// <summary>Have <see cref="Process.Zygote"/> start the child; starts it can't take fall back to <see cref="PosixSpawn"/>.</summary>
+        Zygote,
+    }
+
+    /// <summary>How BeginOutputReadLine and BeginErrorReadLine read the redirected pipes.</summary>
+    public enum ProcessCaptureMode
+    {
+        /// <summary>Each pipe is read by its own asynchronous loop on the thread pool.</summary>
+        ThreadPool,
+        /// <summary>All pipes are read by one shared epoll thread; line callbacks run on that thread.</summary>
+        Reactor,
+    }
+
     public partial class Process : IDisposable
     {
+        /// <summary>AppContext switch that makes <see cref="ProcessSpawnMode.Fork"/> the default spawn mode.</summary>
+        private const string DisablePosixSpawnSwitchName = "MyDiagnostics.Process.DisablePosixSpawn";
+
         private static readonly UTF8Encoding s_utf8NoBom =
             new UTF8Encoding(encoderShouldEmitUTF8Identifier: false);
         private static volatile bool s_initialized = false;
@@ -437,6 +694,19 @@ namespace MyDiagnostics
         private static readonly ReaderWriterLockSlim s_processStartLock = new ReaderWriterLockSlim();
         private static int s_childrenUsingTerminalCount;
 
+        /// <summary>Gets or sets how subsequent Process.Start calls create the child process.</summary>
+        public static ProcessSpawnMode SpawnMode { get; set; } =
+            AppContext.TryGetSwitch(DisablePosixSpawnSwitchName, out bool disabled) && disabled ? ProcessSpawnMode.Fork : ProcessSpawnMode.PosixSpawn;
+
+        /// <summary>
+        /// Gets or sets how subsequent BeginOutputReadLine/BeginErrorReadLine calls read the pipe.
+        /// With <see cref="ProcessCaptureMode.Reactor"/> the data received callbacks must not block.
+        /// </summary>
+        public static ProcessCaptureMode CaptureMode { get; set; } = ProcessCaptureMode.ThreadPool;
+
+        /// <summary>Gets or sets the zygote used when <see cref="SpawnMode"/> is <see cref="ProcessSpawnMode.Zygote"/>.</summary>
+        public static ProcessZygote Zygote { get; set; }
+
         /// <summary>
         /// Puts a Process component in state to interact with operating system processes that run in a 
         /// special mode by enabling the native property SeDebugPrivilege on the current thread.
@@ -637,6 +907,41 @@ namespace MyDiagnostics
             return exited;
         }
 
+        /// <summary>Waits asynchronously for the associated process to exit and for the redirected output to reach EOF.</summary>
+        private async Task WaitForExitCoreAsync(CancellationToken cancellationToken)
+        {
+            await WaitAsync(GetWaitState().GetExitedTask(), cancellationToken).ConfigureAwait(false);
+
+            if (_output != null)
+            {
+                await WaitAsync(_output.EOF, cancellationToken).ConfigureAwait(false);
+            }
+            if (_error != null)
+            {
+                await WaitAsync(_error.EOF, cancellationToken).ConfigureAwait(false);
+            }
+        }
+
+        /// <summary>Waits for <paramref name="task"/>, throwing OperationCanceledException if the token fires first.</summary>
+        private static async Task WaitAsync(Task task, CancellationToken cancellationToken)
+        {
+            if (task.IsCompleted || !cancellationToken.CanBeCanceled)
+            {
+                await task.ConfigureAwait(false);
+                return;
+            }
+
+            var canceled = new TaskCompletionSource<bool>(TaskCreationOptions.RunContinuationsAsynchronously);
+            using (cancellationToken.Register(state => ((TaskCompletionSource<bool>)state).TrySetResult(true), canceled))
+            {
+                if (await Task.WhenAny(task, canceled.Task).ConfigureAwait(false) != task)
+                {
+                    throw new OperationCanceledException(cancellationToken);
+                }
+            }
+            await task.ConfigureAwait(false);
+        }
+
         /// <summary>Checks whether the process has exited and updates state accordingly.</summary>
         private void UpdateHasExited()
         {
@@ -654,6 +959,100 @@ namespace MyDiagnostics
             get { return GetWaitState().ExitTime; }
         }
 
+        /// <summary>Gets the Stopwatch timestamp at which the child was reaped, or 0 if it hasn't been reaped (or isn't our child).</summary>
+        internal long ReapTimestamp
+        {
+            get { return GetWaitState().ReapTimestamp; }
+        }
+
+        /// <summary>
+        /// Gets the time the associated process spent running user code. Available once a child started by
+        /// Process.Start exited: it comes with its exit status from wait4, as /proc is gone by then.
+        /// </summary>
+        public TimeSpan UserProcessorTime
+        {
+            get { return GetExitResourceUsage().UserTime.ToTimeSpan(); }
+        }
+
+        /// <summary>Gets the time the associated process spent running in the kernel, captured like <see cref="UserProcessorTime"/>.</summary>
+        public TimeSpan PrivilegedProcessorTime
+        {
+            get { return GetExitResourceUsage().SystemTime.ToTimeSpan(); }
+        }
+
+        /// <summary>Gets the user plus kernel time of the associated process, captured like <see cref="UserProcessorTime"/>.</summary>
+        public TimeSpan TotalProcessorTime
+        {
+            get
+            {
+                Interop.Sys.ResourceUsage usage = GetExitResourceUsage();
+                return usage.UserTime.ToTimeSpan() + usage.SystemTime.ToTimeSpan();
+            }
+        }
+
+        private Interop.Sys.ResourceUsage GetExitResourceUsage()
+        {
+            EnsureState(State.Associated);
+            if (!GetWaitState().TryGetResourceUsage(out Interop.Sys.ResourceUsage usage))
+            {
+                // Only a reaped child has its usage captured.
+                throw new InvalidOperationException("SR.ResourceUsageNotAvailable");
+            }
+            return usage;
+        }
+
+        /// <summary>Gets the peak resident set size of an exited child, as reported by wait4.</summary>
+        private bool TryGetExitPeakWorkingSet(out long peakWorkingSet)
+        {
+            if (Associated && GetWaitState().TryGetResourceUsage(out Interop.Sys.ResourceUsage usage))
+            {
+                peakWorkingSet = (long)usage.MaxResidentSetSize * 1024; // ru_maxrss is in kilobytes
+                return true;
+            }
+            peakWorkingSet = 0;
+            return false;
+        }
+
+        /// <summary>
+        /// Re-reads the process information (names, priorities, memory counters and optionally threads) of all of
+        /// <paramref name="processes"/> from /proc in one pass that shares its buffers, instead of the per-process
+        /// Refresh() and lazy reload.  A process that is gone keeps no information, so its properties throw as usual.
+        /// </summary>
+        public static void RefreshProcessInfo(IReadOnlyList<Process> processes, bool includeThreads = false)
+        {
+            if (processes == null)
+            {
+                throw new ArgumentNullException(nameof(processes));
+            }
+
+            int count = 0;
+            int[] processIds = System.Buffers.ArrayPool<int>.Shared.Rent(processes.Count);
+            ProcessInfo[] processInfos = System.Buffers.ArrayPool<ProcessInfo>.Shared.Rent(processes.Count);
+            try
+            {
+                for (int i = 0; i < processes.Count; i++)
+                {
+                    Process process = processes[i];
+                    process.EnsureState(State.HaveId | State.IsLocal);
+                    processIds[count] = process._processId;
+                    processInfos[count] = process._processInfo;
+                    count++;
+                }
+
+                ProcessManager.RefreshProcessInfos(new ReadOnlySpan<int>(processIds, 0, count), processInfos, includeThreads);
+
+                for (int i = 0; i < count; i++)
+                {
+                    processes[i]._processInfo = processInfos[i];
+                }
+            }
+            finally
+            {
+                System.Buffers.ArrayPool<int>.Shared.Return(processIds);
+                System.Buffers.ArrayPool<ProcessInfo>.Shared.Return(processInfos, clearArray: true);
+            }
+        }
+
         /// <summary>
         /// Gets or sets a value indicating whether the associated process priority
         /// should be temporarily boosted by the operating system when the main window
@@ -728,7 +1127,7 @@ namespace MyDiagnostics
             }
 
             int stdinFd = -1, stdoutFd = -1, stderrFd = -1;
-            string[] envp = CreateEnvp(startInfo);
+            IDictionary<string, string> environment = startInfo.Environment;
             string cwd = !string.IsNullOrWhiteSpace(startInfo.WorkingDirectory) ? startInfo.WorkingDirectory : null;
 
             bool setCredentials = !string.IsNullOrEmpty(startInfo.UserName);
@@ -764,7 +1163,7 @@ namespace MyDiagnostics
                 {
                     argv = ParseArgv(startInfo);
 
-                    isExecuting = ForkAndExecProcess(filename, argv, envp, cwd,
+                    isExecuting = ForkAndExecProcess(filename, argv, environment, cwd,
                         startInfo.RedirectStandardInput, startInfo.RedirectStandardOutput, startInfo.RedirectStandardError,
                         setCredentials, userId, groupId, groups,
                         out stdinFd, out stdoutFd, out stderrFd, usesTerminal,
@@ -786,7 +1185,7 @@ namespace MyDiagnostics
                     throw new Win32Exception("SR.DirectoryNotValidAsInput");
                 }
 
-                ForkAndExecProcess(filename, argv, envp, cwd,
+                ForkAndExecProcess(filename, argv, environment, cwd,
                     startInfo.RedirectStandardInput, startInfo.RedirectStandardOutput, startInfo.RedirectStandardError,
                     setCredentials, userId, groupId, groups,
                     out stdinFd, out stdoutFd, out stderrFd, usesTerminal);
@@ -820,7 +1219,7 @@ namespace MyDiagnostics
         }
 
         private bool ForkAndExecProcess(
-            string filename, string[] argv, string[] envp, string cwd,
+            string filename, string[] argv, IDictionary<string, string> environment, string cwd,
             bool redirectStdin, bool redirectStdout, bool redirectStderr,
             bool setCredentials, uint userId, uint groupId, uint[] groups,
             out int stdinFd, out int stdoutFd, out int stderrFd,
@@ -831,9 +1230,15 @@ namespace MyDiagnostics
                 throw new Win32Exception(Interop.Error.ENOENT.Info().RawErrno);
             }
 
-            // Lock to avoid races with OnSigChild
+            // Let OnSigChild know a child may exist that isn't in the wait state table yet.
+            ProcessWaitState.BeginChildStart();
+
+            // Lock to avoid racing terminal configuration with OnSigChild.
             // By using a ReaderWriterLock we allow multiple processes to start concurrently.
-            s_processStartLock.EnterReadLock();
+            if (usesTerminal)
+            {
+                s_processStartLock.EnterReadLock();
+            }
             try
             {
                 if (usesTerminal)
@@ -842,24 +1247,53 @@ namespace MyDiagnostics
                 }
 
                 int childPid;
-
-                // Invoke the shim fork/execve routine.  It will create pipes for all requested
-                // redirects, fork a child process, map the pipe ends onto the appropriate stdin/stdout/stderr
-                // descriptors, and execve to execute the requested process.  The shim implementation
-                // is used to fork/execve as executing managed code in a forked process is not safe (only
-                // the calling thread will transfer, thread IDs aren't stable across the fork, etc.)
-                int errno = Interop.Sys.ForkAndExecProcess(
-                    filename, argv, envp, cwd,
-                    redirectStdin, redirectStdout, redirectStderr,
-                    setCredentials, userId, groupId, groups,
-                    out childPid,
-                    out stdinFd, out stdoutFd, out stderrFd);
+                ProcessWaitState zygoteChild = null;
+
+                int errno;
+                ProcessZygote zygote = GetZygote(setCredentials);
+                if (zygote != null &&
+                    (errno = zygote.Spawn(
+                        filename, argv, environment, cwd,
+                        redirectStdin, redirectStdout, redirectStderr, usesTerminal,
+                        out childPid,
+                        out stdinFd, out stdoutFd, out stderrFd,
+                        out zygoteChild)) != ProcessZygote.Unavailable)
+                {
+                    // The zygote forked the child from its own small address space, and already put it in the table.
+                }
+                else if (CanUsePosixSpawn(setCredentials, cwd))
+                {
+                    // posix_spawn does the same pipe and descriptor setup in a CLONE_VFORK child, so unlike
+                    // fork its cost doesn't depend on the size of our address space. Terminal configuration
+                    // happens in this process either way.
+                    errno = Interop.Sys.PosixSpawnProcess(
+                        filename, argv, environment, cwd,
+                        redirectStdin, redirectStdout, redirectStderr,
+                        out childPid,
+                        out stdinFd, out stdoutFd, out stderrFd);
+                }
+                else
+                {
+                    // Invoke the shim fork/execve routine.  It will create pipes for all requested
+                    // redirects, fork a child process, map the pipe ends onto the appropriate stdin/stdout/stderr
+                    // descriptors, and execve to execute the requested process.  The shim implementation
+                    // is used to fork/execve as executing managed code in a forked process is not safe (only
+                    // the calling thread will transfer, thread IDs aren't stable across the fork, etc.)
+                    errno = Interop.Sys.ForkAndExecProcess(
+                        filename, argv, environment, cwd,
+                        redirectStdin, redirectStdout, redirectStderr,
+                        setCredentials, userId, groupId, groups,
+                        out childPid,
+                        out stdinFd, out stdoutFd, out stderrFd);
+                }
 
                 if (errno == 0)
                 {
                     // Ensure we'll reap this process.
                     // note: SetProcessId will set this if we don't set it first.
-                    _waitStateHolder = new ProcessWaitState.Holder(childPid, isNewChild: true, usesTerminal);
+                    _waitStateHolder = zygoteChild != null ?
+                        new ProcessWaitState.Holder(zygoteChild) :
+                        new ProcessWaitState.Holder(childPid, isNewChild: true, usesTerminal);
 
                     // Store the child's information into this Process object.
                     System.Diagnostics.Debug.Assert(childPid >= 0);
@@ -881,7 +1315,12 @@ namespace MyDiagnostics
             }
             finally
             {
-                s_processStartLock.ExitReadLock();
+                if (usesTerminal)
+                {
+                    s_processStartLock.ExitReadLock();
+                }
+
+                ProcessWaitState.EndChildStart();
 
                 if (_waitStateHolder == null && usesTerminal)
                 {
@@ -893,6 +1332,22 @@ namespace MyDiagnostics
             }
         }
 
+        /// <summary>Returns the zygote this start should go through, or null.</summary>
+        private static ProcessZygote GetZygote(bool setCredentials)
+        {
+            return SpawnMode == ProcessSpawnMode.Zygote &&
+                !setCredentials ? // the zygote doesn't run as root on our behalf
+                Zygote : null;
+        }
+
+        /// <summary>Whether this start can go through posix_spawn instead of fork.</summary>
+        private static bool CanUsePosixSpawn(bool setCredentials, string cwd)
+        {
+            return SpawnMode != ProcessSpawnMode.Fork &&
+                !setCredentials && // setuid/setgid/setgroups have to run in a forked child
+                (cwd == null || Interop.Sys.PosixSpawnSupportsChdir);
+        }
+
         // -----------------------------
         // ---- PAL layer ends here ----
         // -----------------------------
@@ -942,20 +1397,6 @@ namespace MyDiagnostics
             return argvList.ToArray();
         }
 
-        /// <summary>Converts the environment variables information from a ProcessStartInfo into an envp array.</summary>
-        /// <param name="psi">The ProcessStartInfo.</param>
-        /// <returns>The envp array.</returns>
-        private static string[] CreateEnvp(System.Diagnostics.ProcessStartInfo psi)
-        {
-            var envp = new string[psi.Environment.Count];
-            int index = 0;
-            foreach (var pair in psi.Environment)
-            {
-                envp[index++] = pair.Key + "=" + pair.Value;
-            }
-            return envp;
-        }
-
         private static string ResolveExecutableForShellExecute(string filename, string workingDirectory)
         {
             // Determine if filename points to an executable file.
@@ -1248,18 +1689,18 @@ namespace MyDiagnostics
 
         private static void OnSigChild(bool reapAll)
         {
-            // Lock to avoid races with Process.Start
-            s_processStartLock.EnterWriteLock();
-            try
-            {
-                ProcessWaitState.CheckChildren(reapAll);
-            }
-            finally
-            {
-                s_processStartLock.ExitWriteLock();
-            }
+            // ProcessWaitState tracks in-progress starts itself, so reaping doesn't block Process.Start.
+            ProcessWaitState.CheckChildren(reapAll);
         }
 
+        /// <summary>
+        /// Taken by the reaper around <see cref="ConfigureTerminalForChildProcesses"/> when children
+        /// using the terminal exited, excluding starts of such children.
+        /// </summary>
+        internal static void EnterTerminalConfigurationWriteLock() => s_processStartLock.EnterWriteLock();
+
+        internal static void ExitTerminalConfigurationWriteLock() => s_processStartLock.ExitWriteLock();
+
         /// <summary>
         /// This method is called when the number of child processes that are using the terminal changes.
         /// It updates the terminal configuration if necessary.
@@ -19,14 +19,26 @@ namespace MyDiagnostics
     //   objects may be used concurrently with each other, even if they refer to the same underlying process.
     //   Same with ProcessWaitHandle objects.  This is based on the Windows design where anyone with a handle to the
     //   process can retrieve completion information about that process.
-    // - There is no good Unix equivalent to asynchronously be notified of a non-child process' exit, which means such
-    //   support needs to be layered on top of kill.
+    // - There is no good portable Unix equivalent to asynchronously be notified of a non-child process' exit. On
+    //   Linux 5.3+ a pidfd becomes readable when the process terminates, so non-child waits are registered with a
+    //   single shared epoll thread (ProcessExitReactor); elsewhere, or if pidfd_open is unavailable, such support
+    //   is layered on top of kill.
     // 
     // As a result, we have the following scheme:
     // - We maintain a static/shared table that maps process ID to ProcessWaitState objects.
     //   Access to this table requires taking a global lock, so we try to minimize the number of
     //   times we need to access the table, primarily just the first time a Process object needs
     //   access to process exit/wait information and subsequently when that Process object gets GC'd.
+    //   Child processes are kept in a separate table that is split into shards by pid, each with its own
+    //   lock, so that starting processes and reaping them on SIGCHLD don't contend on a single lock.
+    // - The SIGCHLD reaper only runs one at a time and does not block Process.Start. A start announces itself
+    //   (BeginChildStart) before forking and until its child is in the table (EndChildStart). If the reaper
+    //   sees a terminated pid it doesn't know while a start is in progress, the pid may belong to that start,
+    //   so the reaper leaves it alone and the starting thread re-runs the check once it has registered its child.
+    //   Terminal settings are updated once per batch of reaped children, before their exit is published.
+    // - Children started through a ProcessZygote are children of the zygote, not ours. They are kept in the child
+    //   table like our own children, but they are never passed to waitpid; the zygote reaps them and the
+    //   ProcessZygote publishes their exit status it received with CompleteZygoteChildren.
     // - Each process holds a ProcessWaitState.Holder object; when that object is constructed,
     //   it ensures there's an appropriate entry in the mapping table and increments that entry's ref count.
     // - When a Process object is dropped and its ProcessWaitState.Holder is finalized, it'll
@@ -61,6 +73,12 @@ namespace MyDiagnostics
                 _state = ProcessWaitState.AddRef(processId, isNewChild, usesTerminal);
             }
 
+            /// <summary>Takes over a reference that was already added for the holder, e.g. by <see cref="AddZygoteChild"/>.</summary>
+            internal Holder(ProcessWaitState state)
+            {
+                _state = state;
+            }
+
             ~Holder()
             {
                 // Don't try to Dispose resources (like ManualResetEvents) if 
@@ -88,11 +106,80 @@ namespace MyDiagnostics
         private static readonly Dictionary<int, ProcessWaitState> s_processWaitStates =
             new Dictionary<int, ProcessWaitState>();
 
+        /// <summary>Number of shards in the child process table. Must be a power of 2.</summary>
+        private const int ChildProcessWaitStateShardCount = 64;
+
         /// <summary>
         /// Global table that maps process IDs of child Processes to the associated shared wait state information.
+        /// The table is sharded by pid; each shard is locked independently.
         /// </summary>
-        private static readonly Dictionary<int, ProcessWaitState> s_childProcessWaitStates =
-            new Dictionary<int, ProcessWaitState>();
+        private static readonly Dictionary<int, ProcessWaitState>[] s_childProcessWaitStates = CreateChildProcessWaitStateShards();
+
+        /// <summary>Serializes CheckChildren calls; only the reaper and deferred re-checks take it.</summary>
+        private static readonly object s_reaperGate = new object();
+        /// <summary>Children reaped by the current CheckChildren pass; only used while s_reaperGate is held.</summary>
+        private static readonly List<ProcessWaitState> s_reapedChildren = new List<ProcessWaitState>();
+        /// <summary>The number of Process.Start calls between fork and adding the child to the table.</summary>
+        private static int s_childStartsInProgress;
+        /// <summary>A CheckChildren pass that was deferred to a starting thread: one of the DeferredCheck* values.</summary>
+        private static int s_deferredCheck;
+        /// <summary>The unknown pid that made the last pass defer, or 0.</summary>
+        private static int s_lastDeferredPid;
+
+        private const int DeferredCheckNone = 0;
+        private const int DeferredCheck = 1;
+        private const int DeferredCheckReapAll = 2;
+
+        private static Dictionary<int, ProcessWaitState>[] CreateChildProcessWaitStateShards()
+        {
+            var shards = new Dictionary<int, ProcessWaitState>[ChildProcessWaitStateShardCount];
+            for (int i = 0; i < shards.Length; i++)
+            {
+                shards[i] = new Dictionary<int, ProcessWaitState>();
+            }
+            return shards;
+        }
+
+        /// <summary>Returns the shard of the child process table that holds <paramref name="processId"/>.</summary>
+        private static Dictionary<int, ProcessWaitState> GetChildProcessWaitStates(int processId)
+        {
+            return s_childProcessWaitStates[processId & (ChildProcessWaitStateShardCount - 1)];
+        }
+
+        /// <summary>Looks up the wait state of a child process, or returns null if the pid isn't a known child.</summary>
+        private static ProcessWaitState FindChild(int processId)
+        {
+            Dictionary<int, ProcessWaitState> childProcessWaitStates = GetChildProcessWaitStates(processId);
+            lock (childProcessWaitStates)
+            {
+                childProcessWaitStates.TryGetValue(processId, out ProcessWaitState pws);
+                return pws;
+            }
+        }
+
+        /// <summary>Called by Process.Start before it forks a child.</summary>
+        internal static void BeginChildStart()
+        {
+            Interlocked.Increment(ref s_childStartsInProgress);
+        }
+
+        /// <summary>
+        /// Called by Process.Start once the child was added to the table (or the start failed).
+        /// Runs a CheckChildren pass the reaper deferred because this start was in progress.
+        /// </summary>
+        internal static void EndChildStart()
+        {
+            Interlocked.Decrement(ref s_childStartsInProgress);
+
+            if (Volatile.Read(ref s_deferredCheck) != DeferredCheckNone)
+            {
+                int deferredCheck = Interlocked.Exchange(ref s_deferredCheck, DeferredCheckNone);
+                if (deferredCheck != DeferredCheckNone)
+                {
+                    CheckChildren(reapAll: deferredCheck == DeferredCheckReapAll);
+                }
+            }
+        }
 
         /// <summary>
         /// Ensures that the mapping table contains an entry for the process ID,
@@ -100,20 +187,21 @@ namespace MyDiagnostics
         /// </summary>
         /// <param name="processId">The process ID for which we need wait state.</param>
         /// <returns>The wait state object.</returns>
-        internal static ProcessWaitState AddRef(int processId, bool isNewChild, bool usesTerminal)
+        internal static ProcessWaitState AddRef(int processId, bool isNewChild, bool usesTerminal, bool isZygoteChild = false)
         {
-            lock (s_childProcessWaitStates)
+            Dictionary<int, ProcessWaitState> childProcessWaitStates = GetChildProcessWaitStates(processId);
+            lock (childProcessWaitStates)
             {
                 ProcessWaitState pws;
                 if (isNewChild)
                 {
                     // When the PID is recycled for a new child, we remove the old child.
-                    s_childProcessWaitStates.Remove(processId);
+                    childProcessWaitStates.Remove(processId);
 
-                    pws = new ProcessWaitState(processId, isChild: true, usesTerminal);
-                    s_childProcessWaitStates.Add(processId, pws);
+                    pws = new ProcessWaitState(processId, isChild: true, usesTerminal, isZygoteChild: isZygoteChild);
+                    childProcessWaitStates.Add(processId, pws);
                     pws._outstandingRefCount++; // For Holder
-                    pws._outstandingRefCount++; // Decremented in CheckChildren
+                    pws._outstandingRefCount++; // Decremented in CheckChildren, or CompleteZygoteChildren for zygote children
                 }
                 else
                 {
@@ -122,7 +210,7 @@ namespace MyDiagnostics
                         DateTime exitTime = default;
                         // We are referencing an existing process.
                         // This may be a child process, so we check s_childProcessWaitStates too.
-                        if (s_childProcessWaitStates.TryGetValue(processId, out pws))
+                        if (childProcessWaitStates.TryGetValue(processId, out pws))
                         {
                             // child process
                         }
@@ -154,6 +242,15 @@ namespace MyDiagnostics
             }
         }
 
+        /// <summary>
+        /// Adds a child that a zygote started to the child table. The result holds a reference for a
+        /// <see cref="Holder"/> and one that <see cref="CompleteZygoteChildren"/> releases.
+        /// </summary>
+        internal static ProcessWaitState AddZygoteChild(int processId, bool usesTerminal)
+        {
+            return AddRef(processId, isNewChild: true, usesTerminal, isZygoteChild: true);
+        }
+
         /// <summary>
         /// Decrements the ref count on the wait state object, and if it's the last one,
         /// removes it from the table.
@@ -161,12 +258,14 @@ namespace MyDiagnostics
         internal void ReleaseRef()
         {
             ProcessWaitState pws;
-            Dictionary<int, ProcessWaitState> waitStates = _isChild ? s_childProcessWaitStates : s_processWaitStates;
+            Dictionary<int, ProcessWaitState> waitStates = _isChild ? GetChildProcessWaitStates(_processId) : s_processWaitStates;
             lock (waitStates)
             {
                 bool foundState = waitStates.TryGetValue(_processId, out pws);
-                System.Diagnostics.Debug.Assert(foundState);
-                if (foundState)
+                // A reaped child's pid may have been recycled for a new child (which replaced this entry)
+                // before the reaper released its reference.
+                System.Diagnostics.Debug.Assert(foundState || _isChild);
+                if (foundState || _isChild)
                 {
                     --_outstandingRefCount;
                     if (_outstandingRefCount == 0)
@@ -199,6 +298,8 @@ namespace MyDiagnostics
         private readonly bool _isChild;
         /// <summary>Associated process is a child that can use the terminal.</summary>
         private readonly bool _usesTerminal;
+        /// <summary>Associated process is a child of a zygote, which reaps it and reports its exit status.</summary>
+        private readonly bool _isZygoteChild;
 
         /// <summary>If a wait operation is in progress, the Task that represents it; otherwise, null.</summary>
         private Task _waitInProgress;
@@ -207,8 +308,16 @@ namespace MyDiagnostics
 
         /// <summary>Whether the associated process exited.</summary>
         private bool _exited;
+        /// <summary>Whether the child was reaped by the current CheckChildren pass, which will publish its exit.</summary>
+        private bool _reaped;
+        /// <summary>The Stopwatch timestamp of the waitpid call that reaped the child.</summary>
+        private long _reapTimestamp;
         /// <summary>If the process exited, it's exit code, or null if we were unable to determine one.</summary>
         private int? _exitCode;
+        /// <summary>The child's resource usage, returned by wait4 when it was reaped.</summary>
+        private Interop.Sys.ResourceUsage _resourceUsage;
+        /// <summary>Whether <see cref="_resourceUsage"/> was captured.</summary>
+        private bool _haveResourceUsage;
         /// <summary>
         /// The approximate time the process exited.  We do not have the ability to know exact time a process
         /// exited, so we approximate it by storing the time that we discovered it exited.
@@ -216,16 +325,20 @@ namespace MyDiagnostics
         private DateTime _exitTime;
         /// <summary>A lazily-initialized event set when the process exits.</summary>
         private ManualResetEvent _exitedEvent;
+        /// <summary>A lazily-initialized task source completed when the process exits.</summary>
+        private TaskCompletionSource<bool> _exitedTaskSource;
 
         /// <summary>Initialize the wait state object.</summary>
         /// <param name="processId">The associated process' ID.</param>
-        private ProcessWaitState(int processId, bool isChild, bool usesTerminal, DateTime exitTime = default)
+        private ProcessWaitState(int processId, bool isChild, bool usesTerminal, DateTime exitTime = default, bool isZygoteChild = false)
         {
             System.Diagnostics.Debug.Assert(processId >= 0);
+            System.Diagnostics.Debug.Assert(isChild || !isZygoteChild);
             _processId = processId;
             _isChild = isChild;
             _usesTerminal = usesTerminal;
             _exitTime = exitTime;
+            _isZygoteChild = isZygoteChild;
         }
 
         /// <summary>Releases managed resources used by the ProcessWaitState.</summary>
@@ -254,6 +367,7 @@ namespace MyDiagnostics
                 _exitTime = DateTime.Now;
             }
             _exitedEvent?.Set();
+            _exitedTaskSource?.TrySetResult(true);
         }
 
         /// <summary>Ensures an exited event has been initialized and returns it.</summary>
@@ -270,24 +384,59 @@ namespace MyDiagnostics
                     // If we don't, create one, and if the process hasn't yet exited,
                     // make sure we have a task that's actively monitoring the completion state.
                     _exitedEvent = new ManualResetEvent(initialState: _exited);
-                    if (!_exited)
-                    {
-                        if (!_isChild)
-                        {
-                            // If we haven't exited, we need to spin up an asynchronous operation that
-                            // will completed the exitedEvent when the other process exits. If there's already
-                            // another operation underway, then we'll just tack ours onto the end of it.
-                            _waitInProgress = _waitInProgress == null ?
-                                WaitForExitAsync() :
-                                _waitInProgress.ContinueWith((_, state) => ((ProcessWaitState)state).WaitForExitAsync(),
-                                    this, CancellationToken.None, TaskContinuationOptions.None, TaskScheduler.Default).Unwrap();
-                        }
-                    }
+                    EnsureExitMonitored();
                 }
                 return _exitedEvent;
             }
         }
 
+        /// <summary>
+        /// Returns a task that completes when the process exits. It is completed by <see cref="SetExited"/>,
+        /// from the SIGCHLD handler for children and from the exit reactor (or polling) otherwise,
+        /// so no thread is blocked on behalf of the callers awaiting it.
+        /// </summary>
+        internal Task GetExitedTask()
+        {
+            System.Diagnostics.Debug.Assert(!Monitor.IsEntered(_gate));
+
+            lock (_gate)
+            {
+                if (_exited)
+                {
+                    return Task.CompletedTask;
+                }
+
+                if (_exitedTaskSource == null)
+                {
+                    // Continuations run on the thread pool rather than inline under _gate in SetExited.
+                    _exitedTaskSource = new TaskCompletionSource<bool>(TaskCreationOptions.RunContinuationsAsynchronously);
+                    EnsureExitMonitored();
+                }
+                return _exitedTaskSource.Task;
+            }
+        }
+
+        /// <summary>Makes sure something will call <see cref="SetExited"/> once the process exits.</summary>
+        private void EnsureExitMonitored()
+        {
+            System.Diagnostics.Debug.Assert(Monitor.IsEntered(_gate));
+
+            // Children are reaped by the SIGCHLD handler.
+            if (!_exited && !_isChild)
+            {
+                // If we haven't exited, we need to spin up an asynchronous operation that
+                // will complete when the other process exits. If there's already
+                // another operation underway, then we'll just tack ours onto the end of it.
+                _waitInProgress = _waitInProgress == null ?
+                    WaitForExitAsync() :
+                    _waitInProgress.ContinueWith((_, state) => ((ProcessWaitState)state).ContinueWaitForExitAsync(),
+                        this, CancellationToken.None, TaskContinuationOptions.None, TaskScheduler.Default).Unwrap();
+            }
+        }
+
+        /// <summary>Whether the child may use the terminal, so publishing its exit updates the terminal settings.</summary>
+        internal bool UsesTerminal => _usesTerminal;
+
         internal DateTime ExitTime
         {
             get
@@ -300,6 +449,31 @@ namespace MyDiagnostics
             }
         }
 
+        /// <summary>The Stopwatch timestamp at which the reaper collected the child's exit status, or 0.</summary>
+        internal long ReapTimestamp
+        {
+            get
+            {
+                lock (_gate)
+                {
+                    return _reapTimestamp;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Gets the resource usage the child accumulated, captured when it was reaped.
+        /// Only available once a child (ours or a zygote's) exited.
+        /// </summary>
+        internal bool TryGetResourceUsage(out Interop.Sys.ResourceUsage usage)
+        {
+            lock (_gate)
+            {
+                usage = _resourceUsage;
+                return _exited && _haveResourceUsage;
+            }
+        }
+
         internal bool HasExited
         {
             get
@@ -494,15 +668,49 @@ namespace MyDiagnostics
             }
         }
 
-        /// <summary>Spawns an asynchronous polling loop for process completion.</summary>
-        /// <param name="cancellationToken">A token to monitor to exit the polling loop.</param>
-        /// <returns>The task representing the loop.</returns>
+        /// <summary>Starts a new wait once the wait that was in progress when the exited event was requested has finished.</summary>
+        private Task ContinueWaitForExitAsync()
+        {
+            lock (_gate)
+            {
+                if (_exited)
+                {
+                    return Task.CompletedTask;
+                }
+
+                // The placeholder continuation was stored in _waitInProgress; this wait replaces it.
+                _waitInProgress = null;
+                return WaitForExitAsync();
+            }
+        }
+
+        /// <summary>
+        /// Spawns an asynchronous wait for process completion: a pidfd registration with the shared
+        /// <see cref="ProcessExitReactor"/> when the kernel supports it, otherwise a polling loop.
+        /// </summary>
+        /// <param name="cancellationToken">A token to monitor to exit the wait.</param>
+        /// <returns>The task representing the wait.</returns>
         private Task WaitForExitAsync(CancellationToken cancellationToken = default(CancellationToken))
         {
             System.Diagnostics.Debug.Assert(Monitor.IsEntered(_gate));
             System.Diagnostics.Debug.Assert(_waitInProgress == null);
             System.Diagnostics.Debug.Assert(!_isChild);
 
+            if (ProcessExitReactor.IsSupported)
+            {
+                Task reactorTask = ProcessExitReactor.WaitForExitAsync(this, _processId, cancellationToken);
+                if (reactorTask != null)
+                {
+                    // The reactor takes _gate before completing the task, so it can only have completed
+                    // already if that happened synchronously on this thread (e.g. immediate cancellation).
+                    if (!reactorTask.IsCompleted)
+                    {
+                        _waitInProgress = reactorTask;
+                    }
+                    return reactorTask;
+                }
+            }
+
             return _waitInProgress = Task.Run(async delegate // Task.Run used because of potential blocking in CheckForNonChildExit
             {
                 // Arbitrary values chosen to balance delays with polling overhead.  Start with fast polling
@@ -549,31 +757,50 @@ namespace MyDiagnostics
             });
         }
 
+        /// <summary>Called by <see cref="ProcessExitReactor"/> when a pidfd wait started by <see cref="WaitForExitAsync"/> ends.</summary>
+        /// <param name="waitTask">The task that was returned for the wait.</param>
+        /// <param name="exited">true if the pidfd reported that the process terminated; false if the wait was canceled.</param>
+        internal void OnReactorWaitCompleted(Task waitTask, bool exited)
+        {
+            lock (_gate)
+            {
+                if (exited && !_exited)
+                {
+                    SetExited();
+                }
+
+                // Task is no longer active
+                if (_waitInProgress == waitTask)
+                {
+                    _waitInProgress = null;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Reaps the child if it terminated and records its exit code. The caller publishes the
+        /// exit with <see cref="CompleteReapedChildren"/>.
+        /// </summary>
         private bool TryReapChild()
         {
             lock (_gate)
             {
-                if (_exited)
+                // A zygote child isn't ours to waitpid for; its exit arrives through SetZygoteChildReaped.
+                if (_exited || _reaped || _isZygoteChild)
                 {
                     return false;
                 }
 
-                // Try to get the state of the child process
+                // Try to get the state of the child process, and what it used, which is gone once it's reaped.
                 int exitCode;
-                int waitResult = Interop.Sys.WaitPidExitedNoHang(_processId, out exitCode);
+                int waitResult = Interop.Sys.WaitPidExitedNoHang(_processId, out exitCode, out _resourceUsage);
 
                 if (waitResult == _processId)
                 {
                     _exitCode = exitCode;
-
-                    if (_usesTerminal)
-                    {
-                        // Update terminal settings before calling SetExited.
-                        Process.ConfigureTerminalForChildProcesses(-1);
-                    }
-
-                    SetExited();
-
+                    _haveResourceUsage = true;
+                    _reaped = true;
+                    _reapTimestamp = System.Diagnostics.Stopwatch.GetTimestamp();
                     return true;
                 }
                 else if (waitResult == 0)
@@ -592,11 +819,11 @@ namespace MyDiagnostics
 
         internal static void CheckChildren(bool reapAll)
         {
-            // This is called on SIGCHLD from a native thread.
-            // A lock in Process ensures no new processes are spawned while we are checking.
-            lock (s_childProcessWaitStates)
+            // This is called on SIGCHLD from a native thread, and by a starting thread for a deferred pass.
+            lock (s_reaperGate)
             {
                 bool checkAll = false;
+                List<ProcessWaitState> reaped = s_reapedChildren;
 
                 // Check terminated processes.
                 int pid;
@@ -606,14 +833,51 @@ namespace MyDiagnostics
                     pid = Interop.Sys.WaitIdAnyExitedNoHangNoWait();
                     if (pid > 0)
                     {
-                        if (s_childProcessWaitStates.TryGetValue(pid, out ProcessWaitState pws))
+                        ProcessWaitState pws = FindChild(pid);
+                        if (pws == null && Volatile.Read(ref s_childStartsInProgress) == 0)
+                        {
+                            // The start that owns this pid may have added it right after we looked.
+                            pws = FindChild(pid);
+                        }
+                        else if (pws == null)
+                        {
+                            // This may be the child of a Process.Start that hasn't added it to the table yet.
+                            // Hand this pass over to the starting thread and look again: if the start finished
+                            // in the meantime we find the child now, otherwise EndChildStart will see the request.
+                            if (reapAll)
+                            {
+                                Volatile.Write(ref s_deferredCheck, DeferredCheckReapAll);
+                            }
+                            else
+                            {
+                                Interlocked.CompareExchange(ref s_deferredCheck, DeferredCheck, DeferredCheckNone);
+                            }
+
+                            pws = FindChild(pid);
+                            if (pws == null)
+                            {
+                                // If we already deferred on this pid it is likely not ours; don't let it hide
+                                // the other children until the starts quiesce.
+                                checkAll = pid == s_lastDeferredPid;
+                                s_lastDeferredPid = pid;
+                                break;
+                            }
+                        }
+
+                        if (pws != null)
                         {
                             // Known Process.
                             if (pws.TryReapChild())
                             {
-                                pws.ReleaseRef();
+                                reaped.Add(pws);
                             }
                         }
+                        else if (reapAll)
+                        {
+                            // This is not a managed Process, and no starts are in progress that could own it.
+                            // No one else reaps children, so we do.
+                            Interop.Sys.WaitPidExitedNoHang(pid, out _);
+                        }
                         else
                         {
                             // unlikely: This is not a managed Process, so we are not responsible for reaping.
@@ -625,6 +889,7 @@ namespace MyDiagnostics
                     else if (pid == 0)
                     {
                         // No more terminated children.
+                        s_lastDeferredPid = 0;
                     }
                     else
                     {
@@ -636,50 +901,100 @@ namespace MyDiagnostics
 
                 if (checkAll)
                 {
-                    // We track things to unref so we don't invalidate our iterator by changing s_childProcessWaitStates. 
-                    ProcessWaitState firstToRemove = null;
-                    List<ProcessWaitState> additionalToRemove = null;
-                    foreach (KeyValuePair<int, ProcessWaitState> kv in s_childProcessWaitStates)
+                    foreach (Dictionary<int, ProcessWaitState> childProcessWaitStates in s_childProcessWaitStates)
                     {
-                        ProcessWaitState pws = kv.Value;
-                        if (pws.TryReapChild())
+                        lock (childProcessWaitStates)
                         {
-                            if (firstToRemove == null)
-                            {
-                                firstToRemove = pws;
-                            }
-                            else
+                            foreach (KeyValuePair<int, ProcessWaitState> kv in childProcessWaitStates)
                             {
-                                if (additionalToRemove == null)
+                                ProcessWaitState pws = kv.Value;
+                                if (pws.TryReapChild())
                                 {
-                                    additionalToRemove = new List<ProcessWaitState>();
+                                    reaped.Add(pws);
                                 }
-                                additionalToRemove.Add(pws);
                             }
                         }
                     }
+                }
 
-                    if (firstToRemove != null)
-                    {
-                        firstToRemove.ReleaseRef();
-                        if (additionalToRemove != null)
-                        {
-                            foreach (ProcessWaitState pws in additionalToRemove)
-                            {
-                                pws.ReleaseRef();
-                            }
-                        }
-                    }
+                if (reaped.Count > 0)
+                {
+                    CompleteReapedChildren(reaped);
+                    reaped.Clear();
                 }
+            }
+        }
+
+        /// <summary>Records the exit status a zygote reported for this child. Publish it with <see cref="CompleteZygoteChildren"/>.</summary>
+        /// <param name="exitCode">The exit code, or null if the zygote was lost before the child's exit could be observed.</param>
+        /// <param name="usage">The resource usage the zygote got from wait4, or null along with a null exit code.</param>
+        /// <returns>false if the exit was already recorded.</returns>
+        internal bool SetZygoteChildReaped(int? exitCode, Interop.Sys.ResourceUsage? usage)
+        {
+            System.Diagnostics.Debug.Assert(_isZygoteChild);
 
-                if (reapAll)
+            lock (_gate)
+            {
+                if (_exited || _reaped)
                 {
-                    do
-                    {
-                        int exitCode;
-                        pid = Interop.Sys.WaitPidExitedNoHang(-1, out exitCode);
-                    } while (pid > 0);
+                    return false;
+                }
+
+                _exitCode = exitCode;
+                _resourceUsage = usage.GetValueOrDefault();
+                _haveResourceUsage = usage.HasValue;
+                _reaped = true;
+                _reapTimestamp = System.Diagnostics.Stopwatch.GetTimestamp();
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Publishes the exit of zygote children recorded with <see cref="SetZygoteChildReaped"/> and drops the
+        /// references taken by <see cref="AddZygoteChild"/>, the same way a CheckChildren pass does.
+        /// </summary>
+        internal static void CompleteZygoteChildren(List<ProcessWaitState> reaped)
+        {
+            CompleteReapedChildren(reaped);
+        }
+
+        /// <summary>Publishes the exit of children reaped by a CheckChildren pass and drops the reaper's references.</summary>
+        private static void CompleteReapedChildren(List<ProcessWaitState> reaped)
+        {
+            int childrenUsingTerminal = 0;
+            foreach (ProcessWaitState pws in reaped)
+            {
+                if (pws._usesTerminal)
+                {
+                    childrenUsingTerminal++;
+                }
+            }
+
+            if (childrenUsingTerminal > 0)
+            {
+                // Update terminal settings before calling SetExited.
+                Process.EnterTerminalConfigurationWriteLock();
+                try
+                {
+                    Process.ConfigureTerminalForChildProcesses(-childrenUsingTerminal);
                 }
+                finally
+                {
+                    Process.ExitTerminalConfigurationWriteLock();
+                }
+            }
+
+            foreach (ProcessWaitState pws in reaped)
+            {
+                lock (pws._gate)
+                {
+                    pws.SetExited();
+                }
+            }
+
+            foreach (ProcessWaitState pws in reaped)
+            {
+                pws.ReleaseRef(); // Added in AddRef for new children
             }
         }
     }
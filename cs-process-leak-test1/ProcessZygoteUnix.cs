@@ -0,0 +1,545 @@
+﻿// Licensed to the .NET Foundation under one or more agreements.
+// The .NET Foundation licenses this file to you under the MIT license.
+// See the LICENSE file in the project root for more information.
+
+using System;
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Collections;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+
+namespace MyDiagnostics
+{
+    /// <summary>
+    /// A small helper process that starts children on our behalf. Because the zygote's address space stays tiny,
+    /// starting a child through it costs the same however large our managed heap grows, and never forks us.
+    /// </summary>
+    /// <remarks>
+    /// The zygote is connected to us by a SOCK_SEQPACKET socket. It answers each spawn request with the pid and,
+    /// as SCM_RIGHTS, our ends of the redirected pipes. Its children are its own, so it reaps them itself and
+    /// reports each exit status over the same socket; their <see cref="ProcessWaitState"/> lives in the child
+    /// table as usual, but is completed from here instead of by the SIGCHLD handler.
+    /// Set <see cref="Process.Zygote"/> and <see cref="Process.SpawnMode"/> to send Process.Start through it.
+    /// </remarks>
+    public sealed class ProcessZygote : IDisposable
+    {
+        /// <summary>Descriptor number of the zygote's end of the socket, in the zygote.</summary>
+        internal const int SocketDescriptor = 3;
+        /// <summary>Largest message either side sends; a start that doesn't fit isn't sent to the zygote.</summary>
+        internal const int MaxMessageSize = 128 * 1024;
+        /// <summary>Returned by <see cref="Spawn"/> when the start has to be done without the zygote.</summary>
+        internal const int Unavailable = -1;
+
+        // Message kinds.
+        internal const byte SpawnRequest = 1;
+        internal const byte SpawnReply = 2;
+        internal const byte ExitNotification = 3;
+
+        // SpawnRequest flags.
+        internal const byte RedirectStdinFlag = 1;
+        internal const byte RedirectStdoutFlag = 2;
+        internal const byte RedirectStderrFlag = 4;
+
+        /// <summary>Protects all mutable state below.</summary>
+        private readonly object _gate = new object();
+        private readonly int _socket;
+        private readonly int _processId;
+        /// <summary>Spawn requests waiting for their reply, by request id.</summary>
+        private readonly Dictionary<int, PendingSpawn> _pendingSpawns = new Dictionary<int, PendingSpawn>();
+        /// <summary>Started children whose exit wasn't reported yet, by pid.</summary>
+        private readonly Dictionary<int, ProcessWaitState> _children = new Dictionary<int, ProcessWaitState>();
+        private int _nextRequestId;
+        /// <summary>No more spawn requests are sent: the zygote was disposed or lost.</summary>
+        private bool _closed;
+
+        private ProcessZygote(int socket, int processId)
+        {
+            _socket = socket;
+            _processId = processId;
+
+            new Thread(ReceiveLoop)
+            {
+                IsBackground = true,
+                Name = ".NET Process Zygote Receiver"
+            }.Start();
+        }
+
+        /// <summary>Gets the process ID of the zygote.</summary>
+        public int ProcessId => _processId;
+
+        /// <summary>Gets whether the zygote still accepts starts.</summary>
+        public bool IsAlive
+        {
+            get
+            {
+                lock (_gate)
+                {
+                    return !_closed;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Starts a zygote, inheriting our environment and standard descriptors. The program has to serve
+        /// the zygote protocol on descriptor 3, as cs_process_leak_test1.ZygoteServer does.
+        /// </summary>
+        public static unsafe ProcessZygote Start(string fileName, string[] argv)
+        {
+            if (fileName == null)
+            {
+                throw new ArgumentNullException(nameof(fileName));
+            }
+            if (argv == null)
+            {
+                throw new ArgumentNullException(nameof(argv));
+            }
+
+            int* fds = stackalloc int[2];
+            if (Interop.Sys.SeqPacketSocketPair(fds) != 0)
+            {
+                throw new System.ComponentModel.Win32Exception();
+            }
+
+            int zygoteEnd = fds[1];
+            if (zygoteEnd == SocketDescriptor)
+            {
+                // dup2 onto itself would keep the close-on-exec flag.
+                zygoteEnd = Interop.Sys.Fcntl.DuplicateCloseOnExec(fds[1], SocketDescriptor + 1);
+                Interop.Sys.Close(fds[1]);
+                if (zygoteEnd < 0)
+                {
+                    int errno = Marshal.GetLastWin32Error();
+                    Interop.Sys.Close(fds[0]);
+                    throw new System.ComponentModel.Win32Exception(errno);
+                }
+            }
+
+            int error, pid;
+            Interop.Sys.SpawnArena arena = Interop.Sys.SpawnArena.Rent();
+            try
+            {
+                arena.Encode(argv, GetEnvironmentBlock(), out byte** argvPtr, out byte** envpPtr);
+                error = Interop.Sys.PosixSpawnWithDescriptor(fileName, argvPtr, envpPtr, zygoteEnd, SocketDescriptor, out pid);
+            }
+            finally
+            {
+                Interop.Sys.SpawnArena.Return(arena);
+                Interop.Sys.Close(zygoteEnd);
+            }
+
+            if (error != 0)
+            {
+                Interop.Sys.Close(fds[0]);
+                throw new System.ComponentModel.Win32Exception(error);
+            }
+
+            return new ProcessZygote(fds[0], pid);
+        }
+
+        private static string[] GetEnvironmentBlock()
+        {
+            var envp = new List<string>();
+            foreach (DictionaryEntry entry in Environment.GetEnvironmentVariables())
+            {
+                envp.Add(entry.Key + "=" + entry.Value);
+            }
+            return envp.ToArray();
+        }
+
+        /// <summary>
+        /// Has the zygote start a child. On success the child is in the wait state table, and
+        /// <paramref name="waitState"/> holds a reference for the caller's <see cref="ProcessWaitState.Holder"/>.
+        /// </summary>
+        /// <returns>0 on success, the platform errno if the zygote failed to start the child, or
+        /// <see cref="Unavailable"/> if the request wasn't sent and the caller should start the child itself.</returns>
+        internal unsafe int Spawn(
+            string filename, string[] argv, IDictionary<string, string> environment, string cwd,
+            bool redirectStdin, bool redirectStdout, bool redirectStderr, bool usesTerminal,
+            out int childPid, out int stdinFd, out int stdoutFd, out int stderrFd, out ProcessWaitState waitState)
+        {
+            childPid = stdinFd = stdoutFd = stderrFd = -1;
+            waitState = null;
+
+            var pending = new PendingSpawn(usesTerminal, redirectStdin, redirectStdout, redirectStderr);
+            int requestId;
+            lock (_gate)
+            {
+                if (_closed)
+                {
+                    return Unavailable;
+                }
+                requestId = ++_nextRequestId;
+                _pendingSpawns.Add(requestId, pending);
+            }
+
+            bool sent = false;
+            var writer = new MessageWriter(SpawnRequest);
+            try
+            {
+                writer.WriteInt32(requestId);
+                writer.WriteByte((byte)((redirectStdin ? RedirectStdinFlag : 0) |
+                    (redirectStdout ? RedirectStdoutFlag : 0) |
+                    (redirectStderr ? RedirectStderrFlag : 0)));
+                writer.WriteString(filename);
+                writer.WriteString(cwd);
+                writer.WriteInt32(argv.Length);
+                foreach (string arg in argv)
+                {
+                    writer.WriteString(arg);
+                }
+                writer.WriteInt32(environment.Count);
+                foreach (KeyValuePair<string, string> pair in environment)
+                {
+                    writer.WriteString(pair.Key + "=" + pair.Value);
+                }
+
+                sent = writer.Length <= MaxMessageSize && writer.Send(_socket, null, 0);
+            }
+            finally
+            {
+                writer.Dispose();
+                if (!sent)
+                {
+                    lock (_gate)
+                    {
+                        _pendingSpawns.Remove(requestId);
+                    }
+                }
+            }
+
+            if (!sent)
+            {
+                return Unavailable;
+            }
+
+            pending.Completed.Wait();
+            pending.Completed.Dispose();
+
+            childPid = pending.ProcessId;
+            stdinFd = pending.StdinFd;
+            stdoutFd = pending.StdoutFd;
+            stderrFd = pending.StderrFd;
+            waitState = pending.WaitState;
+            return pending.Errno;
+        }
+
+        private unsafe void ReceiveLoop()
+        {
+            byte* buffer = stackalloc byte[256];
+            int* fds = stackalloc int[3];
+            var reaped = new List<ProcessWaitState>();
+
+            while (true)
+            {
+                int received = Interop.Sys.ReceiveMessage(_socket, buffer, 256, fds, 3, out int fdCount);
+                if (received < 0 && Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                {
+                    continue;
+                }
+                if (received <= 0)
+                {
+                    break; // The zygote exited, or closed its end after we disposed it.
+                }
+
+                var reader = new MessageReader(new ReadOnlySpan<byte>(buffer, received));
+                switch (reader.ReadByte())
+                {
+                    case SpawnReply:
+                        OnSpawnReply(reader.ReadInt32(), reader.ReadInt32(), reader.ReadInt32(), fds, fdCount);
+                        break;
+
+                    case ExitNotification:
+                        int pid = reader.ReadInt32();
+                        int exitCode = reader.ReadInt32();
+                        var usage = reader.ReadValue<Interop.Sys.ResourceUsage>();
+                        ProcessWaitState child;
+                        lock (_gate)
+                        {
+                            if (_children.TryGetValue(pid, out child))
+                            {
+                                _children.Remove(pid);
+                            }
+                        }
+                        if (child != null && child.SetZygoteChildReaped(exitCode, usage))
+                        {
+                            if (child.UsesTerminal)
+                            {
+                                // Publishing takes the terminal write lock, which waits for starts holding the read
+                                // lock, which may be waiting for spawn replies only this thread can deliver.
+                                ThreadPool.UnsafeQueueUserWorkItem(
+                                    state => ProcessWaitState.CompleteZygoteChildren(new List<ProcessWaitState> { (ProcessWaitState)state }),
+                                    child);
+                            }
+                            else
+                            {
+                                reaped.Add(child);
+                                ProcessWaitState.CompleteZygoteChildren(reaped);
+                                reaped.Clear();
+                            }
+                        }
+                        break;
+
+                    default:
+                        System.Diagnostics.Debug.Fail("Unexpected zygote message");
+                        for (int i = 0; i < fdCount; i++)
+                        {
+                            Interop.Sys.Close(fds[i]);
+                        }
+                        break;
+                }
+            }
+
+            OnZygoteLost(reaped);
+        }
+
+        private unsafe void OnSpawnReply(int requestId, int errno, int pid, int* fds, int fdCount)
+        {
+            PendingSpawn pending;
+            lock (_gate)
+            {
+                _pendingSpawns.TryGetValue(requestId, out pending);
+                _pendingSpawns.Remove(requestId);
+            }
+
+            int next = 0;
+            if (pending != null && errno == 0)
+            {
+                // The descriptors come in stdin, stdout, stderr order, for the streams that were redirected.
+                pending.StdinFd = pending.RedirectStdin && next < fdCount ? fds[next++] : -1;
+                pending.StdoutFd = pending.RedirectStdout && next < fdCount ? fds[next++] : -1;
+                pending.StderrFd = pending.RedirectStderr && next < fdCount ? fds[next++] : -1;
+                pending.ProcessId = pid;
+
+                // Add the child before its exit notification, which comes after this reply, is processed.
+                ProcessWaitState waitState = ProcessWaitState.AddZygoteChild(pid, pending.UsesTerminal);
+                lock (_gate)
+                {
+                    _children[pid] = waitState;
+                }
+                pending.WaitState = waitState;
+            }
+            for (; next < fdCount; next++)
+            {
+                Interop.Sys.Close(fds[next]);
+            }
+
+            if (pending != null)
+            {
+                pending.Errno = errno;
+                pending.Completed.Set();
+            }
+        }
+
+        /// <summary>Fails the starts in flight and completes the children whose exit can no longer be observed.</summary>
+        private void OnZygoteLost(List<ProcessWaitState> reaped)
+        {
+            List<PendingSpawn> pendingSpawns;
+            lock (_gate)
+            {
+                _closed = true;
+                pendingSpawns = new List<PendingSpawn>(_pendingSpawns.Values);
+                _pendingSpawns.Clear();
+                foreach (ProcessWaitState child in _children.Values)
+                {
+                    if (child.SetZygoteChildReaped(exitCode: null, usage: null))
+                    {
+                        reaped.Add(child);
+                    }
+                }
+                _children.Clear();
+            }
+
+            foreach (PendingSpawn pending in pendingSpawns)
+            {
+                // The zygote may or may not have started the child; either way we can't track it.
+                pending.Errno = Interop.Error.EPIPE.Info().RawErrno;
+                pending.Completed.Set();
+            }
+
+            // Safe to publish on this thread now: the waiting starts were released above.
+            if (reaped.Count > 0)
+            {
+                ProcessWaitState.CompleteZygoteChildren(reaped);
+            }
+
+            Interop.Sys.Close(_socket);
+
+            // The zygote is our child but not a Process, so the SIGCHLD handler leaves it to us.
+            while (Interop.Sys.WaitPid(_processId, out _, 0) < 0 && Interop.Sys.GetLastError() == Interop.Error.EINTR)
+            {
+            }
+        }
+
+        /// <summary>
+        /// Stops sending starts to the zygote. The zygote exits once its running children have exited;
+        /// until then it keeps reporting their exit.
+        /// </summary>
+        public void Dispose()
+        {
+            lock (_gate)
+            {
+                if (_closed)
+                {
+                    return;
+                }
+                _closed = true;
+                Interop.Sys.ShutdownSend(_socket);
+            }
+        }
+
+        /// <summary>A spawn request waiting for its reply.</summary>
+        private sealed class PendingSpawn
+        {
+            internal readonly bool UsesTerminal;
+            internal readonly bool RedirectStdin, RedirectStdout, RedirectStderr;
+            internal readonly ManualResetEventSlim Completed = new ManualResetEventSlim();
+
+            internal int Errno;
+            internal int ProcessId = -1;
+            internal int StdinFd = -1, StdoutFd = -1, StderrFd = -1;
+            internal ProcessWaitState WaitState;
+
+            internal PendingSpawn(bool usesTerminal, bool redirectStdin, bool redirectStdout, bool redirectStderr)
+            {
+                UsesTerminal = usesTerminal;
+                RedirectStdin = redirectStdin;
+                RedirectStdout = redirectStdout;
+                RedirectStderr = redirectStderr;
+            }
+        }
+
+        /// <summary>Builds a zygote message in a pooled buffer. Strings are UTF-8 with an Int32 length prefix, -1 for null.</summary>
+        internal struct MessageWriter : IDisposable
+        {
+            private byte[] _buffer;
+            private int _length;
+
+            internal MessageWriter(byte kind)
+            {
+                _buffer = ArrayPool<byte>.Shared.Rent(4096);
+                _buffer[0] = kind;
+                _length = 1;
+            }
+
+            internal int Length => _length;
+
+            internal void WriteByte(byte value)
+            {
+                EnsureCapacity(1);
+                _buffer[_length++] = value;
+            }
+
+            internal void WriteInt32(int value)
+            {
+                EnsureCapacity(sizeof(int));
+                BinaryPrimitives.WriteInt32LittleEndian(_buffer.AsSpan(_length), value);
+                _length += sizeof(int);
+            }
+
+            internal void WriteString(string value)
+            {
+                if (value == null)
+                {
+                    WriteInt32(-1);
+                    return;
+                }
+
+                int byteCount = Encoding.UTF8.GetByteCount(value);
+                WriteInt32(byteCount);
+                EnsureCapacity(byteCount);
+                _length += Encoding.UTF8.GetBytes(value, _buffer.AsSpan(_length));
+            }
+
+            /// <summary>Writes a blittable value as its raw bytes; both ends run on the same machine.</summary>
+            internal unsafe void WriteValue<T>(T value) where T : unmanaged
+            {
+                EnsureCapacity(sizeof(T));
+                MemoryMarshal.Write(_buffer.AsSpan(_length), ref value);
+                _length += sizeof(T);
+            }
+
+            /// <summary>Sends the message with <paramref name="fdCount"/> descriptors attached.</summary>
+            /// <returns>false if the peer is gone.</returns>
+            internal unsafe bool Send(int socket, int* fds, int fdCount)
+            {
+                fixed (byte* buffer = _buffer)
+                {
+                    int sent;
+                    while ((sent = Interop.Sys.SendMessage(socket, buffer, _length, fds, fdCount)) < 0 &&
+                        Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                    {
+                    }
+                    return sent == _length;
+                }
+            }
+
+            private void EnsureCapacity(int additional)
+            {
+                if (_length + additional > _buffer.Length)
+                {
+                    byte[] larger = ArrayPool<byte>.Shared.Rent(Math.Max(_length + additional, _buffer.Length * 2));
+                    _buffer.AsSpan(0, _length).CopyTo(larger);
+                    ArrayPool<byte>.Shared.Return(_buffer);
+                    _buffer = larger;
+                }
+            }
+
+            public void Dispose()
+            {
+                if (_buffer != null)
+                {
+                    ArrayPool<byte>.Shared.Return(_buffer);
+                    _buffer = null;
+                }
+            }
+        }
+
+        /// <summary>Reads a message written by <see cref="MessageWriter"/>.</summary>
+        internal ref struct MessageReader
+        {
+            private ReadOnlySpan<byte> _remaining;
+
+            internal MessageReader(ReadOnlySpan<byte> message)
+            {
+                _remaining = message;
+            }
+
+            internal byte ReadByte()
+            {
+                byte value = _remaining[0];
+                _remaining = _remaining.Slice(1);
+                return value;
+            }
+
+            internal int ReadInt32()
+            {
+                int value = BinaryPrimitives.ReadInt32LittleEndian(_remaining);
+                _remaining = _remaining.Slice(sizeof(int));
+                return value;
+            }
+
+            internal unsafe T ReadValue<T>() where T : unmanaged
+            {
+                T value = MemoryMarshal.Read<T>(_remaining);
+                _remaining = _remaining.Slice(sizeof(T));
+                return value;
+            }
+
+            internal string ReadString()
+            {
+                int length = ReadInt32();
+                if (length < 0)
+                {
+                    return null;
+                }
+
+                string value = Encoding.UTF8.GetString(_remaining.Slice(0, length));
+                _remaining = _remaining.Slice(length);
+                return value;
+            }
+        }
+    }
+}
@@ -4,6 +4,7 @@ using System.Diagnostics;
 using System.Runtime.InteropServices;
 using System.Text;
 using System.Threading;
+using cs_instrumentation;
 
 namespace cs_process_leak_test1
 {
@@ -15,75 +16,43 @@ namespace cs_process_leak_test1
             bool setUser, uint userId, uint groupId, uint[] groups,
             out int lpChildPid, out int stdinFd, out int stdoutFd, out int stderrFd, bool shouldThrow = true)
         {
-            byte** argvPtr = null, envpPtr = null;
-            int result = -1;
+            Interop.Sys.SpawnArena arena = Interop.Sys.SpawnArena.Rent();
             try
             {
-                AllocNullTerminatedArray(argv, ref argvPtr);
-                AllocNullTerminatedArray(envp, ref envpPtr);
+                arena.Encode(argv, envp, out byte** argvPtr, out byte** envpPtr);
                 fixed (uint* pGroups = groups)
                 {
-                    result = ForkAndExecProcessCall(
+                    int result = ForkAndExecProcessCall(
                         filename, argvPtr, envpPtr, cwd,
                         redirectStdin ? 1 : 0, redirectStdout ? 1 : 0, redirectStderr ? 1 : 0,
                         setUser ? 1 : 0, userId, groupId, pGroups, groups?.Length ?? 0,
                         out lpChildPid, out stdinFd, out stdoutFd, out stderrFd);
+                    return result == 0 ? 0 : Marshal.GetLastWin32Error();
                 }
-                return result == 0 ? 0 : Marshal.GetLastWin32Error();
             }
             finally
             {
-                FreeArray(envpPtr, envp.Length);
-                FreeArray(argvPtr, argv.Length);
+                Interop.Sys.SpawnArena.Return(arena);
             }
         }
-        private static unsafe void AllocNullTerminatedArray(string[] arr, ref byte** arrPtr)
-        {
-            int arrLength = arr.Length + 1; // +1 is for null termination
-
-            // Allocate the unmanaged array to hold each string pointer.
-            // It needs to have an extra element to null terminate the array.
-            arrPtr = (byte**)Marshal.AllocHGlobal(sizeof(IntPtr) * arrLength);
-            Debug.Assert(arrPtr != null);
-
-            // Zero the memory so that if any of the individual string allocations fails,
-            // we can loop through the array to free any that succeeded.
-            // The last element will remain null.
-            for (int i = 0; i < arrLength; i++)
-            {
-                arrPtr[i] = null;
-            }
 
-            // Now copy each string to unmanaged memory referenced from the array.
-            // We need the data to be an unmanaged, null-terminated array of UTF8-encoded bytes.
-            for (int i = 0; i < arr.Length; i++)
+        public static unsafe int PosixSpawnProcess(
+            string filename, string[] argv, string[] envp, string cwd,
+            bool redirectStdin, bool redirectStdout, bool redirectStderr,
+            out int lpChildPid, out int stdinFd, out int stdoutFd, out int stderrFd)
+        {
+            Interop.Sys.SpawnArena arena = Interop.Sys.SpawnArena.Rent();
+            try
             {
-                byte[] byteArr = Encoding.UTF8.GetBytes(arr[i]);
-
-                arrPtr[i] = (byte*)Marshal.AllocHGlobal(byteArr.Length + 1); //+1 for null termination
-                Debug.Assert(arrPtr[i] != null);
-
-                Marshal.Copy(byteArr, 0, (IntPtr)arrPtr[i], byteArr.Length); // copy over the data from the managed byte array
-                arrPtr[i][byteArr.Length] = (byte)'\0'; // null terminate
+                arena.Encode(argv, envp, out byte** argvPtr, out byte** envpPtr);
+                return Interop.Sys.PosixSpawnProcess(
+                    filename, argvPtr, envpPtr, cwd,
+                    redirectStdin, redirectStdout, redirectStderr,
+                    out lpChildPid, out stdinFd, out stdoutFd, out stderrFd);
             }
-        }
-
-        private static unsafe void FreeArray(byte** arr, int length)
-        {
-            if (arr != null)
+            finally
             {
-                // Free each element of the array
-                for (int i = 0; i < length; i++)
-                {
-                    if (arr[i] != null)
-                    {
-                        Marshal.FreeHGlobal((IntPtr)arr[i]);
-                        arr[i] = null;
-                    }
-                }
-
-                // And then the array itself
-                Marshal.FreeHGlobal((IntPtr)arr);
+                Interop.Sys.SpawnArena.Return(arena);
             }
         }
 
@@ -96,19 +65,46 @@ namespace cs_process_leak_test1
 
         [DllImport("System.Native", EntryPoint = "SystemNative_WaitPidExitedNoHang", SetLastError = true)]
         internal static extern int WaitPidExitedNoHang(int pid, out int exitCode);
+
+        [DllImport("libc", EntryPoint = "waitpid", SetLastError = true)]
+        internal static extern int WaitPid(int pid, out int status, int options);
     }
 
     class Program
     {
         static List<object> tmp = new List<object>();
+
         static void Main(string[] args)
         {
+            if (args.Length >= 1 && args[0] == "zygote")
+            {
+                ZygoteServer.Run();
+                return;
+            }
+
+            // dotnet-counters monitor -n cs-process-leak-test1 --counters ProcessLeakTest; DN_METRICS_JSON=<file> also writes
+            // the counters, latencies and memory as JSON lines.
+            var registry = new MetricRegistry("ProcessLeakTest");
+            using MetricsJsonWriter json = MetricsJsonWriter.FromEnvironment(registry);
+            using MetricsEventSource eventSource = new MetricsEventSource(registry);
+
+            if (args.Length >= 1 && args[0] == "bench")
+            {
+                SpawnBenchmark.Run(args, registry);
+                return;
+            }
+
+            Counter spawns = registry.GetCounter("spawns");
+            Counter errors = registry.GetCounter("spawn-errors");
+            LatencyHistogram spawnLatency = registry.GetHistogram("spawn");
+            registry.GetGauge("managed-bytes", "Managed heap", "B", () => GC.GetTotalMemory(false));
+
             for (int i = 0; ; i++)
             {
                 if ((i % 100) == 0)
                 {
                     long mem = GC.GetTotalMemory(false);
-                    Console.WriteLine(mem);
+                    Console.WriteLine($"{spawns.Value} spawns, {errors.Value} error(s), managed {mem} bytes; {spawnLatency}");
                     GC.Collect();
                 }
 
@@ -120,19 +116,27 @@ namespace cs_process_leak_test1
                         proc.Kill(false);
                     }*/
 
+                    long start = Stopwatch.GetTimestamp();
                     int r = Internal.ForkAndExecProcess("/bin/true", new string[] { }, new string[] { },
                         "/", false, false, false, false, 0, 0, null, out int pid, out _, out _, out _);
+                    spawnLatency.RecordTicks(Stopwatch.GetTimestamp() - start);
 
                     if (r == 0)
                     {
+                        spawns.Increment();
                         Thread.Sleep(10);
                         Internal.WaitPidExitedNoHang(pid, out _);
                     }
+                    else
+                    {
+                        errors.Increment();
+                    }
 
                     //Console.WriteLine($"r = {r}, pid = {pid}");
                 }
                 catch (Exception ex)
                 {
+                    errors.Increment();
                     Console.WriteLine(ex.ToString());
                 }
             }
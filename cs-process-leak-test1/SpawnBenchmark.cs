@@ -0,0 +1,420 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Runtime.InteropServices;
+using System.Threading;
+using System.Threading.Tasks;
+using cs_instrumentation;
+using Microsoft.Win32.SafeHandles;
+
+namespace cs_process_leak_test1
+{
+    /// <summary>
+    /// Spawn benchmark: starts a child command over and over from several threads through one or more backends,
+    /// and reports throughput, latency histograms and memory usage of the launcher.
+    /// </summary>
+    /// <remarks>
+    /// bench [--backend fork,posix_spawn,process-fork,process,process-zygote|all] [--concurrency N] [--count N | --duration SEC]
+    ///       [--command "/bin/true args"] [--redirect none,i,o,e,io,oe,ioe,...] [--heap MB]
+    /// </remarks>
+    public static class SpawnBenchmark
+    {
+        /// <summary>Raw backends P/Invoke straight into the spawn routine and reap with a blocking waitpid.</summary>
+        static readonly string[] RawBackends = { "fork", "posix_spawn" };
+        /// <summary>Process.Start backends are reaped by the SIGCHLD handler, once that is installed.</summary>
+        static readonly string[] ProcessBackends = { "process-fork", "process", "process-zygote" };
+
+        class Options
+        {
+            public List<string> Backends = new List<string> { "fork", "posix_spawn", "process" };
+            public int Concurrency = 1;
+            public int Count = 2000;
+            public double DurationSeconds;
+            public string FileName = "/bin/true";
+            public string Arguments = "";
+            public List<string> Redirects = new List<string> { "none" };
+            public int HeapMB;
+        }
+
+        class RunResult
+        {
+            public readonly LatencyHistogram Spawn;
+            public readonly LatencyHistogram Reap;
+            public readonly LatencyHistogram ExitNotification;
+            public int Spawns;
+            public int Errors;
+            public int LostExitStatus;
+            public string LastError;
+
+            // Each run's metrics are named after its backend and redirect, so that the runs of one process stay apart.
+            public RunResult(MetricRegistry registry, string run)
+            {
+                Spawn = registry.GetHistogram(run + "/spawn");
+                Reap = registry.GetHistogram(run + "/reap");
+                ExitNotification = registry.GetHistogram(run + "/exit-notify");
+                registry.AddPolledCounter(run + "/spawns", () => Volatile.Read(ref Spawns));
+                registry.AddPolledCounter(run + "/errors", () => Volatile.Read(ref Errors));
+            }
+        }
+
+        static readonly List<byte[]> ballast = new List<byte[]>();
+
+        public static void Run(string[] args, MetricRegistry registry)
+        {
+            Options options = ParseOptions(args);
+
+            // The zygote is a copy of this program; start it while our heap is still small.
+            if (options.Backends.Contains("process-zygote"))
+            {
+                MyDiagnostics.Process.Zygote = ZygoteServer.Launch();
+            }
+
+            // Fork cost grows with the size of the parent's address space; give the heap some weight.
+            for (int i = 0; i < options.HeapMB; i++)
+            {
+                byte[] block = new byte[1024 * 1024];
+                for (int j = 0; j < block.Length; j += 4096)
+                {
+                    block[j] = 1;
+                }
+                ballast.Add(block);
+            }
+
+            // Once Process.Start has installed the SIGCHLD handler it reaps the raw backends' children too,
+            // so those always go first.
+            IEnumerable<string> backends = options.Backends.Where(b => RawBackends.Contains(b))
+                .Concat(options.Backends.Where(b => !RawBackends.Contains(b)));
+
+            Console.WriteLine($"command = {options.FileName} {options.Arguments}, concurrency = {options.Concurrency}, " +
+                (options.DurationSeconds > 0 ? $"duration = {options.DurationSeconds} s" : $"count = {options.Count}") +
+                $", ballast = {options.HeapMB} MB");
+            Console.WriteLine();
+
+            foreach (string backend in backends)
+            {
+                foreach (string redirect in options.Redirects)
+                {
+                    RunOne(options, backend, redirect, registry);
+                }
+            }
+        }
+
+        static Options ParseOptions(string[] args)
+        {
+            var options = new Options();
+            for (int i = 1; i < args.Length; i++)
+            {
+                string name = args[i];
+                string value = i + 1 < args.Length ? args[++i] : throw new ArgumentException("Missing value for " + name);
+                switch (name)
+                {
+                    case "--backend":
+                        options.Backends = value == "all" ? RawBackends.Concat(ProcessBackends).ToList() : SplitList(value);
+                        foreach (string backend in options.Backends)
+                        {
+                            if (!RawBackends.Contains(backend) && !ProcessBackends.Contains(backend))
+                            {
+                                throw new ArgumentException("Unknown backend: " + backend);
+                            }
+                        }
+                        break;
+                    case "--concurrency":
+                        options.Concurrency = Math.Max(1, int.Parse(value));
+                        break;
+                    case "--count":
+                        options.Count = int.Parse(value);
+                        break;
+                    case "--duration":
+                        options.DurationSeconds = double.Parse(value);
+                        break;
+                    case "--command":
+                        value = value.Trim();
+                        int space = value.IndexOf(' ');
+                        options.FileName = space < 0 ? value : value.Substring(0, space);
+                        options.Arguments = space < 0 ? "" : value.Substring(space + 1);
+                        break;
+                    case "--redirect":
+                        options.Redirects = SplitList(value);
+                        break;
+                    case "--heap":
+                        options.HeapMB = int.Parse(value);
+                        break;
+                    default:
+                        throw new ArgumentException("Unknown option: " + name);
+                }
+            }
+            return options;
+        }
+
+        static List<string> SplitList(string value)
+        {
+            return value.Split(',', StringSplitOptions.RemoveEmptyEntries).Select(s => s.Trim()).ToList();
+        }
+
+        static void RunOne(Options options, string backend, string redirect, MetricRegistry registry)
+        {
+            bool none = redirect == "none";
+            bool redirectStdin = !none && redirect.Contains('i');
+            bool redirectStdout = !none && redirect.Contains('o');
+            bool redirectStderr = !none && redirect.Contains('e');
+
+            var result = new RunResult(registry, $"{backend}/{redirect}");
+            var memoryBefore = MemoryStats.Capture();
+            long peakRss = memoryBefore.Rss;
+            int remaining = options.Count;
+            long deadline = options.DurationSeconds > 0 ?
+                Stopwatch.GetTimestamp() + (long)(options.DurationSeconds * Stopwatch.Frequency) : long.MaxValue;
+
+            using (var sampler = new Timer(_ =>
+            {
+                long rss = MemoryStats.ReadRss();
+                long peak;
+                while (rss > (peak = Interlocked.Read(ref peakRss)) && Interlocked.CompareExchange(ref peakRss, rss, peak) != peak)
+                {
+                }
+            }, null, 0, 100))
+            {
+                Stopwatch elapsed = Stopwatch.StartNew();
+                var threads = new Thread[options.Concurrency];
+                for (int t = 0; t < threads.Length; t++)
+                {
+                    threads[t] = new Thread(() =>
+                    {
+                        string[] argv = ParseArgv(options);
+                        while (options.DurationSeconds > 0 ? Stopwatch.GetTimestamp() < deadline : Interlocked.Decrement(ref remaining) >= 0)
+                        {
+                            try
+                            {
+                                if (RawBackends.Contains(backend))
+                                {
+                                    SpawnRaw(backend, options.FileName, argv, redirectStdin, redirectStdout, redirectStderr, result);
+                                }
+                                else
+                                {
+                                    SpawnWithProcess(backend, options, redirectStdin, redirectStdout, redirectStderr, result);
+                                }
+                            }
+                            catch (Exception ex)
+                            {
+                                Interlocked.Increment(ref result.Errors);
+                                result.LastError = ex.Message;
+                            }
+                        }
+                    });
+                    threads[t].Start();
+                }
+
+                foreach (Thread thread in threads)
+                {
+                    thread.Join();
+                }
+                elapsed.Stop();
+
+                var memoryAfter = MemoryStats.Capture();
+                Console.WriteLine($"backend = {backend}, redirect = {redirect}: {result.Spawns} spawns, {result.Spawns / elapsed.Elapsed.TotalSeconds:F0} spawns/sec, " +
+                    $"errors = {result.Errors}" + (result.LastError != null ? $" ({result.LastError})" : "") +
+                    (result.LostExitStatus > 0 ? $", reaped elsewhere = {result.LostExitStatus}" : ""));
+                Console.WriteLine("  " + result.Spawn);
+                Console.WriteLine("  " + result.Reap);
+                if (result.ExitNotification.Count > 0)
+                {
+                    Console.WriteLine("  " + result.ExitNotification);
+                }
+                Console.WriteLine($"  memory: managed {MB(memoryAfter.Managed)} ({DeltaMB(memoryAfter.Managed - memoryBefore.Managed)}), " +
+                    $"native heap {MB(memoryAfter.NativeHeap)} ({DeltaMB(memoryAfter.NativeHeap - memoryBefore.NativeHeap)}), " +
+                    $"rss {MB(memoryAfter.Rss)} ({DeltaMB(memoryAfter.Rss - memoryBefore.Rss)}, peak {MB(Math.Max(memoryAfter.Rss, Interlocked.Read(ref peakRss)))})");
+                Console.WriteLine();
+            }
+        }
+
+        static string MB(long bytes) => (bytes / (1024.0 * 1024.0)).ToString("F1") + " MB";
+
+        static string DeltaMB(long bytes) => (bytes >= 0 ? "+" : "") + MB(bytes);
+
+        static string[] ParseArgv(Options options)
+        {
+            var argv = new List<string> { options.FileName };
+            argv.AddRange(options.Arguments.Split(' ', StringSplitOptions.RemoveEmptyEntries));
+            return argv.ToArray();
+        }
+
+        /// <summary>
+        /// Spawn through <see cref="Internal"/>: spawn latency is the P/Invoke, reap latency runs from its return
+        /// until a blocking waitpid returns.
+        /// </summary>
+        static void SpawnRaw(string backend, string fileName, string[] argv,
+            bool redirectStdin, bool redirectStdout, bool redirectStderr, RunResult result)
+        {
+            int pid, stdinFd, stdoutFd, stderrFd;
+            long start = Stopwatch.GetTimestamp();
+            int errno = backend == "fork" ?
+                Internal.ForkAndExecProcess(fileName, argv, new string[] { }, null,
+                    redirectStdin, redirectStdout, redirectStderr, false, 0, 0, null, out pid, out stdinFd, out stdoutFd, out stderrFd) :
+                Internal.PosixSpawnProcess(fileName, argv, new string[] { }, null,
+                    redirectStdin, redirectStdout, redirectStderr, out pid, out stdinFd, out stdoutFd, out stderrFd);
+            long spawned = Stopwatch.GetTimestamp();
+
+            if (errno != 0)
+            {
+                Interlocked.Increment(ref result.Errors);
+                result.LastError = "errno = " + errno;
+                return;
+            }
+            result.Spawn.RecordTicks(spawned - start);
+            Interlocked.Increment(ref result.Spawns);
+
+            if (stdinFd >= 0)
+            {
+                Interop.Sys.Close(stdinFd);
+            }
+            Task drainError = stderrFd >= 0 ? Task.Run(() => Drain(stderrFd)) : Task.CompletedTask;
+            if (stdoutFd >= 0)
+            {
+                Drain(stdoutFd);
+            }
+            drainError.Wait();
+
+            if (Internal.WaitPid(pid, out _, 0) == pid)
+            {
+                result.Reap.RecordTicks(Stopwatch.GetTimestamp() - spawned);
+            }
+            else
+            {
+                Interlocked.Increment(ref result.LostExitStatus);
+            }
+        }
+
+        static void Drain(int fd)
+        {
+            using (var stream = new FileStream(new SafeFileHandle((IntPtr)fd, ownsHandle: true), FileAccess.Read, 1))
+            {
+                stream.CopyTo(Stream.Null);
+            }
+        }
+
+        /// <summary>
+        /// Spawn through MyDiagnostics.Process: reap latency runs from Start returning until the SIGCHLD handler
+        /// reaped the child, exit notification from there until WaitForExit returned.
+        /// </summary>
+        static void SpawnWithProcess(string backend, Options options,
+            bool redirectStdin, bool redirectStdout, bool redirectStderr, RunResult result)
+        {
+            MyDiagnostics.Process.SpawnMode =
+                backend == "process-fork" ? MyDiagnostics.ProcessSpawnMode.Fork :
+                backend == "process-zygote" ? MyDiagnostics.ProcessSpawnMode.Zygote :
+                MyDiagnostics.ProcessSpawnMode.PosixSpawn;
+
+            var psi = new ProcessStartInfo(options.FileName, options.Arguments)
+            {
+                RedirectStandardInput = redirectStdin,
+                RedirectStandardOutput = redirectStdout,
+                RedirectStandardError = redirectStderr,
+            };
+
+            long start = Stopwatch.GetTimestamp();
+            using (MyDiagnostics.Process process = MyDiagnostics.Process.Start(psi))
+            {
+                long spawned = Stopwatch.GetTimestamp();
+                result.Spawn.RecordTicks(spawned - start);
+                Interlocked.Increment(ref result.Spawns);
+
+                if (redirectStdin)
+                {
+                    process.StandardInput.Close();
+                }
+                Task drainError = redirectStderr ? process.StandardError.ReadToEndAsync() : Task.CompletedTask;
+                if (redirectStdout)
+                {
+                    process.StandardOutput.ReadToEnd();
+                }
+                drainError.Wait();
+
+                process.WaitForExit();
+                long notified = Stopwatch.GetTimestamp();
+
+                long reaped = process.ReapTimestamp;
+                if (reaped != 0)
+                {
+                    result.Reap.RecordTicks(reaped - spawned);
+                    result.ExitNotification.RecordTicks(notified - reaped);
+                }
+            }
+        }
+    }
+
+    /// <summary>Managed, native heap and resident memory of this process.</summary>
+    public struct MemoryStats
+    {
+        public long Managed;
+        public long NativeHeap;
+        public long Rss;
+
+        public static MemoryStats Capture()
+        {
+            return new MemoryStats
+            {
+                Managed = GC.GetTotalMemory(false),
+                NativeHeap = ReadNativeHeap(),
+                Rss = ReadRss(),
+            };
+        }
+
+        /// <summary>Resident set size from /proc/self/statm.</summary>
+        public static long ReadRss()
+        {
+            try
+            {
+                string[] fields = File.ReadAllText("/proc/self/statm").Split(' ');
+                return long.Parse(fields[1]) * Environment.SystemPageSize;
+            }
+            catch (IOException)
+            {
+                return 0;
+            }
+        }
+
+        static bool mallinfo2Missing;
+
+        /// <summary>Bytes allocated from malloc: in-use arena chunks plus mmapped blocks.</summary>
+        public static long ReadNativeHeap()
+        {
+            if (!mallinfo2Missing)
+            {
+                try
+                {
+                    MallInfo2 info = mallinfo2();
+                    return (long)(ulong)info.uordblks + (long)(ulong)info.hblkhd;
+                }
+                catch (EntryPointNotFoundException)
+                {
+                    // glibc < 2.33
+                    mallinfo2Missing = true;
+                }
+            }
+
+            // The int fields of mallinfo wrap at 2 GB; good enough for deltas.
+            MallInfo legacy = mallinfo();
+            return (uint)legacy.uordblks + (long)(uint)legacy.hblkhd;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        struct MallInfo2
+        {
+            public UIntPtr arena, ordblks, smblks, hblks, hblkhd, usmblks, fsmblks, uordblks, fordblks, keepcost;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        struct MallInfo
+        {
+            public int arena, ordblks, smblks, hblks, hblkhd, usmblks, fsmblks, uordblks, fordblks, keepcost;
+        }
+
+        [DllImport("libc")]
+        static extern MallInfo2 mallinfo2();
+
+        [DllImport("libc")]
+        static extern MallInfo mallinfo();
+    }
+}
@@ -0,0 +1,217 @@
+﻿using System;
+using System.Diagnostics;
+using System.Threading;
+using MyDiagnostics;
+
+namespace cs_process_leak_test1
+{
+    /// <summary>
+    /// The zygote side of <see cref="ProcessZygote"/>: started as "zygote" by <see cref="Launch"/>, it reads spawn
+    /// requests from descriptor 3, starts each child with <see cref="Internal.ForkAndExecProcess"/>, replies with
+    /// the pid and the pipe descriptors, and reports every child's exit status and resource usage once it reaped it.
+    /// </summary>
+    public static class ZygoteServer
+    {
+        /// <summary>Protects liveChildren and inputClosed, and serializes replies with exit notifications.</summary>
+        static readonly object gate = new object();
+        static readonly object sendGate = new object();
+        static int liveChildren;
+        static bool inputClosed;
+
+        /// <summary>Starts this program again as a zygote.</summary>
+        public static ProcessZygote Launch()
+        {
+            // Either "dotnet app.dll" or the apphost.
+            string host = System.Diagnostics.Process.GetCurrentProcess().MainModule.FileName;
+            string assembly = typeof(ZygoteServer).Assembly.Location;
+            string[] argv = host.EndsWith("/dotnet", StringComparison.Ordinal) ?
+                new[] { host, assembly, "zygote" } :
+                new[] { host, "zygote" };
+            return ProcessZygote.Start(host, argv);
+        }
+
+        public static unsafe void Run()
+        {
+            int socket = ProcessZygote.SocketDescriptor;
+
+            // Our children must not inherit the socket.
+            if (Interop.Sys.Fcntl.SetCloseOnExec(socket) != 0)
+            {
+                Console.Error.WriteLine("zygote: descriptor 3 is not usable");
+                return;
+            }
+
+            var reaper = new Thread(ReapChildren) { Name = "Zygote Reaper" };
+            reaper.Start();
+
+            byte[] buffer = new byte[4096];
+            int* fds = stackalloc int[3];
+            while (true)
+            {
+                int length = Interop.Sys.PeekMessageLength(socket);
+                if (length < 0 && Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                {
+                    continue;
+                }
+                if (length <= 0)
+                {
+                    break; // The parent disposed us or exited.
+                }
+                if (length > buffer.Length)
+                {
+                    buffer = new byte[Math.Max(length, buffer.Length * 2)];
+                }
+
+                int received;
+                fixed (byte* pBuffer = buffer)
+                {
+                    while ((received = Interop.Sys.ReceiveMessage(socket, pBuffer, buffer.Length, fds, 0, out _)) < 0 &&
+                        Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                    {
+                    }
+                }
+                if (received <= 0)
+                {
+                    break;
+                }
+
+                var reader = new ProcessZygote.MessageReader(new ReadOnlySpan<byte>(buffer, 0, received));
+                if (reader.ReadByte() == ProcessZygote.SpawnRequest)
+                {
+                    Spawn(socket, ref reader);
+                }
+            }
+
+            lock (gate)
+            {
+                inputClosed = true;
+                Monitor.PulseAll(gate);
+            }
+            reaper.Join();
+        }
+
+        static unsafe void Spawn(int socket, ref ProcessZygote.MessageReader reader)
+        {
+            int requestId = reader.ReadInt32();
+            byte flags = reader.ReadByte();
+            string filename = reader.ReadString();
+            string cwd = reader.ReadString();
+            var argv = new string[reader.ReadInt32()];
+            for (int i = 0; i < argv.Length; i++)
+            {
+                argv[i] = reader.ReadString();
+            }
+            var envp = new string[reader.ReadInt32()];
+            for (int i = 0; i < envp.Length; i++)
+            {
+                envp[i] = reader.ReadString();
+            }
+
+            bool redirectStdin = (flags & ProcessZygote.RedirectStdinFlag) != 0;
+            bool redirectStdout = (flags & ProcessZygote.RedirectStdoutFlag) != 0;
+            bool redirectStderr = (flags & ProcessZygote.RedirectStderrFlag) != 0;
+
+            int* fds = stackalloc int[3];
+            int fdCount = 0;
+
+            // Hold the send lock from the fork until the reply is out, so the reaper can't report this child's
+            // exit before the parent heard of the child.
+            lock (sendGate)
+            {
+                int errno = Internal.ForkAndExecProcess(filename, argv, envp, cwd,
+                    redirectStdin, redirectStdout, redirectStderr, false, 0, 0, null,
+                    out int pid, out int stdinFd, out int stdoutFd, out int stderrFd);
+
+                if (errno == 0)
+                {
+                    lock (gate)
+                    {
+                        liveChildren++;
+                        Monitor.Pulse(gate);
+                    }
+
+                    if (stdinFd >= 0) fds[fdCount++] = stdinFd;
+                    if (stdoutFd >= 0) fds[fdCount++] = stdoutFd;
+                    if (stderrFd >= 0) fds[fdCount++] = stderrFd;
+                }
+
+                var writer = new ProcessZygote.MessageWriter(ProcessZygote.SpawnReply);
+                try
+                {
+                    writer.WriteInt32(requestId);
+                    writer.WriteInt32(errno);
+                    writer.WriteInt32(errno == 0 ? pid : -1);
+                    writer.Send(socket, fds, fdCount);
+                }
+                finally
+                {
+                    writer.Dispose();
+                }
+            }
+
+            // The parent has its own copies now.
+            for (int i = 0; i < fdCount; i++)
+            {
+                Interop.Sys.Close(fds[i]);
+            }
+        }
+
+        static unsafe void ReapChildren()
+        {
+            int socket = ProcessZygote.SocketDescriptor;
+            while (true)
+            {
+                lock (gate)
+                {
+                    while (liveChildren == 0 && !inputClosed)
+                    {
+                        Monitor.Wait(gate);
+                    }
+                    if (liveChildren == 0)
+                    {
+                        return; // No more requests, and every child was reported.
+                    }
+                }
+
+                int pid = Interop.Sys.Wait4(-1, out int status, 0, out Interop.Sys.ResourceUsage usage);
+                if (pid < 0)
+                {
+                    if (Interop.Sys.GetLastError() == Interop.Error.EINTR)
+                    {
+                        continue;
+                    }
+
+                    // ECHILD: nothing left to wait for.
+                    lock (gate)
+                    {
+                        liveChildren = 0;
+                    }
+                    continue;
+                }
+
+                lock (gate)
+                {
+                    liveChildren--;
+                }
+
+                int exitCode = Interop.Sys.DecodeExitStatus(status);
+
+                lock (sendGate)
+                {
+                    var writer = new ProcessZygote.MessageWriter(ProcessZygote.ExitNotification);
+                    try
+                    {
+                        writer.WriteInt32(pid);
+                        writer.WriteInt32(exitCode);
+                        writer.WriteValue(usage);
+                        writer.Send(socket, null, 0);
+                    }
+                    finally
+                    {
+                        writer.Dispose();
+                    }
+                }
+            }
+        }
+    }
+}
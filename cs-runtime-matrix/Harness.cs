@@ -0,0 +1,312 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Net;
+using System.Net.Sockets;
+using System.Threading;
+using cs_instrumentation;
+
+namespace cs_runtime_matrix
+{
+    /// <summary>
+    /// One of the test projects, run as a workload: its arguments, and which of its metrics are its throughput and
+    /// its latency. A harness with a <see cref="Server"/> loads it: the server is started first, under the same
+    /// configuration, and stopped when the harness is done, and both are reported.
+    /// </summary>
+    public sealed class Harness
+    {
+        public string Name { get; set; }
+
+        public string Description { get; set; }
+
+        /// <summary>The project's directory under the repository root, which is also its assembly name.</summary>
+        public string Project { get; set; }
+
+        public Func<MatrixOptions, string[]> Arguments { get; set; }
+
+        /// <summary>The counters, by name or by "/name" suffix, whose totals per second are the throughput.</summary>
+        public string[] ThroughputCounters { get; set; }
+
+        public string ThroughputUnit { get; set; }
+
+        /// <summary>Applied to the throughput, such as 1e-6 to report bytes as MB.</summary>
+        public double ThroughputScale { get; set; } = 1;
+
+        /// <summary>The histograms, by name or "/name" suffix, whose worst p99 is reported.</summary>
+        public string LatencyHistogram { get; set; }
+
+        public Harness Server { get; set; }
+
+        /// <summary>For a server: whether it serves yet, polled after it is started and before what loads it is.</summary>
+        public Func<bool> IsReady { get; set; }
+
+        public static IReadOnlyList<Harness> All { get; } = CreateAll();
+
+        static IReadOnlyList<Harness> CreateAll()
+        {
+            var dnsServer = new Harness
+            {
+                Name = "dns-server",
+                Description = "UDP-heavy: the SO_REUSEPORT server under the load test",
+                Project = "cs-dns-server-test1",
+                Arguments = o => new[] { "reuseport", "--quiet" },
+                ThroughputCounters = new[] { "answered" },
+                ThroughputUnit = "answers/s",
+                LatencyHistogram = "/recv->send",
+                IsReady = () => AnswersDns(new IPEndPoint(IPAddress.Loopback, 54)),
+            };
+
+            return new[]
+            {
+                new Harness
+                {
+                    Name = "leak",
+                    Description = "spawn-heavy: posix_spawn and Process.Start of /bin/true, with a 128 MB heap",
+                    Project = "cs-process-leak-test1",
+                    // Two backends, each for half the duration.
+                    Arguments = o => new[] { "bench", "--backend", "posix_spawn,process", "--concurrency", "4", "--heap", "128",
+                        "--duration", (o.Duration.TotalSeconds / 2).ToString(CultureInfo.InvariantCulture) },
+                    ThroughputCounters = new[] { "/spawns" },
+                    ThroughputUnit = "spawns/s",
+                    LatencyHistogram = "/spawn",
+                },
+                new Harness
+                {
+                    Name = "dns",
+                    Description = "UDP-heavy: the open-loop load generator, Zipf over names the server answers from its cache",
+                    Project = "cs-dns-load-test1",
+                    Arguments = o => new[] { "--server", o.DnsServer ?? "127.0.0.1:54", "--proto", "udp", "--scenario", "hit",
+                        "--rate", o.DnsRate.ToString(CultureInfo.InvariantCulture), "--threads", "2",
+                        "--duration", o.Duration.TotalSeconds.ToString(CultureInfo.InvariantCulture) },
+                    ThroughputCounters = new[] { "/answered" },
+                    ThroughputUnit = "answers/s",
+                    LatencyHistogram = "/latency",
+                    Server = dnsServer,
+                },
+                new Harness
+                {
+                    Name = "samba",
+                    Description = "large buffers: 1 MB I/Os on files of up to 32 MB, 4 workers x queue depth 4",
+                    Project = "cs-linux-samba-inconsistency",
+                    Arguments = o => new[] { "stress", "--dir", o.SambaDirectory, "--files", "16", "--max-size", "32M",
+                        "--chunk-size", "1M", "--workers", "4", "--queue-depth", "4",
+                        "--duration", o.Duration.TotalSeconds.ToString(CultureInfo.InvariantCulture) },
+                    ThroughputCounters = new[] { "bytes-written", "bytes-read" },
+                    ThroughputUnit = "MB/s",
+                    ThroughputScale = 1e-6,
+                    LatencyHistogram = "write",
+                },
+            };
+        }
+
+        /// <summary>Builds the project in Release, once before the runs.</summary>
+        public bool Build(MatrixOptions options)
+        {
+            string project = Path.Combine(options.Root, Project, Project + ".csproj");
+            Console.WriteLine($"building {project}");
+            using var build = Process.Start(new ProcessStartInfo("dotnet")
+            {
+                ArgumentList = { "build", "-c", "Release", "-nologo", "-v", "q", project },
+                UseShellExecute = false,
+            });
+            build.WaitForExit();
+            return build.ExitCode == 0;
+        }
+
+        /// <summary>
+        /// Runs the harness (and its server) once under <paramref name="configuration"/>, with its runtimeconfig.json
+        /// written to <paramref name="output"/>[.server].runtimeconfig.json, its metrics to .jsonl and its console to
+        /// .log, and reads the metrics back.
+        /// </summary>
+        public IEnumerable<RunSummary> Run(RuntimeConfiguration configuration, IReadOnlyList<RuntimeConfiguration> all, MatrixOptions options, string output)
+        {
+            // Whatever goes wrong, the server is killed: left running, it would keep its port from the next runs.
+            HarnessProcess server = null;
+            try
+            {
+                if (Server != null && options.DnsServer == null)
+                {
+                    server = Server.Start(configuration, all, options, output + ".server");
+                    Server.WaitUntilReady(server, options.ServerStartup, output + ".server.log");
+                }
+
+                int exitCode;
+                using (HarnessProcess process = Start(configuration, all, options, output))
+                {
+                    exitCode = process.WaitForExit(options.Duration + options.RunTimeout);
+                }
+
+                var summaries = new List<RunSummary> { RunSummary.Read(this, output + ".jsonl", exitCode) };
+                if (server != null)
+                {
+                    // A line on its console is its Enter key: it stops and writes its last metrics.
+                    server.StandardInput.WriteLine();
+                    summaries.Add(RunSummary.Read(Server, output + ".server.jsonl", server.WaitForExit(options.RunTimeout)));
+                }
+                return summaries;
+            }
+            finally
+            {
+                server?.Dispose();
+            }
+        }
+
+        void WaitUntilReady(HarnessProcess server, TimeSpan timeout, string log)
+        {
+            if (IsReady == null)
+            {
+                return;
+            }
+
+            var stopwatch = Stopwatch.StartNew();
+            while (!IsReady())
+            {
+                if (server.HasExited)
+                {
+                    throw new InvalidOperationException($"{Name} exited before it was ready; see {log}.");
+                }
+                if (stopwatch.Elapsed > timeout)
+                {
+                    throw new TimeoutException($"{Name} was not ready after {timeout.TotalSeconds:F0} s; see {log}.");
+                }
+                Thread.Sleep(100);
+            }
+        }
+
+        /// <summary>Whether <paramref name="server"/> answers a query for the root's SOA within 200 ms, whatever the answer.</summary>
+        static bool AnswersDns(IPEndPoint server)
+        {
+            byte[] query =
+            {
+                0x52, 0x4D, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ID, no flags, one question
+                0x00, 0x00, 0x06, 0x00, 0x01, // ".", SOA, IN
+            };
+            using var socket = new Socket(server.AddressFamily, SocketType.Dgram, ProtocolType.Udp) { ReceiveTimeout = 200 };
+            try
+            {
+                socket.Connect(server);
+                socket.Send(query);
+                var answer = new byte[512];
+                return socket.Receive(answer) >= 2 && answer[0] == query[0] && answer[1] == query[1];
+            }
+            catch (SocketException)
+            {
+                return false; // Nothing listening yet (ICMP port unreachable), or no answer in time.
+            }
+        }
+
+        HarnessProcess Start(RuntimeConfiguration configuration, IReadOnlyList<RuntimeConfiguration> all, MatrixOptions options, string output)
+        {
+            string bin = Path.Combine(options.Root, Project, "bin", "Release");
+            string assembly = Directory.Exists(bin)
+                ? Directory.EnumerateFiles(bin, Project + ".dll", SearchOption.AllDirectories).FirstOrDefault()
+                : null;
+            if (assembly == null)
+            {
+                throw new FileNotFoundException($"No Release build of {Project} under {bin}.");
+            }
+
+            string runtimeConfig = output + ".runtimeconfig.json";
+            configuration.WriteRuntimeConfig(Path.ChangeExtension(assembly, ".runtimeconfig.json"), runtimeConfig);
+
+            var psi = new ProcessStartInfo("dotnet")
+            {
+                UseShellExecute = false,
+                RedirectStandardInput = true,
+                RedirectStandardOutput = true,
+                RedirectStandardError = true,
+            };
+            psi.ArgumentList.Add("exec");
+            psi.ArgumentList.Add("--runtimeconfig");
+            psi.ArgumentList.Add(runtimeConfig);
+            psi.ArgumentList.Add(assembly);
+            foreach (string argument in Arguments(options))
+            {
+                psi.ArgumentList.Add(argument);
+            }
+            foreach (KeyValuePair<string, string> variable in configuration.GetEnvironment(all))
+            {
+                if (variable.Value != null)
+                {
+                    psi.Environment[variable.Key] = variable.Value;
+                }
+                else
+                {
+                    psi.Environment.Remove(variable.Key);
+                }
+            }
+            File.Delete(output + ".jsonl");
+            psi.Environment[MetricsJsonWriter.PathVariable] = output + ".jsonl";
+            psi.Environment[MetricsJsonWriter.RunVariable] = configuration.Name;
+            psi.Environment[MetricsJsonWriter.IntervalVariable] = "1000";
+
+            return new HarnessProcess(psi, output + ".log");
+        }
+    }
+
+    /// <summary>A harness process, with its console copied to a log file.</summary>
+    sealed class HarnessProcess : IDisposable
+    {
+        readonly Process process;
+        readonly StreamWriter log;
+
+        public HarnessProcess(ProcessStartInfo psi, string logPath)
+        {
+            log = new StreamWriter(logPath, append: false) { AutoFlush = true };
+            process = new Process { StartInfo = psi };
+            process.OutputDataReceived += (_, e) => Write(e.Data);
+            process.ErrorDataReceived += (_, e) => Write(e.Data);
+            process.Start();
+            process.BeginOutputReadLine();
+            process.BeginErrorReadLine();
+        }
+
+        public StreamWriter StandardInput => process.StandardInput;
+
+        public bool HasExited => process.HasExited;
+
+        /// <summary>The exit code, or -1 when it had to be killed.</summary>
+        public int WaitForExit(TimeSpan timeout)
+        {
+            if (!process.WaitForExit((int)Math.Min(int.MaxValue, timeout.TotalMilliseconds)))
+            {
+                process.Kill(entireProcessTree: true);
+                process.WaitForExit();
+                Write($"*** killed after {timeout.TotalSeconds:F0} s");
+                return -1;
+            }
+            // Also waits for the end of the redirected output.
+            process.WaitForExit();
+            return process.ExitCode;
+        }
+
+        void Write(string line)
+        {
+            if (line == null)
+            {
+                return;
+            }
+            lock (log)
+            {
+                log.WriteLine(line);
+            }
+        }
+
+        public void Dispose()
+        {
+            if (!process.HasExited)
+            {
+                process.Kill(entireProcessTree: true);
+                process.WaitForExit();
+            }
+            process.Dispose();
+            lock (log)
+            {
+                log.Dispose();
+            }
+        }
+    }
+}
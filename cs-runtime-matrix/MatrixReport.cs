@@ -0,0 +1,88 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Runtime.InteropServices;
+using System.Text;
+
+namespace cs_runtime_matrix
+{
+    /// <summary>
+    /// The comparison, as Markdown: a table per harness with a row per configuration, each value the median of the
+    /// repeats, and the throughput also relative to the first configuration. The medians keep one slow run (a
+    /// neighbour on the machine, a page cache flush) from deciding the comparison.
+    /// </summary>
+    public sealed class MatrixReport
+    {
+        readonly List<(RuntimeConfiguration Configuration, RunSummary Summary)> runs = new List<(RuntimeConfiguration, RunSummary)>();
+
+        public void Add(RuntimeConfiguration configuration, RunSummary summary)
+        {
+            runs.Add((configuration, summary));
+        }
+
+        public string Format(MatrixOptions options, IReadOnlyList<RuntimeConfiguration> configurations)
+        {
+            var text = new StringBuilder();
+            text.AppendLine("# Runtime configuration matrix");
+            text.AppendLine();
+            text.AppendLine($"{Environment.MachineName}, {RuntimeInformation.OSDescription}, {Environment.ProcessorCount} processor(s), " +
+                $"{DateTime.Now:yyyy-MM-dd HH:mm}; median of {options.Repeat} run(s) of {options.Duration.TotalSeconds:F0} s each.");
+
+            foreach (Harness harness in runs.Select(r => r.Summary.Harness).Distinct())
+            {
+                text.AppendLine();
+                text.AppendLine($"## {harness.Name}: {harness.Description}");
+                text.AppendLine();
+                text.AppendLine($"| configuration | {harness.ThroughputUnit} | vs {configurations[0].Name} | p99 latency ms | GC pauses ms | GC pause p99 ms | " +
+                    "max GC pause ms | gen0/gen1/gen2 | peak RSS MB | CPU s | runtime | runs |");
+                text.AppendLine("|---|--:|--:|--:|--:|--:|--:|--:|--:|--:|---|--:|");
+
+                double baseline = double.NaN;
+                foreach (RuntimeConfiguration configuration in configurations)
+                {
+                    List<RunSummary> all = runs.Where(r => r.Configuration == configuration && r.Summary.Harness == harness).Select(r => r.Summary).ToList();
+                    List<RunSummary> completed = all.Where(s => s.Completed).ToList();
+                    if (all.Count == 0)
+                    {
+                        continue;
+                    }
+                    if (completed.Count == 0)
+                    {
+                        text.AppendLine($"| {configuration.Name} | failed | | | | | | | | | | 0/{all.Count} |");
+                        continue;
+                    }
+
+                    double throughput = Median(completed, s => s.Throughput);
+                    if (configuration == configurations[0])
+                    {
+                        baseline = throughput;
+                    }
+                    string relative = double.IsNaN(baseline) || baseline == 0 ? "" : $"{100.0 * (throughput - baseline) / baseline:+0.0;-0.0}%";
+
+                    text.AppendLine($"| {configuration.Name} | {throughput:N1} | {relative} | {Median(completed, s => s.LatencyP99Us) / 1000:F3} | " +
+                        $"{Median(completed, s => s.GcPauseTotalMs):F1} | {Median(completed, s => s.GcPauseP99Us) / 1000:F3} | " +
+                        $"{Median(completed, s => s.GcPauseMaxUs) / 1000:F3} | " +
+                        $"{Median(completed, s => s.Gen0Collections):F0}/{Median(completed, s => s.Gen1Collections):F0}/{Median(completed, s => s.Gen2Collections):F0} | " +
+                        $"{Median(completed, s => s.PeakRssBytes) / (1024.0 * 1024.0):F1} | {Median(completed, s => s.CpuMs) / 1000:F2} | " +
+                        $"{string.Join(", ", completed.Select(s => s.Runtime).Distinct())} | {completed.Count}/{all.Count} |");
+                }
+            }
+
+            text.AppendLine();
+            text.AppendLine("## Configurations");
+            text.AppendLine();
+            foreach (RuntimeConfiguration configuration in configurations)
+            {
+                text.AppendLine($"- {configuration.Name}: {configuration.Description}; {configuration}");
+            }
+            return text.ToString();
+        }
+
+        static double Median(List<RunSummary> summaries, Func<RunSummary, double> value)
+        {
+            double[] values = summaries.Select(value).OrderBy(v => v).ToArray();
+            int middle = values.Length / 2;
+            return values.Length % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+        }
+    }
+}
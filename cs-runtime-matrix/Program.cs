@@ -0,0 +1,175 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+
+namespace cs_runtime_matrix
+{
+    public sealed class MatrixOptions
+    {
+        /// <summary>The repository: the directory with the test projects in it.</summary>
+        public string Root { get; set; }
+
+        public string Output { get; set; }
+        public int Repeat { get; set; } = 3;
+        public TimeSpan Duration { get; set; } = TimeSpan.FromSeconds(20);
+
+        /// <summary>How much longer than the duration a run may take before it is killed.</summary>
+        public TimeSpan RunTimeout { get; set; } = TimeSpan.FromSeconds(60);
+
+        /// <summary>An already running DNS server to load, rather than a cs-dns-server-test1 per run.</summary>
+        public string DnsServer { get; set; }
+
+        /// <summary>How long a started server has to answer its readiness probe.</summary>
+        public TimeSpan ServerStartup { get; set; } = TimeSpan.FromSeconds(30);
+        public double DnsRate { get; set; } = 20000;
+
+        /// <summary>The Samba test's files; a mount of the share, to measure it rather than the local disk.</summary>
+        public string SambaDirectory { get; set; } = Path.Combine(Path.GetTempPath(), "cs-runtime-matrix");
+    }
+
+    class Program
+    {
+        const string Usage =
+@"usage: cs-runtime-matrix [options]
+  --harness <name>[,<name>]...   leak, dns, samba; default all
+  --config <name>[,<name>]...    of the default configurations (--list); default all
+  --define <name>:<setting>=<value>[,<setting>=<value>]...
+                                 adds a configuration, such as server-4heaps:System.GC.Server=true,System.GC.HeapCount=4;
+                                 a setting without a dot is a COMPlus_/DOTNET_ variable, such as GCgen0size=4000000
+  --repeat <n>                   runs of each harness in each configuration, default 3
+  --duration <seconds>           of each run, default 20
+  --out <dir>                    runtimeconfig.json files, metrics, console logs and report.md; default ./matrix-<time>
+  --root <dir>                   the repository; default found from this program's directory
+  --dns-server <ip:port>         load this server instead of starting cs-dns-server-test1 per run
+  --dns-rate <qps>               default 20000
+  --samba-dir <dir>              where the Samba test writes, default $TMPDIR/cs-runtime-matrix
+  --no-build                     use the Release builds as they are
+  --list                         print the default configurations";
+
+        static int Main(string[] args)
+        {
+            var options = new MatrixOptions();
+            List<Harness> harnesses = Harness.All.ToList();
+            List<RuntimeConfiguration> configurations = RuntimeConfiguration.Defaults.ToList();
+            var defined = new List<RuntimeConfiguration>();
+            bool build = true;
+
+            try
+            {
+                for (int i = 0; i < args.Length; i++)
+                {
+                    switch (args[i])
+                    {
+                        case "--harness": harnesses = Select(Harness.All, h => h.Name, args[++i]); break;
+                        case "--config": configurations = Select(RuntimeConfiguration.Defaults, c => c.Name, args[++i]); break;
+                        case "--define": defined.Add(RuntimeConfiguration.Parse(args[++i])); break;
+                        case "--repeat": options.Repeat = Math.Max(1, int.Parse(args[++i])); break;
+                        case "--duration": options.Duration = TimeSpan.FromSeconds(double.Parse(args[++i], CultureInfo.InvariantCulture)); break;
+                        case "--out": options.Output = args[++i]; break;
+                        case "--root": options.Root = args[++i]; break;
+                        case "--dns-server": options.DnsServer = args[++i]; break;
+                        case "--dns-rate": options.DnsRate = double.Parse(args[++i], CultureInfo.InvariantCulture); break;
+                        case "--samba-dir": options.SambaDirectory = args[++i]; break;
+                        case "--no-build": build = false; break;
+                        case "--list":
+                            foreach (RuntimeConfiguration configuration in RuntimeConfiguration.Defaults)
+                            {
+                                Console.WriteLine($"{configuration.Name,-26} {configuration.Description}; {configuration}");
+                            }
+                            return 0;
+                        default: throw new FormatException($"Unknown option '{args[i]}'.");
+                    }
+                }
+            }
+            catch (Exception ex) when (ex is FormatException || ex is IndexOutOfRangeException)
+            {
+                Console.Error.WriteLine(ex.Message);
+                Console.Error.WriteLine(Usage);
+                return 2;
+            }
+            configurations.AddRange(defined);
+
+            options.Root ??= FindRoot(AppContext.BaseDirectory);
+            if (options.Root == null)
+            {
+                Console.Error.WriteLine("The repository was not found above this program; give it with --root.");
+                return 2;
+            }
+            options.Output ??= Path.GetFullPath($"matrix-{DateTime.Now:yyyyMMdd-HHmmss}");
+            Directory.CreateDirectory(options.Output);
+            Directory.CreateDirectory(options.SambaDirectory);
+
+            if (build)
+            {
+                IEnumerable<Harness> projects = harnesses.Concat(harnesses.Where(h => h.Server != null && options.DnsServer == null).Select(h => h.Server));
+                foreach (Harness harness in projects)
+                {
+                    if (!harness.Build(options))
+                    {
+                        Console.Error.WriteLine($"{harness.Project} did not build.");
+                        return 1;
+                    }
+                }
+            }
+
+            // The configurations take turns within each repeat, so that a change on the machine during the run
+            // spreads over all of them instead of landing on one.
+            var report = new MatrixReport();
+            int total = options.Repeat * configurations.Count * harnesses.Count, done = 0;
+            for (int repeat = 0; repeat < options.Repeat; repeat++)
+            {
+                foreach (RuntimeConfiguration configuration in configurations)
+                {
+                    foreach (Harness harness in harnesses)
+                    {
+                        done++;
+                        Console.WriteLine($"[{done}/{total}] {harness.Name} {configuration.Name} #{repeat + 1}: {configuration}");
+                        string output = Path.Combine(options.Output, $"{harness.Name}.{configuration.Name}.{repeat + 1}");
+                        foreach (RunSummary summary in harness.Run(configuration, configurations, options, output))
+                        {
+                            report.Add(configuration, summary);
+                            Console.WriteLine(summary.Completed
+                                ? $"  {summary.Harness.Name}: {summary.Throughput:N1} {summary.Harness.ThroughputUnit}, p99 {summary.LatencyP99Us / 1000:F3} ms, " +
+                                  $"GC pauses {summary.GcPauseTotalMs:F1} ms, peak RSS {summary.PeakRssBytes / (1024.0 * 1024.0):F1} MB, {summary.Runtime}"
+                                : $"  {summary.Harness.Name}: no metrics (exit code {summary.ExitCode}), see {output}.log");
+                        }
+                    }
+                }
+            }
+
+            string text = report.Format(options, configurations);
+            string reportPath = Path.Combine(options.Output, "report.md");
+            File.WriteAllText(reportPath, text);
+            Console.WriteLine();
+            Console.Write(text);
+            Console.WriteLine();
+            Console.WriteLine($"# {reportPath}");
+            return 0;
+        }
+
+        static List<T> Select<T>(IEnumerable<T> all, Func<T, string> name, string list)
+        {
+            var selected = new List<T>();
+            foreach (string wanted in list.Split(',', StringSplitOptions.RemoveEmptyEntries).Select(s => s.Trim()))
+            {
+                T item = all.FirstOrDefault(x => name(x) == wanted);
+                selected.Add(item != null ? item : throw new FormatException($"Unknown name '{wanted}'; one of {string.Join(", ", all.Select(name))}."));
+            }
+            return selected;
+        }
+
+        static string FindRoot(string directory)
+        {
+            for (var dir = new DirectoryInfo(directory); dir != null; dir = dir.Parent)
+            {
+                if (Harness.All.All(h => Directory.Exists(Path.Combine(dir.FullName, h.Project))))
+                {
+                    return dir.FullName;
+                }
+            }
+            return null;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text.Json;
+
+namespace cs_runtime_matrix
+{
+    /// <summary>
+    /// What one run of a harness did, from its metrics: the effective settings, the throughput, the worst p99
+    /// latency of its histograms, the GC pauses, the collections, the peak RSS and the CPU time. The throughput is
+    /// over the samples in which the work went on, not the process's whole life, so that a server's wait for its
+    /// load, or a harness's startup, does not count against it.
+    /// </summary>
+    public sealed class RunSummary
+    {
+        public Harness Harness { get; private set; }
+
+        /// <summary>False when the run left no "end" line: it crashed, or was killed.</summary>
+        public bool Completed { get; private set; }
+
+        public int ExitCode { get; private set; }
+
+        /// <summary>
+        /// The GC and JIT the runtime actually ran, such as "server/Interactive, not tiered", to check that the
+        /// settings took (a server GC on one processor is a workstation GC, for one).
+        /// </summary>
+        public string Runtime { get; private set; }
+
+        public double ElapsedSeconds { get; private set; }
+        public double Throughput { get; private set; }
+        public double LatencyP99Us { get; private set; }
+        public double GcPauseTotalMs { get; private set; }
+        public double GcPauseP99Us { get; private set; }
+        public double GcPauseMaxUs { get; private set; }
+        public long Gen0Collections { get; private set; }
+        public long Gen1Collections { get; private set; }
+        public long Gen2Collections { get; private set; }
+        public long PeakRssBytes { get; private set; }
+        public double CpuMs { get; private set; }
+
+        public static RunSummary Read(Harness harness, string path, int exitCode)
+        {
+            var summary = new RunSummary { Harness = harness, ExitCode = exitCode };
+            if (!File.Exists(path))
+            {
+                return summary;
+            }
+
+            // The throughput counters' total at each sample, from the start.
+            var totals = new List<(double Seconds, long Total)> { (0, 0) };
+
+            foreach (string line in File.ReadLines(path))
+            {
+                if (line.Length == 0)
+                {
+                    continue;
+                }
+                using JsonDocument document = JsonDocument.Parse(line);
+                JsonElement root = document.RootElement;
+                switch (root.GetProperty("event").GetString())
+                {
+                    case "start":
+                        summary.Runtime = (root.GetProperty("serverGc").GetBoolean() ? "server" : "workstation") + "/" +
+                            root.GetProperty("gcLatencyMode").GetString() +
+                            (root.GetProperty("tieredCompilation").GetBoolean() ? "" : ", not tiered");
+                        break;
+
+                    case "sample":
+                        totals.Add((root.GetProperty("elapsedSeconds").GetDouble(), summary.ThroughputTotal(root)));
+                        break;
+
+                    case "end":
+                        totals.Add((root.GetProperty("elapsedSeconds").GetDouble(), summary.ThroughputTotal(root)));
+                        summary.ReadEnd(root);
+                        break;
+                }
+            }
+
+            // From the last sample before the totals start going up to the last one at which they still do.
+            int first = Enumerable.Range(1, totals.Count - 1).FirstOrDefault(i => totals[i].Total > totals[i - 1].Total);
+            int last = Enumerable.Range(1, totals.Count - 1).LastOrDefault(i => totals[i].Total > totals[i - 1].Total);
+            if (first != 0 && totals[last].Seconds > totals[first - 1].Seconds)
+            {
+                summary.Throughput = (totals[last].Total - totals[first - 1].Total) * harness.ThroughputScale /
+                    (totals[last].Seconds - totals[first - 1].Seconds);
+            }
+            return summary;
+        }
+
+        long ThroughputTotal(JsonElement line) => line.GetProperty("counters").EnumerateObject()
+            .Where(counter => Harness.ThroughputCounters.Any(name => Matches(counter.Name, name)))
+            .Sum(counter => counter.Value.GetProperty("total").GetInt64());
+
+        void ReadEnd(JsonElement end)
+        {
+            Completed = true;
+            ElapsedSeconds = end.GetProperty("elapsedSeconds").GetDouble();
+
+            JsonElement process = end.GetProperty("process");
+            PeakRssBytes = process.GetProperty("peakRssBytes").GetInt64();
+            GcPauseTotalMs = process.GetProperty("gcPauseTotalMs").GetDouble();
+            Gen0Collections = process.GetProperty("gen0Collections").GetInt64();
+            Gen1Collections = process.GetProperty("gen1Collections").GetInt64();
+            Gen2Collections = process.GetProperty("gen2Collections").GetInt64();
+            CpuMs = process.GetProperty("cpuMs").GetDouble();
+
+            foreach (JsonProperty histogram in end.GetProperty("histograms").EnumerateObject())
+            {
+                if (histogram.Name == "gc-pause")
+                {
+                    GcPauseP99Us = histogram.Value.GetProperty("p99Us").GetDouble();
+                    GcPauseMaxUs = histogram.Value.GetProperty("maxUs").GetDouble();
+                }
+                else if (Matches(histogram.Name, Harness.LatencyHistogram) && histogram.Value.GetProperty("count").GetInt64() != 0)
+                {
+                    LatencyP99Us = Math.Max(LatencyP99Us, histogram.Value.GetProperty("p99Us").GetDouble());
+                }
+            }
+        }
+
+        static bool Matches(string metric, string pattern) =>
+            pattern.StartsWith("/") ? metric.EndsWith(pattern, StringComparison.Ordinal) : metric == pattern;
+    }
+}
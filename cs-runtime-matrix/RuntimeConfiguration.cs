@@ -0,0 +1,165 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text.Json;
+
+namespace cs_runtime_matrix
+{
+    /// <summary>
+    /// A named set of runtime settings. A setting with a dot in its name is a runtimeconfig.json property, such as
+    /// System.GC.Server: the harness is run with a copy of its runtimeconfig.json that has it, which is also how
+    /// the chosen values are to be shipped. (The COMPlus_ and DOTNET_ variables do not do: on .NET Core 3.1 and .NET
+    /// 5 a GC setting in runtimeconfig.json wins over them, so the settings cs-process-leak-test1 pins would.) A
+    /// setting without a dot is a runtime knob that has no property, given as both COMPlus_ (the only prefix .NET
+    /// Core 3.1 reads) and DOTNET_ variables, with the value as the runtime reads it: in hexadecimal.
+    /// </summary>
+    public sealed class RuntimeConfiguration
+    {
+        public RuntimeConfiguration(string name, string description, params (string Name, string Value)[] settings)
+        {
+            Name = name;
+            Description = description;
+            Settings = settings;
+        }
+
+        public string Name { get; }
+
+        public string Description { get; }
+
+        /// <summary>Such as ("System.GC.Server", "true") or ("GCgen0size", "4000000").</summary>
+        public IReadOnlyList<(string Name, string Value)> Settings { get; }
+
+        IEnumerable<(string Name, string Value)> Properties => Settings.Where(s => IsProperty(s.Name));
+
+        /// <summary>
+        /// The environment variables. Every variable of every configuration of the run is set, the ones not in this
+        /// configuration to null (removed), so that the driver's own environment does not leak into a run.
+        /// </summary>
+        public IEnumerable<KeyValuePair<string, string>> GetEnvironment(IEnumerable<RuntimeConfiguration> all)
+        {
+            foreach (string name in all.SelectMany(c => c.Settings).Select(s => s.Name).Where(n => !IsProperty(n)).Distinct())
+            {
+                string value = Settings.Where(s => s.Name == name).Select(s => s.Value).FirstOrDefault();
+                yield return new KeyValuePair<string, string>("COMPlus_" + name, value);
+                yield return new KeyValuePair<string, string>("DOTNET_" + name, value);
+            }
+        }
+
+        /// <summary>
+        /// Writes <paramref name="source"/>, a runtimeconfig.json, to <paramref name="destination"/> with the
+        /// properties of this configuration set in its configProperties.
+        /// </summary>
+        public void WriteRuntimeConfig(string source, string destination)
+        {
+            using JsonDocument document = JsonDocument.Parse(File.ReadAllBytes(source));
+            using var stream = new FileStream(destination, FileMode.Create);
+            using var json = new Utf8JsonWriter(stream, new JsonWriterOptions { Indented = true });
+
+            json.WriteStartObject();
+            foreach (JsonProperty property in document.RootElement.EnumerateObject())
+            {
+                if (property.Name != "runtimeOptions")
+                {
+                    property.WriteTo(json);
+                    continue;
+                }
+
+                json.WriteStartObject(property.Name);
+                JsonElement existing = default;
+                foreach (JsonProperty option in property.Value.EnumerateObject())
+                {
+                    if (option.Name == "configProperties")
+                    {
+                        existing = option.Value;
+                    }
+                    else
+                    {
+                        option.WriteTo(json);
+                    }
+                }
+
+                json.WriteStartObject("configProperties");
+                if (existing.ValueKind == JsonValueKind.Object)
+                {
+                    foreach (JsonProperty setting in existing.EnumerateObject())
+                    {
+                        if (!Properties.Any(s => s.Name == setting.Name))
+                        {
+                            setting.WriteTo(json);
+                        }
+                    }
+                }
+                foreach ((string name, string value) in Properties)
+                {
+                    if (bool.TryParse(value, out bool boolean)) json.WriteBoolean(name, boolean);
+                    else if (long.TryParse(value, out long number)) json.WriteNumber(name, number);
+                    else json.WriteString(name, value);
+                }
+                json.WriteEndObject();
+
+                json.WriteEndObject();
+            }
+            json.WriteEndObject();
+        }
+
+        public override string ToString() =>
+            Settings.Count == 0 ? "(as built)" : string.Join(" ", Settings.Select(s => $"{s.Name}={s.Value}"));
+
+        /// <summary>
+        /// Parses "name:System.GC.Server=true,System.GC.HeapCount=4", a configuration given on the command line.
+        /// </summary>
+        public static RuntimeConfiguration Parse(string text)
+        {
+            int colon = text.IndexOf(':');
+            if (colon <= 0)
+            {
+                throw new FormatException($"'{text}' is not <name>:<setting>=<value>[,<setting>=<value>]...");
+            }
+
+            var settings = new List<(string, string)>();
+            foreach (string setting in text.Substring(colon + 1).Split(',', StringSplitOptions.RemoveEmptyEntries))
+            {
+                int equals = setting.IndexOf('=');
+                if (equals <= 0)
+                {
+                    throw new FormatException($"'{setting}' is not <setting>=<value>.");
+                }
+                string name = setting.Substring(0, equals).Trim();
+                if (name.StartsWith("COMPlus_", StringComparison.OrdinalIgnoreCase)) name = name.Substring(8);
+                else if (name.StartsWith("DOTNET_", StringComparison.OrdinalIgnoreCase)) name = name.Substring(7);
+                settings.Add((name, setting.Substring(equals + 1).Trim()));
+            }
+            return new RuntimeConfiguration(text.Substring(0, colon), "from the command line", settings.ToArray());
+        }
+
+        static bool IsProperty(string name) => name.Contains('.');
+
+        /// <summary>
+        /// The default matrix: the GC flavours, the server GC's heap count and affinity, and the JIT tiers. The first
+        /// one changes nothing and is what the others are compared with.
+        /// </summary>
+        public static IReadOnlyList<RuntimeConfiguration> Defaults { get; } = new[]
+        {
+            new RuntimeConfiguration("as-built", "each harness's own runtimeconfig.json"),
+            new RuntimeConfiguration("workstation", "workstation GC, background collections",
+                ("System.GC.Server", "false"), ("System.GC.Concurrent", "true")),
+            new RuntimeConfiguration("workstation-nonconcurrent", "workstation GC, blocking collections only",
+                ("System.GC.Server", "false"), ("System.GC.Concurrent", "false")),
+            new RuntimeConfiguration("server", "server GC, a heap per processor, heaps affinitized",
+                ("System.GC.Server", "true"), ("System.GC.Concurrent", "true")),
+            new RuntimeConfiguration("server-nonconcurrent", "server GC, blocking collections only",
+                ("System.GC.Server", "true"), ("System.GC.Concurrent", "false")),
+            new RuntimeConfiguration("server-2heaps", "server GC with 2 heaps, affinitized to processors 0 and 1",
+                ("System.GC.Server", "true"), ("System.GC.HeapCount", "2"), ("System.GC.HeapAffinitizeMask", "3")),
+            new RuntimeConfiguration("server-2heaps-floating", "server GC with 2 heaps, threads not affinitized",
+                ("System.GC.Server", "true"), ("System.GC.HeapCount", "2"), ("System.GC.NoAffinitize", "true")),
+            new RuntimeConfiguration("tiered", "tiered compilation with quick JIT (the .NET default)",
+                ("System.Runtime.TieredCompilation", "true"), ("System.Runtime.TieredCompilation.QuickJit", "true")),
+            new RuntimeConfiguration("not-tiered", "tiered compilation off, as cs-process-leak-test1 is built",
+                ("System.Runtime.TieredCompilation", "false")),
+            new RuntimeConfiguration("tiered-pgo", "tiered compilation with dynamic PGO (ignored before .NET 6)",
+                ("System.Runtime.TieredCompilation", "true"), ("System.Runtime.TieredPGO", "true")),
+        };
+    }
+}